@@ -0,0 +1,293 @@
+// Замеры производительности хранилищ на синтетических проектах.
+// Результат - JSON для сравнения между выпусками.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QSqlError>
+#include <algorithm>
+#include <functional>
+#include "benchgenerator.h"
+#include "databasehandler.h"
+#include "tracing.h"
+#include "memorystoragebackend.h"
+#include "sqlstoragebackend.h"
+
+namespace {
+
+QTextStream &err() {
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+// Прогон одного замера: сколько элементарных операций выполнено за итерацию
+using BenchBody = std::function<bool(int &operations)>;
+
+QJsonObject measure(const QString &name, int iterations, const BenchBody &body) {
+    QVector<double> timings;
+    int operations = 0;
+    bool ok = true;
+
+    for (int i = 0; i < iterations && ok; ++i) {
+        operations = 0;
+        QElapsedTimer timer;
+        timer.start();
+        ok = body(operations);
+        timings.append(timer.nsecsElapsed() / 1e6);
+    }
+
+    std::sort(timings.begin(), timings.end());
+    double total = 0;
+    for (double timing : timings) total += timing;
+    const double median = timings[timings.size() / 2];
+
+    err() << "  " << name << ": " << QString::number(median, 'f', 2) << " ms" << (ok ? "" : " (ошибка)") << Qt::endl;
+
+    return {
+        {"name", name},
+        {"ok", ok},
+        {"iterations", timings.size()},
+        {"operations", operations},
+        {"minMs", timings.first()},
+        {"medianMs", median},
+        {"meanMs", total / timings.size()},
+        {"maxMs", timings.last()},
+        {"perOperationUs", operations > 0 ? median * 1000 / operations : 0.0}
+    };
+}
+
+// Необязательный шаг после генерации, например перевод сеток в другой формат хранения
+using PrepareProject = std::function<bool(int projectId)>;
+
+QJsonObject runBackend(StorageBackend &backend, const BenchShape &shape, int iterations,
+                       const QString &label = QString(), const PrepareProject &prepare = PrepareProject()) {
+    const QString name = label.isEmpty() ? backend.backendName() : label;
+    err() << name << Qt::endl;
+
+    QJsonArray results;
+    GeneratedProject project;
+    BenchGenerator generator(shape);
+
+    results.append(measure("generate", 1, [&](int &operations) {
+        const bool ok = generator.populate(backend, project);
+        operations = project.templateIds.size();
+        return ok;
+    }));
+
+    if (prepare) {
+        results.append(measure("prepare", 1, [&](int &operations) {
+            operations = project.templateIds.size();
+            return prepare(project.projectId);
+        }));
+    }
+
+    results.append(measure("tree_load", iterations, [&](int &operations) {
+        const QVector<Category> categories = backend.getCategoriesByProject(project.projectId);
+        for (const Category &category : categories) {
+            backend.getTemplatesForCategory(category.categoryId);
+        }
+        operations = categories.size();
+        return categories.size() == project.categoryIds.size();
+    }));
+
+    results.append(measure("template_load", iterations, [&](int &operations) {
+        TemplateGrid grid;
+        for (int templateId : project.templateIds) {
+            if (!backend.getTemplateGrid(templateId, grid)) return false;
+            ++operations;
+        }
+        return true;
+    }));
+
+    // Сетки читаются до замера, чтобы измерялась только запись
+    QVector<TemplateGrid> grids(project.templateIds.size());
+    for (int i = 0; i < project.templateIds.size(); ++i) {
+        backend.getTemplateGrid(project.templateIds[i], grids[i]);
+    }
+    int saveRound = 0;
+    results.append(measure("full_save", iterations, [&](int &operations) {
+        ++saveRound;
+        if (!backend.beginTransaction()) return false;
+        for (int i = 0; i < project.templateIds.size(); ++i) {
+            TemplateGrid &grid = grids[i];
+            if (!grid.cells.isEmpty() && !grid.cells[0].isEmpty()) {
+                grid.cells[0][0] = QString("правка %1").arg(saveRound);
+            }
+            if (!backend.saveTemplateGrid(project.templateIds[i], grid)) {
+                backend.rollbackTransaction();
+                return false;
+            }
+            ++operations;
+        }
+        return backend.commitTransaction();
+    }));
+
+    // Уплотнение нумерации проекта, как после правки дерева: на сплошной нумерации
+    // замер показывает цену проверки всех элементов без записи
+    results.append(measure("renumber", iterations, [&](int &operations) {
+        operations = project.categoryIds.size() + project.templateIds.size();
+        return backend.renumberProject(project.projectId);
+    }));
+
+    results.append(measure("search_hit", iterations, [&](int &operations) {
+        operations = backend.search(project.projectId, project.searchTerm, 100).size();
+        return operations > 0;
+    }));
+
+    results.append(measure("search_miss", iterations, [&](int &operations) {
+        operations = 1;
+        return backend.search(project.projectId, "отсутствующееслово", 100).isEmpty();
+    }));
+
+    // Разрушающие операции выполняются один раз в конце
+    if (project.rootCategoryIds.size() >= 2) {
+        results.append(measure("unpack_category", 1, [&](int &operations) {
+            operations = 1;
+            return backend.deleteCategory(project.rootCategoryIds[0], false);
+        }));
+        results.append(measure("delete_subtree", 1, [&](int &operations) {
+            operations = 1;
+            return backend.deleteCategory(project.rootCategoryIds[1], true);
+        }));
+    }
+
+    backend.deleteProject(project.projectId);
+
+    return {
+        {"backend", name},
+        {"categories", project.categoryIds.size()},
+        {"templates", project.templateIds.size()},
+        {"results", results}
+    };
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setOrganizationName("AutoTLG");
+    app.setApplicationName("AutoTLG");
+    app.setApplicationVersion(AUTOTLG_VERSION);
+    Tracer::startFromEnvironment();   // AUTOTLG_TRACE=<файл>
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Замеры хранилищ AutoTLG на синтетическом проекте.");
+    parser.addHelpOption();
+
+    const QCommandLineOption backendsOption("backends", "Хранилища через запятую: memory, sqlite, postgres, postgres-packed.",
+                                            "list", "memory,sqlite");
+    const QCommandLineOption categoriesOption("categories", "Категорий на каждом уровне.", "n", "5");
+    const QCommandLineOption depthOption("depth", "Глубина дерева категорий.", "n", "2");
+    const QCommandLineOption templatesOption("templates", "Шаблонов в каждой категории.", "n", "4");
+    const QCommandLineOption rowsOption("rows", "Строк в шаблоне.", "n", "20");
+    const QCommandLineOption columnsOption("columns", "Столбцов в шаблоне.", "n", "6");
+    const QCommandLineOption cellLengthOption("cell-length", "Длина текста ячейки.", "n", "24");
+    const QCommandLineOption seedOption("seed", "Начальное значение генератора.", "n", "1");
+    const QCommandLineOption iterationsOption("iterations", "Повторов каждого замера.", "n", "5");
+    const QCommandLineOption outputOption("output", "Файл для JSON (по умолчанию stdout).", "file");
+    const QCommandLineOption hostOption("host", "Сервер PostgreSQL.", "host");
+    const QCommandLineOption portOption("port", "Порт PostgreSQL.", "port", "5432");
+    const QCommandLineOption dbNameOption("dbname", "Отдельная база PostgreSQL для замеров (обязательна для postgres).", "name");
+    const QCommandLineOption userOption("user", "Пользователь PostgreSQL.", "user");
+    const QCommandLineOption passwordOption("password", "Пароль PostgreSQL.", "password");
+    parser.addOptions({backendsOption, categoriesOption, depthOption, templatesOption, rowsOption, columnsOption,
+                       cellLengthOption, seedOption, iterationsOption, outputOption,
+                       hostOption, portOption, dbNameOption, userOption, passwordOption});
+    parser.process(app);
+
+    BenchShape shape;
+    shape.categoriesPerLevel = qMax(1, parser.value(categoriesOption).toInt());
+    shape.depth = qMax(1, parser.value(depthOption).toInt());
+    shape.templatesPerCategory = qMax(0, parser.value(templatesOption).toInt());
+    shape.rows = qMax(0, parser.value(rowsOption).toInt());
+    shape.columns = qMax(0, parser.value(columnsOption).toInt());
+    shape.cellLength = qMax(1, parser.value(cellLengthOption).toInt());
+    shape.seed = parser.value(seedOption).toUInt();
+    const int iterations = qMax(1, parser.value(iterationsOption).toInt());
+
+    QJsonArray backends;
+    bool ok = true;
+
+    for (const QString &name : parser.value(backendsOption).split(',', Qt::SkipEmptyParts)) {
+        if (name == "memory") {
+            MemoryStorageBackend backend;
+            backends.append(runBackend(backend, shape, iterations));
+        } else if (name == "sqlite") {
+            QTemporaryDir dir;
+            {
+                QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "bench_sqlite");
+                db.setDatabaseName(dir.filePath("bench.sqlite"));
+                if (!db.open() || !SqliteStorageBackend::prepareSchema(db)) {
+                    err() << "Не удалось открыть SQLite: " << db.lastError().text() << Qt::endl;
+                    ok = false;
+                } else {
+                    SqliteStorageBackend backend(db);
+                    backends.append(runBackend(backend, shape, iterations));
+                }
+                db.close();
+            }
+            QSqlDatabase::removeDatabase("bench_sqlite");
+        } else if (name == "postgres" || name == "postgres-packed") {
+            // Замеры создают и удаляют проекты, поэтому база указывается явно:
+            // рабочее подключение из настроек интерфейса не используется
+            if (!parser.isSet(dbNameOption)) {
+                err() << "Для замеров " << name << " укажите отдельную базу параметром --dbname" << Qt::endl;
+                ok = false;
+                continue;
+            }
+            DatabaseHandler handler;
+            const bool connected = handler.connectToDatabase(parser.value(dbNameOption), parser.value(userOption),
+                                                             parser.value(passwordOption), parser.value(hostOption),
+                                                             parser.value(portOption).toInt());
+            if (!connected) {
+                err() << "Не удалось подключиться к PostgreSQL" << Qt::endl;
+                ok = false;
+                continue;
+            }
+            QSqlDatabase db = QSqlDatabase::database(handler.connectionName());
+            PostgresStorageBackend backend(db);
+            if (name == "postgres-packed") {
+                // Те же замеры на сетках, упакованных в template_grid
+                backends.append(runBackend(backend, shape, iterations, name, [&db](int projectId) {
+                    return TemplateManager(db).convertProjectGrids(projectId, GridFormat::Packed);
+                }));
+            } else {
+                backends.append(runBackend(backend, shape, iterations));
+            }
+        } else {
+            err() << "Неизвестное хранилище: " << name << Qt::endl;
+            ok = false;
+        }
+    }
+
+    const QJsonObject report = {
+        {"timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate)},
+        {"version", QCoreApplication::applicationVersion()},
+        {"qtVersion", qVersion()},
+        {"cpu", QSysInfo::currentCpuArchitecture()},
+        {"os", QSysInfo::prettyProductName()},
+        {"shape", shape.toJson()},
+        {"iterations", iterations},
+        {"backends", backends}
+    };
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+            err() << "Не удалось записать " << file.fileName() << Qt::endl;
+            return 1;
+        }
+    } else {
+        QTextStream(stdout) << json;
+    }
+    return ok ? 0 : 1;
+}
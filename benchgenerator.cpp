@@ -0,0 +1,98 @@
+#include "benchgenerator.h"
+#include <QDebug>
+
+namespace {
+const QString SearchTerm = "needle";
+const int SearchTermPeriod = 97;    // Каждая 97-я ячейка содержит искомое слово
+}
+
+QJsonObject BenchShape::toJson() const {
+    return {
+        {"categoriesPerLevel", categoriesPerLevel},
+        {"depth", depth},
+        {"templatesPerCategory", templatesPerCategory},
+        {"rows", rows},
+        {"columns", columns},
+        {"cellLength", cellLength},
+        {"seed", static_cast<qint64>(seed)}
+    };
+}
+
+BenchGenerator::BenchGenerator(const BenchShape &shape)
+    : shape(shape), random(shape.seed) {}
+
+bool BenchGenerator::populate(StorageBackend &backend, GeneratedProject &project) {
+    project = GeneratedProject();
+    project.searchTerm = SearchTerm;
+
+    if (!backend.beginTransaction()) return false;
+
+    if (!backend.createProject(QString("bench_%1").arg(shape.seed), &project.projectId) ||
+        !populateLevel(backend, project, -1, 1)) {
+        backend.rollbackTransaction();
+        return false;
+    }
+
+    return backend.commitTransaction();
+}
+
+bool BenchGenerator::populateLevel(StorageBackend &backend, GeneratedProject &project, int parentId, int level) {
+    for (int i = 0; i < shape.categoriesPerLevel; ++i) {
+        int categoryId = -1;
+        if (!backend.createCategory(QString("Категория %1.%2").arg(level).arg(i + 1), parentId,
+                                    project.projectId, &categoryId)) {
+            return false;
+        }
+        project.categoryIds.append(categoryId);
+        if (parentId == -1) project.rootCategoryIds.append(categoryId);
+
+        for (int t = 0; t < shape.templatesPerCategory; ++t) {
+            int templateId = -1;
+            if (!backend.createTemplate(categoryId, QString("Таблица %1").arg(makeText(16)), &templateId) ||
+                !backend.updateTemplate(templateId, std::nullopt, makeText(shape.cellLength * 4), makeText(shape.cellLength)) ||
+                !backend.saveTemplateGrid(templateId, makeGrid())) {
+                return false;
+            }
+            project.templateIds.append(templateId);
+        }
+
+        if (level < shape.depth && !populateLevel(backend, project, categoryId, level + 1)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TemplateGrid BenchGenerator::makeGrid() {
+    TemplateGrid grid;
+    for (int column = 0; column < shape.columns; ++column) {
+        grid.headers.append(QString("Столбец %1").arg(column + 1));
+    }
+
+    grid.cells.resize(shape.rows);
+    for (QVector<QString> &row : grid.cells) {
+        row.reserve(shape.columns);
+        for (int column = 0; column < shape.columns; ++column) {
+            QString content = makeText(shape.cellLength);
+            if (++cellCounter % SearchTermPeriod == 0) {
+                content = SearchTerm + ' ' + content;
+            }
+            row.append(content);
+        }
+    }
+    return grid;
+}
+
+QString BenchGenerator::makeText(int length) {
+    // Слова из строчных латинских букв длиной 2-9 символов через пробел
+    QString text;
+    text.reserve(length);
+    while (text.size() < length) {
+        if (!text.isEmpty()) text += ' ';
+        const int wordLength = 2 + random() % 8;
+        for (int i = 0; i < wordLength && text.size() < length; ++i) {
+            text += QChar('a' + random() % 26);
+        }
+    }
+    return text;
+}
@@ -0,0 +1,51 @@
+#ifndef BENCHGENERATOR_H
+#define BENCHGENERATOR_H
+
+#include <QJsonObject>
+#include <QString>
+#include <QVector>
+#include <random>
+#include "storagebackend.h"
+
+// Форма синтетического проекта: categoriesPerLevel^1 + ... + categoriesPerLevel^depth
+// категорий, в каждой templatesPerCategory шаблонов с сеткой rows x columns
+struct BenchShape {
+    int categoriesPerLevel = 5;
+    int depth = 2;
+    int templatesPerCategory = 4;
+    int rows = 20;
+    int columns = 6;
+    int cellLength = 24;
+    quint32 seed = 1;
+
+    QJsonObject toJson() const;
+};
+
+// Идентификаторы созданного проекта для последующих замеров
+struct GeneratedProject {
+    int projectId = -1;
+    QVector<int> rootCategoryIds;
+    QVector<int> categoryIds;
+    QVector<int> templateIds;
+    QString searchTerm;     // Слово, которое встречается примерно в каждой сотой ячейке
+};
+
+// Детерминированный генератор: при одинаковых форме и seed содержимое
+// проекта совпадает на любой платформе и в любом хранилище
+class BenchGenerator {
+public:
+    explicit BenchGenerator(const BenchShape &shape);
+
+    bool populate(StorageBackend &backend, GeneratedProject &project);
+    TemplateGrid makeGrid();
+
+private:
+    bool populateLevel(StorageBackend &backend, GeneratedProject &project, int parentId, int level);
+    QString makeText(int length);
+
+    BenchShape shape;
+    std::mt19937 random;    // Распределения std:: не переносимы, поэтому используются только сырые значения
+    int cellCounter = 0;
+};
+
+#endif // BENCHGENERATOR_H
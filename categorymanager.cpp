@@ -1,20 +1,25 @@
-#include "CategoryManager.h"
+#include "categorymanager.h"
+#include "queryexecutor.h"
+#include "tracing.h"
 #include <QSqlQuery>
 #include <QSqlError>
+#include <QStringList>
 
 CategoryManager::CategoryManager(QSqlDatabase &db) : db(db) {}
 
-bool CategoryManager::createCategory(const QString &name, int parentId, int projectId) {
+bool CategoryManager::createCategory(const QString &name, int parentId, int projectId, int *newCategoryId,
+                                     int *newPosition) {
+    TRACE_SCOPE("manager", "CategoryManager::createCategory");
     QSqlQuery query(db);
 
-    int depth = 0;
+    int depth = 1;     // Корневые категории имеют глубину 1, как при нумерации дерева
     int position = 0;
 
     if (parentId != -1) {
         query.prepare("SELECT depth FROM category WHERE category_id = :parentId");
         query.bindValue(":parentId", parentId);
 
-        if (!query.exec() || !query.next()) {
+        if (!execQuery(query) || !query.next()) {
             qDebug() << "Ошибка получения глубины родительской категории:" << query.lastError();
             return false;
         }
@@ -22,10 +27,21 @@ bool CategoryManager::createCategory(const QString &name, int parentId, int proj
         depth = query.value(0).toInt() + 1;
     }
 
-    query.prepare("SELECT COALESCE(MAX(position), 0) + 1 FROM category WHERE parent_id = :parentId");
-    query.bindValue(":parentId", parentId == -1 ? QVariant() : parentId);
+    // Подкатегории и шаблоны одного родителя нумеруются общим рядом
+    if (parentId == -1) {
+        query.prepare("SELECT COALESCE(MAX(position), 0) + 1 FROM category "
+                      "WHERE project_id = :projectId AND parent_id IS NULL");
+        query.bindValue(":projectId", projectId);
+    } else {
+        query.prepare("SELECT COALESCE(MAX(position), 0) + 1 FROM ( "
+                      "    SELECT position FROM category WHERE parent_id = :parentId "
+                      "    UNION ALL "
+                      "    SELECT position FROM table_template WHERE category_id = :parentId2) s");
+        query.bindValue(":parentId", parentId);
+        query.bindValue(":parentId2", parentId);
+    }
 
-    if (!query.exec() || !query.next()) {
+    if (!execQuery(query) || !query.next()) {
         qDebug() << "Ошибка определения позиции категории:" << query.lastError();
         return false;
     }
@@ -33,29 +49,37 @@ bool CategoryManager::createCategory(const QString &name, int parentId, int proj
     position = query.value(0).toInt();
 
     query.prepare("INSERT INTO category (name, parent_id, position, depth, project_id) VALUES "
-                  "(:name, :parentId, :position, :depth, :projectId)");
+                  "(:name, :parentId, :position, :depth, :projectId) RETURNING category_id");
     query.bindValue(":name", name);
     query.bindValue(":parentId", parentId == -1 ? QVariant() : parentId);
     query.bindValue(":position", position);
     query.bindValue(":depth", depth);
     query.bindValue(":projectId", projectId);
 
-    if (!query.exec()) {
+    if (!execQuery(query) || !query.next()) {
         qDebug() << "Ошибка создания категории:" << query.lastError();
         return false;
     }
 
+    if (newCategoryId) {
+        *newCategoryId = query.value(0).toInt();
+    }
+    if (newPosition) {
+        *newPosition = position;
+    }
+
     return true;
 }
 
 bool CategoryManager::updateCategory(int categoryId, const QString &newName) {
+    TRACE_SCOPE("manager", "CategoryManager::updateCategory");
     QSqlQuery query(db);
 
     query.prepare("UPDATE category SET name = :newName WHERE category_id = :categoryId");
     query.bindValue(":newName", newName);
     query.bindValue(":categoryId", categoryId);
 
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка обновления категории:" << query.lastError();
         return false;
     }
@@ -63,94 +87,92 @@ bool CategoryManager::updateCategory(int categoryId, const QString &newName) {
     return true;
 }
 
-bool CategoryManager::deleteCategory(int categoryId, bool deleteAll) {
+bool CategoryManager::deleteCategory(int categoryId, bool deleteAll, QVector<TreeChange> *changes) {
+    TRACE_SCOPE("manager", "CategoryManager::deleteCategory");
+    // Поддерево, перенос детей и нумерация соседей - одной серверной функцией за одно обращение
     QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare(QString("SELECT item_id, is_category, removed, parent_id, position, depth FROM %1(:categoryId)")
+                      .arg(deleteAll ? "delete_category_tree" : "unpack_category"));
+    query.bindValue(":categoryId", categoryId);
 
-    if (deleteAll) {
-        // Удаляем категорию вместе с её подкатегориями и шаблонами
-        query.prepare(
-            "WITH RECURSIVE subcategories AS ( "
-            "    SELECT category_id FROM category WHERE category_id = :categoryId "
-            "    UNION ALL "
-            "    SELECT c.category_id FROM category c "
-            "    INNER JOIN subcategories s ON c.parent_id = s.category_id "
-            ") "
-            "DELETE FROM table_template WHERE category_id IN (SELECT category_id FROM subcategories);"
-            );
-        query.bindValue(":categoryId", categoryId);
-
-        if (!query.exec()) {
-            qDebug() << "Ошибка удаления шаблонов связанных с категорией:" << query.lastError();
-            return false;
-        }
-
-        query.prepare(
-            "WITH RECURSIVE subcategories AS ( "
-            "    SELECT category_id FROM category WHERE category_id = :categoryId "
-            "    UNION ALL "
-            "    SELECT c.category_id FROM category c "
-            "    INNER JOIN subcategories s ON c.parent_id = s.category_id "
-            ") "
-            "DELETE FROM category WHERE category_id IN (SELECT category_id FROM subcategories);"
-            );
-        query.bindValue(":categoryId", categoryId);
-
-        if (!query.exec()) {
-            qDebug() << "Ошибка удаления категории и её подкатегорий:" << query.lastError();
-            return false;
-        }
-    } else {
-        // "Распаковываем" содержимое в родительскую категорию
-        query.prepare("SELECT parent_id FROM category WHERE category_id = :categoryId");
-        query.bindValue(":categoryId", categoryId);
-
-        if (!query.exec() || !query.next()) {
-            qDebug() << "Ошибка получения родительской категории:" << query.lastError();
-            return false;
-        }
+    if (!execQuery(query)) {
+        qDebug() << (deleteAll ? "Ошибка удаления категории:" : "Ошибка распаковки категории:") << query.lastError();
+        return false;
+    }
 
-        int parentId = query.value(0).toInt();
+    if (changes) changes->clear();
+    while (changes && query.next()) {
+        changes->append({query.value(0).toInt(), query.value(1).toBool(), query.value(2).toBool(),
+                         query.value(3).toInt(), query.value(4).toInt(), query.value(5).toInt()});
+    }
+    return true;
+}
 
-        // Обновляем шаблоны, связанные с категорией
-        query.prepare("UPDATE table_template SET category_id = :parentId WHERE category_id = :categoryId");
-        query.bindValue(":parentId", parentId);
-        query.bindValue(":categoryId", categoryId);
+bool CategoryManager::deleteTemplate(int templateId, QVector<TreeChange> *changes) {
+    TRACE_SCOPE("manager", "CategoryManager::deleteTemplate");
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT item_id, is_category, removed, parent_id, position, depth FROM delete_template(:templateId)");
+    query.bindValue(":templateId", templateId);
 
-        if (!query.exec()) {
-            qDebug() << "Ошибка перемещения шаблонов в родительскую категорию:" << query.lastError();
-            return false;
-        }
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка удаления шаблона:" << query.lastError();
+        return false;
+    }
 
-        // Обновляем подкатегории
-        query.prepare("UPDATE category SET parent_id = :parentId WHERE parent_id = :categoryId");
-        query.bindValue(":parentId", parentId);
-        query.bindValue(":categoryId", categoryId);
+    if (changes) changes->clear();
+    while (changes && query.next()) {
+        changes->append({query.value(0).toInt(), query.value(1).toBool(), query.value(2).toBool(),
+                         query.value(3).toInt(), query.value(4).toInt(), query.value(5).toInt()});
+    }
+    return true;
+}
 
-        if (!query.exec()) {
-            qDebug() << "Ошибка перемещения подкатегорий в родительскую категорию:" << query.lastError();
-            return false;
-        }
+bool CategoryManager::getCategoryStats(const QVector<int> &categoryIds, QVector<Category> &stats) const {
+    TRACE_SCOPE("manager", "CategoryManager::getCategoryStats");
+    stats.clear();
+    if (categoryIds.isEmpty()) return true;
 
-        // Удаляем саму категорию
-        query.prepare("DELETE FROM category WHERE category_id = :categoryId");
-        query.bindValue(":categoryId", categoryId);
+    QStringList ids;
+    for (int id : categoryIds) ids.append(QString::number(id));
 
-        if (!query.exec()) {
-            qDebug() << "Ошибка удаления категории:" << query.lastError();
-            return false;
-        }
+    QSqlQuery query(db);
+    query.prepare("SELECT c.category_id, COALESCE(s.template_count, 0), COALESCE(s.approved_count, 0), "
+                  "COALESCE(s.cell_count, 0) "
+                  "FROM category c LEFT JOIN category_stats s ON s.category_id = c.category_id "
+                  "WHERE c.category_id = ANY(CAST(:ids AS INTEGER[]))");
+    query.bindValue(":ids", "{" + ids.join(',') + "}");
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка загрузки агрегатов категорий:" << query.lastError();
+        return false;
     }
 
+    while (query.next()) {
+        Category category = {};
+        category.categoryId = query.value(0).toInt();
+        category.templateCount = query.value(1).toInt();
+        category.approvedCount = query.value(2).toInt();
+        category.cellCount = query.value(3).toLongLong();
+        stats.append(category);
+    }
     return true;
 }
 
 QVector<Category> CategoryManager::getCategoriesByProject(int projectId) const {
+    TRACE_SCOPE("manager", "CategoryManager::getCategoriesByProject");
     QVector<Category> categories;
     QSqlQuery query(db);
-    query.prepare("SELECT category_id, name, parent_id, position, depth, project_id FROM category WHERE project_id = :projectId ORDER BY position");
+    query.prepare("SELECT c.category_id, c.name, c.parent_id, c.position, c.depth, c.project_id, "
+                  "COALESCE(s.template_count, 0) AS template_count, "
+                  "COALESCE(s.approved_count, 0) AS approved_count, "
+                  "COALESCE(s.cell_count, 0) AS cell_count "
+                  "FROM category c LEFT JOIN category_stats s ON s.category_id = c.category_id "
+                  "WHERE c.project_id = :projectId ORDER BY c.position");
     query.bindValue(":projectId", projectId);
 
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка загрузки категорий:" << query.lastError().text();
         return categories;
     }
@@ -163,7 +185,130 @@ QVector<Category> CategoryManager::getCategoriesByProject(int projectId) const {
         category.position = query.value("position").toInt();
         category.depth = query.value("depth").toInt();
         category.projectId = query.value("project_id").toInt();
+        category.templateCount = query.value("template_count").toInt();
+        category.approvedCount = query.value("approved_count").toInt();
+        category.cellCount = query.value("cell_count").toLongLong();
         categories.append(category);
     }
     return categories;
 }
+
+bool CategoryManager::updateNumeration(int itemId, int parentId, const QString &numeration, int depth) {
+    TRACE_SCOPE("manager", "CategoryManager::updateNumeration");
+    QSqlQuery checkQuery(db);
+
+    // Определяем, является ли элемент категорией
+    checkQuery.prepare("SELECT 1 FROM category WHERE category_id = :itemId");
+    checkQuery.bindValue(":itemId", itemId);
+
+    bool isCategory = false;
+
+    if (execQuery(checkQuery)) {
+        if (checkQuery.next()) {
+            isCategory = true; // Найдено в таблице `category`
+        }
+    } else {
+        qDebug() << "Ошибка выполнения запроса проверки категории:" << checkQuery.lastError();
+        return false;
+    }
+
+    // Подготовка запроса для обновления
+    QSqlQuery query(db);
+    QStringList numerationParts = numeration.split(".");
+    int position = numerationParts.last().toInt();
+
+    if (isCategory) {
+        query.prepare("UPDATE category "
+                      "SET position = :position, "
+                      "depth = :depth, "
+                      "parent_id = :parentId "
+                      "WHERE category_id = :itemId");
+        query.bindValue(":parentId", (parentId == -1) ? QVariant() : parentId);
+        query.bindValue(":depth", depth);
+    } else {
+        query.prepare("UPDATE table_template "
+                      "SET position = :position "
+                      "WHERE template_id = :itemId");
+    }
+
+    query.bindValue(":itemId", itemId);
+    query.bindValue(":position", position);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка обновления нумерации в базе данных:" << query.lastError();
+        return false;
+    }
+
+    return true;
+}
+
+bool CategoryManager::updateParentId(int itemId, int newParentId) {
+    TRACE_SCOPE("manager", "CategoryManager::updateParentId");
+    QSqlQuery query(db);
+
+    query.prepare("UPDATE category SET parent_id = :newParentId WHERE category_id = :itemId");
+    query.bindValue(":newParentId", newParentId <= 0 ? QVariant() : newParentId);   // 0 и -1 - верхний уровень
+    query.bindValue(":itemId", itemId);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка обновления parent_id:" << query.lastError();
+        return false;
+    }
+
+    return true;
+}
+
+bool CategoryManager::renumberProject(int projectId, QVector<PositionChange> *moved) {
+    TRACE_SCOPE("manager", "CategoryManager::renumberProject");
+    // Подкатегории и шаблоны одного родителя нумеруются общим рядом; обновляются только
+    // строки, у которых позиция или глубина действительно изменились
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare(
+        "WITH RECURSIVE tree AS ( "
+        "    SELECT category_id, 1 AS depth FROM category WHERE project_id = :projectId AND parent_id IS NULL "
+        "    UNION ALL "
+        "    SELECT c.category_id, t.depth + 1 FROM category c "
+        "    INNER JOIN tree t ON c.parent_id = t.category_id WHERE t.depth < 1000 "
+        "), "
+        "siblings AS ( "
+        "    SELECT TRUE AS is_category, c.category_id AS item_id, c.parent_id, c.position AS old_position, "
+        "           c.depth AS old_depth, t.depth "
+        "    FROM category c INNER JOIN tree t ON t.category_id = c.category_id "
+        "    UNION ALL "
+        "    SELECT FALSE, x.template_id, x.category_id, x.position, NULL, NULL "
+        "    FROM table_template x INNER JOIN tree t ON t.category_id = x.category_id "
+        "), "
+        "numbered AS ( "
+        "    SELECT s.*, ROW_NUMBER() OVER (PARTITION BY s.parent_id "
+        "        ORDER BY s.is_category DESC, s.old_position NULLS LAST, s.item_id) AS new_position "
+        "    FROM siblings s "
+        "), "
+        "moved AS ( "
+        "    SELECT * FROM numbered WHERE old_position IS DISTINCT FROM new_position "
+        "    OR (is_category AND old_depth IS DISTINCT FROM depth) "
+        "), "
+        "moved_categories AS ( "
+        "    UPDATE category c SET position = m.new_position, depth = m.depth FROM moved m "
+        "    WHERE m.is_category AND c.category_id = m.item_id "
+        "), "
+        "moved_templates AS ( "
+        "    UPDATE table_template x SET position = m.new_position FROM moved m "
+        "    WHERE NOT m.is_category AND x.template_id = m.item_id "
+        ") "
+        "SELECT item_id, is_category, COALESCE(parent_id, 0), COALESCE(old_position, 0), new_position FROM moved "
+        "ORDER BY is_category DESC, parent_id NULLS FIRST, new_position");
+    query.bindValue(":projectId", projectId);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка уплотнения позиций проекта:" << query.lastError();
+        return false;
+    }
+
+    if (moved) moved->clear();
+    while (moved && query.next()) {
+        moved->append({query.value(0).toInt(), query.value(1).toBool(), query.value(2).toInt(),
+                       query.value(3).toInt(), query.value(4).toInt()});
+    }
+    return true;
+}
@@ -12,17 +12,58 @@ struct Category {
     int position;
     int depth;
     int projectId;
+
+    // Агрегаты по поддереву (поддерживаются триггерами на сервере)
+    int templateCount;
+    int approvedCount;
+    qint64 cellCount;
+};
+
+// Элемент, сдвинутый при уплотнении позиций
+struct PositionChange {
+    int itemId;
+    bool isCategory;
+    int parentId;           // Для шаблона - категория, для корневой категории 0
+    int oldPosition;
+    int newPosition;
+};
+
+// Элемент, затронутый удалением или распаковкой категории: удалённый либо новое положение
+struct TreeChange {
+    int itemId;
+    bool isCategory;
+    bool removed;
+    int parentId;           // 0 - верхний уровень
+    int position;
+    int depth;
 };
 
 class CategoryManager {
 public:
     CategoryManager(QSqlDatabase &db);
 
-    bool createCategory(const QString &name, int parentId, int projectId);
+    bool createCategory(const QString &name, int parentId, int projectId, int *newCategoryId = nullptr,
+                        int *newPosition = nullptr);
     bool updateCategory(int categoryId, const QString &newName);
-    bool deleteCategory(int categoryId, bool deleteAll);
+    // deleteAll - вместе с поддеревом, иначе дети переходят к родителю на место категории.
+    // Соседи нумеруются заново; changes - удалённые элементы и новые положения детей родителя
+    bool deleteCategory(int categoryId, bool deleteAll, QVector<TreeChange> *changes = nullptr);
+
+    // Удаление шаблона с нумерацией его соседей на сервере; changes - как у deleteCategory
+    bool deleteTemplate(int templateId, QVector<TreeChange> *changes = nullptr);
 
     QVector<Category> getCategoriesByProject(int projectId) const;  // Получение списка категорий
+    // Текущие агрегаты категорий (заполнены categoryId и поля агрегатов)
+    bool getCategoryStats(const QVector<int> &categoryIds, QVector<Category> &stats) const;
+
+    // Нумерация и перенос элементов дерева
+    bool updateNumeration(int itemId, int parentId, const QString &numeration, int depth);
+    bool updateParentId(int itemId, int newParentId);
+
+    // Сплошная нумерация всего проекта (1, 2, 3...) в порядке текущих позиций одним запросом:
+    // у каждого родителя сначала подкатегории, затем шаблоны, как в дереве интерфейса.
+    // Глубина категорий пересчитывается тем же запросом; moved - сдвинутые элементы
+    bool renumberProject(int projectId, QVector<PositionChange> *moved = nullptr);
 
 private:
     QSqlDatabase &db;
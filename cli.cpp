@@ -0,0 +1,559 @@
+// Консольный клиент AutoTLG для пакетных заданий и cron: работает с теми же
+// менеджерами, что и интерфейс, но без виджетов.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryFile>
+#include <QTextStream>
+#include <QSqlError>
+#include "databasehandler.h"
+#include "tracing.h"
+#include "importmanager.h"
+#include "exportmanager.h"
+#include "projectvalidator.h"
+#include "griddiff.h"
+#include "stringpool.h"
+#include <QMap>
+#include <QtConcurrent>
+
+namespace {
+
+QTextStream &out() {
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+QTextStream &err() {
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+// Коды возврата: 0 - успех, 1 - ошибка выполнения или найдены нарушения, 2 - неверный вызов
+enum ExitCode {
+    ExitOk = 0,
+    ExitFailed = 1,
+    ExitUsage = 2
+};
+
+bool toId(const QString &text, int &id) {
+    bool ok = false;
+    id = text.toInt(&ok);
+    return ok && id > 0;
+}
+
+int listProjects(DatabaseHandler &handler) {
+    for (const Project &project : handler.getProjectManager()->getProjects()) {
+        out() << project.projectId << '\t' << project.name << Qt::endl;
+    }
+    return ExitOk;
+}
+
+int cloneProject(DatabaseHandler &handler, int projectId, const QString &newName) {
+    // Клон - это выгрузка и загрузка через временный файл JSON Lines:
+    // идентификаторы переназначаются, память не зависит от размера проекта
+    QTemporaryFile file;
+    if (!file.open()) {
+        err() << "Не удалось создать временный файл" << Qt::endl;
+        return ExitFailed;
+    }
+    file.close();
+
+    ProjectManager *projects = handler.getProjectManager();
+    int newProjectId = -1;
+    if (!projects->exportProject(projectId, file.fileName()) ||
+        !projects->importProject(file.fileName(), &newProjectId) ||
+        !projects->updateProject(newProjectId, newName)) {
+        err() << "Не удалось клонировать проект " << projectId << Qt::endl;
+        return ExitFailed;
+    }
+
+    out() << newProjectId << Qt::endl;
+    return ExitOk;
+}
+
+int exportProject(DatabaseHandler &handler, int projectId, const QString &filePath) {
+    if (!handler.getProjectManager()->exportProject(projectId, filePath)) {
+        err() << "Не удалось выгрузить проект " << projectId << Qt::endl;
+        return ExitFailed;
+    }
+    return ExitOk;
+}
+
+int importProject(DatabaseHandler &handler, const QString &filePath) {
+    int newProjectId = -1;
+    if (!handler.getProjectManager()->importProject(filePath, &newProjectId)) {
+        err() << "Не удалось загрузить проект из " << filePath << Qt::endl;
+        return ExitFailed;
+    }
+    out() << newProjectId << Qt::endl;
+    return ExitOk;
+}
+
+int exportDocuments(DatabaseHandler &handler, int projectId, const QString &outputDir,
+                    const QString &format, bool combined) {
+    ExportOptions options;
+    options.outputDir = outputDir;
+    options.html = format != "rtf";
+    options.rtf = format != "html";
+    options.combined = combined;
+
+    // Сигналы менеджера при прямом вызове приходят синхронно
+    bool ok = false;
+    ExportManager exporter(handler.connectionName());
+    QObject::connect(&exporter, &ExportManager::finished, [&ok](bool success, const QString &message) {
+        ok = success;
+        (success ? out() : err()) << message << Qt::endl;
+    });
+    exporter.run(projectId, options);
+    return ok ? ExitOk : ExitFailed;
+}
+
+int importCsv(DatabaseHandler &handler, int categoryId, const QStringList &paths) {
+    bool ok = false;
+    ImportManager importer(handler.connectionName());
+    QObject::connect(&importer, &ImportManager::finished, [&ok](bool success, const QString &message) {
+        ok = success;
+        (success ? out() : err()) << message << Qt::endl;
+    });
+    importer.run(paths, categoryId);
+    return ok ? ExitOk : ExitFailed;
+}
+
+int renumberProject(DatabaseHandler &handler, int projectId) {
+    QSqlDatabase db = QSqlDatabase::database(handler.connectionName());
+    if (!db.transaction()) {
+        err() << "Ошибка начала транзакции: " << db.lastError().text() << Qt::endl;
+        return ExitFailed;
+    }
+
+    QVector<PositionChange> moved;
+    if (!handler.getCategoryManager()->renumberProject(projectId, &moved)) {
+        db.rollback();
+        err() << "Не удалось перенумеровать проект " << projectId << Qt::endl;
+        return ExitFailed;
+    }
+    if (!db.commit()) {
+        err() << "Ошибка фиксации транзакции: " << db.lastError().text() << Qt::endl;
+        return ExitFailed;
+    }
+
+    // Сдвинутые элементы: вид, идентификатор, родитель, прежняя и новая позиция
+    for (const PositionChange &change : moved) {
+        out() << (change.isCategory ? "category" : "template") << '\t' << change.itemId << '\t'
+              << change.parentId << '\t' << change.oldPosition << '\t' << change.newPosition << Qt::endl;
+    }
+    return ExitOk;
+}
+
+int validateProject(DatabaseHandler &handler, int projectId) {
+    QSqlDatabase db = QSqlDatabase::database(handler.connectionName());
+    QVector<ValidationIssue> issues;
+    if (!ProjectValidator(db).validate(projectId, issues)) {
+        err() << "Не удалось проверить проект " << projectId << Qt::endl;
+        return ExitFailed;
+    }
+
+    for (const ValidationIssue &issue : issues) {
+        out() << issue.check << '\t' << issue.itemId << '\t' << issue.message << Qt::endl;
+    }
+    return issues.isEmpty() ? ExitOk : ExitFailed;
+}
+
+// positionsOnly - только повторы позиций в сетках: база ещё не прошла миграцию ключей
+int repairProject(DatabaseHandler &handler, int projectId, bool positionsOnly) {
+    QSqlDatabase db = QSqlDatabase::database(handler.connectionName());
+    ProjectValidator validator(db);
+    auto validate = [&validator, projectId, positionsOnly](QVector<ValidationIssue> &issues) {
+        return positionsOnly ? validator.validateGridPositions(projectId, issues)
+                             : validator.validate(projectId, issues);
+    };
+    QVector<ValidationIssue> issues;
+    if (!validate(issues)) {
+        err() << "Не удалось проверить проект " << projectId << Qt::endl;
+        return ExitFailed;
+    }
+
+    if (!db.transaction()) {
+        err() << "Ошибка начала транзакции: " << db.lastError().text() << Qt::endl;
+        return ExitFailed;
+    }
+    int fixed = 0;
+    if (!validator.fix(projectId, issues, &fixed)) {
+        db.rollback();
+        err() << "Не удалось исправить проект " << projectId << Qt::endl;
+        return ExitFailed;
+    }
+    if (!db.commit()) {
+        err() << "Ошибка фиксации транзакции: " << db.lastError().text() << Qt::endl;
+        return ExitFailed;
+    }
+
+    // Оставшиеся нарушения выводятся так же, как в validate
+    issues.clear();
+    if (!validate(issues)) {
+        err() << "Не удалось проверить проект " << projectId << Qt::endl;
+        return ExitFailed;
+    }
+    err() << "Исправлено нарушений: " << fixed << Qt::endl;
+    for (const ValidationIssue &issue : issues) {
+        out() << issue.check << '\t' << issue.itemId << '\t' << issue.message << Qt::endl;
+    }
+    return issues.isEmpty() ? ExitOk : ExitFailed;
+}
+
+int convertGridFormat(DatabaseHandler &handler, int projectId, const QString &format) {
+    if (format != "rows" && format != "packed") {
+        err() << "Формат сетки должен быть rows или packed: " << format << Qt::endl;
+        return ExitUsage;
+    }
+
+    QSqlDatabase db = QSqlDatabase::database(handler.connectionName());
+    if (!db.transaction()) {
+        err() << "Ошибка начала транзакции: " << db.lastError().text() << Qt::endl;
+        return ExitFailed;
+    }
+
+    int converted = 0;
+    const GridFormat target = format == "packed" ? GridFormat::Packed : GridFormat::Rows;
+    if (!handler.getTemplateManager()->convertProjectGrids(projectId, target, &converted)) {
+        db.rollback();
+        err() << "Не удалось перевести сетки проекта " << projectId << Qt::endl;
+        return ExitFailed;
+    }
+    if (!db.commit()) {
+        err() << "Ошибка фиксации транзакции: " << db.lastError().text() << Qt::endl;
+        return ExitFailed;
+    }
+
+    out() << converted << Qt::endl;
+    return ExitOk;
+}
+
+int listRevisions(DatabaseHandler &handler, int templateId) {
+    for (const TemplateRevision &revision : handler.getRevisionManager()->listRevisions(templateId)) {
+        out() << revision.revision << '\t' << revision.createdAt.toString(Qt::ISODate) << '\t'
+              << (revision.isSnapshot ? "snapshot" : "delta") << '\t' << revision.changedCells << Qt::endl;
+    }
+    return ExitOk;
+}
+
+int revertTemplate(DatabaseHandler &handler, int templateId, int revision) {
+    QSqlDatabase db = QSqlDatabase::database(handler.connectionName());
+    if (!db.transaction()) {
+        err() << "Ошибка начала транзакции: " << db.lastError().text() << Qt::endl;
+        return ExitFailed;
+    }
+
+    if (!handler.getRevisionManager()->revert(templateId, revision)) {
+        db.rollback();
+        err() << "Не удалось вернуть шаблон " << templateId << " к ревизии " << revision << Qt::endl;
+        return ExitFailed;
+    }
+    return db.commit() ? ExitOk : ExitFailed;
+}
+
+// Построчный вывод отличий: "-" только слева, "+" только справа, ">" перемещение, "~" изменение.
+// Номера строк и столбцов с единицы
+void printDiff(const TemplateGrid &left, const TemplateGrid &right, const GridDiff &diff) {
+    auto header = [](const TemplateGrid &grid, int column) {
+        return column >= 0 && column < grid.headers.size() ? grid.headers[column] : QString();
+    };
+    auto rowText = [](const TemplateGrid &grid, int row) {
+        return QStringList(grid.cells[row].begin(), grid.cells[row].end()).join(" | ");
+    };
+
+    for (const DiffLine &column : diff.columns) {
+        switch (column.kind) {
+        case DiffKind::Equal:
+            break;
+        case DiffKind::Deleted:
+            out() << "- column " << column.left + 1 << '\t' << header(left, column.left) << Qt::endl;
+            break;
+        case DiffKind::Inserted:
+            out() << "+ column " << column.right + 1 << '\t' << header(right, column.right) << Qt::endl;
+            break;
+        case DiffKind::Moved:
+            out() << "> column " << column.left + 1 << " -> " << column.right + 1 << '\t' << header(right, column.right) << Qt::endl;
+            break;
+        case DiffKind::Changed:
+            out() << "~ column " << column.left + 1 << " -> " << column.right + 1 << '\t'
+                  << header(left, column.left) << " -> " << header(right, column.right) << Qt::endl;
+            break;
+        }
+    }
+
+    for (const DiffLine &row : diff.rows) {
+        switch (row.kind) {
+        case DiffKind::Equal:
+            break;
+        case DiffKind::Deleted:
+            out() << "- row " << row.left + 1 << '\t' << rowText(left, row.left) << Qt::endl;
+            break;
+        case DiffKind::Inserted:
+            out() << "+ row " << row.right + 1 << '\t' << rowText(right, row.right) << Qt::endl;
+            break;
+        case DiffKind::Moved:
+        case DiffKind::Changed:
+            out() << (row.kind == DiffKind::Moved ? "> row " : "~ row ") << row.left + 1 << " -> " << row.right + 1;
+            for (int c : row.changedColumns) {
+                const DiffLine &column = diff.columns[c];
+                const QString before = column.left < left.cells[row.left].size() ? left.cells[row.left][column.left] : QString();
+                const QString after = column.right < right.cells[row.right].size() ? right.cells[row.right][column.right] : QString();
+                out() << '\t' << header(right, column.right) << ": \"" << before << "\" -> \"" << after << '"';
+            }
+            out() << Qt::endl;
+            break;
+        }
+    }
+    out() << diff.summary() << Qt::endl;
+}
+
+int diffTemplates(DatabaseHandler &handler, int leftId, int rightId) {
+    // Отсутствующий шаблон читается как пустая сетка, поэтому проверяется отдельно
+    QVector<int> missing;
+    if (!handler.getTemplateManager()->findMissingTemplates({leftId, rightId}, missing)) {
+        err() << "Не удалось проверить шаблоны" << Qt::endl;
+        return ExitFailed;
+    }
+    for (int templateId : missing) {
+        err() << "Шаблон " << templateId << " не найден" << Qt::endl;
+    }
+    if (!missing.isEmpty()) return ExitFailed;
+
+    QHash<int, TemplateGrid> grids;
+    if (!handler.getTemplateManager()->getGridsForTemplates({leftId, rightId}, grids)) {
+        err() << "Не удалось загрузить сетки шаблонов" << Qt::endl;
+        return ExitFailed;
+    }
+
+    const TemplateGrid left = grids.value(leftId);
+    const TemplateGrid right = grids.value(rightId);
+    const GridDiff diff = diffGrids(left, right);
+    printDiff(left, right, diff);
+    return diff.isEmpty() ? ExitOk : ExitFailed;
+}
+
+int diffRevisions(DatabaseHandler &handler, int templateId, int leftRevision, int rightRevision) {
+    TemplateGrid left;
+    TemplateGrid right;
+    if (!handler.getRevisionManager()->reconstruct(templateId, leftRevision, left)
+        || !handler.getRevisionManager()->reconstruct(templateId, rightRevision, right)) {
+        err() << "Не удалось восстановить ревизии шаблона " << templateId << Qt::endl;
+        return ExitFailed;
+    }
+
+    const GridDiff diff = diffGrids(left, right);
+    printDiff(left, right, diff);
+    return diff.isEmpty() ? ExitOk : ExitFailed;
+}
+
+// Шаблоны проекта по пути "категория/подкатегория/название". Одинаковый путь у нескольких
+// шаблонов (одноимённые шаблоны или категории) не сопоставить с другим проектом: такие
+// шаблоны получают путь с идентификатором "путь#id" и выводятся как добавленные и удалённые
+bool templatesByPath(DatabaseHandler &handler, int projectId, QMap<QString, int> &templates) {
+    const QVector<Category> categories = handler.getCategoryManager()->getCategoriesByProject(projectId);
+    QHash<int, Category> byId;
+    for (const Category &category : categories) {
+        byId.insert(category.categoryId, category);
+    }
+
+    QHash<int, QString> categoryPaths;
+    for (const Category &category : categories) {
+        QStringList path;
+        for (int id = category.categoryId; byId.contains(id) && path.size() <= categories.size(); id = byId[id].parentId) {
+            path.prepend(byId[id].name);
+        }
+        categoryPaths.insert(category.categoryId, path.join('/'));
+    }
+
+    QMap<QString, QVector<int>> byPath;
+    for (const Template &tmpl : handler.getTemplateManager()->getTemplatesForProject(projectId)) {
+        byPath[categoryPaths.value(tmpl.categoryId) + '/' + tmpl.name].append(tmpl.templateId);
+    }
+    for (auto it = byPath.constBegin(); it != byPath.constEnd(); ++it) {
+        if (it.value().size() == 1) {
+            templates.insert(it.key(), it.value().first());
+            continue;
+        }
+        err() << "Путь " << it.key() << " в проекте " << projectId << " неоднозначен, шаблоны сравниваются по id" << Qt::endl;
+        for (int templateId : it.value()) {
+            templates.insert(QString("%1#%2").arg(it.key()).arg(templateId), templateId);
+        }
+    }
+    return !categories.isEmpty();
+}
+
+// Сводка по всем шаблонам двух проектов; сетки читаются пакетно, сравнение идёт в пуле потоков
+int diffProjects(DatabaseHandler &handler, int leftProjectId, int rightProjectId) {
+    QMap<QString, int> leftTemplates;
+    QMap<QString, int> rightTemplates;
+    if (!templatesByPath(handler, leftProjectId, leftTemplates) || !templatesByPath(handler, rightProjectId, rightTemplates)) {
+        err() << "Не удалось загрузить структуру проектов" << Qt::endl;
+        return ExitFailed;
+    }
+
+    // Сетки обоих проектов находятся в памяти одновременно и в основном совпадают,
+    // поэтому одинаковые тексты разделяются через общий пул
+    StringPool strings;
+    QHash<int, TemplateGrid> leftGrids;
+    QHash<int, TemplateGrid> rightGrids;
+    if (!handler.getTemplateManager()->getGridsForTemplates(QVector<int>(leftTemplates.begin(), leftTemplates.end()),
+                                                            leftGrids, &strings)
+        || !handler.getTemplateManager()->getGridsForTemplates(QVector<int>(rightTemplates.begin(), rightTemplates.end()),
+                                                               rightGrids, &strings)) {
+        err() << "Не удалось загрузить сетки шаблонов" << Qt::endl;
+        return ExitFailed;
+    }
+
+    struct Pair {
+        QString path;
+        int leftId;
+        int rightId;
+        GridDiff diff;
+    };
+    QVector<Pair> pairs;
+    QStringList paths = leftTemplates.keys() + rightTemplates.keys();
+    paths.removeDuplicates();
+    paths.sort();
+    for (const QString &path : paths) {
+        pairs.append({path, leftTemplates.value(path, 0), rightTemplates.value(path, 0), GridDiff()});
+    }
+
+    QtConcurrent::blockingMap(pairs, [&leftGrids, &rightGrids](Pair &pair) {
+        if (pair.leftId > 0 && pair.rightId > 0) {
+            pair.diff = diffGrids(leftGrids.value(pair.leftId), rightGrids.value(pair.rightId));
+        }
+    });
+
+    bool identical = true;
+    for (const Pair &pair : pairs) {
+        if (pair.leftId == 0) {
+            out() << "+\t" << pair.path << Qt::endl;
+        } else if (pair.rightId == 0) {
+            out() << "-\t" << pair.path << Qt::endl;
+        } else if (!pair.diff.isEmpty()) {
+            out() << "~\t" << pair.path << '\t' << pair.diff.summary() << Qt::endl;
+        } else {
+            continue;
+        }
+        identical = false;
+    }
+    return identical ? ExitOk : ExitFailed;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setOrganizationName("AutoTLG");
+    app.setApplicationName("AutoTLG");   // Те же настройки подключения, что и у интерфейса
+    Tracer::startFromEnvironment();   // AUTOTLG_TRACE=<файл>
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Пакетные операции AutoTLG без графического интерфейса.\n\n"
+        "Команды:\n"
+        "  projects                            список проектов\n"
+        "  clone <projectId> <name>            копия проекта под новым названием\n"
+        "  export <projectId> <file.jsonl>     выгрузка проекта в JSON Lines\n"
+        "  import <file.jsonl>                 загрузка проекта из JSON Lines\n"
+        "  export-docs <projectId> <dir>       документы шаблонов в RTF/HTML\n"
+        "  import-csv <categoryId> <path>...   CSV/TSV файлы и каталоги в категорию\n"
+        "  renumber <projectId>                сплошная нумерация дерева проекта, вывод сдвинутых элементов\n"
+        "  validate <projectId>                проверка целостности (код 1 при нарушениях)\n"
+        "  repair <projectId>                  исправление нарушений целостности (код 1, если остались)\n"
+        "  grid-format <projectId> rows|packed перевод сеток шаблонов в построчный или упакованный формат\n"
+        "  revisions <templateId>              история сетки шаблона\n"
+        "  revert <templateId> <revision>      возврат сетки шаблона к ревизии\n"
+        "  diff <templateId> <templateId>      отличия сеток двух шаблонов (код 1 при отличиях)\n"
+        "  diff-revisions <templateId> <rev> <rev> отличия двух ревизий шаблона\n"
+        "  diff-projects <projectId> <projectId> отличающиеся шаблоны двух проектов по пути в дереве");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command", "Команда и её аргументы.", "<command> [args...]");
+
+    const QCommandLineOption hostOption("host", "Сервер PostgreSQL.", "host");
+    const QCommandLineOption portOption("port", "Порт PostgreSQL.", "port", "5432");
+    const QCommandLineOption dbNameOption("dbname", "Имя базы данных.", "name");
+    const QCommandLineOption userOption("user", "Пользователь.", "user");
+    const QCommandLineOption passwordOption("password", "Пароль (по умолчанию из PGPASSWORD или ~/.pgpass).", "password");
+    const QCommandLineOption formatOption("format", "Формат export-docs: html, rtf или both.", "format", "both");
+    const QCommandLineOption combinedOption("combined", "export-docs: один общий документ.");
+    const QCommandLineOption noMigrateOption("no-migrate", "Не применять миграции схемы; repair исправляет только "
+                                                           "повторы позиций в сетках, на которых миграция остановилась.");
+    parser.addOptions({hostOption, portOption, dbNameOption, userOption, passwordOption, formatOption, combinedOption,
+                       noMigrateOption});
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.isEmpty()) {
+        parser.showHelp(ExitUsage);
+    }
+    const QString command = args.first();
+
+    // Без параметров в командной строке используются настройки интерфейса
+    DatabaseHandler handler;
+    const bool migrate = !parser.isSet(noMigrateOption);
+    const bool connected = parser.isSet(dbNameOption)
+        ? handler.connectToDatabase(parser.value(dbNameOption), parser.value(userOption),
+                                    parser.value(passwordOption), parser.value(hostOption),
+                                    parser.value(portOption).toInt(), migrate)
+        : handler.connectToDatabase(migrate);
+    if (!connected) {
+        err() << "Не удалось подключиться к базе данных" << Qt::endl;
+        return ExitFailed;
+    }
+
+    int id = 0;
+    if (command == "projects" && args.size() == 1) {
+        return listProjects(handler);
+    }
+    if (command == "clone" && args.size() == 3 && toId(args[1], id)) {
+        return cloneProject(handler, id, args[2]);
+    }
+    if (command == "export" && args.size() == 3 && toId(args[1], id)) {
+        return exportProject(handler, id, args[2]);
+    }
+    if (command == "import" && args.size() == 2) {
+        return importProject(handler, args[1]);
+    }
+    if (command == "export-docs" && args.size() == 3 && toId(args[1], id)) {
+        return exportDocuments(handler, id, args[2], parser.value(formatOption), parser.isSet(combinedOption));
+    }
+    if (command == "import-csv" && args.size() >= 3 && toId(args[1], id)) {
+        return importCsv(handler, id, args.mid(2));
+    }
+    if (command == "renumber" && args.size() == 2 && toId(args[1], id)) {
+        return renumberProject(handler, id);
+    }
+    if (command == "validate" && args.size() == 2 && toId(args[1], id)) {
+        return validateProject(handler, id);
+    }
+    if (command == "repair" && args.size() == 2 && toId(args[1], id)) {
+        return repairProject(handler, id, !migrate);
+    }
+    if (command == "grid-format" && args.size() == 3 && toId(args[1], id)) {
+        return convertGridFormat(handler, id, args[2]);
+    }
+    if (command == "revisions" && args.size() == 2 && toId(args[1], id)) {
+        return listRevisions(handler, id);
+    }
+    int revision = 0;
+    if (command == "revert" && args.size() == 3 && toId(args[1], id) && toId(args[2], revision)) {
+        return revertTemplate(handler, id, revision);
+    }
+    int otherId = 0;
+    if (command == "diff" && args.size() == 3 && toId(args[1], id) && toId(args[2], otherId)) {
+        return diffTemplates(handler, id, otherId);
+    }
+    if (command == "diff-revisions" && args.size() == 4 && toId(args[1], id)
+        && toId(args[2], revision) && toId(args[3], otherId)) {
+        return diffRevisions(handler, id, revision, otherId);
+    }
+    if (command == "diff-projects" && args.size() == 3 && toId(args[1], id) && toId(args[2], otherId)) {
+        return diffProjects(handler, id, otherId);
+    }
+
+    err() << "Неизвестная команда или неверные аргументы: " << args.join(' ') << Qt::endl;
+    parser.showHelp(ExitUsage);
+}
@@ -1,6 +1,11 @@
-#include "databaseHandler.h"
+#include "databasehandler.h"
+#include "queryexecutor.h"
+#include "schemamigrations.h"
+#include "tracing.h"
 #include <QSqlQuery>
 #include <QSqlError>
+#include <QSettings>
+#include <QMultiHash>
 
 DatabaseHandler::DatabaseHandler(QObject *parent)
     : QObject(parent) {
@@ -14,16 +19,22 @@ DatabaseHandler::DatabaseHandler(QObject *parent)
     categoryManager = new CategoryManager(db);
     templateManager = new TemplateManager(db);
     tableManager = new TableManager(db);
+    searchManager = new SearchManager(db);
+    revisionManager = new RevisionManager(db);
+    editJournal = new EditJournal(db);
 }
 
 
 DatabaseHandler::DatabaseHandler(QSqlDatabase &db, QObject *parent)
-    : QObject(parent), db(db) {
+    : QObject(parent), db(db), ownsConnection(false) {
 
     projectManager = new ProjectManager(db);
     categoryManager = new CategoryManager(db);
     templateManager = new TemplateManager(db);
     tableManager = new TableManager(db);
+    searchManager = new SearchManager(db);
+    revisionManager = new RevisionManager(db);
+    editJournal = new EditJournal(db);
 }
 
 DatabaseHandler::~DatabaseHandler() {
@@ -31,6 +42,11 @@ DatabaseHandler::~DatabaseHandler() {
     delete categoryManager;
     delete templateManager;
     delete tableManager;
+    delete searchManager;
+    delete revisionManager;
+    delete editJournal;
+    // Чужое соединение закрывает и удаляет его владелец
+    if (!ownsConnection) return;
     if (db.isOpen()) {
         db.close();
     }
@@ -54,8 +70,22 @@ TableManager* DatabaseHandler::getTableManager() {
     return tableManager;
 }
 
+SearchManager* DatabaseHandler::getSearchManager() {
+    return searchManager;
+}
+
+RevisionManager* DatabaseHandler::getRevisionManager() {
+    return revisionManager;
+}
+
+EditJournal* DatabaseHandler::getEditJournal() {
+    return editJournal;
+}
+
 //
-bool DatabaseHandler::connectToDatabase(const QString &dbName, const QString &user, const QString &password, const QString &host, int port) {
+bool DatabaseHandler::connectToDatabase(const QString &dbName, const QString &user, const QString &password, const QString &host, int port,
+                                        bool migrate) {
+    TRACE_SCOPE("manager", "DatabaseHandler::connectToDatabase");
 
     db = QSqlDatabase::addDatabase("QPSQL");
     db.setDatabaseName(dbName);
@@ -69,70 +99,204 @@ bool DatabaseHandler::connectToDatabase(const QString &dbName, const QString &us
         return false;
     }
 
-    return true;
+    return !migrate || prepareSchema();
 }
 
-//
-bool DatabaseHandler::updateNumerationDB(int itemId, int parentId, const QString &numeration, int depth) {
-    QSqlQuery checkQuery(db);
+QString DatabaseHandler::connectionName() const {
+    return db.connectionName();
+}
+
+bool DatabaseHandler::prepareSchema() {
+    TRACE_SCOPE("manager", "DatabaseHandler::prepareSchema");
+    return migrateSchema() && verifySchema();
+}
 
-    // Определяем, является ли элемент категорией
-    checkQuery.prepare("SELECT 1 FROM category WHERE category_id = :itemId");
-    checkQuery.bindValue(":itemId", itemId);
+int DatabaseHandler::schemaVersion() {
+    QSqlQuery query(db);
+    if (!execQuery(query, "SELECT to_regclass('schema_migrations') IS NOT NULL") || !query.next()) {
+        qDebug() << "Ошибка проверки журнала миграций:" << query.lastError().text();
+        return -1;
+    }
+    if (!query.value(0).toBool()) {
+        return 0;
+    }
+    if (!execQuery(query, "SELECT COALESCE(MAX(version), 0) FROM schema_migrations") || !query.next()) {
+        qDebug() << "Ошибка чтения версии схемы:" << query.lastError().text();
+        return -1;
+    }
+    return query.value(0).toInt();
+}
 
-    bool isCategory = false;
+bool DatabaseHandler::migrateSchema() {
+    TRACE_SCOPE("manager", "DatabaseHandler::migrateSchema");
+    if (!db.transaction()) {
+        qDebug() << "Ошибка начала транзакции подготовки схемы:" << db.lastError().text();
+        return false;
+    }
 
-    if (checkQuery.exec()) {
-        if (checkQuery.next()) {
-            isCategory = true; // Найдено в таблице `category`
+    // Одновременно запущенные клиенты применяют миграции по очереди
+    QSqlQuery query(db);
+    const QStringList setup = {
+        "SELECT pg_advisory_xact_lock(hashtext('autotlg_schema_migrations'))",
+        "CREATE TABLE IF NOT EXISTS schema_migrations ("
+        "    version INTEGER PRIMARY KEY, "
+        "    description TEXT NOT NULL, "
+        "    applied_at TIMESTAMPTZ NOT NULL DEFAULT now())"
+    };
+    for (const QString &statement : setup) {
+        if (!execQuery(query, statement)) {
+            qDebug() << "Ошибка подготовки журнала миграций:" << query.lastError().text();
+            db.rollback();
+            return false;
         }
-    } else {
-        qDebug() << "Ошибка выполнения запроса проверки категории:" << checkQuery.lastError();
+    }
+
+    const int currentVersion = schemaVersion();
+    if (currentVersion < 0) {
+        db.rollback();
         return false;
     }
 
-    // Подготовка запроса для обновления
+    const QVector<SchemaMigration> &migrations = schemaMigrations();
+    if (currentVersion > migrations.last().version) {
+        qDebug() << "Версия схемы базы" << currentVersion << "новее поддерживаемой клиентом"
+                 << migrations.last().version << "- требуется обновление приложения";
+    }
+
+    for (const SchemaMigration &migration : migrations) {
+        if (migration.version <= currentVersion) continue;
+
+        for (const QString &statement : migration.statements) {
+            if (!execQuery(query, statement)) {
+                qDebug() << "Ошибка миграции" << migration.version << ":" << query.lastError().text() << statement;
+                db.rollback();
+                return false;
+            }
+        }
+
+        query.prepare("INSERT INTO schema_migrations (version, description) VALUES (:version, :description)");
+        query.bindValue(":version", migration.version);
+        query.bindValue(":description", migration.description);
+        if (!execQuery(query)) {
+            qDebug() << "Ошибка записи миграции" << migration.version << ":" << query.lastError().text();
+            db.rollback();
+            return false;
+        }
+        qDebug() << "Применена миграция схемы" << migration.version << migration.description;
+    }
+
+    return db.commit();
+}
+
+bool DatabaseHandler::verifySchema() {
+    TRACE_SCOPE("manager", "DatabaseHandler::verifySchema");
     QSqlQuery query(db);
-    QStringList numerationParts = numeration.split(".");
-    int position = numerationParts.last().toInt();
-
-    if (isCategory) {
-        query.prepare("UPDATE category "
-                      "SET position = :position, "
-                      "depth = :depth, "
-                      "parent_id = :parentId "
-                      "WHERE category_id = :itemId");
-        query.bindValue(":parentId", (parentId == -1) ? QVariant() : parentId);
-        query.bindValue(":depth", depth);
-    } else {
-        query.prepare("UPDATE table_template "
-                      "SET position = :position "
-                      "WHERE template_id = :itemId");
+
+    // Ведущие столбцы всех индексов наших таблиц
+    QStringList tables;
+    for (const RequiredIndex &index : requiredIndexes()) {
+        if (!tables.contains(index.table)) tables.append(index.table);
+    }
+    const QString indexColumnsSql = QString(
+        "SELECT t.relname, string_agg(a.attname, ',' ORDER BY k.ord) "
+        "FROM pg_index i "
+        "INNER JOIN pg_class t ON t.oid = i.indrelid "
+        "CROSS JOIN LATERAL unnest(i.indkey::int2[]) WITH ORDINALITY AS k (attnum, ord) "
+        "INNER JOIN pg_attribute a ON a.attrelid = i.indrelid AND a.attnum = k.attnum "
+        "WHERE pg_table_is_visible(t.oid) AND t.relname IN ('%1') "
+        "GROUP BY t.relname, i.indexrelid").arg(tables.join("', '"));
+
+    if (!execQuery(query, indexColumnsSql)) {
+        qDebug() << "Ошибка чтения индексов:" << query.lastError().text();
+        return false;
     }
+    QMultiHash<QString, QStringList> existing;
+    while (query.next()) {
+        existing.insert(query.value(0).toString(), query.value(1).toString().split(','));
+    }
+
+    for (const RequiredIndex &index : requiredIndexes()) {
+        bool found = false;
+        for (const QStringList &columns : existing.values(index.table)) {
+            if (columns.mid(0, index.columns.size()) == index.columns) {
+                found = true;
+                break;
+            }
+        }
+        if (found) continue;
 
-    query.bindValue(":itemId", itemId);
-    query.bindValue(":position", position);
+        // Индекс мог быть удалён вручную; без него загрузка дерева и сетки идёт полным просмотром.
+        // Создание индекса блокирует таблицу, поэтому при подключении выводится только предупреждение
+        qDebug() << "Отсутствует индекс" << index.table << index.columns << "- создайте его:"
+                 << QString("CREATE INDEX CONCURRENTLY %1 ON %2 (%3)")
+                        .arg(index.name, index.table, index.columns.join(", "));
+    }
 
-    if (!query.exec()) {
-        qDebug() << "Ошибка обновления нумерации в базе данных:" << query.lastError();
+    // Внешние ключи не восстанавливаются автоматически: их добавляет только миграция
+    query.prepare("SELECT conname FROM pg_constraint WHERE contype = 'f' AND conname = ANY(CAST(:names AS TEXT[]))");
+    query.bindValue(":names", "{" + requiredForeignKeys().join(',') + "}");
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка чтения внешних ключей:" << query.lastError().text();
         return false;
     }
+    QStringList missingKeys = requiredForeignKeys();
+    while (query.next()) {
+        missingKeys.removeAll(query.value(0).toString());
+    }
+    if (!missingKeys.isEmpty()) {
+        qDebug() << "Отсутствуют внешние ключи:" << missingKeys;
+    }
 
     return true;
 }
 
-bool DatabaseHandler::updateParentId(int itemId, int newParentId) {
-    QSqlQuery query(db);
+bool DatabaseHandler::connectToDatabase(bool migrate) {
+    TRACE_SCOPE("manager", "DatabaseHandler::connectToDatabase");
+    db = QSqlDatabase::addDatabase("QPSQL");
+    if (!openWithSavedSettings(db)) {
+        return false;
+    }
+    return !migrate || prepareSchema();
+}
 
-    query.prepare("UPDATE category SET parent_id = :newParentId WHERE category_id = :itemId");
-    query.bindValue(":newParentId", newParentId == NULL ? QVariant() : newParentId);
-    query.bindValue(":itemId", itemId);
+bool DatabaseHandler::openWithSavedSettings(QSqlDatabase &db) {
+    QSettings settings;
+    settings.beginGroup("database");
+    db.setDatabaseName(settings.value("name", "autotlg").toString());
+    db.setUserName(settings.value("user", "postgres").toString());
+    db.setPassword(settings.value("password").toString());
+    db.setHostName(settings.value("host", "localhost").toString());
+    db.setPort(settings.value("port", 5432).toInt());
 
-    if (!query.exec()) {
-        qDebug() << "Ошибка обновления parent_id:" << query.lastError();
+    if (!db.open()) {
+        qDebug() << "Ошибка подключения к базе данных:" << db.lastError().text();
         return false;
     }
-
     return true;
 }
 
+bool DatabaseHandler::prepareServer(const QString &connectionName) {
+    TRACE_SCOPE("manager", "DatabaseHandler::prepareServer");
+    bool ok = false;
+    {
+        QSqlDatabase probe = QSqlDatabase::addDatabase("QPSQL", connectionName);
+        if (openWithSavedSettings(probe)) {
+            DatabaseHandler handler(probe);
+            ok = handler.prepareSchema();
+            probe.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+    return ok;
+}
+
+//
+bool DatabaseHandler::updateNumerationDB(int itemId, int parentId, const QString &numeration, int depth) {
+    TRACE_SCOPE("manager", "DatabaseHandler::updateNumerationDB");
+    return categoryManager->updateNumeration(itemId, parentId, numeration, depth);
+}
+
+bool DatabaseHandler::updateParentId(int itemId, int newParentId) {
+    TRACE_SCOPE("manager", "DatabaseHandler::updateParentId");
+    return categoryManager->updateParentId(itemId, newParentId);
+}
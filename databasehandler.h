@@ -3,10 +3,13 @@
 
 #include <QObject>
 #include <QSqlDatabase>
-#include "projectManager.h"
-#include "categoryManager.h"
-#include "templateManager.h"
-#include "tableManager.h"
+#include "projectmanager.h"
+#include "categorymanager.h"
+#include "templatemanager.h"
+#include "tablemanager.h"
+#include "searchmanager.h"
+#include "revisionmanager.h"
+#include "editjournal.h"
 
 class DatabaseHandler : public QObject {
 public:
@@ -19,9 +22,28 @@ public:
     CategoryManager* getCategoryManager();
     TemplateManager* getTemplateManager();
     TableManager* getTableManager();
+    SearchManager* getSearchManager();
+    RevisionManager* getRevisionManager();
+    EditJournal* getEditJournal();
 
     // Подключение к бд
-    bool connectToDatabase(const QString &dbName, const QString &user, const QString &password, const QString &host, int port);
+    // migrate = false - без миграций схемы (исправление данных, на которых миграция остановилась)
+    bool connectToDatabase(const QString &dbName, const QString &user, const QString &password, const QString &host, int port,
+                           bool migrate = true);
+    bool connectToDatabase(bool migrate = true);   // Параметры из QSettings (группа "database")
+
+    // Проверка сервера и миграции схемы на отдельном соединении; вызывается из рабочего
+    // потока, после чего основное соединение открывается без миграций
+    static bool prepareServer(const QString &connectionName);
+
+    // Имя соединения, по которому рабочие потоки открывают собственные копии
+    QString connectionName() const;
+
+    // Подготовка схемы: применение миграций и проверка обязательных индексов
+    bool prepareSchema();
+    bool migrateSchema();   // Неприменённые шаги из schemaMigrations() в одной транзакции
+    bool verifySchema();    // О недостающих индексах и ключах выводится предупреждение
+    int schemaVersion();    // 0 - журнал миграций ещё не создан, -1 - ошибка
 
     // Обновление нумерации
     bool updateNumerationDB(int itemId, int parentId, const QString &numeration, int depth);
@@ -30,11 +52,17 @@ public:
 
 
 private:
+    static bool openWithSavedSettings(QSqlDatabase &db);   // Параметры из QSettings (группа "database")
+
     QSqlDatabase db;
+    bool ownsConnection = true;     // Соединение создано этим объектом (main_connection)
     ProjectManager *projectManager;
     CategoryManager *categoryManager;
     TemplateManager *templateManager;
     TableManager *tableManager;
+    SearchManager *searchManager;
+    RevisionManager *revisionManager;
+    EditJournal *editJournal;
 };
 
 #endif // DATABASEHANDLER_H
@@ -0,0 +1,257 @@
+#include "editcommands.h"
+#include "mainwindow.h"
+#include "queryexecutor.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMessageBox>
+#include <QSqlError>
+#include <QDebug>
+
+EditCommand::EditCommand(MainWindow *window, const QString &text)
+    : window(window) {
+    setText(text);
+}
+
+void EditCommand::undo() {
+    run(false);
+}
+
+void EditCommand::redo() {
+    if (pending) {
+        pending = false;    // Изменение уже выполнено до записи команды
+        return;
+    }
+    run(true);
+}
+
+void EditCommand::run(bool forward) {
+    OperationScope scope(forward ? "Повтор изменения" : "Отмена изменения");
+    QSqlDatabase db = database();
+    if (!db.transaction()) {
+        qDebug() << "Ошибка начала транзакции:" << db.lastError().text();
+        setObsolete(true);
+        return;
+    }
+
+    appliedForward = forward;
+    if (!apply(forward) || !db.commit()) {
+        db.rollback();
+        setObsolete(true);
+        QMessageBox::warning(window, "Ошибка",
+                             QString("Не удалось %1: %2").arg(forward ? "повторить" : "отменить", text()));
+        return;
+    }
+    refresh();
+}
+
+//
+RenameCommand::RenameCommand(MainWindow *window, int itemId, bool isCategory,
+                             const QString &oldName, const QString &newName)
+    : EditCommand(window, QString("Переименование «%1»").arg(newName)),
+      itemId(itemId), isCategory(isCategory), oldName(oldName), newName(newName) {}
+
+QSqlDatabase RenameCommand::database() const {
+    return isCategory ? window->serverDatabase() : window->editDatabase();
+}
+
+bool RenameCommand::apply(bool forward) {
+    const QString name = forward ? newName : oldName;
+    if (isCategory) {
+        return window->databaseHandler()->getCategoryManager()->updateCategory(itemId, name);
+    }
+    return window->templateStore()->updateTemplate(itemId, name, std::nullopt, std::nullopt);
+}
+
+void RenameCommand::refresh() {
+    window->renameTreeItem(itemId, isCategory, appliedForward ? newName : oldName);
+    if (isCategory) {
+        window->refreshReplicaItems({itemId}, {});
+    }
+}
+
+//
+StructureCommand::StructureCommand(MainWindow *window, const QString &text, const QVector<RemovedRows> &removed,
+                                   const QVector<TreePlacement> &undoLayout, const QVector<TreePlacement> &redoLayout,
+                                   const std::function<bool()> &removal)
+    : EditCommand(window, text), removed(removed), undoLayout(undoLayout), redoLayout(redoLayout), removal(removal) {}
+
+QSqlDatabase StructureCommand::database() const {
+    return window->serverDatabase();
+}
+
+bool StructureCommand::apply(bool forward) {
+    EditJournal *journal = window->databaseHandler()->getEditJournal();
+    if (forward) {
+        // Сначала дочерние элементы занимают новые места, затем удаляется сам элемент
+        return journal->applyLayout(redoLayout) && (!removal || removal());
+    }
+    // Удалённые строки возвращаются раньше, чтобы дочерние элементы могли сослаться на них
+    return journal->restoreRows(removed) && journal->applyLayout(undoLayout);
+}
+
+void StructureCommand::refresh() {
+    // Элементы, возвращённые отменой удаления, читаются из базы вместе со сводками
+    if (!appliedForward && !removed.isEmpty()) {
+        window->reloadTree();
+        return;
+    }
+
+    // Дерево правится по тем же положениям, что были записаны в базу
+    QVector<TreeChange> changes;
+    for (const TreePlacement &placement : appliedForward ? redoLayout : undoLayout) {
+        changes.append({placement.itemId, placement.isCategory, false, placement.parentId,
+                        placement.position, placement.depth});
+    }
+    if (appliedForward) {
+        for (const RemovedRows &rows : removed) {
+            const bool isCategory = rows.table == "category";
+            if (!isCategory && rows.table != "table_template") continue;
+            const QJsonArray records = QJsonDocument::fromJson(rows.rows.toUtf8()).array();
+            for (const QJsonValue &record : records) {
+                const int itemId = record.toObject().value(isCategory ? "category_id" : "template_id").toInt();
+                changes.append({itemId, isCategory, true, 0, 0, 0});
+            }
+        }
+    }
+    window->refreshReplicaItems(changes);
+    window->applyTreeChanges(changes);
+}
+
+//
+GridCommand::GridCommand(MainWindow *window, const QString &text, int templateId)
+    : EditCommand(window, text), templateId(templateId) {}
+
+QSqlDatabase GridCommand::database() const {
+    return window->editDatabase();
+}
+
+void GridCommand::refresh() {
+    // Перезагружается только сетка, и только если шаблон сейчас открыт
+    if (window->currentTemplateId() == templateId) {
+        window->loadTableTemplate(templateId);
+    }
+}
+
+bool GridCommand::loadGrid(TemplateGrid &grid) const {
+    QHash<int, TemplateGrid> grids;
+    if (!window->templateStore()->getGridsForTemplates({templateId}, grids)) {
+        return false;
+    }
+    grid = grids.value(templateId);
+    return true;
+}
+
+bool GridCommand::saveGrid(const TemplateGrid &grid) const {
+    return window->tableStore()->saveDataTableTemplate(templateId, grid.headers, grid.cells);
+}
+
+//
+GridLineCommand::GridLineCommand(MainWindow *window, int templateId, bool inserted, const QString &type, int index,
+                                 const QString &header, const QVector<QString> &cells)
+    : GridCommand(window, QString("%1 %2").arg(inserted ? "Добавление" : "Удаление",
+                                               type == "row" ? "строки" : "столбца"), templateId),
+      inserted(inserted), type(type), index(index), header(header), cells(cells) {}
+
+bool GridLineCommand::apply(bool forward) {
+    return forward == inserted ? insertLine() : removeLine();
+}
+
+bool GridLineCommand::insertLine() {
+    TemplateGrid grid;
+    if (!loadGrid(grid)) return false;
+
+    // Пустая линия в конце добавляется как при обычном редактировании
+    const int count = type == "row" ? grid.cells.size() : grid.headers.size();
+    bool blank = true;
+    for (const QString &cell : cells) {
+        blank = blank && cell.isEmpty();
+    }
+    if (index >= count && blank) {
+        int order = count;
+        return window->tableStore()->createRowOrColumn(templateId, type, header, order);
+    }
+
+    // Иначе сетка пересобирается с линией на прежнем месте и сохраняется целиком
+    if (type == "row") {
+        QVector<QString> row = cells;
+        row.resize(grid.headers.size());
+        grid.cells.insert(qMin(index, int(grid.cells.size())), row);
+    } else {
+        const int column = qMin(index, int(grid.headers.size()));
+        grid.headers.insert(column, header);
+        for (int row = 0; row < grid.cells.size(); ++row) {
+            QVector<QString> &rowCells = grid.cells[row];
+            rowCells.resize(qMax(int(rowCells.size()), column));
+            rowCells.insert(column, row < cells.size() ? cells[row] : QString());
+        }
+    }
+    return saveGrid(grid);
+}
+
+bool GridLineCommand::removeLine() {
+    return window->tableStore()->deleteRowOrColumn(templateId, index, type);
+}
+
+//
+HeaderCommand::HeaderCommand(MainWindow *window, int templateId, int column,
+                             const QString &oldHeader, const QString &newHeader)
+    : GridCommand(window, QString("Заголовок «%1»").arg(newHeader), templateId),
+      column(column), oldHeader(oldHeader), newHeader(newHeader) {}
+
+bool HeaderCommand::apply(bool forward) {
+    return window->tableStore()->updateColumnHeader(templateId, column, forward ? newHeader : oldHeader);
+}
+
+//
+SaveGridCommand::SaveGridCommand(MainWindow *window, int templateId, const TemplateGrid &before,
+                                 const TemplateGrid &after, const QStringList &notesBefore,
+                                 const QStringList &notesAfter)
+    : GridCommand(window, "Сохранение шаблона", templateId), notesBefore(notesBefore), notesAfter(notesAfter) {
+    reshaped = before.headers.size() != after.headers.size() || before.cells.size() != after.cells.size();
+    for (int row = 0; !reshaped && row < after.cells.size(); ++row) {
+        reshaped = before.cells[row].size() != after.cells[row].size();
+    }
+    if (reshaped) {
+        gridBefore = before;
+        gridAfter = after;
+        return;
+    }
+
+    for (int column = 0; column < after.headers.size(); ++column) {
+        if (before.headers[column] != after.headers[column]) {
+            changes.append({-1, column, before.headers[column], after.headers[column]});
+        }
+    }
+    for (int row = 0; row < after.cells.size(); ++row) {
+        for (int column = 0; column < after.cells[row].size(); ++column) {
+            if (before.cells[row][column] != after.cells[row][column]) {
+                changes.append({row, column, before.cells[row][column], after.cells[row][column]});
+            }
+        }
+    }
+}
+
+bool SaveGridCommand::isEmpty() const {
+    return !reshaped && changes.isEmpty() && notesBefore == notesAfter;
+}
+
+bool SaveGridCommand::apply(bool forward) {
+    if (reshaped) {
+        if (!saveGrid(forward ? gridAfter : gridBefore)) return false;
+    } else if (!changes.isEmpty()) {
+        // Записываются только изменённые ячейки и заголовки
+        QVector<GridCellValue> cells;
+        cells.reserve(changes.size());
+        for (const CellChange &change : changes) {
+            cells.append({change.row, change.column, forward ? change.after : change.before});
+        }
+        if (!window->tableStore()->updateCells(templateId, cells)) return false;
+    }
+
+    if (notesBefore != notesAfter) {
+        const QStringList &notes = forward ? notesAfter : notesBefore;
+        return window->templateStore()->updateTemplate(templateId, std::nullopt, notes.value(0), notes.value(1));
+    }
+    return true;
+}
@@ -0,0 +1,151 @@
+#ifndef EDITCOMMANDS_H
+#define EDITCOMMANDS_H
+
+#include <QSqlDatabase>
+#include <QUndoCommand>
+#include <functional>
+#include "editjournal.h"
+#include "templatemanager.h"
+#include "tablemanager.h"
+
+class MainWindow;
+
+// Команда журнала отмены. Записывается после того, как изменение уже выполнено,
+// поэтому первый redo() пропускается. Отмена и повтор выполняются одной транзакцией;
+// при ошибке команда помечается устаревшей и удаляется из стека.
+class EditCommand : public QUndoCommand {
+public:
+    EditCommand(MainWindow *window, const QString &text);
+
+    void undo() override;
+    void redo() override;
+
+protected:
+    virtual QSqlDatabase database() const = 0;
+    virtual bool apply(bool forward) = 0;   // forward - повтор изменения, иначе отмена
+    virtual void refresh() = 0;             // Обновление интерфейса после успешного apply
+
+    MainWindow *window;
+    bool appliedForward = true;     // Направление последнего выполненного apply
+
+private:
+    void run(bool forward);
+
+    bool pending = true;
+};
+
+// Переименование категории или шаблона
+class RenameCommand : public EditCommand {
+public:
+    RenameCommand(MainWindow *window, int itemId, bool isCategory, const QString &oldName, const QString &newName);
+
+protected:
+    QSqlDatabase database() const override;
+    bool apply(bool forward) override;
+    void refresh() override;
+
+private:
+    int itemId;
+    bool isCategory;
+    QString oldName;
+    QString newName;
+};
+
+// Изменение дерева: нумерация, перенос, удаление и распаковка. Хранит только изменившиеся
+// положения элементов и строки удалённых элементов; removal повторяет удаление
+class StructureCommand : public EditCommand {
+public:
+    StructureCommand(MainWindow *window, const QString &text, const QVector<RemovedRows> &removed,
+                     const QVector<TreePlacement> &undoLayout, const QVector<TreePlacement> &redoLayout,
+                     const std::function<bool()> &removal);
+
+protected:
+    QSqlDatabase database() const override;
+    bool apply(bool forward) override;
+    void refresh() override;
+
+private:
+    QVector<RemovedRows> removed;
+    QVector<TreePlacement> undoLayout;
+    QVector<TreePlacement> redoLayout;
+    std::function<bool()> removal;
+};
+
+// Базовый класс команд над сеткой шаблона: сервер или локальная копия проекта
+class GridCommand : public EditCommand {
+public:
+    GridCommand(MainWindow *window, const QString &text, int templateId);
+
+protected:
+    QSqlDatabase database() const override;
+    void refresh() override;
+
+    bool loadGrid(TemplateGrid &grid) const;
+    bool saveGrid(const TemplateGrid &grid) const;
+
+    int templateId;
+};
+
+// Добавление или удаление строки либо столбца вместе с содержимым
+class GridLineCommand : public GridCommand {
+public:
+    GridLineCommand(MainWindow *window, int templateId, bool inserted, const QString &type, int index,
+                    const QString &header, const QVector<QString> &cells);
+
+protected:
+    bool apply(bool forward) override;
+
+private:
+    bool insertLine();
+    bool removeLine();
+
+    bool inserted;          // Команда добавила линию; иначе удалила
+    QString type;           // "row" или "column"
+    int index;
+    QString header;
+    QVector<QString> cells; // Содержимое удалённой линии
+};
+
+// Изменение заголовка столбца
+class HeaderCommand : public GridCommand {
+public:
+    HeaderCommand(MainWindow *window, int templateId, int column, const QString &oldHeader, const QString &newHeader);
+
+protected:
+    bool apply(bool forward) override;
+
+private:
+    int column;
+    QString oldHeader;
+    QString newHeader;
+};
+
+// Сохранение сетки и заметок. При неизменных размерах хранятся только изменённые ячейки
+// и заголовки, иначе обе сетки целиком
+class SaveGridCommand : public GridCommand {
+public:
+    SaveGridCommand(MainWindow *window, int templateId, const TemplateGrid &before, const TemplateGrid &after,
+                    const QStringList &notesBefore, const QStringList &notesAfter);
+
+    bool isEmpty() const;
+
+protected:
+    bool apply(bool forward) override;
+
+private:
+    struct CellChange {
+        int row;
+        int column;         // -1 - заголовок
+        QString before;
+        QString after;
+    };
+
+    QVector<CellChange> changes;
+    bool reshaped = false;
+    TemplateGrid gridBefore;
+    TemplateGrid gridAfter;
+    QStringList notesBefore;    // Заметки и программные заметки
+    QStringList notesAfter;
+};
+
+#endif // EDITCOMMANDS_H
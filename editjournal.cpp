@@ -0,0 +1,207 @@
+#include "editjournal.h"
+#include "queryexecutor.h"
+#include "tracing.h"
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QStringList>
+#include <QDebug>
+
+namespace {
+
+// Источник строк для каждой таблицы в порядке восстановления (родительские раньше).
+// search_vector пересчитывается триггерами, cell_count - триггерами при загрузке ячеек
+struct RowSource {
+    const char *table;
+    const char *parameter;
+    const char *select;
+};
+
+const RowSource RowSources[] = {
+    {"category", ":categories",
+     "SELECT to_jsonb(c) AS r FROM category c WHERE c.category_id = ANY(CAST(:categories AS INTEGER[]))"},
+    {"table_template", ":templates",
+     "SELECT to_jsonb(t) || jsonb_build_object('cell_count', 0) AS r FROM table_template t "
+     "WHERE t.template_id = ANY(CAST(:templates AS INTEGER[]))"},
+    {"table_column", ":templates",
+     "SELECT to_jsonb(x) AS r FROM table_column x WHERE x.template_id = ANY(CAST(:templates AS INTEGER[]))"},
+    {"table_row", ":templates",
+     "SELECT to_jsonb(x) AS r FROM table_row x WHERE x.template_id = ANY(CAST(:templates AS INTEGER[]))"},
+    {"table_cell", ":templates",
+     "SELECT to_jsonb(x) AS r FROM table_cell x WHERE x.template_id = ANY(CAST(:templates AS INTEGER[]))"},
+    // Заголовки общего набора возвращаются в data, триггер снова найдёт или создаст набор
+    {"template_grid", ":templates",
+     "SELECT jsonb_build_object('template_id', g.template_id, 'format_version', g.format_version, "
+     "                          'data', g.data) AS r "
+     "FROM template_grid_full g WHERE g.template_id = ANY(CAST(:templates AS INTEGER[]))"},
+    {"template_revision", ":templates",
+     "SELECT to_jsonb(x) AS r FROM template_revision x WHERE x.template_id = ANY(CAST(:templates AS INTEGER[]))"}
+};
+
+QString placementsJson(const QVector<TreePlacement> &layout, bool categories) {
+    QJsonArray array;
+    for (const TreePlacement &placement : layout) {
+        if (placement.isCategory != categories) continue;
+        array.append(QJsonObject{{"id", placement.itemId}, {"parent_id", placement.parentId},
+                                 {"position", placement.position}, {"depth", placement.depth}});
+    }
+    return array.isEmpty() ? QString() : QString::fromUtf8(QJsonDocument(array).toJson(QJsonDocument::Compact));
+}
+
+} // namespace
+
+bool TreePlacement::operator==(const TreePlacement &other) const {
+    return itemId == other.itemId && isCategory == other.isCategory && parentId == other.parentId
+        && position == other.position && depth == other.depth;
+}
+
+EditJournal::EditJournal(QSqlDatabase &db) : db(db) {}
+
+bool EditJournal::captureLayout(int projectId, QVector<TreePlacement> &layout) {
+    TRACE_SCOPE("manager", "EditJournal::captureLayout");
+    layout.clear();
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT category_id, TRUE, COALESCE(parent_id, 0), COALESCE(position, 0), COALESCE(depth, 0) "
+                  "FROM category WHERE project_id = :projectId "
+                  "UNION ALL "
+                  "SELECT template_id, FALSE, COALESCE(category_id, 0), COALESCE(position, 0), 0 "
+                  "FROM table_template WHERE project_id = :projectId2");
+    query.bindValue(":projectId", projectId);
+    query.bindValue(":projectId2", projectId);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка чтения положения элементов проекта:" << query.lastError();
+        return false;
+    }
+
+    while (query.next()) {
+        layout.append({query.value(0).toInt(), query.value(1).toBool(), query.value(2).toInt(),
+                       query.value(3).toInt(), query.value(4).toInt()});
+    }
+    return true;
+}
+
+bool EditJournal::applyLayout(const QVector<TreePlacement> &layout) {
+    TRACE_SCOPE("manager", "EditJournal::applyLayout");
+    QSqlQuery query(db);
+
+    const QString categories = placementsJson(layout, true);
+    if (!categories.isEmpty()) {
+        query.prepare("UPDATE category c SET parent_id = NULLIF(u.parent_id, 0), position = u.position, depth = u.depth "
+                      "FROM jsonb_to_recordset(CAST(:layout AS JSONB)) "
+                      "     AS u (id INTEGER, parent_id INTEGER, position INTEGER, depth INTEGER) "
+                      "WHERE c.category_id = u.id "
+                      // Строки с прежним положением не переписываются
+                      "AND (c.parent_id IS DISTINCT FROM NULLIF(u.parent_id, 0) OR c.position IS DISTINCT FROM u.position "
+                      "     OR c.depth IS DISTINCT FROM u.depth)");
+        query.bindValue(":layout", categories);
+        if (!execQuery(query)) {
+            qDebug() << "Ошибка восстановления положения категорий:" << query.lastError();
+            return false;
+        }
+    }
+
+    const QString templates = placementsJson(layout, false);
+    if (!templates.isEmpty()) {
+        query.prepare("UPDATE table_template t SET category_id = u.parent_id, position = u.position "
+                      "FROM jsonb_to_recordset(CAST(:layout AS JSONB)) "
+                      "     AS u (id INTEGER, parent_id INTEGER, position INTEGER) "
+                      "WHERE t.template_id = u.id "
+                      "AND (t.category_id IS DISTINCT FROM u.parent_id OR t.position IS DISTINCT FROM u.position)");
+        query.bindValue(":layout", templates);
+        if (!execQuery(query)) {
+            qDebug() << "Ошибка восстановления положения шаблонов:" << query.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
+void EditJournal::diffLayouts(const QVector<TreePlacement> &before, const QVector<TreePlacement> &after,
+                              QVector<TreePlacement> &undo, QVector<TreePlacement> &redo) {
+    undo.clear();
+    redo.clear();
+
+    // Идентификаторы категорий и шаблонов независимы, поэтому ключ включает тип
+    QHash<qint64, int> previous;
+    for (int i = 0; i < before.size(); ++i) {
+        previous.insert(qint64(before[i].itemId) * 2 + before[i].isCategory, i);
+    }
+    for (const TreePlacement &placement : after) {
+        const int index = previous.value(qint64(placement.itemId) * 2 + placement.isCategory, -1);
+        if (index >= 0 && !(before[index] == placement)) {
+            undo.append(before[index]);
+            redo.append(placement);
+        }
+    }
+}
+
+bool EditJournal::captureCategory(int categoryId, bool withContents, QVector<RemovedRows> &rows) {
+    TRACE_SCOPE("manager", "EditJournal::captureCategory");
+    if (!withContents) {
+        return captureRows(QString("{%1}").arg(categoryId), "{}", rows);
+    }
+
+    QSqlQuery query(db);
+    query.prepare(
+        "WITH RECURSIVE subcategories AS ( "
+        "    SELECT category_id FROM category WHERE category_id = :categoryId "
+        "    UNION ALL "
+        "    SELECT c.category_id FROM category c "
+        "    INNER JOIN subcategories s ON c.parent_id = s.category_id "
+        ") "
+        "SELECT '{' || (SELECT string_agg(category_id::text, ',') FROM subcategories) || '}', "
+        "       '{' || COALESCE((SELECT string_agg(template_id::text, ',') FROM table_template "
+        "                        WHERE category_id IN (SELECT category_id FROM subcategories)), '') || '}'");
+    query.bindValue(":categoryId", categoryId);
+
+    if (!execQuery(query) || !query.next()) {
+        qDebug() << "Ошибка чтения содержимого категории:" << query.lastError();
+        return false;
+    }
+    return captureRows(query.value(0).toString(), query.value(1).toString(), rows);
+}
+
+bool EditJournal::captureTemplate(int templateId, QVector<RemovedRows> &rows) {
+    TRACE_SCOPE("manager", "EditJournal::captureTemplate");
+    return captureRows("{}", QString("{%1}").arg(templateId), rows);
+}
+
+bool EditJournal::captureRows(const QString &categoryIds, const QString &templateIds, QVector<RemovedRows> &rows) {
+    rows.clear();
+    QSqlQuery query(db);
+    for (const RowSource &source : RowSources) {
+        const QString ids = QString(source.parameter) == ":categories" ? categoryIds : templateIds;
+        if (ids == "{}") continue;
+
+        query.prepare(QString("SELECT jsonb_agg(s.r - 'search_vector')::text FROM (%1) s").arg(source.select));
+        query.bindValue(source.parameter, ids);
+        if (!execQuery(query) || !query.next()) {
+            qDebug() << "Ошибка чтения строк" << source.table << ":" << query.lastError();
+            return false;
+        }
+        if (!query.value(0).isNull()) {
+            rows.append({source.table, query.value(0).toString()});
+        }
+    }
+    return true;
+}
+
+bool EditJournal::restoreRows(const QVector<RemovedRows> &rows) {
+    TRACE_SCOPE("manager", "EditJournal::restoreRows");
+    QSqlQuery query(db);
+    for (const RemovedRows &removed : rows) {
+        query.prepare(QString("INSERT INTO %1 SELECT * FROM jsonb_populate_recordset(NULL::%1, CAST(:rows AS JSONB))")
+                          .arg(removed.table));
+        query.bindValue(":rows", removed.rows);
+        if (!execQuery(query)) {
+            qDebug() << "Ошибка восстановления строк" << removed.table << ":" << query.lastError();
+            return false;
+        }
+    }
+    return true;
+}
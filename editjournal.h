@@ -0,0 +1,52 @@
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include <QSqlDatabase>
+#include <QString>
+#include <QVector>
+
+// Положение элемента дерева проекта
+struct TreePlacement {
+    int itemId;
+    bool isCategory;
+    int parentId;       // Родительская категория; 0 - верхний уровень
+    int position;
+    int depth;          // Только у категорий
+
+    bool operator==(const TreePlacement &other) const;
+};
+
+// Строки одной таблицы, удаляемые вместе с элементами дерева, как JSON-массив записей
+struct RemovedRows {
+    QString table;
+    QString rows;
+};
+
+// Данные для отмены изменений дерева на сервере: положения элементов до и после
+// изменения и строки удалённых элементов. Восстановление касается только
+// затронутых строк и выполняется одним оператором на таблицу (только PostgreSQL).
+class EditJournal {
+public:
+    EditJournal(QSqlDatabase &db);
+
+    bool captureLayout(int projectId, QVector<TreePlacement> &layout);
+    bool applyLayout(const QVector<TreePlacement> &layout);
+
+    // Положения, различающиеся до и после изменения: undo - прежние, redo - новые.
+    // Элементы, которых нет в одном из снимков, не попадают ни в один список
+    static void diffLayouts(const QVector<TreePlacement> &before, const QVector<TreePlacement> &after,
+                            QVector<TreePlacement> &undo, QVector<TreePlacement> &redo);
+
+    // Строки категории (с подкатегориями и шаблонами, если withContents) или шаблона,
+    // включая каскадно удаляемые сетки и ревизии
+    bool captureCategory(int categoryId, bool withContents, QVector<RemovedRows> &rows);
+    bool captureTemplate(int templateId, QVector<RemovedRows> &rows);
+    bool restoreRows(const QVector<RemovedRows> &rows);
+
+private:
+    bool captureRows(const QString &categoryIds, const QString &templateIds, QVector<RemovedRows> &rows);
+
+    QSqlDatabase &db;
+};
+
+#endif // EDITJOURNAL_H
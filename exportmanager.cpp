@@ -0,0 +1,359 @@
+#include "exportmanager.h"
+#include "queryexecutor.h"
+#include "templatemanager.h"
+#include <QDir>
+#include <QFile>
+#include <QTextStream>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QStringList>
+#include <QtConcurrent>
+#include <QDebug>
+
+namespace {
+
+const int BatchSize = 200;
+const int RtfTableWidth = 9000;   // Ширина таблицы в твипах
+
+struct RenderedShell {
+    QString html;
+    QString rtf;
+    QString error;      // Ошибка записи файлов шаблона при раздельном экспорте
+};
+
+QString rtfEscaped(const QString &text) {
+    QString result;
+    result.reserve(text.size());
+    for (QChar ch : text) {
+        ushort code = ch.unicode();
+        if (ch == '\\' || ch == '{' || ch == '}') {
+            result += '\\';
+            result += ch;
+        } else if (ch == '\n') {
+            result += "\\line ";
+        } else if (code > 127) {
+            // Символы вне ASCII: \uN с 16-битным знаковым кодом и заменой '?'
+            result += QString("\\u%1?").arg(qint16(code));
+        } else {
+            result += ch;
+        }
+    }
+    return result;
+}
+
+QString htmlFragment(const ShellDocument &document) {
+    QString html;
+    html += QString("<h2>%1 %2</h2>\n").arg(document.numeration.toHtmlEscaped(), document.name.toHtmlEscaped());
+
+    html += "<table border=\"1\" cellspacing=\"0\" cellpadding=\"4\">\n<thead><tr>";
+    for (const QString &header : document.headers) {
+        html += "<th>" + header.toHtmlEscaped() + "</th>";
+    }
+    html += "</tr></thead>\n<tbody>\n";
+    for (const QVector<QString> &row : document.cells) {
+        html += "<tr>";
+        for (const QString &cell : row) {
+            html += "<td>" + cell.toHtmlEscaped() + "</td>";
+        }
+        html += "</tr>\n";
+    }
+    html += "</tbody>\n</table>\n";
+
+    if (!document.notes.isEmpty()) {
+        html += "<p class=\"notes\">" + document.notes.toHtmlEscaped().replace('\n', "<br>") + "</p>\n";
+    }
+    if (!document.programmingNotes.isEmpty()) {
+        html += "<p class=\"programming-notes\"><i>" +
+                document.programmingNotes.toHtmlEscaped().replace('\n', "<br>") + "</i></p>\n";
+    }
+    return html;
+}
+
+QString rtfFragment(const ShellDocument &document) {
+    QString rtf;
+    rtf += QString("{\\pard\\sa200\\b %1 %2\\b0\\par}\n")
+               .arg(rtfEscaped(document.numeration), rtfEscaped(document.name));
+
+    int columnCount = document.headers.size();
+    for (const QVector<QString> &row : document.cells) {
+        columnCount = qMax(columnCount, row.size());
+    }
+
+    if (columnCount > 0) {
+        // Описание строки таблицы одинаково для заголовка и всех строк
+        QString rowDefinition = "\\trowd\\trgaph108";
+        for (int col = 1; col <= columnCount; ++col) {
+            rowDefinition += QString("\\clbrdrt\\brdrs\\clbrdrl\\brdrs\\clbrdrb\\brdrs\\clbrdrr\\brdrs\\cellx%1")
+                                 .arg(RtfTableWidth * col / columnCount);
+        }
+
+        auto appendRow = [&rtf, &rowDefinition, columnCount](const QVector<QString> &values, bool bold) {
+            rtf += rowDefinition + "\n";
+            for (int col = 0; col < columnCount; ++col) {
+                QString value = col < values.size() ? rtfEscaped(values[col]) : QString();
+                rtf += bold ? QString("\\pard\\intbl\\b %1\\b0\\cell ").arg(value)
+                            : QString("\\pard\\intbl %1\\cell ").arg(value);
+            }
+            rtf += "\\row\n";
+        };
+
+        appendRow(document.headers, true);
+        for (const QVector<QString> &row : document.cells) {
+            appendRow(row, false);
+        }
+    }
+
+    if (!document.notes.isEmpty()) {
+        rtf += "{\\pard\\sb200 " + rtfEscaped(document.notes) + "\\par}\n";
+    }
+    if (!document.programmingNotes.isEmpty()) {
+        rtf += "{\\pard\\sb200\\i " + rtfEscaped(document.programmingNotes) + "\\i0\\par}\n";
+    }
+    return rtf;
+}
+
+const char *HtmlPrologue = "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"></head><body>\n";
+const char *HtmlEpilogue = "</body></html>\n";
+const char *RtfPrologue = "{\\rtf1\\ansi\\ansicpg1251\\deff0{\\fonttbl{\\f0 Times New Roman;}}\\f0\\fs20\n";
+const char *RtfEpilogue = "}\n";
+
+QString fileBaseName(const ShellDocument &document) {
+    QString name = document.numeration + " " + document.name;
+    static const QString forbidden = "\\/:*?\"<>|";
+    for (QChar &ch : name) {
+        if (forbidden.contains(ch)) ch = '_';
+    }
+    return name.left(150);
+}
+
+// Запись порции в открытый файл; ошибка записи запоминается в error
+bool writeChunk(QFile &file, const QByteArray &data, QString &error) {
+    if (!error.isEmpty()) return false;
+    if (file.write(data) != data.size()) {
+        error = QString("Не удалось записать файл %1: %2").arg(file.fileName(), file.errorString());
+        qDebug() << error;
+        return false;
+    }
+    return true;
+}
+
+// Сброс буфера и закрытие: переполнение диска обнаруживается только здесь
+bool finishFile(QFile &file, QString &error) {
+    const bool flushed = file.flush();
+    file.close();
+    if (error.isEmpty() && (!flushed || file.error() != QFileDevice::NoError)) {
+        error = QString("Не удалось записать файл %1: %2").arg(file.fileName(), file.errorString());
+        qDebug() << error;
+    }
+    return error.isEmpty();
+}
+
+bool writeTextFile(const QString &path, const QString &text, QString &error) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        error = QString("Не удалось создать файл %1: %2").arg(path, file.errorString());
+        qDebug() << error;
+        return false;
+    }
+    writeChunk(file, text.toUtf8(), error);
+    if (finishFile(file, error)) return true;
+
+    file.remove();      // Неполный документ не оставляем
+    return false;
+}
+
+}
+
+ExportManager::ExportManager(const QString &sourceConnectionName, QObject *parent)
+    : QObject(parent), sourceConnectionName(sourceConnectionName) {}
+
+QString ExportManager::renderHtml(const ShellDocument &document) {
+    return QString(HtmlPrologue) + htmlFragment(document) + HtmlEpilogue;
+}
+
+QString ExportManager::renderRtf(const ShellDocument &document) {
+    return QString(RtfPrologue) + rtfFragment(document) + RtfEpilogue;
+}
+
+void ExportManager::run(int projectId, const ExportOptions &options) {
+    OperationScope scope("Экспорт документов");
+    const QString connectionName = QString("export_connection_%1").arg(quintptr(this));
+    bool ok = false;
+    QString error;
+
+    {
+        db = QSqlDatabase::cloneDatabase(sourceConnectionName, connectionName);
+        if (db.open()) {
+            ok = exportProject(projectId, options, error);
+            db.close();
+        } else {
+            qDebug() << "Ошибка подключения для экспорта:" << db.lastError().text();
+        }
+        db = QSqlDatabase();
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+
+    emit finished(ok, ok ? QString("Экспорт завершён: %1").arg(options.outputDir)
+                         : error.isEmpty() ? QString("Ошибка экспорта проекта")
+                                           : QString("Ошибка экспорта проекта.\n%1").arg(error));
+}
+
+bool ExportManager::exportProject(int projectId, const ExportOptions &options, QString &error) {
+    if (!QDir().mkpath(options.outputDir)) {
+        error = QString("Не удалось создать каталог %1").arg(options.outputDir);
+        qDebug() << error;
+        return false;
+    }
+
+    // Курсор существует только внутри транзакции; число шаблонов, порядок и
+    // содержимое документов читаются из одного снимка данных
+    ReadSnapshot snapshot(db);
+    if (!snapshot.isStarted()) {
+        qDebug() << "Ошибка начала транзакции экспорта:" << db.lastError();
+        return false;
+    }
+
+    QSqlQuery query(db);
+    query.prepare("SELECT COUNT(*) FROM table_template WHERE project_id = :projectId");
+    query.bindValue(":projectId", projectId);
+    if (!execQuery(query) || !query.next()) {
+        qDebug() << "Ошибка подсчёта шаблонов для экспорта:" << query.lastError();
+        return false;
+    }
+    int total = query.value(0).toInt();
+
+    // Порядок совпадает с деревом: сначала подкатегории, затем шаблоны категории
+    if (!execQuery(query, QString(
+            "DECLARE export_templates NO SCROLL CURSOR FOR "
+            "WITH RECURSIVE tree AS ( "
+            "    SELECT category_id, position::text AS numeration, ARRAY[0, position] AS sort_key "
+            "    FROM category WHERE project_id = %1 AND parent_id IS NULL "
+            "    UNION ALL "
+            "    SELECT c.category_id, tree.numeration || '.' || c.position, tree.sort_key || ARRAY[0, c.position] "
+            "    FROM category c INNER JOIN tree ON c.parent_id = tree.category_id "
+            ") "
+            "SELECT t.template_id, tree.numeration || '.' || t.position, t.name, t.notes, t.programming_notes "
+            "FROM table_template t INNER JOIN tree ON t.category_id = tree.category_id "
+            "ORDER BY tree.sort_key || ARRAY[1, t.position]").arg(projectId))) {
+        qDebug() << "Ошибка открытия курсора экспорта:" << query.lastError();
+        return false;
+    }
+
+    QFile combinedHtml(QDir(options.outputDir).filePath("shells.html"));
+    QFile combinedRtf(QDir(options.outputDir).filePath("shells.rtf"));
+    if (options.combined) {
+        for (QFile *file : {&combinedHtml, &combinedRtf}) {
+            const bool needed = file == &combinedHtml ? options.html : options.rtf;
+            if (needed && !file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+                error = QString("Не удалось создать файл %1: %2").arg(file->fileName(), file->errorString());
+                qDebug() << error;
+                if (combinedHtml.isOpen()) combinedHtml.remove();
+                return false;
+            }
+        }
+        if (options.html) writeChunk(combinedHtml, HtmlPrologue, error);
+        if (options.rtf) writeChunk(combinedRtf, RtfPrologue, error);
+    }
+
+    int done = 0;
+    bool firstDocument = true;
+    QVector<ShellDocument> batch;
+
+    while (error.isEmpty()) {
+        if (!fetchBatch(batch)) {
+            error = "Ошибка чтения шаблонов из базы данных";
+            break;
+        }
+        if (batch.isEmpty()) break;
+
+        // Вывод документов порции выполняется параллельно; при раздельном экспорте
+        // каждый поток сам записывает свои файлы
+        std::function<RenderedShell(const ShellDocument &)> render = [&options](const ShellDocument &document) {
+            RenderedShell rendered;
+            if (options.combined) {
+                if (options.html) rendered.html = htmlFragment(document);
+                if (options.rtf) rendered.rtf = rtfFragment(document);
+            } else {
+                QString base = QDir(options.outputDir).filePath(fileBaseName(document));
+                if (options.html) writeTextFile(base + ".html", renderHtml(document), rendered.error);
+                if (options.rtf && rendered.error.isEmpty()) {
+                    writeTextFile(base + ".rtf", renderRtf(document), rendered.error);
+                }
+            }
+            return rendered;
+        };
+        QList<RenderedShell> rendered = QtConcurrent::blockingMapped<QList<RenderedShell>>(batch, render);
+
+        // Общий документ дописываем последовательно, сохраняя порядок нумерации
+        for (const RenderedShell &shell : rendered) {
+            if (!shell.error.isEmpty()) {
+                error = shell.error;
+                break;
+            }
+            if (!options.combined) continue;
+            if (options.html) writeChunk(combinedHtml, shell.html.toUtf8(), error);
+            if (options.rtf) {
+                if (!firstDocument) writeChunk(combinedRtf, "\\page\n", error);
+                writeChunk(combinedRtf, shell.rtf.toUtf8(), error);
+            }
+            firstDocument = false;
+        }
+
+        done += batch.size();
+        emit progress(done, total);
+    }
+
+    if (options.combined) {
+        if (options.html) {
+            writeChunk(combinedHtml, HtmlEpilogue, error);
+            finishFile(combinedHtml, error);
+        }
+        if (options.rtf) {
+            writeChunk(combinedRtf, RtfEpilogue, error);
+            finishFile(combinedRtf, error);
+        }
+        // Оборванный общий документ удаляем, чтобы его не приняли за готовый
+        if (!error.isEmpty()) {
+            if (options.html) combinedHtml.remove();
+            if (options.rtf) combinedRtf.remove();
+        }
+    }
+
+    execQuery(query, "CLOSE export_templates");
+    return error.isEmpty();
+}
+
+bool ExportManager::fetchBatch(QVector<ShellDocument> &batch) {
+    batch.clear();
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    if (!execQuery(query, QString("FETCH FORWARD %1 FROM export_templates").arg(BatchSize))) {
+        qDebug() << "Ошибка чтения курсора экспорта:" << query.lastError();
+        return false;
+    }
+
+    QVector<int> ids;
+    while (query.next()) {
+        ShellDocument document;
+        document.templateId = query.value(0).toInt();
+        document.numeration = query.value(1).toString();
+        document.name = query.value(2).toString();
+        document.notes = query.value(3).toString();
+        document.programmingNotes = query.value(4).toString();
+        ids.append(document.templateId);
+        batch.append(document);
+    }
+    if (batch.isEmpty()) return true;
+
+    // Сетки всей порции читаются тремя запросами
+    QHash<int, TemplateGrid> grids;
+    if (!TemplateManager(db).getGridsForTemplates(ids, grids)) return false;
+    for (ShellDocument &document : batch) {
+        TemplateGrid grid = grids.take(document.templateId);
+        document.headers = grid.headers;
+        document.cells = grid.cells;
+    }
+
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef EXPORTMANAGER_H
+#define EXPORTMANAGER_H
+
+#include <QObject>
+#include <QSqlDatabase>
+#include <QVector>
+#include <QString>
+
+// Данные одного шаблона, необходимые для вывода документа
+struct ShellDocument {
+    int templateId;
+    QString numeration;
+    QString name;
+    QString notes;
+    QString programmingNotes;
+    QVector<QString> headers;
+    QVector<QVector<QString>> cells;
+};
+
+struct ExportOptions {
+    QString outputDir;
+    bool html = true;
+    bool rtf = true;
+    bool combined = false;  // Один общий документ вместо файла на каждый шаблон
+};
+
+// Пакетный экспорт всех шаблонов проекта в RTF/HTML.
+// Шаблоны читаются курсором порциями в порядке нумерации, а вывод документов
+// распределяется по пулу потоков на все ядра.
+class ExportManager : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ExportManager(const QString &sourceConnectionName, QObject *parent = nullptr);
+
+    static QString renderHtml(const ShellDocument &document);
+    static QString renderRtf(const ShellDocument &document);
+
+public slots:
+    void run(int projectId, const ExportOptions &options);
+
+signals:
+    void progress(int templatesDone, int templatesTotal);
+    void finished(bool ok, const QString &message);
+
+private:
+    // error - причина отказа для показа пользователю
+    bool exportProject(int projectId, const ExportOptions &options, QString &error);
+    bool fetchBatch(QVector<ShellDocument> &batch);
+
+    QString sourceConnectionName;
+    QSqlDatabase db;
+};
+
+#endif // EXPORTMANAGER_H
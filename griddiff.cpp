@@ -0,0 +1,298 @@
+#include "griddiff.h"
+#include "tracing.h"
+#include <QHash>
+#include <QMultiHash>
+#include <QPair>
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+typedef QPair<int, int> Match;     // Индексы совпавших элементов слева и справа
+
+struct Range {
+    int a0, a1, b0, b1;
+};
+
+// Больший промежуток без опорных элементов не выравнивается по LCS (память n * m)
+const qint64 MaxLcsCells = 4000000;
+
+const QString &cellAt(const TemplateGrid &grid, int row, int column) {
+    static const QString empty;
+    if (row < 0 || column < 0 || row >= grid.cells.size() || column >= grid.cells[row].size()) return empty;
+    return grid.cells[row][column];
+}
+
+// Наибольшая возрастающая по второму индексу подпоследовательность (сортировка стопками)
+QVector<Match> longestIncreasing(const QVector<Match> &candidates) {
+    QVector<int> tails;
+    QVector<int> previous(candidates.size(), -1);
+    for (int i = 0; i < candidates.size(); ++i) {
+        const int value = candidates[i].second;
+        int low = 0;
+        int high = tails.size();
+        while (low < high) {
+            const int middle = (low + high) / 2;
+            if (candidates[tails[middle]].second < value) low = middle + 1;
+            else high = middle;
+        }
+        if (low > 0) previous[i] = tails[low - 1];
+        if (low == tails.size()) tails.append(i);
+        else tails[low] = i;
+    }
+
+    QVector<Match> result(tails.size());
+    int k = tails.size() - 1;
+    for (int i = tails.isEmpty() ? -1 : tails.last(); i >= 0; i = previous[i]) {
+        result[k--] = candidates[i];
+    }
+    return result;
+}
+
+void alignLcs(const QVector<uint> &a, const QVector<uint> &b, const Range &range, QVector<Match> &matches) {
+    const int n = range.a1 - range.a0;
+    const int m = range.b1 - range.b0;
+    if (n == 0 || m == 0 || qint64(n) * m > MaxLcsCells) return;
+
+    // lengths[i * (m + 1) + j] - длина LCS суффиксов a[i..] и b[j..]
+    const int stride = m + 1;
+    QVector<int> lengths((n + 1) * stride, 0);
+    for (int i = n - 1; i >= 0; --i) {
+        for (int j = m - 1; j >= 0; --j) {
+            lengths[i * stride + j] = a[range.a0 + i] == b[range.b0 + j]
+                ? lengths[(i + 1) * stride + j + 1] + 1
+                : qMax(lengths[(i + 1) * stride + j], lengths[i * stride + j + 1]);
+        }
+    }
+
+    for (int i = 0, j = 0; i < n && j < m;) {
+        if (a[range.a0 + i] == b[range.b0 + j]) {
+            matches.append({range.a0 + i, range.b0 + j});
+            ++i;
+            ++j;
+        } else if (lengths[(i + 1) * stride + j] >= lengths[i * stride + j + 1]) {
+            ++i;
+        } else {
+            ++j;
+        }
+    }
+}
+
+// Patience diff без рекурсии: общие начало и конец, опорные уникальные элементы,
+// затем те же шаги для промежутков между опорными
+QVector<Match> alignSequences(const QVector<uint> &a, const QVector<uint> &b) {
+    QVector<Match> matches;
+    QVector<Range> pending{{0, int(a.size()), 0, int(b.size())}};
+
+    while (!pending.isEmpty()) {
+        Range range = pending.takeLast();
+        while (range.a0 < range.a1 && range.b0 < range.b1 && a[range.a0] == b[range.b0]) {
+            matches.append({range.a0++, range.b0++});
+        }
+        while (range.a0 < range.a1 && range.b0 < range.b1 && a[range.a1 - 1] == b[range.b1 - 1]) {
+            matches.append({--range.a1, --range.b1});
+        }
+        if (range.a0 == range.a1 || range.b0 == range.b1) continue;
+
+        // Позиция элемента в своей части; -1, если он встречается больше одного раза
+        QHash<uint, int> positionsA;
+        QHash<uint, int> positionsB;
+        for (int i = range.a0; i < range.a1; ++i) {
+            auto it = positionsA.find(a[i]);
+            if (it == positionsA.end()) positionsA.insert(a[i], i);
+            else *it = -1;
+        }
+        for (int j = range.b0; j < range.b1; ++j) {
+            auto it = positionsB.find(b[j]);
+            if (it == positionsB.end()) positionsB.insert(b[j], j);
+            else *it = -1;
+        }
+
+        QVector<Match> candidates;
+        for (int i = range.a0; i < range.a1; ++i) {
+            const int j = positionsB.value(a[i], -1);
+            if (j >= 0 && positionsA.value(a[i]) == i) {
+                candidates.append({i, j});
+            }
+        }
+
+        const QVector<Match> anchors = longestIncreasing(candidates);
+        if (anchors.isEmpty()) {
+            alignLcs(a, b, range, matches);
+            continue;
+        }
+
+        int a0 = range.a0;
+        int b0 = range.b0;
+        for (const Match &anchor : anchors) {
+            matches.append(anchor);
+            if (anchor.first > a0 && anchor.second > b0) {
+                pending.append({a0, anchor.first, b0, anchor.second});
+            }
+            a0 = anchor.first + 1;
+            b0 = anchor.second + 1;
+        }
+        if (range.a1 > a0 && range.b1 > b0) {
+            pending.append({a0, range.a1, b0, range.b1});
+        }
+    }
+
+    std::sort(matches.begin(), matches.end());
+    return matches;
+}
+
+// Линии результата по выравниванию. Несопоставленные элементы с одинаковым ключом
+// становятся перемещёнными, остальные в пределах промежутка объединяются в изменённые,
+// если pairable, иначе остаются удалёнными и вставленными
+QVector<DiffLine> buildLines(const QVector<uint> &a, const QVector<uint> &b, const QVector<Match> &matches,
+                             const std::function<bool(int, int)> &pairable) {
+    QVector<bool> usedA(a.size(), false);
+    QVector<bool> usedB(b.size(), false);
+    for (const Match &match : matches) {
+        usedA[match.first] = true;
+        usedB[match.second] = true;
+    }
+
+    QMultiHash<uint, int> freeA;
+    for (int i = a.size() - 1; i >= 0; --i) {
+        if (!usedA[i]) freeA.insert(a[i], i);
+    }
+    QVector<int> movedFrom(b.size(), -1);
+    for (int j = 0; j < b.size(); ++j) {
+        if (usedB[j]) continue;
+        auto it = freeA.find(b[j]);
+        if (it != freeA.end()) {
+            movedFrom[j] = it.value();
+            usedA[it.value()] = true;
+            freeA.erase(it);
+        }
+    }
+
+    QVector<DiffLine> lines;
+    lines.reserve(qMax(a.size(), b.size()));
+    int i = 0;
+    int j = 0;
+    auto flushGap = [&](int endA, int endB) {
+        QVector<int> gapA;
+        for (; i < endA; ++i) {
+            if (!usedA[i]) gapA.append(i);
+        }
+        int k = 0;
+        for (; j < endB; ++j) {
+            if (movedFrom[j] >= 0) {
+                lines.append({movedFrom[j], j, DiffKind::Moved, {}});
+            } else if (k < gapA.size() && pairable(gapA[k], j)) {
+                lines.append({gapA[k++], j, DiffKind::Changed, {}});
+            } else {
+                lines.append({-1, j, DiffKind::Inserted, {}});
+            }
+        }
+        for (; k < gapA.size(); ++k) {
+            lines.append({gapA[k], -1, DiffKind::Deleted, {}});
+        }
+    };
+
+    for (const Match &match : matches) {
+        flushGap(match.first, match.second);
+        lines.append({match.first, match.second, DiffKind::Equal, {}});
+        i = match.first + 1;
+        j = match.second + 1;
+    }
+    flushGap(a.size(), b.size());
+    return lines;
+}
+
+int countKind(const QVector<DiffLine> &lines, DiffKind kind) {
+    return std::count_if(lines.begin(), lines.end(), [kind](const DiffLine &line) { return line.kind == kind; });
+}
+
+} // namespace
+
+int GridDiff::columnCount(DiffKind kind) const {
+    return countKind(columns, kind);
+}
+
+int GridDiff::rowCount(DiffKind kind) const {
+    return countKind(rows, kind);
+}
+
+bool GridDiff::isEmpty() const {
+    return changedCells == 0 && columnCount(DiffKind::Equal) == columns.size()
+        && rowCount(DiffKind::Equal) == rows.size();
+}
+
+QString GridDiff::summary() const {
+    if (isEmpty()) return QString("Различий нет");
+    return QString("Строки: +%1 -%2 перемещено %3 изменено %4; столбцы: +%5 -%6 перемещено %7 переименовано %8; ячеек изменено: %9")
+        .arg(rowCount(DiffKind::Inserted)).arg(rowCount(DiffKind::Deleted))
+        .arg(rowCount(DiffKind::Moved)).arg(rowCount(DiffKind::Changed))
+        .arg(columnCount(DiffKind::Inserted)).arg(columnCount(DiffKind::Deleted))
+        .arg(columnCount(DiffKind::Moved)).arg(columnCount(DiffKind::Changed))
+        .arg(changedCells);
+}
+
+GridDiff diffGrids(const TemplateGrid &left, const TemplateGrid &right) {
+    TRACE_SCOPE("grid", "diffGrids");
+    GridDiff diff;
+
+    // Столбцы: по заголовкам; переименованный столбец остаётся на месте в своём промежутке
+    auto headerKeys = [](const TemplateGrid &grid) {
+        int columns = grid.headers.size();
+        for (const QVector<QString> &row : grid.cells) columns = qMax(columns, int(row.size()));
+        QVector<uint> keys(columns);
+        for (int column = 0; column < columns; ++column) {
+            keys[column] = uint(qHash(column < grid.headers.size() ? grid.headers[column] : QString()));
+        }
+        return keys;
+    };
+    const QVector<uint> leftColumns = headerKeys(left);
+    const QVector<uint> rightColumns = headerKeys(right);
+    diff.columns = buildLines(leftColumns, rightColumns, alignSequences(leftColumns, rightColumns),
+                              [](int, int) { return true; });
+
+    // Строки: хеш текста только в столбцах, которые есть в обеих сетках
+    QVector<int> common;
+    for (int c = 0; c < diff.columns.size(); ++c) {
+        if (diff.columns[c].left >= 0 && diff.columns[c].right >= 0) common.append(c);
+    }
+    auto rowKeys = [&diff, &common](const TemplateGrid &grid, bool leftSide) {
+        QVector<uint> keys(grid.cells.size());
+        for (int row = 0; row < grid.cells.size(); ++row) {
+            uint hash = 0;
+            for (int c : common) {
+                const DiffLine &column = diff.columns[c];
+                hash = uint(qHash(cellAt(grid, row, leftSide ? column.left : column.right), hash));
+            }
+            keys[row] = hash;
+        }
+        return keys;
+    };
+    const QVector<uint> leftRows = rowKeys(left, true);
+    const QVector<uint> rightRows = rowKeys(right, false);
+
+    auto similar = [&](int leftRow, int rightRow) {
+        int same = 0;
+        for (int c : common) {
+            const DiffLine &column = diff.columns[c];
+            if (cellAt(left, leftRow, column.left) == cellAt(right, rightRow, column.right)) ++same;
+        }
+        return 2 * same >= common.size() && same > 0;
+    };
+    diff.rows = buildLines(leftRows, rightRows, alignSequences(leftRows, rightRows), similar);
+
+    // Ячейки сопоставленных строк; совпадение хешей проверяется здесь же
+    for (DiffLine &row : diff.rows) {
+        if (row.left < 0 || row.right < 0) continue;
+        for (int c : common) {
+            const DiffLine &column = diff.columns[c];
+            if (cellAt(left, row.left, column.left) != cellAt(right, row.right, column.right)) {
+                row.changedColumns.append(c);
+            }
+        }
+        diff.changedCells += row.changedColumns.size();
+        if (row.kind == DiffKind::Equal && !row.changedColumns.isEmpty()) {
+            row.kind = DiffKind::Changed;
+        }
+    }
+    return diff;
+}
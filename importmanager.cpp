@@ -0,0 +1,345 @@
+#include "importmanager.h"
+#include "queryexecutor.h"
+#include "categorymanager.h"
+#include "templatemanager.h"
+#include "revisionmanager.h"
+#include "pgcopy.h"
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+
+namespace {
+
+const int ChunkSize = 64 * 1024;
+const QStringList CsvFilters = {"*.csv", "*.tsv", "*.txt"};
+
+// Разбор CSV по частям: поля в кавычках могут содержать разделители и переводы строк
+// и переходить через границу порции
+class CsvParser {
+public:
+    explicit CsvParser(QChar delimiter) : delimiter(delimiter) {}
+
+    // Разбирает очередную порцию, завершённые записи добавляются в records
+    void feed(const QString &chunk, QVector<QStringList> &records) {
+        for (QChar ch : chunk) {
+            if (inQuotes) {
+                if (quotePending) {
+                    quotePending = false;
+                    if (ch == '"') {
+                        field.append('"');  // Удвоенная кавычка внутри поля
+                        continue;
+                    }
+                    inQuotes = false;       // Кавычка закрыла поле, символ обрабатываем ниже
+                } else if (ch == '"') {
+                    quotePending = true;
+                    continue;
+                } else {
+                    field.append(ch);
+                    continue;
+                }
+            }
+
+            if (ch == '"' && field.isEmpty()) {
+                inQuotes = true;
+            } else if (ch == delimiter) {
+                record.append(field);
+                field.clear();
+            } else if (ch == '\n') {
+                finishRecord(records);
+            } else if (ch != '\r') {
+                field.append(ch);
+            }
+        }
+    }
+
+    void finish(QVector<QStringList> &records) {
+        if (!field.isEmpty() || !record.isEmpty()) {
+            finishRecord(records);
+        }
+    }
+
+private:
+    void finishRecord(QVector<QStringList> &records) {
+        record.append(field);
+        field.clear();
+        inQuotes = false;
+        quotePending = false;
+        // Пустые строки файла пропускаем
+        if (!(record.size() == 1 && record.first().isEmpty())) {
+            records.append(record);
+        }
+        record.clear();
+    }
+
+    QChar delimiter;
+    QString field;
+    QStringList record;
+    bool inQuotes = false;
+    bool quotePending = false;
+};
+
+QChar detectDelimiter(const QString &filePath, const QString &sample) {
+    if (filePath.endsWith(".tsv", Qt::CaseInsensitive)) return '\t';
+
+    // По первой строке выбираем самый частый из возможных разделителей
+    QString firstLine = sample.section('\n', 0, 0);
+    QChar best = ',';
+    int bestCount = 0;
+    for (QChar candidate : {QChar(','), QChar(';'), QChar('\t')}) {
+        int count = firstLine.count(candidate);
+        if (count > bestCount) {
+            best = candidate;
+            bestCount = count;
+        }
+    }
+    return best;
+}
+
+}
+
+ImportManager::ImportManager(const QString &sourceConnectionName, QObject *parent)
+    : QObject(parent), sourceConnectionName(sourceConnectionName) {}
+
+void ImportManager::run(const QStringList &paths, int targetCategoryId) {
+    OperationScope scope("Импорт CSV/TSV");
+    const QString connectionName = QString("import_connection_%1").arg(quintptr(this));
+    bool ok = true;
+
+    {
+        // Собственное соединение рабочего потока
+        db = QSqlDatabase::cloneDatabase(sourceConnectionName, connectionName);
+        if (!db.open()) {
+            emit finished(false, "Ошибка подключения для импорта: " + db.lastError().text());
+            db = QSqlDatabase();
+            QSqlDatabase::removeDatabase(connectionName);
+            return;
+        }
+
+        // Предварительный подсчёт объёма для индикатора прогресса
+        processedBytes = totalBytes = 0;
+        filesDone = filesTotal = 0;
+        widenedFiles = 0;
+        for (const QString &path : paths) {
+            QFileInfo info(path);
+            if (info.isDir()) {
+                QDirIterator it(path, CsvFilters, QDir::Files, QDirIterator::Subdirectories);
+                while (it.hasNext()) {
+                    it.next();
+                    totalBytes += it.fileInfo().size();
+                    ++filesTotal;
+                }
+            } else {
+                totalBytes += info.size();
+                ++filesTotal;
+            }
+        }
+        emit progress(0, totalBytes, 0, filesTotal);
+
+        for (const QString &path : paths) {
+            if (!importPath(path, targetCategoryId)) {
+                ok = false;
+                break;
+            }
+        }
+
+        db.close();
+        db = QSqlDatabase();
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+
+    QString message = ok ? QString("Импортировано файлов: %1").arg(filesDone)
+                         : QString("Импорт прерван после %1 файлов из %2").arg(filesDone).arg(filesTotal);
+    if (widenedFiles > 0) {
+        message += QString(". Файлов со строками длиннее заголовков: %1 (добавлены столбцы)").arg(widenedFiles);
+    }
+    emit finished(ok, message);
+}
+
+bool ImportManager::importPath(const QString &path, int categoryId) {
+    QFileInfo info(path);
+    if (!info.isDir()) {
+        return importFile(path, categoryId);
+    }
+
+    int dirCategoryId = findOrCreateCategory(info.fileName(), categoryId);
+    if (dirCategoryId < 0) return false;
+
+    QDir dir(path);
+    for (const QFileInfo &file : dir.entryInfoList(CsvFilters, QDir::Files, QDir::Name)) {
+        if (!importFile(file.filePath(), dirCategoryId)) return false;
+    }
+    for (const QFileInfo &subdir : dir.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name)) {
+        if (!importPath(subdir.filePath(), dirCategoryId)) return false;
+    }
+    return true;
+}
+
+int ImportManager::findOrCreateCategory(const QString &name, int parentId) {
+    QSqlQuery query(db);
+    query.prepare("SELECT c.category_id FROM category c "
+                  "INNER JOIN category p ON p.project_id = c.project_id AND p.category_id = :parentId "
+                  "WHERE c.parent_id = p.category_id AND c.name = :name");
+    query.bindValue(":parentId", parentId);
+    query.bindValue(":name", name);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка поиска категории для импорта:" << query.lastError();
+        return -1;
+    }
+    if (query.next()) {
+        return query.value(0).toInt();
+    }
+
+    query.prepare("SELECT project_id FROM category WHERE category_id = :parentId");
+    query.bindValue(":parentId", parentId);
+    if (!execQuery(query) || !query.next()) {
+        qDebug() << "Ошибка получения проекта категории:" << query.lastError();
+        return -1;
+    }
+
+    int newCategoryId = -1;
+    CategoryManager categoryManager(db);
+    if (!categoryManager.createCategory(name, parentId, query.value(0).toInt(), &newCategoryId)) {
+        return -1;
+    }
+    return newCategoryId;
+}
+
+bool ImportManager::importFile(const QString &filePath, int categoryId) {
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Не удалось открыть файл для импорта:" << filePath;
+        return false;
+    }
+
+    // Каждый файл импортируется в своей транзакции
+    if (!db.transaction()) {
+        qDebug() << "Ошибка начала транзакции импорта:" << db.lastError();
+        return false;
+    }
+
+    PgCopyWriter writer(db);
+    auto fail = [this, &filePath, &writer](const QString &message) {
+        qDebug() << "Ошибка импорта" << filePath << ":" << message;
+        writer.abort();
+        db.rollback();
+        return false;
+    };
+
+    int templateId = -1;
+    TemplateManager templateManager(db);
+    if (!templateManager.createTemplate(categoryId, QFileInfo(filePath).completeBaseName(), &templateId)) {
+        return fail("не удалось создать шаблон");
+    }
+
+    QTextStream in(&file);
+    QString chunk = in.read(ChunkSize);
+    CsvParser parser(detectDelimiter(filePath, chunk));
+
+    const QString templateIdText = QString::number(templateId);
+    QVector<QStringList> records;
+    int columnCount = -1;   // Определяется первой записью (заголовки)
+    int width = 0;          // Самая длинная строка; столбцы сверх заголовков добавляются после загрузки
+    int rowCount = 0;
+    qint64 fileStartBytes = processedBytes;
+
+    auto writeRecords = [&]() {
+        for (QStringList &record : records) {
+            if (columnCount < 0) {
+                // Заголовки пишем отдельным COPY, затем открываем поток для ячеек
+                columnCount = record.size();
+                if (!writer.begin("COPY table_column (template_id, column_order, header) FROM STDIN")) return false;
+                for (int col = 0; col < columnCount; ++col) {
+                    if (!writer.writeRow({templateIdText, QString::number(col), record[col]})) return false;
+                }
+                if (!writer.end()) return false;
+                if (!writer.begin("COPY table_cell (template_id, row_order, column_order, content) FROM STDIN")) return false;
+                continue;
+            }
+
+            // Короткие строки дополняем пустыми ячейками до числа заголовков,
+            // ячейки длинных строк сохраняем все
+            const QString rowText = QString::number(rowCount);
+            const int rowWidth = qMax(columnCount, int(record.size()));
+            for (int col = 0; col < rowWidth; ++col) {
+                if (!writer.writeRow({templateIdText, rowText, QString::number(col),
+                                      col < record.size() ? record[col] : QString()})) return false;
+            }
+            width = qMax(width, rowWidth);
+            ++rowCount;
+        }
+        records.clear();
+        return true;
+    };
+
+    while (!chunk.isEmpty()) {
+        parser.feed(chunk, records);
+        if (!writeRecords()) return fail(writer.lastError());
+
+        processedBytes = fileStartBytes + file.pos();
+        emit progress(processedBytes, totalBytes, filesDone, filesTotal);
+        chunk = in.read(ChunkSize);
+    }
+    parser.finish(records);
+    if (!writeRecords()) return fail(writer.lastError());
+
+    if (columnCount >= 0 && !writer.end()) {
+        return fail(writer.lastError());
+    }
+
+    // Строки таблицы создаём одним оператором
+    QSqlQuery query(db);
+    query.prepare("INSERT INTO table_row (template_id, row_order) "
+                  "SELECT :templateId, generate_series(0, :rowCount - 1)");
+    query.bindValue(":templateId", templateId);
+    query.bindValue(":rowCount", rowCount);
+    if (!execQuery(query)) {
+        return fail(query.lastError().text());
+    }
+
+    // Столбцы для ячеек за последним заголовком: заголовки по номеру столбца,
+    // в более коротких строках - пустые ячейки
+    if (columnCount >= 0 && width > columnCount) {
+        query.prepare("INSERT INTO table_column (template_id, column_order, header) "
+                      "SELECT :templateId, n, 'Столбец ' || (n + 1) FROM generate_series(:firstColumn, :lastColumn) AS n");
+        query.bindValue(":templateId", templateId);
+        query.bindValue(":firstColumn", columnCount);
+        query.bindValue(":lastColumn", width - 1);
+        if (!execQuery(query)) {
+            return fail(query.lastError().text());
+        }
+
+        query.prepare("INSERT INTO table_cell (template_id, row_order, column_order, content) "
+                      "SELECT r.template_id, r.row_order, c.column_order, '' "
+                      "FROM table_row r "
+                      "INNER JOIN table_column c ON c.template_id = r.template_id AND c.column_order >= :firstColumn "
+                      "WHERE r.template_id = :templateId AND NOT EXISTS ("
+                      "    SELECT 1 FROM table_cell x WHERE x.template_id = r.template_id "
+                      "    AND x.row_order = r.row_order AND x.column_order = c.column_order)");
+        query.bindValue(":templateId", templateId);
+        query.bindValue(":firstColumn", columnCount);
+        if (!execQuery(query)) {
+            return fail(query.lastError().text());
+        }
+        ++widenedFiles;
+    }
+
+    // Загруженная сетка - первая ревизия шаблона
+    if (!RevisionManager(db).recordSnapshots({templateId})) {
+        return fail("не удалось записать ревизию шаблона");
+    }
+
+    if (!db.commit()) {
+        return fail(db.lastError().text());
+    }
+
+    processedBytes = fileStartBytes + file.size();
+    ++filesDone;
+    emit progress(processedBytes, totalBytes, filesDone, filesTotal);
+    return true;
+}
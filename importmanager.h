@@ -0,0 +1,40 @@
+#ifndef IMPORTMANAGER_H
+#define IMPORTMANAGER_H
+
+#include <QObject>
+#include <QSqlDatabase>
+#include <QStringList>
+
+// Потоковый импорт сеток шаблонов из CSV/TSV.
+// Объект переносится в рабочий поток и открывает там собственное соединение,
+// поэтому интерфейс во время импорта не блокируется.
+class ImportManager : public QObject {
+    Q_OBJECT
+
+public:
+    explicit ImportManager(const QString &sourceConnectionName, QObject *parent = nullptr);
+
+public slots:
+    // Файл становится шаблоном в целевой категории; каталог - категорией
+    // с тем же названием (создаётся при отсутствии), содержимое разбирается рекурсивно
+    void run(const QStringList &paths, int targetCategoryId);
+
+signals:
+    void progress(qint64 processedBytes, qint64 totalBytes, int filesDone, int filesTotal);
+    void finished(bool ok, const QString &message);
+
+private:
+    bool importPath(const QString &path, int categoryId);
+    bool importFile(const QString &filePath, int categoryId);
+    int findOrCreateCategory(const QString &name, int parentId);
+
+    QString sourceConnectionName;
+    QSqlDatabase db;
+    qint64 processedBytes = 0;
+    qint64 totalBytes = 0;
+    int filesDone = 0;
+    int filesTotal = 0;
+    int widenedFiles = 0;   // Файлы, строки которых длиннее заголовков
+};
+
+#endif // IMPORTMANAGER_H
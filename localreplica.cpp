@@ -0,0 +1,582 @@
+#include "localreplica.h"
+#include "queryexecutor.h"
+#include "sqlstoragebackend.h"
+#include <QDir>
+#include <QHash>
+#include <QFileInfo>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QStandardPaths>
+#include <QDebug>
+
+namespace {
+
+const QStringList GridTables = {"table_column", "table_row", "table_cell"};
+
+// Выборки сеток с сервера: по проекту целиком или по списку шаблонов.
+// Представления grid_* отдают упакованные сетки в том же построчном виде
+const QString ProjectGridSelect[] = {
+    "SELECT c.template_id, c.column_order, c.header FROM grid_column c "
+    "INNER JOIN table_template t ON t.template_id = c.template_id WHERE t.project_id = :projectId",
+    "SELECT r.template_id, r.row_order FROM grid_row r "
+    "INNER JOIN table_template t ON t.template_id = r.template_id WHERE t.project_id = :projectId",
+    "SELECT c.template_id, c.row_order, c.column_order, c.content FROM grid_cell c "
+    "INNER JOIN table_template t ON t.template_id = c.template_id WHERE t.project_id = :projectId"
+};
+const QString TemplateGridSelect[] = {
+    "SELECT template_id, column_order, header FROM grid_column WHERE template_id = ANY(CAST(:ids AS INTEGER[]))",
+    "SELECT template_id, row_order FROM grid_row WHERE template_id = ANY(CAST(:ids AS INTEGER[]))",
+    "SELECT template_id, row_order, column_order, content FROM grid_cell WHERE template_id = ANY(CAST(:ids AS INTEGER[]))"
+};
+const int GridColumnCount[] = {3, 2, 4};
+
+const QString TemplateColumns = "template_id, category_id, project_id, name, position, notes, programming_notes, "
+                                "is_approved, version";
+
+QString idList(const QSet<int> &ids) {
+    QStringList list;
+    for (int id : ids) list.append(QString::number(id));
+    return list.join(',');
+}
+
+QString idArray(const QSet<int> &ids) {
+    return "{" + idList(ids) + "}";
+}
+
+} // namespace
+
+LocalReplica::LocalReplica()
+    : connectionName(QString("local_replica_%1").arg(quintptr(this))) {}
+
+LocalReplica::~LocalReplica() {
+    close();
+}
+
+QString LocalReplica::replicaPath(int projectId) {
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/replicas";
+    return QDir(dir).filePath(QString("project_%1.sqlite").arg(projectId));
+}
+
+bool LocalReplica::prepareSchema(QSqlDatabase &local) {
+    if (!SqliteStorageBackend::prepareSchema(local)) {
+        return false;
+    }
+
+    QStringList statements = {
+        // Журнал изменённых шаблонов: версия сервера, от которой начаты правки,
+        // и счётчик правок, по которому синхронизация узнаёт о новых изменениях
+        "CREATE TABLE IF NOT EXISTS sync_journal (template_id INTEGER PRIMARY KEY, "
+        "base_version INTEGER NOT NULL, seq INTEGER NOT NULL DEFAULT 1, conflict INTEGER NOT NULL DEFAULT 0)",
+        // Загрузка с сервера выполняется с отключённым журналом
+        "CREATE TABLE IF NOT EXISTS sync_control (id INTEGER PRIMARY KEY CHECK (id = 1), "
+        "suspended INTEGER NOT NULL DEFAULT 0)",
+        "INSERT OR IGNORE INTO sync_control (id, suspended) VALUES (1, 0)",
+        "CREATE TRIGGER IF NOT EXISTS journal_table_template AFTER UPDATE OF name, notes, programming_notes, "
+        "is_approved ON table_template WHEN (SELECT suspended FROM sync_control) = 0 "
+        "BEGIN "
+        "    INSERT INTO sync_journal (template_id, base_version) VALUES (NEW.template_id, OLD.version) "
+        "    ON CONFLICT (template_id) DO UPDATE SET seq = seq + 1; "
+        "END"
+    };
+
+    // Любое изменение сетки отмечает шаблон в журнале
+    for (const QString &table : GridTables) {
+        const QList<QPair<QString, QString>> events = {{"INSERT", "NEW"}, {"UPDATE", "NEW"}, {"DELETE", "OLD"}};
+        for (const auto &event : events) {
+            statements.append(QString(
+                "CREATE TRIGGER IF NOT EXISTS journal_%1_%2 AFTER %3 ON %1 "
+                "WHEN (SELECT suspended FROM sync_control) = 0 "
+                "BEGIN "
+                "    INSERT INTO sync_journal (template_id, base_version) "
+                "    SELECT template_id, version FROM table_template WHERE template_id = %4.template_id "
+                "    ON CONFLICT (template_id) DO UPDATE SET seq = seq + 1; "
+                "END").arg(table, event.first.toLower(), event.first, event.second));
+        }
+    }
+
+    QSqlQuery query(local);
+    for (const QString &statement : statements) {
+        if (!execQuery(query, statement)) {
+            qDebug() << "Ошибка подготовки схемы локальной реплики:" << query.lastError().text() << statement;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LocalReplica::open(int projectId) {
+    close();
+
+    path = replicaPath(projectId);
+    QDir().mkpath(QFileInfo(path).absolutePath());
+
+    db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+    db.setDatabaseName(path);
+    db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+    if (!db.open()) {
+        qDebug() << "Ошибка открытия локальной реплики:" << db.lastError().text();
+        close();
+        return false;
+    }
+    if (!prepareSchema(db)) {
+        close();
+        return false;
+    }
+
+    currentProjectId = projectId;
+    categoryManager = new CategoryManager(db);
+    templateManager = new TemplateManager(db);
+    tableManager = new TableManager(db);
+    return true;
+}
+
+void LocalReplica::close() {
+    delete categoryManager;
+    delete templateManager;
+    delete tableManager;
+    categoryManager = nullptr;
+    templateManager = nullptr;
+    tableManager = nullptr;
+    currentProjectId = 0;
+
+    if (db.isValid()) {
+        db.close();
+        db = QSqlDatabase();
+        QSqlDatabase::removeDatabase(connectionName);
+    }
+}
+
+bool LocalReplica::isOpen() const {
+    return db.isOpen();
+}
+
+int LocalReplica::projectId() const {
+    return currentProjectId;
+}
+
+QString LocalReplica::projectName() const {
+    QSqlQuery query(db);
+    query.prepare("SELECT name FROM project WHERE project_id = :projectId");
+    query.bindValue(":projectId", currentProjectId);
+    return (execQuery(query) && query.next()) ? query.value(0).toString() : QString();
+}
+
+QString LocalReplica::filePath() const {
+    return path;
+}
+
+QSqlDatabase &LocalReplica::database() {
+    return db;
+}
+
+bool LocalReplica::isEmpty() const {
+    QSqlQuery query(db);
+    return !execQuery(query, "SELECT 1 FROM project LIMIT 1") || !query.next();
+}
+
+CategoryManager *LocalReplica::getCategoryManager() {
+    return categoryManager;
+}
+
+TemplateManager *LocalReplica::getTemplateManager() {
+    return templateManager;
+}
+
+TableManager *LocalReplica::getTableManager() {
+    return tableManager;
+}
+
+bool LocalReplica::setJournalSuspended(bool suspended) {
+    QSqlQuery query(db);
+    query.prepare("UPDATE sync_control SET suspended = :suspended");
+    query.bindValue(":suspended", suspended ? 1 : 0);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка переключения журнала реплики:" << query.lastError();
+        return false;
+    }
+    return true;
+}
+
+QSet<int> LocalReplica::dirtyTemplates() const {
+    QSet<int> ids;
+    QSqlQuery query(db);
+    if (!execQuery(query, "SELECT template_id FROM sync_journal")) {
+        qDebug() << "Ошибка чтения журнала реплики:" << query.lastError();
+        return ids;
+    }
+    while (query.next()) {
+        ids.insert(query.value(0).toInt());
+    }
+    return ids;
+}
+
+int LocalReplica::pendingCount() const {
+    QSqlQuery query(db);
+    if (!execQuery(query, "SELECT COUNT(*) FROM sync_journal") || !query.next()) {
+        return 0;
+    }
+    return query.value(0).toInt();
+}
+
+QSet<int> LocalReplica::conflictedTemplates() const {
+    QSet<int> ids;
+    QSqlQuery query(db);
+    if (execQuery(query, "SELECT template_id FROM sync_journal WHERE conflict = 1")) {
+        while (query.next()) {
+            ids.insert(query.value(0).toInt());
+        }
+    }
+    return ids;
+}
+
+bool LocalReplica::copyRows(QSqlDatabase &server, const QString &selectSql, const QString &bindName,
+                            const QVariant &bindValue, const QString &table, int columnCount,
+                            const QSet<int> &skipTemplates) {
+    QSqlQuery select(server);
+    select.setForwardOnly(true);
+    select.prepare(selectSql);
+    select.bindValue(bindName, bindValue);
+    if (!execQuery(select)) {
+        qDebug() << "Ошибка чтения" << table << "для локальной реплики:" << select.lastError();
+        return false;
+    }
+
+    QStringList placeholders;
+    for (int i = 0; i < columnCount; ++i) placeholders.append("?");
+    QSqlQuery insert(db);
+    insert.prepare(QString("INSERT INTO %1 VALUES (%2)").arg(table, placeholders.join(", ")));
+
+    // Первый столбец сеток и шаблонов - template_id
+    while (select.next()) {
+        if (!skipTemplates.isEmpty() && skipTemplates.contains(select.value(0).toInt())) continue;
+        for (int i = 0; i < columnCount; ++i) {
+            insert.bindValue(i, select.value(i));
+        }
+        if (!execQuery(insert)) {
+            qDebug() << "Ошибка записи" << table << "в локальную реплику:" << insert.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LocalReplica::pullProject(QSqlDatabase &server, bool withGrids) {
+    if (!isOpen()) return false;
+
+    const QSet<int> dirty = dirtyTemplates();
+    QHash<int, int> knownVersions;
+    {
+        QSqlQuery query(db);
+        execQuery(query, "SELECT template_id, version FROM table_template");
+        while (query.next()) knownVersions.insert(query.value(0).toInt(), query.value(1).toInt());
+    }
+
+    // Сервер читается из одного снимка данных
+    if (!server.transaction()) {
+        qDebug() << "Ошибка начала транзакции чтения проекта:" << server.lastError();
+        return false;
+    }
+    QSqlQuery isolation(server);
+    execQuery(isolation, "SET TRANSACTION ISOLATION LEVEL REPEATABLE READ, READ ONLY");
+
+    auto fail = [this, &server]() {
+        db.rollback();
+        server.rollback();
+        return false;
+    };
+
+    if (!db.transaction() || !setJournalSuspended(true)) {
+        server.rollback();
+        return false;
+    }
+
+    QSqlQuery query(db);
+    const QStringList cleanup = {
+        "DELETE FROM project",
+        "DELETE FROM category",
+        "DELETE FROM category_stats",
+        "DELETE FROM table_template WHERE template_id NOT IN (SELECT template_id FROM sync_journal)"
+    };
+    for (const QString &statement : cleanup) {
+        if (!execQuery(query, statement)) {
+            qDebug() << "Ошибка очистки локальной реплики:" << query.lastError();
+            return fail();
+        }
+    }
+
+    if (!copyRows(server, "SELECT project_id, name FROM project WHERE project_id = :projectId",
+                  ":projectId", currentProjectId, "project", 2, {}) ||
+        !copyRows(server, "SELECT category_id, name, parent_id, position, depth, project_id "
+                          "FROM category WHERE project_id = :projectId",
+                  ":projectId", currentProjectId, "category", 6, {}) ||
+        !copyRows(server, "SELECT s.category_id, s.template_count, s.approved_count, s.cell_count "
+                          "FROM category_stats s INNER JOIN category c ON c.category_id = s.category_id "
+                          "WHERE c.project_id = :projectId",
+                  ":projectId", currentProjectId, "category_stats", 4, {}) ||
+        !copyRows(server, "SELECT " + TemplateColumns + " FROM table_template WHERE project_id = :projectId",
+                  ":projectId", currentProjectId, "table_template", 9, dirty)) {
+        return fail();
+    }
+
+    if (withGrids) {
+        for (const QString &table : GridTables) {
+            if (!execQuery(query, QString("DELETE FROM %1 WHERE template_id NOT IN (SELECT template_id FROM sync_journal)")
+                                .arg(table))) {
+                qDebug() << "Ошибка очистки сеток локальной реплики:" << query.lastError();
+                return fail();
+            }
+        }
+        for (int i = 0; i < GridTables.size(); ++i) {
+            if (!copyRows(server, ProjectGridSelect[i], ":projectId", currentProjectId,
+                          GridTables[i], GridColumnCount[i], dirty)) {
+                return fail();
+            }
+        }
+    } else {
+        // Перезагружаются сетки новых шаблонов и шаблонов, изменённых на сервере
+        QSet<int> staleTemplates;
+        execQuery(query, "SELECT template_id, version FROM table_template");
+        while (query.next()) {
+            int templateId = query.value(0).toInt();
+            if (dirty.contains(templateId)) continue;
+            auto known = knownVersions.constFind(templateId);
+            if (known == knownVersions.constEnd() || known.value() != query.value(1).toInt()) {
+                staleTemplates.insert(templateId);
+            }
+        }
+
+        QStringList staleIds;
+        for (int templateId : staleTemplates) staleIds.append(QString::number(templateId));
+        for (const QString &table : GridTables) {
+            // Сетки удалённых шаблонов удаляются всегда
+            QString statement = QString("DELETE FROM %1 WHERE (template_id NOT IN (SELECT template_id FROM table_template) "
+                                        "AND template_id NOT IN (SELECT template_id FROM sync_journal))").arg(table);
+            if (!staleIds.isEmpty()) {
+                statement += " OR template_id IN (" + staleIds.join(',') + ")";
+            }
+            if (!execQuery(query, statement)) {
+                qDebug() << "Ошибка очистки сеток локальной реплики:" << query.lastError();
+                return fail();
+            }
+        }
+
+        if (!staleTemplates.isEmpty()) {
+            for (int i = 0; i < GridTables.size(); ++i) {
+                if (!copyRows(server, TemplateGridSelect[i], ":ids", idArray(staleTemplates),
+                              GridTables[i], GridColumnCount[i], {})) {
+                    return fail();
+                }
+            }
+        }
+    }
+
+    if (!setJournalSuspended(false) || !db.commit()) {
+        return fail();
+    }
+    server.commit();
+    return true;
+}
+
+bool LocalReplica::pullItems(QSqlDatabase &server, const QSet<int> &categoryIds, const QSet<int> &templateIds) {
+    if (!isOpen()) return false;
+    if (categoryIds.isEmpty() && templateIds.isEmpty()) return true;
+
+    // Шаблоны с несинхронизированными правками не перезаписываются
+    const QSet<int> templates = templateIds - dirtyTemplates();
+    const QString categoryList = categoryIds.isEmpty() ? QString("NULL") : idList(categoryIds);
+    const QString templateList = templates.isEmpty() ? QString("NULL") : idList(templates);
+
+    QSqlQuery query(db);
+    auto readIds = [&query](const QString &statement) {
+        QSet<int> ids;
+        if (!execQuery(query, statement)) {
+            qDebug() << "Ошибка чтения локальной реплики:" << query.lastError();
+        }
+        while (query.next()) ids.insert(query.value(0).toInt());
+        return ids;
+    };
+
+    // Итоги меняются у затронутых категорий, категорий затронутых шаблонов и у всех их предков
+    const QString ancestorsSql = QString(
+        "WITH RECURSIVE up (category_id) AS ( "
+        "    SELECT category_id FROM category WHERE category_id IN (%1) "
+        "    UNION SELECT category_id FROM table_template WHERE template_id IN (%2) "
+        "    UNION SELECT c.parent_id FROM category c INNER JOIN up ON c.category_id = up.category_id "
+        "    WHERE c.parent_id IS NOT NULL "
+        ") SELECT category_id FROM up").arg(categoryList, templateList);
+
+    QSet<int> statsIds = readIds(ancestorsSql);
+    QHash<int, int> knownVersions;
+    execQuery(query, QString("SELECT template_id, version FROM table_template WHERE template_id IN (%1)").arg(templateList));
+    while (query.next()) knownVersions.insert(query.value(0).toInt(), query.value(1).toInt());
+
+    if (!server.transaction()) {
+        qDebug() << "Ошибка начала транзакции чтения проекта:" << server.lastError();
+        return false;
+    }
+    QSqlQuery isolation(server);
+    execQuery(isolation, "SET TRANSACTION ISOLATION LEVEL REPEATABLE READ, READ ONLY");
+
+    auto fail = [this, &server]() {
+        db.rollback();
+        server.rollback();
+        return false;
+    };
+
+    if (!db.transaction() || !setJournalSuspended(true)) {
+        server.rollback();
+        return false;
+    }
+
+    // Категории перечитываются вместе с поддеревьями: перенос меняет глубину вложенных
+    const QStringList cleanup = {
+        QString("WITH RECURSIVE sub (category_id) AS ( "
+                "    SELECT category_id FROM category WHERE category_id IN (%1) "
+                "    UNION SELECT c.category_id FROM category c INNER JOIN sub ON c.parent_id = sub.category_id "
+                ") DELETE FROM category WHERE category_id IN (SELECT category_id FROM sub)").arg(categoryList),
+        QString("DELETE FROM table_template WHERE template_id IN (%1)").arg(templateList)
+    };
+    for (const QString &statement : cleanup) {
+        if (!execQuery(query, statement)) {
+            qDebug() << "Ошибка очистки локальной реплики:" << query.lastError();
+            return fail();
+        }
+    }
+
+    if ((!categoryIds.isEmpty() &&
+         !copyRows(server, "WITH RECURSIVE sub (category_id) AS ( "
+                           "    SELECT category_id FROM category WHERE category_id = ANY(CAST(:ids AS INTEGER[])) "
+                           "    UNION ALL SELECT c.category_id FROM category c INNER JOIN sub ON c.parent_id = sub.category_id "
+                           ") SELECT c.category_id, c.name, c.parent_id, c.position, c.depth, c.project_id "
+                           "FROM category c INNER JOIN sub ON sub.category_id = c.category_id",
+                   ":ids", idArray(categoryIds), "category", 6, {})) ||
+        (!templates.isEmpty() &&
+         !copyRows(server, "SELECT " + TemplateColumns + " FROM table_template "
+                           "WHERE template_id = ANY(CAST(:ids AS INTEGER[]))",
+                   ":ids", idArray(templates), "table_template", 9, {}))) {
+        return fail();
+    }
+
+    // Шаблоны удалённых на сервере категорий
+    QSet<int> goneTemplates = readIds(
+        "SELECT template_id FROM table_template WHERE category_id NOT IN (SELECT category_id FROM category) "
+        "AND template_id NOT IN (SELECT template_id FROM sync_journal)");
+    if (!goneTemplates.isEmpty() &&
+        !execQuery(query, QString("DELETE FROM table_template WHERE template_id IN (%1)").arg(idList(goneTemplates)))) {
+        qDebug() << "Ошибка очистки локальной реплики:" << query.lastError();
+        return fail();
+    }
+
+    // Сетки перечитываются у новых шаблонов и у шаблонов, версия которых изменилась
+    QSet<int> staleTemplates;
+    QSet<int> presentTemplates;
+    execQuery(query, QString("SELECT template_id, version FROM table_template WHERE template_id IN (%1)").arg(templateList));
+    while (query.next()) {
+        int templateId = query.value(0).toInt();
+        presentTemplates.insert(templateId);
+        auto known = knownVersions.constFind(templateId);
+        if (known == knownVersions.constEnd() || known.value() != query.value(1).toInt()) {
+            staleTemplates.insert(templateId);
+        }
+    }
+    goneTemplates += templates - presentTemplates;
+
+    const QSet<int> gridCleanup = goneTemplates + staleTemplates;
+    if (!gridCleanup.isEmpty()) {
+        for (const QString &table : GridTables) {
+            if (!execQuery(query, QString("DELETE FROM %1 WHERE template_id IN (%2)").arg(table, idList(gridCleanup)))) {
+                qDebug() << "Ошибка очистки сеток локальной реплики:" << query.lastError();
+                return fail();
+            }
+        }
+    }
+    if (!staleTemplates.isEmpty()) {
+        for (int i = 0; i < GridTables.size(); ++i) {
+            if (!copyRows(server, TemplateGridSelect[i], ":ids", idArray(staleTemplates),
+                          GridTables[i], GridColumnCount[i], {})) {
+                return fail();
+            }
+        }
+    }
+
+    // Итоги: прежние предки и предки после переноса
+    statsIds += readIds(ancestorsSql);
+    if (!statsIds.isEmpty()) {
+        if (!execQuery(query, QString("DELETE FROM category_stats WHERE category_id IN (%1)").arg(idList(statsIds))) ||
+            !copyRows(server, "SELECT category_id, template_count, approved_count, cell_count FROM category_stats "
+                              "WHERE category_id = ANY(CAST(:ids AS INTEGER[]))",
+                      ":ids", idArray(statsIds), "category_stats", 4, {})) {
+            qDebug() << "Ошибка обновления итогов локальной реплики:" << query.lastError();
+            return fail();
+        }
+    }
+
+    if (!setJournalSuspended(false) || !db.commit()) {
+        return fail();
+    }
+    server.commit();
+    return true;
+}
+
+bool LocalReplica::pullTemplate(QSqlDatabase &server, int templateId) {
+    if (!isOpen()) return false;
+
+    if (!db.transaction() || !setJournalSuspended(true)) {
+        return false;
+    }
+
+    QSqlQuery query(db);
+    QStringList statements = {"DELETE FROM sync_journal WHERE template_id = :templateId",
+                              "DELETE FROM table_template WHERE template_id = :templateId"};
+    for (const QString &table : GridTables) {
+        statements.append(QString("DELETE FROM %1 WHERE template_id = :templateId").arg(table));
+    }
+    for (const QString &statement : statements) {
+        query.prepare(statement);
+        query.bindValue(":templateId", templateId);
+        if (!execQuery(query)) {
+            qDebug() << "Ошибка удаления шаблона из локальной реплики:" << query.lastError();
+            db.rollback();
+            return false;
+        }
+    }
+
+    const QString ids = idArray({templateId});
+    bool ok = copyRows(server, "SELECT " + TemplateColumns + " FROM table_template "
+                               "WHERE template_id = ANY(CAST(:ids AS INTEGER[]))",
+                       ":ids", ids, "table_template", 9, {});
+    for (int i = 0; ok && i < GridTables.size(); ++i) {
+        ok = copyRows(server, TemplateGridSelect[i], ":ids", ids, GridTables[i], GridColumnCount[i], {});
+    }
+
+    if (!ok || !setJournalSuspended(false) || !db.commit()) {
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+
+bool LocalReplica::resolveConflict(QSqlDatabase &server, int templateId, bool keepLocal) {
+    if (!keepLocal) {
+        return pullTemplate(server, templateId);
+    }
+
+    // Локальная версия будет отправлена поверх текущей серверной
+    QSqlQuery serverQuery(server);
+    serverQuery.prepare("SELECT version FROM table_template WHERE template_id = :templateId");
+    serverQuery.bindValue(":templateId", templateId);
+    if (!execQuery(serverQuery) || !serverQuery.next()) {
+        qDebug() << "Шаблон" << templateId << "удалён на сервере, локальные правки отброшены.";
+        return pullTemplate(server, templateId);
+    }
+
+    QSqlQuery query(db);
+    query.prepare("UPDATE sync_journal SET base_version = :version, conflict = 0 WHERE template_id = :templateId");
+    query.bindValue(":version", serverQuery.value(0));
+    query.bindValue(":templateId", templateId);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка разрешения конфликта:" << query.lastError();
+        return false;
+    }
+    return true;
+}
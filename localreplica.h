@@ -0,0 +1,78 @@
+#ifndef LOCALREPLICA_H
+#define LOCALREPLICA_H
+
+#include <QSet>
+#include <QSqlDatabase>
+#include <QString>
+#include <QVector>
+#include "categorymanager.h"
+#include "templatemanager.h"
+#include "tablemanager.h"
+
+// Локальная копия выбранного проекта в SQLite.
+// Чтение дерева и шаблонов и правка содержимого шаблонов идут в локальный файл;
+// триггеры SQLite отмечают изменённые шаблоны в журнале sync_journal, откуда их
+// в фоне забирает ReplicaSync. Структура проекта (категории, создание и удаление
+// шаблонов) по-прежнему меняется в PostgreSQL и затем перечитывается в реплику.
+class LocalReplica {
+public:
+    LocalReplica();
+    ~LocalReplica();
+
+    LocalReplica(const LocalReplica &) = delete;
+    LocalReplica &operator=(const LocalReplica &) = delete;
+
+    static QString replicaPath(int projectId);
+
+    bool open(int projectId);
+    void close();
+    bool isOpen() const;
+    int projectId() const;
+    QString projectName() const;
+    QString filePath() const;
+    QSqlDatabase &database();
+    bool isEmpty() const;      // Проект ещё ни разу не загружался в реплику
+
+    // Загрузка проекта из PostgreSQL. Шаблоны с несинхронизированными правками не перезаписываются.
+    // При withGrids == false структура обновляется целиком, а сетки - только у новых шаблонов
+    // и у шаблонов, версия которых на сервере отличается от локальной.
+    bool pullProject(QSqlDatabase &server, bool withGrids);
+
+    // Перечитывание после правки структуры: только указанные категории (с поддеревьями),
+    // шаблоны и итоги их предков. Удалённые на сервере элементы удаляются из реплики.
+    bool pullItems(QSqlDatabase &server, const QSet<int> &categoryIds, const QSet<int> &templateIds);
+
+    // Повторная загрузка одного шаблона с сервера (отказ от локальных правок)
+    bool pullTemplate(QSqlDatabase &server, int templateId);
+
+    int pendingCount() const;
+    QSet<int> conflictedTemplates() const;
+
+    // Разрешение конфликта: keepLocal - перезаписать сервер локальной версией,
+    // иначе локальные правки отбрасываются и шаблон перечитывается с сервера
+    bool resolveConflict(QSqlDatabase &server, int templateId, bool keepLocal);
+
+    // Менеджеры, работающие с локальной копией
+    CategoryManager *getCategoryManager();
+    TemplateManager *getTemplateManager();
+    TableManager *getTableManager();
+
+    // Подготовка схемы реплики; используется и соединением фоновой синхронизации
+    static bool prepareSchema(QSqlDatabase &local);
+
+private:
+    bool setJournalSuspended(bool suspended);
+    bool copyRows(QSqlDatabase &server, const QString &selectSql, const QString &bindName, const QVariant &bindValue,
+                  const QString &table, int columnCount, const QSet<int> &skipTemplates);
+    QSet<int> dirtyTemplates() const;
+
+    QSqlDatabase db;
+    QString connectionName;
+    QString path;
+    int currentProjectId = 0;
+    CategoryManager *categoryManager = nullptr;
+    TemplateManager *templateManager = nullptr;
+    TableManager *tableManager = nullptr;
+};
+
+#endif // LOCALREPLICA_H
@@ -1,10 +1,14 @@
 #include "mainwindow.h"
+#include "tracing.h"
 
 #include <QApplication>
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    a.setOrganizationName("AutoTLG");
+    a.setApplicationName("AutoTLG");
+    Tracer::startFromEnvironment();   // AUTOTLG_TRACE=<файл>
     MainWindow w;
     w.show();
     return a.exec();
@@ -1,10 +1,39 @@
 #include "mainwindow.h"
 #include "nonmodaldialogue.h"
+#include "queryexecutor.h"
+#include "tracing.h"
 #include <QSplitter>
 #include <QInputDialog>
 #include <QHeaderView>
 #include <QMessageBox>
 #include <QMenu>
+#include <QLocale>
+#include <QLabel>
+#include <QMenuBar>
+#include <QFileDialog>
+#include <QProgressDialog>
+#include <QThread>
+#include <QStatusBar>
+#include <QSqlError>
+#include "importmanager.h"
+#include "exportmanager.h"
+#include "replicasync.h"
+#include "editcommands.h"
+#include "projectvalidator.h"
+#include <QUndoStack>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QDir>
+#include <QTimer>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <QSet>
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <memory>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent) {
@@ -12,18 +41,16 @@ MainWindow::MainWindow(QWidget *parent)
     // Создаем объект DatabaseHandler и передаем объект базы данных
     dbHandler = new DatabaseHandler(this);
 
-    // Подключение к базе данных
-    if (!dbHandler->connectToDatabase()) {
-        qDebug() << "Не удалось подключиться к базе данных";
-        close();
-        return;
-    }
-
     setupUI();                    // Настройка интерфейса
-    loadProjects();               // Загрузка списка проектов
+    openSnapshotAtStartup();      // Дерево последнего проекта из снимка, если он есть
+
+    // Подключение к базе данных и загрузка проектов после первой отрисовки окна
+    QTimer::singleShot(0, this, &MainWindow::connectAndRefresh);
 }
 
-MainWindow::~MainWindow() {}
+MainWindow::~MainWindow() {
+    closeLocalReplica();
+}
 
 //
 void MainWindow::setupUI() {
@@ -36,9 +63,17 @@ void MainWindow::setupUI() {
     projectComboBox->addItem("Выберите проект");
     connect(projectComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &MainWindow::onProjectSelected);
 
+    // Фильтр неутвержденных шаблонов (отбор выполняется на сервере)
+    unapprovedFilterCheckBox = new QCheckBox("Только неутвержденные", this);
+    connect(unapprovedFilterCheckBox, &QCheckBox::toggled, this, [this]() {
+        if (projectComboBox->currentData().isValid()) {
+            loadCategoriesAndTemplates();
+        }
+    });
+
     categoryTreeWidget = new QTreeWidget(this);
-    categoryTreeWidget->setColumnCount(2);
-    categoryTreeWidget->setHeaderLabels({"№", "Название"});
+    categoryTreeWidget->setColumnCount(3);
+    categoryTreeWidget->setHeaderLabels({"№", "Название", "Утверждено"});
     categoryTreeWidget->setDragDropMode(QAbstractItemView::InternalMove);
     categoryTreeWidget->setSelectionMode(QAbstractItemView::SingleSelection);
     categoryTreeWidget->setContextMenuPolicy(Qt::CustomContextMenu);
@@ -47,9 +82,30 @@ void MainWindow::setupUI() {
     connect(categoryTreeWidget, &QTreeWidget::itemDoubleClicked, this, &MainWindow::onCategoryOrTemplateDoubleClickedForEditing);
     connect(categoryTreeWidget, &QWidget::customContextMenuRequested, this, &MainWindow::showContextMenu);
 
+    // Мгновенный фильтр дерева при вводе
+    treeFilterField = new QLineEdit(this);
+    treeFilterField->setPlaceholderText("Фильтр по названию или номеру...");
+    treeFilterField->setClearButtonEnabled(true);
+    connect(treeFilterField, &QLineEdit::textChanged, this, &MainWindow::applyTreeFilter);
+
+    // Полнотекстовый поиск по названиям, заметкам и ячейкам
+    searchField = new QLineEdit(this);
+    searchField->setPlaceholderText("Поиск по шаблонам и ячейкам...");
+    searchField->setClearButtonEnabled(true);
+    connect(searchField, &QLineEdit::returnPressed, this, &MainWindow::runSearch);
+
+    searchResultsList = new QListWidget(this);
+    searchResultsList->hide();
+    connect(searchResultsList, &QListWidget::itemActivated, this, &MainWindow::onSearchResultActivated);
+    connect(searchResultsList, &QListWidget::itemClicked, this, &MainWindow::onSearchResultActivated);
+
     QVBoxLayout *leftLayout = new QVBoxLayout;
     leftLayout->addWidget(projectComboBox);
-    leftLayout->addWidget(categoryTreeWidget);
+    leftLayout->addWidget(unapprovedFilterCheckBox);
+    leftLayout->addWidget(treeFilterField);
+    leftLayout->addWidget(searchField);
+    leftLayout->addWidget(categoryTreeWidget, 3);
+    leftLayout->addWidget(searchResultsList, 1);
 
     // Таблица
     templateTableWidget = new QTableWidget(this);
@@ -123,18 +179,180 @@ void MainWindow::setupUI() {
     centralWidget->setLayout(mainLayout);
     setCentralWidget(centralWidget);
 
+    // Меню
+    QMenu *fileMenu = menuBar()->addMenu("Файл");
+    fileMenu->addAction("Импорт CSV/TSV...", this, [this]() { importCsv(false); });
+    fileMenu->addAction("Импорт каталога...", this, [this]() { importCsv(true); });
+    fileMenu->addSeparator();
+    fileMenu->addAction("Экспорт проекта в RTF/HTML...", this, &MainWindow::exportProject);
+    fileMenu->addSeparator();
+    fileMenu->addAction("Выгрузить проект (JSONL)...", this, &MainWindow::exportProjectJsonl);
+    fileMenu->addAction("Загрузить проект (JSONL)...", this, &MainWindow::importProjectJsonl);
+    fileMenu->addSeparator();
+    localReplicaAction = fileMenu->addAction("Работать с локальной копией проекта");
+    localReplicaAction->setCheckable(true);
+    localReplicaAction->setChecked(QSettings().value("localReplica", false).toBool());
+    connect(localReplicaAction, &QAction::toggled, this, [this](bool enabled) {
+        QSettings().setValue("localReplica", enabled);
+        onProjectSelected(projectComboBox->currentIndex());
+    });
+
+    QMenu *editMenu = menuBar()->addMenu("Правка");
+    undoStack = new QUndoStack(this);
+    QAction *undoAction = undoStack->createUndoAction(this, "Отменить");
+    undoAction->setShortcut(QKeySequence::Undo);
+    QAction *redoAction = undoStack->createRedoAction(this, "Повторить");
+    redoAction->setShortcut(QKeySequence::Redo);
+    editMenu->addAction(undoAction);
+    editMenu->addAction(redoAction);
+    editMenu->addSeparator();
+    QAction *findReplaceAction = editMenu->addAction("Найти и заменить...", this, &MainWindow::openFindReplaceDialog);
+    findReplaceAction->setShortcut(QKeySequence("Ctrl+H"));
+
+    QMenu *toolsMenu = menuBar()->addMenu("Сервис");
+    toolsMenu->addAction("Проверка проекта...", this, &MainWindow::validateProject);
+    toolsMenu->addAction("Уплотнить нумерацию", this, &MainWindow::compactNumbering);
+    toolsMenu->addSeparator();
+    toolsMenu->addAction("Диагностика запросов...", this, &MainWindow::openDiagnostics);
+    QAction *traceAction = toolsMenu->addAction("Запись трассировки (Perfetto)");
+    traceAction->setCheckable(true);
+    traceAction->setChecked(Tracer::isEnabled());
+    connect(traceAction, &QAction::toggled, this, &MainWindow::setTracingEnabled);
+
     // Настройки окна
     setWindowTitle("AutoShell");
     resize(1000, 600);
 }
 
 //
+QString MainWindow::snapshotPath(int projectId) {
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/snapshots";
+    return QDir(dir).filePath(QString("project_%1.atlgsnap").arg(projectId));
+}
+
+bool MainWindow::openSnapshotAtStartup() {
+    QVariant lastProjectId = QSettings().value("lastProjectId");
+    if (!lastProjectId.isValid() || !snapshot.open(snapshotPath(lastProjectId.toInt()))) {
+        return false;
+    }
+
+    setReadOnlyMode(true);
+
+    // Проект из снимка добавляем без сигнала, чтобы не обращаться к БД
+    projectComboBox->blockSignals(true);
+    projectComboBox->addItem(snapshot.projectName(), snapshot.projectId());
+    projectComboBox->setCurrentIndex(projectComboBox->count() - 1);
+    projectComboBox->blockSignals(false);
+
+    loadCategoriesAndTemplates();
+    statusBar()->showMessage(QString("Снимок от %1, подключение к базе данных...")
+                                 .arg(QDateTime::fromMSecsSinceEpoch(snapshot.createdAt()).toString("dd.MM.yyyy HH:mm")));
+    return true;
+}
+
+void MainWindow::connectAndRefresh() {
+    // Ожидание сервера и миграции схемы идут в рабочем потоке на собственном соединении,
+    // окно со снимком тем временем остаётся отзывчивым
+    QFutureWatcher<bool> *watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher]() {
+        finishConnecting(watcher->result());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(QtConcurrent::run([]() {
+        return DatabaseHandler::prepareServer("startup_connection");
+    }));
+}
+
+void MainWindow::finishConnecting(bool serverReady) {
+    // Схема уже подготовлена в фоне, основное соединение открывается без миграций
+    if (!serverReady || !dbHandler->connectToDatabase(false)) {
+        // Без сервера можно продолжить работу с локальной копией последнего проекта
+        int lastProjectId = QSettings().value("lastProjectId", -1).toInt();
+        if (localReplicaAction->isChecked() && QFileInfo::exists(LocalReplica::replicaPath(lastProjectId)) &&
+            openLocalReplica(lastProjectId, false)) {
+            setReadOnlyMode(false);
+            snapshot.close();
+            projectComboBox->blockSignals(true);
+            if (projectComboBox->findData(lastProjectId) < 0) {
+                projectComboBox->addItem(replica.projectName(), lastProjectId);
+            }
+            projectComboBox->setCurrentIndex(projectComboBox->findData(lastProjectId));
+            projectComboBox->blockSignals(false);
+            loadCategoriesAndTemplates();
+            statusBar()->showMessage("Нет подключения к базе данных: изменения сохраняются в локальной копии");
+            return;
+        }
+        if (readOnlyMode) {
+            statusBar()->showMessage("Нет подключения к базе данных: открыт снимок только для чтения");
+            return;
+        }
+        qDebug() << "Не удалось подключиться к базе данных";
+        close();
+        return;
+    }
+
+    // Переходим на данные из БД и восстанавливаем выбранный проект
+    int projectId = readOnlyMode ? snapshot.projectId() : QSettings().value("lastProjectId", -1).toInt();
+    setReadOnlyMode(false);
+    snapshot.close();
+
+    loadProjects();               // Загрузка списка проектов
+    int index = projectComboBox->findData(projectId);
+    if (index > 0) {
+        projectComboBox->setCurrentIndex(index);
+    }
+    statusBar()->clearMessage();
+}
+
+void MainWindow::setReadOnlyMode(bool readOnly) {
+    readOnlyMode = readOnly;
+
+    for (QPushButton *button : {addRowButton, addColumnButton, deleteRowButton, deleteColumnButton, saveButton, checkButton}) {
+        button->setEnabled(!readOnly);
+    }
+    notesField->setReadOnly(readOnly);
+    notesProgrammingField->setReadOnly(readOnly);
+    searchField->setEnabled(!readOnly);
+    projectComboBox->setEnabled(!readOnly);
+    menuBar()->setEnabled(!readOnly);
+    templateTableWidget->setEditTriggers(readOnly ? QAbstractItemView::NoEditTriggers
+                                                  : QAbstractItemView::DoubleClicked | QAbstractItemView::EditKeyPressed
+                                                        | QAbstractItemView::AnyKeyPressed);
+    categoryTreeWidget->setDragDropMode(readOnly ? QAbstractItemView::NoDragDrop
+                                                 : QAbstractItemView::InternalMove);
+
+    setWindowTitle(readOnly ? "AutoShell (только чтение)" : "AutoShell");
+}
+
+void MainWindow::refreshSnapshot(int projectId) {
+    // Снимок нужен только до подключения при следующем запуске, поэтому свежий
+    // снимок не переписывается при каждом выборе проекта
+    QString filePath = snapshotPath(projectId);
+    QFileInfo info(filePath);
+    const qint64 maxAgeMs = QSettings().value("snapshot/maxAgeMinutes", 60).toLongLong() * 60 * 1000;
+    if (info.exists() && info.lastModified().msecsTo(QDateTime::currentDateTime()) < maxAgeMs) {
+        return;
+    }
+
+    // Снимок для следующего запуска пишется в фоне на отдельном соединении
+    QDir().mkpath(info.absolutePath());
+
+    runInBackground("Обновление снимка проекта...",
+                    [projectId, filePath](QSqlDatabase &db) {
+                        return ProjectSnapshot::write(db, projectId, filePath);
+                    },
+                    [](bool ok) {
+                        if (!ok) qDebug() << "Не удалось обновить снимок проекта.";
+                    });
+}
+
 void MainWindow::onCategoryOrTemplateSelected(QTreeWidgetItem *item, int column) {
     Q_UNUSED(column);
+    TRACE_SCOPE("ui", "MainWindow::onCategoryOrTemplateSelected");
 
     if (!item) return;
 
-    if (item->parent() == nullptr) {
+    if (item->data(0, Qt::UserRole + 1).toBool()) {
         // Это категория
         item->setExpanded(!item->isExpanded()); // Раскрываем или сворачиваем список шаблонов
     } else {
@@ -145,7 +363,7 @@ void MainWindow::onCategoryOrTemplateSelected(QTreeWidgetItem *item, int column)
 }
 
 void MainWindow::onCategoryOrTemplateDoubleClickedForEditing(QTreeWidgetItem *item, int column) {
-    if (!item) return;
+    if (!item || readOnlyMode) return;
 
     if (column == 0) { // Редактирование нумерации
         QString currentNumeration = item->text(column);
@@ -156,8 +374,20 @@ void MainWindow::onCategoryOrTemplateDoubleClickedForEditing(QTreeWidgetItem *it
                                                       currentNumeration, &ok);
 
         if (ok && !newNumeration.isEmpty() && newNumeration != currentNumeration) {
-            item->setText(column, newNumeration);
-            updateNumberingFromItem(item); // Автоматическое обновление
+            // Последняя часть номера - новое место среди соседей; остальное пересчитывает сервер
+            QTreeWidgetItem *parent = item->parent();
+            const int count = parent ? parent->childCount() : categoryTreeWidget->topLevelItemCount();
+            const int index = qBound(0, newNumeration.section('.', -1).toInt() - 1, count - 1);
+            const bool expanded = item->isExpanded();
+            if (parent) {
+                parent->insertChild(index, parent->takeChild(parent->indexOfChild(item)));
+            } else {
+                categoryTreeWidget->insertTopLevelItem(
+                    index, categoryTreeWidget->takeTopLevelItem(categoryTreeWidget->indexOfTopLevelItem(item)));
+            }
+            item->setExpanded(expanded);
+            categoryTreeWidget->setCurrentItem(item);
+            updateNumbering("Изменение нумерации");
         }
     } else if (column == 1) { // Редактирование названия
         QString currentName = item->text(column);
@@ -169,20 +399,27 @@ void MainWindow::onCategoryOrTemplateDoubleClickedForEditing(QTreeWidgetItem *it
 
         if (ok && !newName.isEmpty() && newName != currentName) {
             item->setText(column, newName);
+            updateTreeFilterNode(item);
 
             // Сохранение изменений в базе данных
-            if (item->parent() == nullptr) {
-                int categoryId = item->data(0, Qt::UserRole).toInt();
-                dbHandler->getCategoryManager()->updateCategory(categoryId, newName);
+            bool isCategory = item->data(0, Qt::UserRole + 1).toBool();
+            int itemId = item->data(0, Qt::UserRole).toInt();
+            bool saved = false;
+            if (isCategory) {
+                saved = dbHandler->getCategoryManager()->updateCategory(itemId, newName);
+                refreshReplicaItems({itemId}, {});
             } else {
-                int templateId = item->data(0, Qt::UserRole).toInt();
-                dbHandler->getTemplateManager()->updateTemplate(templateId, newName, std::nullopt, std::nullopt);
+                saved = templateStore()->updateTemplate(itemId, newName, std::nullopt, std::nullopt);
+            }
+            if (saved) {
+                undoStack->push(new RenameCommand(this, itemId, isCategory, currentName, newName));
             }
         }
     }
 }
 
 void MainWindow::onCheckButtonClicked() {
+    OperationScope scope("Утверждение шаблона");
     // Получаем текущий выбранный элемент
     QTreeWidgetItem *selectedItem = categoryTreeWidget->currentItem();
 
@@ -191,16 +428,55 @@ void MainWindow::onCheckButtonClicked() {
         return;
     }
 
-    // Проверяем текущий цвет текста элемента
-    if (selectedItem->foreground(1).color() == Qt::red) {
-        // Меняем цвет с красного на зеленый
-        selectedItem->setForeground(1, QBrush(Qt::darkGreen));
-    } else if (selectedItem->foreground(1).color() == Qt::darkGreen) {
-        // (Опционально) Можно вернуть цвет обратно в красный
-        selectedItem->setForeground(1, QBrush(Qt::red));
+    // Для категории утверждаем всё поддерево
+    if (selectedItem->data(0, Qt::UserRole + 1).toBool()) {
+        setApprovedForSelectedCategory(true);
+        return;
+    }
+
+    int templateId = selectedItem->data(0, Qt::UserRole).toInt();
+    bool approved = !selectedItem->data(0, Qt::UserRole + 2).toBool();
+
+    // Сохраняем статус в базе данных
+    if (!templateStore()->setTemplateApproved(templateId, approved)) {
+        QMessageBox::warning(this, "Ошибка", "Не удалось изменить статус утверждения шаблона.");
+        return;
+    }
+
+    selectedItem->setData(0, Qt::UserRole + 2, approved);
+    selectedItem->setForeground(1, QBrush(approved ? Qt::darkGreen : Qt::red));
+
+    // Агрегаты на сервере уже обновлены триггером, поправляем только предков в дереве
+    for (QTreeWidgetItem *ancestor = selectedItem->parent(); ancestor; ancestor = ancestor->parent()) {
+        setCategoryProgress(ancestor,
+                            ancestor->data(2, Qt::UserRole).toInt(),
+                            ancestor->data(2, Qt::UserRole + 1).toInt() + (approved ? 1 : -1),
+                            ancestor->data(2, Qt::UserRole + 2).toLongLong());
+    }
+
+    // При активном фильтре утвержденный шаблон скрывается вместе с текстовым фильтром
+    if (unapprovedFilterCheckBox->isChecked()) {
+        applyTreeFilter(treeFilterField->text());
+    }
+
+    qDebug() << "Статус утверждения шаблона" << templateId << "обновлен.";
+}
+
+void MainWindow::setApprovedForSelectedCategory(bool approved) {
+    OperationScope scope("Утверждение категории");
+    QTreeWidgetItem *selectedItem = categoryTreeWidget->currentItem();
+    if (!selectedItem || !selectedItem->data(0, Qt::UserRole + 1).toBool()) {
+        qDebug() << "Нет выбранной категории для утверждения.";
+        return;
+    }
+
+    int categoryId = selectedItem->data(0, Qt::UserRole).toInt();
+    if (!templateStore()->setApprovedForCategoryTree(categoryId, approved)) {
+        QMessageBox::warning(this, "Ошибка", "Не удалось изменить статус утверждения шаблонов.");
+        return;
     }
 
-    qDebug() << "Цвет выбранного элемента обновлен.";
+    loadCategoriesAndTemplates();
 }
 
 //
@@ -214,31 +490,73 @@ void MainWindow::loadProjects() {
     }
 
     categoryTreeWidget->clear(); // Очищаем дерево категорий
+    templateItems.clear();
+    rebuildTreeFilterIndex();
 }
 
 void MainWindow::onProjectSelected(int index) {
+    OperationScope scope("Выбор проекта");
     // Проверяем, выбран ли проект
     QVariant projectData = projectComboBox->itemData(index);
+    closeLocalReplica();
+    undoStack->clear();     // Команды относятся к проекту и источнику данных
     if (!projectData.isValid()) {
         categoryTreeWidget->clear(); // Очищаем дерево, если проект не выбран
+        templateItems.clear();
+        rebuildTreeFilterIndex();
         return;
     }
 
     int projectId = projectData.toInt();
+    if (localReplicaAction->isChecked()) {
+        openLocalReplica(projectId, true);
+    }
+
     categoryTreeWidget->clear(); // Очищаем дерево перед загрузкой новых данных
-    loadCategoriesForProject(projectId, nullptr, QString());
+    templateItems.clear();
+    searchResultsList->clear();
+    searchResultsList->hide();
+    {
+        // Категории и шаблоны всех уровней читаются из одного снимка данных
+        ReadSnapshot consistentRead(readOnlyMode ? QSqlDatabase() : editDatabase());
+        loadCategoriesForProject(projectId, nullptr, QString());
+    }
+    rebuildTreeFilterIndex();
+
+    // Запоминаем проект и обновляем его снимок для быстрого следующего запуска
+    QSettings().setValue("lastProjectId", projectId);
+    refreshSnapshot(projectId);
 }
 
 void MainWindow::loadCategoriesAndTemplates() {
+    OperationScope scope("Загрузка дерева");
     int projectId = projectComboBox->currentData().toInt();
+    // Категории и шаблоны всех уровней читаются из одного снимка данных
+    ReadSnapshot consistentRead(readOnlyMode ? QSqlDatabase() : editDatabase());
     categoryTreeWidget->clear();
+    templateItems.clear();
     loadCategoriesForProject(projectId, nullptr, QString());
+    rebuildTreeFilterIndex();
 }
 
 void MainWindow::loadCategoriesForProject(int projectId, QTreeWidgetItem *parentItem, const QString &parentPath) {
-    QVector<Category> categories = dbHandler->getCategoryManager()->getCategoriesByProject(projectId);
+    // Категории проекта читаются один раз и используются для всех уровней дерева
+    loadedCategories = readOnlyMode ? snapshot.categories()
+                                    : categoryStore()->getCategoriesByProject(projectId);
+
+    // Шаблоны всех категорий читаются одним запросом по проекту
+    bool onlyUnapproved = unapprovedFilterCheckBox->isChecked();
+    loadedTemplates.clear();
+    const QVector<Template> templates = readOnlyMode ? snapshot.templates()
+                                                     : templateStore()->getTemplatesForProject(projectId, onlyUnapproved);
+    for (const Template &tmpl : templates) {
+        if (onlyUnapproved && tmpl.isApproved) continue;
+        loadedTemplates[tmpl.categoryId].append(tmpl);
+    }
+
+    for (const Category &category : loadedCategories) {
+        if (category.parentId != 0) continue;   // Подкатегории добавляются под родителем
 
-    for (const Category &category : categories) {
         QTreeWidgetItem *categoryItem = nullptr;
 
         if (parentItem == nullptr) {
@@ -249,26 +567,48 @@ void MainWindow::loadCategoriesForProject(int projectId, QTreeWidgetItem *parent
 
         categoryItem->setText(1, category.name);
         categoryItem->setData(0, Qt::UserRole, QVariant::fromValue(category.categoryId));
+        categoryItem->setData(0, Qt::UserRole + 1, true);
 
         QString numeration = parentPath.isEmpty() ? QString::number(category.position) : parentPath + "." + QString::number(category.position);
         categoryItem->setText(0, numeration);
+        setCategoryProgress(categoryItem, category.templateCount, category.approvedCount, category.cellCount);
 
         loadCategoriesForCategory(category, categoryItem, numeration);
         loadTemplatesForCategory(category.categoryId, categoryItem, numeration);
     }
+
+    // При фильтре неутвержденных ветки без подходящих шаблонов не показываются
+    if (onlyUnapproved) {
+        QTreeWidgetItem *root = parentItem ? parentItem : categoryTreeWidget->invisibleRootItem();
+        for (int i = root->childCount() - 1; i >= 0; --i) {
+            pruneEmptyCategory(root->child(i));
+        }
+    }
+    loadedTemplates.clear();
 }
 
-void MainWindow::loadCategoriesForCategory(const Category &category, QTreeWidgetItem *parentItem, const QString &parentPath) {
-    QVector<Category> subCategories = dbHandler->getCategoryManager()->getCategoriesByProject(category.projectId);
+void MainWindow::pruneEmptyCategory(QTreeWidgetItem *categoryItem) {
+    if (!categoryItem->data(0, Qt::UserRole + 1).toBool()) return;
 
-    for (const Category &subCategory : subCategories) {
+    for (int i = categoryItem->childCount() - 1; i >= 0; --i) {
+        pruneEmptyCategory(categoryItem->child(i));
+    }
+    if (categoryItem->childCount() == 0) {
+        delete categoryItem;
+    }
+}
+
+void MainWindow::loadCategoriesForCategory(const Category &category, QTreeWidgetItem *parentItem, const QString &parentPath) {
+    for (const Category &subCategory : loadedCategories) {
         if (subCategory.parentId == category.categoryId) {
             QTreeWidgetItem *subCategoryItem = new QTreeWidgetItem(parentItem);
             subCategoryItem->setText(1, subCategory.name);
             subCategoryItem->setData(0, Qt::UserRole, QVariant::fromValue(subCategory.categoryId));
+            subCategoryItem->setData(0, Qt::UserRole + 1, true);
 
             QString numeration = parentPath + "." + QString::number(subCategory.position);
             subCategoryItem->setText(0, numeration);
+            setCategoryProgress(subCategoryItem, subCategory.templateCount, subCategory.approvedCount, subCategory.cellCount);
 
             loadCategoriesForCategory(subCategory, subCategoryItem, numeration);
             loadTemplatesForCategory(subCategory.categoryId, subCategoryItem, numeration);
@@ -277,122 +617,1053 @@ void MainWindow::loadCategoriesForCategory(const Category &category, QTreeWidget
 }
 
 void MainWindow::loadTemplatesForCategory(int categoryId, QTreeWidgetItem *parentItem, const QString &parentPath) {
-    QVector<Template> templates = dbHandler->getTemplateManager()->getTemplatesForCategory(categoryId);
-
-    for (const Template &tmpl : templates) {
+    for (const Template &tmpl : loadedTemplates.value(categoryId)) {
         QTreeWidgetItem *templateItem = new QTreeWidgetItem(parentItem);
         templateItem->setText(1, tmpl.name);
         templateItem->setData(0, Qt::UserRole, QVariant::fromValue(tmpl.templateId));
+        templateItem->setData(0, Qt::UserRole + 1, false);
+        templateItem->setData(0, Qt::UserRole + 2, tmpl.isApproved);
+        templateItems.insert(tmpl.templateId, templateItem);
 
         QString numeration = parentPath + "." + QString::number(tmpl.position);
         templateItem->setText(0, numeration);
 
-        // Устанавливаем красный цвет текста по умолчанию
-        templateItem->setForeground(1, QBrush(Qt::red));
+        // Цвет текста отражает статус утверждения: красный - не утвержден, зеленый - утвержден
+        templateItem->setForeground(1, QBrush(tmpl.isApproved ? Qt::darkGreen : Qt::red));
     }
 }
 
-void MainWindow::loadTableTemplate(int templateId) {
+void MainWindow::setCategoryProgress(QTreeWidgetItem *categoryItem, int templateCount, int approvedCount, qint64 cellCount) {
+    // Значения храним в данных элемента, чтобы обновлять их без перезагрузки дерева
+    categoryItem->setData(2, Qt::UserRole, templateCount);
+    categoryItem->setData(2, Qt::UserRole + 1, approvedCount);
+    categoryItem->setData(2, Qt::UserRole + 2, cellCount);
+
+    categoryItem->setText(2, QString("%1/%2, %3 яч.")
+                                 .arg(approvedCount)
+                                 .arg(templateCount)
+                                 .arg(QLocale().toString(cellCount)));
+    categoryItem->setForeground(2, QBrush(templateCount > 0 && approvedCount == templateCount ? Qt::darkGreen : Qt::black));
+}
+
+void MainWindow::loadTableTemplate(int templateId, QVector<int> *rowOrders, QVector<int> *columnOrders) {
+    OperationScope scope("Открытие шаблона");
+    TRACE_SCOPE("ui", "MainWindow::loadTableTemplate");
     // Очистка текущей таблицы
     templateTableWidget->clear();
 
-    // Загрузка заголовков столбцов
-    QVector<QString> columnHeaders = dbHandler->getTemplateManager()->getColumnHeadersForTemplate(templateId);
-    templateTableWidget->setColumnCount(columnHeaders.size());
-    templateTableWidget->setHorizontalHeaderLabels(columnHeaders);
-
-    // Загрузка данных таблицы
-    QVector<QVector<QString>> tableData = dbHandler->getTemplateManager()->getTableData(templateId);
-    templateTableWidget->setRowCount(tableData.size());
+    // В режиме только для чтения сетка и заметки берутся из отображённого в память снимка
+    if (readOnlyMode) {
+        TemplateGrid grid;
+        Template tmpl;
+        if (!snapshot.loadGrid(templateId, grid) || !snapshot.templateById(templateId, tmpl)) {
+            qDebug() << "Шаблон" << templateId << "отсутствует в снимке.";
+            return;
+        }
+        // В снимке сетка хранится без пропусков в нумерации
+        if (rowOrders) {
+            rowOrders->clear();
+            for (int i = 0; i < grid.cells.size(); ++i) rowOrders->append(i);
+        }
+        if (columnOrders) {
+            columnOrders->clear();
+            for (int i = 0; i < grid.headers.size(); ++i) columnOrders->append(i);
+        }
 
-    for (int row = 0; row < tableData.size(); ++row) {
-        for (int col = 0; col < tableData[row].size(); ++col) {
-            QTableWidgetItem *item = new QTableWidgetItem(tableData[row][col]);
-            templateTableWidget->setItem(row, col, item);
+        {
+            TRACE_SCOPE("ui", "create items");
+            templateTableWidget->setColumnCount(grid.headers.size());
+            templateTableWidget->setHorizontalHeaderLabels(grid.headers);
+            templateTableWidget->setRowCount(grid.cells.size());
+            for (int row = 0; row < grid.cells.size(); ++row) {
+                for (int col = 0; col < grid.cells[row].size(); ++col) {
+                    templateTableWidget->setItem(row, col, new QTableWidgetItem(grid.cells[row][col]));
+                }
+            }
+            notesField->setText(tmpl.notes);
+            notesProgrammingField->setText(tmpl.programmingNotes);
         }
+        traceTablePaint();
+        return;
     }
 
-    // Загрузка заметок и программных заметок
-    QString notes = dbHandler->getTemplateManager()->getNotesForTemplate(templateId);
-    QString programmingNotes = dbHandler->getTemplateManager()->getProgrammingNotesForTemplate(templateId);
+    // Загрузка сетки одним чтением и заметок из одного снимка данных
+    ReadSnapshot consistentRead(editDatabase());
+    TemplateGrid grid;
+    templateStore()->getGridForTemplate(templateId, grid, rowOrders, columnOrders);
+    const QVector<QString> &columnHeaders = grid.headers;
+    const QVector<QVector<QString>> &tableData = grid.cells;
+    QString notes = templateStore()->getNotesForTemplate(templateId);
+    QString programmingNotes = templateStore()->getProgrammingNotesForTemplate(templateId);
+
+    {
+        TRACE_SCOPE("ui", "create items");
+        templateTableWidget->setColumnCount(columnHeaders.size());
+        templateTableWidget->setHorizontalHeaderLabels(columnHeaders);
+        templateTableWidget->setRowCount(tableData.size());
+
+        for (int row = 0; row < tableData.size(); ++row) {
+            for (int col = 0; col < tableData[row].size(); ++col) {
+                QTableWidgetItem *item = new QTableWidgetItem(tableData[row][col]);
+                templateTableWidget->setItem(row, col, item);
+            }
+        }
 
-    notesField->setText(notes);
-    notesProgrammingField->setText(programmingNotes);
+        notesField->setText(notes);
+        notesProgrammingField->setText(programmingNotes);
+    }
+    traceTablePaint();
 
     qDebug() << "Шаблон таблицы с ID" << templateId << "загружен.";
 }
 
+void MainWindow::traceTablePaint() {
+    // При записи трассировки раскладка и отрисовка выполняются сразу, чтобы попасть в интервал
+    if (!Tracer::isEnabled()) return;
+    TRACE_SCOPE("ui", "layout and paint");
+    templateTableWidget->doItemsLayout();
+    templateTableWidget->viewport()->repaint();
+}
+
 //
-void MainWindow::dropEvent(QDropEvent *event) {
-    MainWindow::dropEvent(event);
-    updateNumbering();  // Обновление после перетаскивания
+void MainWindow::rebuildTreeFilterIndex() {
+    treeFilterIndex.clear();
+    treeFilterItems.clear();
+
+    // Обход в глубину без рекурсии; номер узла индекса сохраняется в элементе
+    QVector<QPair<QTreeWidgetItem*, int>> stack;
+    for (int i = categoryTreeWidget->topLevelItemCount() - 1; i >= 0; --i) {
+        stack.append({categoryTreeWidget->topLevelItem(i), -1});
+    }
+
+    while (!stack.isEmpty()) {
+        QPair<QTreeWidgetItem*, int> entry = stack.takeLast();
+        QTreeWidgetItem *item = entry.first;
+        int node = treeFilterIndex.addNode(entry.second, item->text(0), item->text(1));
+        item->setData(1, Qt::UserRole, node);
+        treeFilterItems.append(item);
+
+        for (int i = item->childCount() - 1; i >= 0; --i) {
+            stack.append({item->child(i), node});
+        }
+    }
+
+    applyTreeFilter(treeFilterField->text());
+}
+
+void MainWindow::updateTreeFilterNode(QTreeWidgetItem *item) {
+    QVariant node = item->data(1, Qt::UserRole);
+    if (node.isValid()) {
+        treeFilterIndex.updateNode(node.toInt(), item->text(0), item->text(1));
+    }
 }
 
-void MainWindow::updateNumbering() {
-    for (int i = 0; i < categoryTreeWidget->topLevelItemCount(); ++i) {
-        QTreeWidgetItem *topLevelItem = categoryTreeWidget->topLevelItem(i);
+void MainWindow::addTreeFilterNode(QTreeWidgetItem *item) {
+    QTreeWidgetItem *parent = item->parent();
+    int parentNode = parent ? parent->data(1, Qt::UserRole).toInt() : -1;
+    int node = treeFilterIndex.addNode(parentNode, item->text(0), item->text(1));
+    item->setData(1, Qt::UserRole, node);
+    treeFilterItems.append(item);
+}
 
-        // Обновляем нумерацию для корневых элементов
-        QString newNumeration = QString::number(i + 1);
-        topLevelItem->setText(0, newNumeration);
+void MainWindow::removeTreeFilterNodes(QTreeWidgetItem *item) {
+    QVariant node = item->data(1, Qt::UserRole);
+    if (node.isValid()) {
+        treeFilterIndex.removeNode(node.toInt());
+        treeFilterItems[node.toInt()] = nullptr;
+    }
+    for (int i = 0; i < item->childCount(); ++i) {
+        removeTreeFilterNodes(item->child(i));
+    }
+}
 
-        int itemId = topLevelItem->data(0, Qt::UserRole).toInt();
-        int parentId = -1; // У корневых элементов нет родителя
-        int depth = 1;
+void MainWindow::applyTreeFilter(const QString &text) {
+    // Утвержденные шаблоны, оставшиеся в дереве после утверждения, скрыты фильтром статуса
+    const bool onlyUnapproved = unapprovedFilterCheckBox->isChecked();
+    QVector<bool> approvedHidden(treeFilterItems.size(), false);
+    for (int node = 0; onlyUnapproved && node < treeFilterItems.size(); ++node) {
+        QTreeWidgetItem *item = treeFilterItems[node];
+        if (!item) continue;    // Узел удалённого элемента
+        approvedHidden[node] = !item->data(0, Qt::UserRole + 1).toBool() && item->data(0, Qt::UserRole + 2).toBool();
+    }
 
-        // Обновляем в базе данных
-        dbHandler->updateNumerationDB(itemId, parentId, newNumeration, depth);
+    bool filtering = !text.trimmed().isEmpty();
+    QVector<bool> visible = filtering ? treeFilterIndex.visibleNodes(text, approvedHidden) : QVector<bool>();
 
-        // Рекурсивно обновляем вложенные элементы
-        updateNumberingFromItem(topLevelItem);
+    categoryTreeWidget->setUpdatesEnabled(false);
+    for (int node = 0; node < treeFilterItems.size(); ++node) {
+        QTreeWidgetItem *item = treeFilterItems[node];
+        if (!item) continue;
+        bool hidden = (filtering && !visible[node]) || approvedHidden[node];
+        if (item->isHidden() != hidden) {
+            item->setHidden(hidden);
+        }
+        // Раскрываем ветки, ведущие к совпадениям
+        if (filtering && !hidden && item->childCount() > 0 && !item->isExpanded()) {
+            item->setExpanded(true);
+        }
     }
+    categoryTreeWidget->setUpdatesEnabled(true);
+}
+
+void MainWindow::runSearch() {
+    OperationScope scope("Поиск");
+    searchResultsList->clear();
+
+    int projectId = projectComboBox->currentData().toInt();
+    QString text = searchField->text().trimmed();
+    if (projectId == 0 || text.isEmpty()) {
+        searchResultsList->hide();
+        return;
+    }
+
+    QVector<SearchResult> results = dbHandler->getSearchManager()->search(projectId, text);
+    for (const SearchResult &result : results) {
+        QListWidgetItem *item = new QListWidgetItem(searchResultsList);
+        item->setData(Qt::UserRole, result.templateId);
+        item->setData(Qt::UserRole + 1, result.rowOrder);
+        item->setData(Qt::UserRole + 2, result.columnOrder);
+
+        // Фрагмент с подсветкой совпадений выводим через QLabel
+        QTreeWidgetItem *treeItem = templateItems.value(result.templateId);
+        QString title = treeItem ? treeItem->text(0) + " " + result.templateName : result.templateName;
+        QString place = result.rowOrder < 0 ? QString("шаблон")
+                                            : QString("ячейка %1:%2").arg(result.rowOrder).arg(result.columnOrder);
+        QLabel *label = new QLabel(QString("<b>%1</b> <i>(%2)</i><br>%3")
+                                       .arg(title.toHtmlEscaped(), place, result.snippet),
+                                   searchResultsList);
+        label->setTextFormat(Qt::RichText);
+        label->setAttribute(Qt::WA_TransparentForMouseEvents);
+        item->setSizeHint(label->sizeHint());
+        searchResultsList->setItemWidget(item, label);
+    }
+
+    if (results.isEmpty()) {
+        new QListWidgetItem("Ничего не найдено", searchResultsList);
+    }
+    searchResultsList->show();
+}
+
+void MainWindow::onSearchResultActivated(QListWidgetItem *item) {
+    if (!item || !item->data(Qt::UserRole).isValid()) return;
+
+    openTemplateAtCell(item->data(Qt::UserRole).toInt(),
+                       item->data(Qt::UserRole + 1).toInt(),
+                       item->data(Qt::UserRole + 2).toInt());
 }
 
-void MainWindow::updateNumberingFromItem(QTreeWidgetItem *parentItem) {
-    if (!parentItem) return;
+void MainWindow::openTemplateAtCell(int templateId, int rowOrder, int columnOrder) {
+    // Выделяем шаблон в дереве (при активном фильтре его может не быть)
+    if (QTreeWidgetItem *treeItem = templateItems.value(templateId)) {
+        categoryTreeWidget->setCurrentItem(treeItem);
+        categoryTreeWidget->scrollToItem(treeItem);
+    }
+
+    // Порядковые номера берутся из того же чтения, что и загруженная сетка
+    QVector<int> rowOrders, columnOrders;
+    loadTableTemplate(templateId, &rowOrders, &columnOrders);
 
-    QString parentPath = parentItem->text(0);
-    for (int i = 0; i < parentItem->childCount(); ++i) {
-        QTreeWidgetItem *childItem = parentItem->child(i);
+    if (rowOrder < 0 || columnOrder < 0) return;
 
-        QString newNumeration = parentPath + "." + QString::number(i + 1);
-        childItem->setText(0, newNumeration);
+    // Порядковые номера в БД могут идти с пропусками, переводим их в индексы таблицы
+    int row = rowOrders.indexOf(rowOrder);
+    int column = columnOrders.indexOf(columnOrder);
+    if (row < 0 || column < 0) return;
 
-        int itemId = childItem->data(0, Qt::UserRole).toInt();
-        int parentId = parentItem->data(0, Qt::UserRole).toInt();
-        int depth = newNumeration.count('.') + 1;
+    templateTableWidget->setCurrentCell(row, column);
+    templateTableWidget->scrollToItem(templateTableWidget->item(row, column));
+}
 
-        bool isCategory = (childItem->childCount() > 0); // Если есть дети, это категория
+void MainWindow::importCsv(bool directory) {
+    QTreeWidgetItem *currentItem = categoryTreeWidget->currentItem();
+    if (!currentItem || !currentItem->data(0, Qt::UserRole + 1).toBool()) {
+        QMessageBox::warning(this, "Ошибка", "Выберите категорию, в которую будет выполнен импорт.");
+        return;
+    }
+    int categoryId = currentItem->data(0, Qt::UserRole).toInt();
 
-        if (!dbHandler->updateNumerationDB(itemId, parentId, newNumeration, depth)) {
-            qDebug() << "Ошибка обновления нумерации для элемента ID" << itemId;
+    QStringList paths;
+    if (directory) {
+        QString dir = QFileDialog::getExistingDirectory(this, "Каталог с файлами CSV/TSV");
+        if (!dir.isEmpty()) paths << dir;
+    } else {
+        paths = QFileDialog::getOpenFileNames(this, "Файлы CSV/TSV", QString(),
+                                              "Таблицы (*.csv *.tsv *.txt)");
+    }
+    if (paths.isEmpty()) return;
+
+    // Импорт идёт в отдельном потоке с собственным соединением
+    QThread *thread = new QThread(this);
+    ImportManager *importer = new ImportManager(dbHandler->connectionName());
+    importer->moveToThread(thread);
+
+    QProgressDialog *progressDialog = new QProgressDialog("Импорт...", QString(), 0, 1000, this);
+    progressDialog->setWindowTitle("Импорт CSV/TSV");
+    progressDialog->setMinimumDuration(0);
+    progressDialog->setAttribute(Qt::WA_DeleteOnClose);
+
+    connect(thread, &QThread::started, importer, [importer, paths, categoryId]() {
+        importer->run(paths, categoryId);
+    });
+    connect(importer, &ImportManager::progress, progressDialog,
+            [progressDialog](qint64 processedBytes, qint64 totalBytes, int filesDone, int filesTotal) {
+        progressDialog->setLabelText(QString("Файлов: %1 из %2").arg(filesDone).arg(filesTotal));
+        progressDialog->setValue(totalBytes > 0 ? int(processedBytes * 1000 / totalBytes) : 0);
+    });
+    connect(importer, &ImportManager::finished, this, [this, thread, progressDialog](bool ok, const QString &message) {
+        progressDialog->close();
+        thread->quit();
+        if (ok) {
+            statusBar()->showMessage(message, 5000);
+        } else {
+            QMessageBox::warning(this, "Ошибка импорта", message);
         }
+        refreshReplicaStructure();
+        loadCategoriesAndTemplates();
+    });
+    connect(thread, &QThread::finished, importer, &QObject::deleteLater);
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
 
-        if (isCategory) {
-            updateNumberingFromItem(childItem); // Рекурсивно обновляем только для категорий
+    thread->start();
+}
+
+void MainWindow::exportProject() {
+    int projectId = projectComboBox->currentData().toInt();
+    if (projectId == 0) {
+        QMessageBox::warning(this, "Ошибка", "Выберите проект для экспорта.");
+        return;
+    }
+
+    ExportOptions options;
+    options.outputDir = QFileDialog::getExistingDirectory(this, "Каталог для экспорта");
+    if (options.outputDir.isEmpty()) return;
+
+    bool ok;
+    QString mode = QInputDialog::getItem(this, "Экспорт проекта", "Формат вывода:",
+                                         {"Отдельный документ на каждый шаблон", "Один общий документ"},
+                                         0, false, &ok);
+    if (!ok) return;
+    options.combined = (mode == "Один общий документ");
+
+    // Чтение из БД идёт в отдельном потоке, вывод документов - в пуле потоков
+    QThread *thread = new QThread(this);
+    ExportManager *exporter = new ExportManager(dbHandler->connectionName());
+    exporter->moveToThread(thread);
+
+    QProgressDialog *progressDialog = new QProgressDialog("Экспорт...", QString(), 0, 0, this);
+    progressDialog->setWindowTitle("Экспорт проекта");
+    progressDialog->setMinimumDuration(0);
+    progressDialog->setAttribute(Qt::WA_DeleteOnClose);
+
+    connect(thread, &QThread::started, exporter, [exporter, projectId, options]() {
+        exporter->run(projectId, options);
+    });
+    connect(exporter, &ExportManager::progress, progressDialog, [progressDialog](int templatesDone, int templatesTotal) {
+        progressDialog->setMaximum(templatesTotal);
+        progressDialog->setValue(templatesDone);
+        progressDialog->setLabelText(QString("Шаблонов: %1 из %2").arg(templatesDone).arg(templatesTotal));
+    });
+    connect(exporter, &ExportManager::finished, this, [this, thread, progressDialog](bool ok, const QString &message) {
+        progressDialog->close();
+        thread->quit();
+        if (ok) {
+            statusBar()->showMessage(message, 5000);
+        } else {
+            QMessageBox::warning(this, "Ошибка экспорта", message);
+        }
+    });
+    connect(thread, &QThread::finished, exporter, &QObject::deleteLater);
+    connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+
+    thread->start();
+}
+
+CategoryManager *MainWindow::categoryStore() {
+    return replica.isOpen() ? replica.getCategoryManager() : dbHandler->getCategoryManager();
+}
+
+TemplateManager *MainWindow::templateStore() {
+    return replica.isOpen() ? replica.getTemplateManager() : dbHandler->getTemplateManager();
+}
+
+TableManager *MainWindow::tableStore() {
+    return replica.isOpen() ? replica.getTableManager() : dbHandler->getTableManager();
+}
+
+bool MainWindow::openLocalReplica(int projectId, bool online) {
+    closeLocalReplica();
+    if (!replica.open(projectId)) {
+        statusBar()->showMessage("Не удалось открыть локальную копию проекта, данные читаются с сервера", 5000);
+        return false;
+    }
+
+    if (online) {
+        // Новая копия загружается целиком, существующая - только изменившимися на сервере шаблонами.
+        // Загрузка идёт в фоне на собственных соединениях с сервером и с файлом реплики
+        const bool firstLoad = replica.isEmpty();
+        runInBackground(firstLoad ? "Загрузка локальной копии проекта..." : "Обновление локальной копии проекта...",
+                        [projectId, firstLoad](QSqlDatabase &db) {
+                            LocalReplica loader;
+                            return loader.open(projectId) && loader.pullProject(db, firstLoad);
+                        },
+                        [this, projectId, firstLoad](bool ok) {
+                            if (!ok) {
+                                statusBar()->showMessage("Не удалось обновить локальную копию проекта", 5000);
+                            } else if (firstLoad && replica.projectId() == projectId) {
+                                loadCategoriesAndTemplates();
+                            }
+                        });
+    }
+
+    // Фоновая отправка локальных правок на сервер
+    syncThread = new QThread(this);
+    replicaSync = new ReplicaSync(dbHandler->connectionName(), replica.filePath());
+    replicaSync->moveToThread(syncThread);
+    connect(syncThread, &QThread::started, replicaSync, &ReplicaSync::start);
+    connect(replicaSync, &ReplicaSync::synced, this, [this](int pushedTemplates, int pendingTemplates) {
+        statusBar()->showMessage(QString("Синхронизировано шаблонов: %1, ожидают отправки: %2")
+                                     .arg(pushedTemplates).arg(pendingTemplates), 5000);
+    });
+    connect(replicaSync, &ReplicaSync::conflict, this, &MainWindow::onReplicaConflict);
+    connect(replicaSync, &ReplicaSync::failed, this, [](const QString &message) {
+        qDebug() << message;
+    });
+    syncThread->start();
+    return true;
+}
+
+void MainWindow::closeLocalReplica() {
+    if (syncThread) {
+        // Неотправленные правки остаются в журнале файла реплики до следующего открытия
+        QMetaObject::invokeMethod(replicaSync, &ReplicaSync::stop, Qt::BlockingQueuedConnection);
+        syncThread->quit();
+        syncThread->wait();
+        delete replicaSync;
+        delete syncThread;
+        replicaSync = nullptr;
+        syncThread = nullptr;
+    }
+    replica.close();
+}
+
+void MainWindow::refreshReplicaStructure() {
+    if (!replica.isOpen()) return;
+
+    QSqlDatabase server = QSqlDatabase::database(dbHandler->connectionName(), false);
+    if (!server.isOpen() || !replica.pullProject(server, false)) {
+        qDebug() << "Не удалось обновить структуру локальной копии проекта.";
+    }
+}
+
+void MainWindow::refreshReplicaItems(const QSet<int> &categoryIds, const QSet<int> &templateIds) {
+    if (!replica.isOpen()) return;
+
+    QSqlDatabase server = QSqlDatabase::database(dbHandler->connectionName(), false);
+    if (!server.isOpen() || !replica.pullItems(server, categoryIds, templateIds)) {
+        qDebug() << "Не удалось обновить изменённые элементы в локальной копии проекта.";
+    }
+}
+
+void MainWindow::refreshReplicaItems(const QVector<TreeChange> &changes) {
+    QSet<int> categoryIds;
+    QSet<int> templateIds;
+    for (const TreeChange &change : changes) {
+        (change.isCategory ? categoryIds : templateIds).insert(change.itemId);
+    }
+    refreshReplicaItems(categoryIds, templateIds);
+}
+
+void MainWindow::onReplicaConflict(int templateId) {
+    QTreeWidgetItem *item = templateItems.value(templateId);
+    QString name = item ? item->text(0) + " " + item->text(1) : QString::number(templateId);
+
+    QMessageBox::StandardButton reply = QMessageBox::question(
+        this, "Конфликт синхронизации",
+        QString("Шаблон \"%1\" изменён на сервере после начала локальной правки.\n"
+                "Сохранить локальную версию поверх серверной?\n"
+                "«Нет» - отбросить локальные правки и загрузить версию с сервера.").arg(name),
+        QMessageBox::Yes | QMessageBox::No);
+
+    QSqlDatabase server = QSqlDatabase::database(dbHandler->connectionName(), false);
+    if (!replica.isOpen() || !server.isOpen() ||
+        !replica.resolveConflict(server, templateId, reply == QMessageBox::Yes)) {
+        QMessageBox::warning(this, "Ошибка", "Не удалось разрешить конфликт синхронизации.");
+        return;
+    }
+
+    // Открытый шаблон перечитываем, если была загружена серверная версия
+    QTreeWidgetItem *currentItem = categoryTreeWidget->currentItem();
+    if (reply == QMessageBox::No && currentItem && currentItem == item) {
+        loadTableTemplate(templateId);
+    }
+}
+
+void MainWindow::runInBackground(const QString &title,
+                                 const std::function<bool(QSqlDatabase &)> &job,
+                                 const std::function<void(bool)> &done) {
+    static std::atomic<int> connectionCounter{0};
+    const QString sourceConnection = dbHandler->connectionName();
+    const QString connectionName = QString("background_connection_%1").arg(++connectionCounter);
+
+    QProgressDialog *progressDialog = new QProgressDialog(title, QString(), 0, 0, this);
+    progressDialog->setMinimumDuration(0);
+    progressDialog->setAttribute(Qt::WA_DeleteOnClose);
+
+    QFutureWatcher<bool> *watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [watcher, progressDialog, done]() {
+        progressDialog->close();
+        done(watcher->result());
+        watcher->deleteLater();
+    });
+
+    watcher->setFuture(QtConcurrent::run([sourceConnection, connectionName, title, job]() {
+        bool ok = false;
+        {
+            QSqlDatabase db = QSqlDatabase::cloneDatabase(sourceConnection, connectionName);
+            if (db.open()) {
+                OperationScope scope(title);
+                ok = job(db);
+                db.close();
+            }
+        }
+        QSqlDatabase::removeDatabase(connectionName);
+        return ok;
+    }));
+}
+
+void MainWindow::exportProjectJsonl() {
+    int projectId = projectComboBox->currentData().toInt();
+    if (projectId == 0) {
+        QMessageBox::warning(this, "Ошибка", "Выберите проект для выгрузки.");
+        return;
+    }
+
+    QString filePath = QFileDialog::getSaveFileName(this, "Выгрузить проект", projectComboBox->currentText() + ".jsonl",
+                                                    "JSON Lines (*.jsonl)");
+    if (filePath.isEmpty()) return;
+
+    runInBackground("Выгрузка проекта...",
+                    [projectId, filePath](QSqlDatabase &db) {
+                        return ProjectManager(db).exportProject(projectId, filePath);
+                    },
+                    [this](bool ok) {
+                        if (ok) {
+                            statusBar()->showMessage("Проект выгружен.", 5000);
+                        } else {
+                            QMessageBox::warning(this, "Ошибка", "Не удалось выгрузить проект.");
+                        }
+                    });
+}
+
+void MainWindow::importProjectJsonl() {
+    QString filePath = QFileDialog::getOpenFileName(this, "Загрузить проект", QString(), "JSON Lines (*.jsonl)");
+    if (filePath.isEmpty()) return;
+
+    auto newProjectId = std::make_shared<int>(-1);
+    runInBackground("Загрузка проекта...",
+                    [filePath, newProjectId](QSqlDatabase &db) {
+                        return ProjectManager(db).importProject(filePath, newProjectId.get());
+                    },
+                    [this, newProjectId](bool ok) {
+                        if (!ok) {
+                            QMessageBox::warning(this, "Ошибка", "Не удалось загрузить проект.");
+                            return;
+                        }
+                        loadProjects();
+                        projectComboBox->setCurrentIndex(projectComboBox->findData(*newProjectId));
+                    });
+}
+
+void MainWindow::openFindReplaceDialog() {
+    int projectId = projectComboBox->currentData().toInt();
+    if (projectId == 0) {
+        QMessageBox::warning(this, "Ошибка", "Выберите проект перед заменой.");
+        return;
+    }
+
+    DialogFindReplace dialog(this);
+
+    // Определяем область замены по выбранному в диалоге варианту
+    auto resolveScope = [this, &dialog, projectId](ReplaceScope &scope, int &scopeId) {
+        QTreeWidgetItem *currentItem = categoryTreeWidget->currentItem();
+        bool isCategory = currentItem && currentItem->data(0, Qt::UserRole + 1).toBool();
+
+        switch (dialog.scopeIndex()) {
+        case 1:
+            if (!isCategory) {
+                dialog.setStatusText("Выберите категорию в дереве.");
+                return false;
+            }
+            scope = ReplaceScope::Category;
+            scopeId = currentItem->data(0, Qt::UserRole).toInt();
+            return true;
+        case 2:
+            if (!currentItem || isCategory) {
+                dialog.setStatusText("Выберите шаблон в дереве.");
+                return false;
+            }
+            scope = ReplaceScope::Template;
+            scopeId = currentItem->data(0, Qt::UserRole).toInt();
+            return true;
+        default:
+            scope = ReplaceScope::Project;
+            scopeId = projectId;
+            return true;
+        }
+    };
+
+    auto run = [this, &dialog, resolveScope](bool dryRun) {
+        ReplaceScope scope;
+        int scopeId;
+        if (!resolveScope(scope, scopeId)) return;
+
+        ReplaceCounts counts;
+        if (!dbHandler->getSearchManager()->findReplace(scope, scopeId, dialog.findText(), dialog.replaceText(),
+                                                        dialog.useRegex(), dryRun, counts)) {
+            dialog.setStatusText("Ошибка выполнения (проверьте выражение).");
+            return;
+        }
+
+        dialog.setStatusText(QString("%1: ячеек - %2, заголовков - %3, шаблонов с заметками - %4")
+                                 .arg(dryRun ? "Найдено" : "Заменено")
+                                 .arg(counts.cells).arg(counts.headers).arg(counts.notes));
+
+        // Команды отмены хранят сетки до замены и вернули бы их поверх неё;
+        // замену отменяет возврат к ревизии, записанной до неё
+        if (!dryRun) {
+            undoStack->clear();
+            refreshReplicaStructure();
+        }
+
+        // Перечитываем открытый шаблон, если данные изменились
+        QTreeWidgetItem *currentItem = categoryTreeWidget->currentItem();
+        if (!dryRun && currentItem && !currentItem->data(0, Qt::UserRole + 1).toBool()) {
+            loadTableTemplate(currentItem->data(0, Qt::UserRole).toInt());
+        }
+    };
+
+    connect(&dialog, &DialogFindReplace::previewRequested, this, [run]() { run(true); });
+    connect(&dialog, &DialogFindReplace::replaceRequested, this, [run]() { run(false); });
+    dialog.exec();
+}
+
+void MainWindow::setTracingEnabled(bool enabled) {
+    if (enabled) {
+        QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/traces";
+        Tracer::start(QDir(dir).filePath(QDateTime::currentDateTime().toString("'trace_'yyyyMMdd_HHmmss'.json'")));
+        statusBar()->showMessage("Запись трассировки включена.", 5000);
+    } else if (Tracer::stop()) {
+        statusBar()->showMessage("Трассировка сохранена: " + QDir::toNativeSeparators(Tracer::filePath()));
+    }
+}
+
+void MainWindow::validateProject() {
+    int projectId = projectComboBox->currentData().toInt();
+    if (projectId == 0) {
+        QMessageBox::warning(this, "Ошибка", "Выберите проект для проверки.");
+        return;
+    }
+
+    auto issues = std::make_shared<QVector<ValidationIssue>>();
+    runInBackground("Проверка проекта...",
+                    [projectId, issues](QSqlDatabase &db) {
+                        return ProjectValidator(db).validate(projectId, *issues);
+                    },
+                    [this, projectId, issues](bool ok) {
+                        if (!ok) {
+                            QMessageBox::warning(this, "Ошибка", "Не удалось проверить проект.");
+                            return;
+                        }
+                        if (!validationDialog) {
+                            validationDialog = new DialogValidation(this);
+                        }
+                        // Диалог исправляет проект, который был проверен, а не выбранный позже
+                        validationDialog->disconnect(this);
+                        connect(validationDialog, &DialogValidation::fixRequested, this,
+                                [this, projectId]() { fixProject(projectId); });
+                        validationDialog->setIssues(*issues);
+                        validationDialog->show();
+                        validationDialog->raise();
+                        validationDialog->activateWindow();
+                    });
+}
+
+void MainWindow::fixProject(int projectId) {
+    if (!validationDialog) return;
+    const QVector<ValidationIssue> found = validationDialog->issues();
+
+    // Исправление одной транзакцией, затем повторная проверка на том же соединении
+    auto fixed = std::make_shared<int>(0);
+    auto issues = std::make_shared<QVector<ValidationIssue>>();
+    runInBackground("Исправление проекта...",
+                    [projectId, found, fixed, issues](QSqlDatabase &db) {
+                        ProjectValidator validator(db);
+                        if (!db.transaction()) return false;
+                        if (!validator.fix(projectId, found, fixed.get()) || !db.commit()) {
+                            db.rollback();
+                            return false;
+                        }
+                        return validator.validate(projectId, *issues);
+                    },
+                    [this, projectId, fixed, issues](bool ok) {
+                        if (!ok) {
+                            QMessageBox::warning(this, "Ошибка", "Не удалось исправить проект.");
+                            return;
+                        }
+                        // Дерево и журнал отмены описывают прежнее состояние проекта
+                        if (projectComboBox->currentData().toInt() == projectId) {
+                            undoStack->clear();
+                            reloadTree();
+                        }
+                        if (validationDialog) {
+                            validationDialog->setIssues(*issues, QString("Исправлено нарушений: %1.").arg(*fixed));
+                        }
+                    });
+}
+
+void MainWindow::compactNumbering() {
+    OperationScope scope("Уплотнение нумерации");
+    int projectId = projectComboBox->currentData().toInt();
+    if (projectId == 0 || readOnlyMode) return;
+
+    // Одно изменение в журнале отмены; сдвинутые элементы перечисляются в подробностях
+    QVector<PositionChange> moved;
+    CategoryManager *categories = dbHandler->getCategoryManager();
+    if (!editStructure("Уплотнение нумерации", nullptr, [categories, projectId, &moved]() {
+            return categories->renumberProject(projectId, &moved);
+        }, nullptr)) {
+        QMessageBox::warning(this, "Ошибка", "Не удалось уплотнить нумерацию проекта.");
+        return;
+    }
+    if (moved.isEmpty()) {
+        statusBar()->showMessage("Нумерация проекта уже сплошная.", 5000);
+        return;
+    }
+    reloadTree();
+
+    QStringList lines;
+    for (const PositionChange &change : moved) {
+        lines.append(QString("%1 %2: позиция %3 → %4")
+                         .arg(change.isCategory ? "Категория" : "Шаблон")
+                         .arg(change.itemId).arg(change.oldPosition).arg(change.newPosition));
+    }
+    QMessageBox box(QMessageBox::Information, "Уплотнение нумерации",
+                    QString("Сдвинуто элементов: %1.").arg(moved.size()), QMessageBox::Ok, this);
+    box.setDetailedText(lines.join('\n'));
+    box.exec();
+}
+
+void MainWindow::openDiagnostics() {
+    // Окно немодальное и существует в одном экземпляре
+    if (!diagnosticsDialog) {
+        diagnosticsDialog = new DialogDiagnostics(this);
+    }
+    diagnosticsDialog->show();
+    diagnosticsDialog->raise();
+    diagnosticsDialog->activateWindow();
+}
+
+void MainWindow::compareTemplates(int leftTemplateId, const QString &leftTitle, int rightTemplateId, const QString &rightTitle) {
+    OperationScope scope("Сравнение шаблонов");
+    QHash<int, TemplateGrid> grids;
+    if (!templateStore()->getGridsForTemplates({leftTemplateId, rightTemplateId}, grids)) {
+        QMessageBox::warning(this, "Ошибка", "Не удалось загрузить сетки шаблонов.");
+        return;
+    }
+
+    const TemplateGrid left = grids.value(leftTemplateId);
+    const TemplateGrid right = grids.value(rightTemplateId);
+    DialogGridDiff *dialog = new DialogGridDiff(leftTitle, left, rightTitle, right, diffGrids(left, right), this);
+    dialog->show();
+}
+
+void MainWindow::compareWithPreviousRevision(int templateId, const QString &name) {
+    OperationScope scope("Сравнение ревизий");
+    RevisionManager *revisions = dbHandler->getRevisionManager();
+    const QVector<TemplateRevision> history = revisions->listRevisions(templateId);
+    if (history.size() < 2) {
+        QMessageBox::information(this, "Сравнение", "У шаблона нет предыдущих ревизий.");
+        return;
+    }
+
+    TemplateGrid previous;
+    TemplateGrid latest;
+    if (!revisions->reconstruct(templateId, history[1].revision, previous)
+        || !revisions->reconstruct(templateId, history[0].revision, latest)) {
+        QMessageBox::warning(this, "Ошибка", "Не удалось восстановить ревизии шаблона.");
+        return;
+    }
+
+    const QString title = "%1, ревизия %2";
+    DialogGridDiff *dialog = new DialogGridDiff(title.arg(name).arg(history[1].revision), previous,
+                                                title.arg(name).arg(history[0].revision), latest,
+                                                diffGrids(previous, latest), this);
+    dialog->show();
+}
+
+QSqlDatabase MainWindow::serverDatabase() const {
+    return QSqlDatabase::database(dbHandler->connectionName());
+}
+
+QSqlDatabase MainWindow::editDatabase() {
+    return replica.isOpen() ? replica.database() : serverDatabase();
+}
+
+DatabaseHandler *MainWindow::databaseHandler() const {
+    return dbHandler;
+}
+
+int MainWindow::currentTemplateId() const {
+    QTreeWidgetItem *item = categoryTreeWidget->currentItem();
+    if (!item || item->data(0, Qt::UserRole + 1).toBool()) return 0;
+    return item->data(0, Qt::UserRole).toInt();
+}
+
+void MainWindow::reloadTree() {
+    refreshReplicaStructure();
+    loadCategoriesAndTemplates();
+}
+
+void MainWindow::renameTreeItem(int itemId, bool isCategory, const QString &name) {
+    QTreeWidgetItem *found = isCategory ? nullptr : templateItems.value(itemId);
+    for (int i = 0; isCategory && !found && i < treeFilterItems.size(); ++i) {
+        QTreeWidgetItem *item = treeFilterItems[i];
+        if (item && item->data(0, Qt::UserRole + 1).toBool() && item->data(0, Qt::UserRole).toInt() == itemId) {
+            found = item;
         }
     }
+    if (!found) return;     // Шаблон может быть скрыт фильтром
+
+    found->setText(1, name);
+    updateTreeFilterNode(found);
+}
+
+bool MainWindow::editStructure(const QString &text,
+                               const std::function<bool(QVector<RemovedRows> &)> &capture,
+                               const std::function<bool()> &edit,
+                               const std::function<bool()> &removal) {
+    // Положения до и после изменения читаются в той же транзакции, что и само изменение
+    const int projectId = projectComboBox->currentData().toInt();
+    EditJournal *journal = dbHandler->getEditJournal();
+    QSqlDatabase server = serverDatabase();
+    if (!server.transaction()) {
+        qDebug() << "Ошибка начала транзакции:" << server.lastError().text();
+        return false;
+    }
+
+    QVector<TreePlacement> before;
+    QVector<TreePlacement> after;
+    QVector<RemovedRows> removed;
+    bool ok = journal->captureLayout(projectId, before)
+           && (!capture || capture(removed))
+           && edit()
+           && journal->captureLayout(projectId, after);
+    if (!ok || !server.commit()) {
+        qDebug() << "Ошибка изменения дерева:" << text << server.lastError().text();
+        server.rollback();
+        return false;
+    }
+
+    QVector<TreePlacement> undoLayout;
+    QVector<TreePlacement> redoLayout;
+    EditJournal::diffLayouts(before, after, undoLayout, redoLayout);
+    if (removed.isEmpty() && undoLayout.isEmpty()) {
+        return true;    // Ничего не изменилось
+    }
+    undoStack->push(new StructureCommand(this, text, removed, undoLayout, redoLayout, removal));
+    return true;
+}
+
+//
+void MainWindow::dropEvent(QDropEvent *event) {
+    MainWindow::dropEvent(event);
+    updateNumbering();  // Обновление после перетаскивания
+}
+
+void MainWindow::updateNumbering(const QString &text) {
+    OperationScope scope("Перенумерация");
+    // Положения из дерева записываются одним запросом на таблицу, затем сервер уплотняет
+    // нумерацию; дерево правится по возвращённым позициям без перезагрузки
+    const int projectId = projectComboBox->currentData().toInt();
+    const QVector<TreePlacement> layout = treeLayout();
+    EditJournal *journal = dbHandler->getEditJournal();
+    CategoryManager *categories = dbHandler->getCategoryManager();
+    QVector<PositionChange> moved;
+    bool ok = editStructure(text, nullptr, [journal, categories, projectId, &layout, &moved]() {
+        return journal->applyLayout(layout) && categories->renumberProject(projectId, &moved);
+    }, nullptr);
+    if (!ok) {
+        QMessageBox::warning(this, "Ошибка", "Не удалось сохранить нумерацию.");
+        reloadTree();
+        return;
+    }
+
+    // Идентификаторы категорий и шаблонов независимы, поэтому ключ включает тип
+    QHash<qint64, int> positions;
+    for (const PositionChange &change : moved) {
+        positions.insert(qint64(change.itemId) * 2 + change.isCategory, change.newPosition);
+    }
+    QVector<TreeChange> changes;
+    changes.reserve(layout.size());
+    for (const TreePlacement &placement : layout) {
+        const int position = positions.value(qint64(placement.itemId) * 2 + placement.isCategory, placement.position);
+        changes.append({placement.itemId, placement.isCategory, false, placement.parentId, position, placement.depth});
+    }
+    refreshReplicaItems(changes);
+    applyTreeChanges(changes);
+}
+
+QVector<TreePlacement> MainWindow::treeLayout() const {
+    // Положение каждого элемента - его место среди соседей в дереве интерфейса
+    QVector<TreePlacement> layout;
+    std::function<void(QTreeWidgetItem *, int)> collect = [&](QTreeWidgetItem *parent, int depth) {
+        const int parentId = parent ? parent->data(0, Qt::UserRole).toInt() : 0;
+        const int count = parent ? parent->childCount() : categoryTreeWidget->topLevelItemCount();
+        for (int i = 0; i < count; ++i) {
+            QTreeWidgetItem *child = parent ? parent->child(i) : categoryTreeWidget->topLevelItem(i);
+            const bool isCategory = child->data(0, Qt::UserRole + 1).toBool();
+            layout.append({child->data(0, Qt::UserRole).toInt(), isCategory, parentId, i + 1, isCategory ? depth : 0});
+            if (isCategory) collect(child, depth + 1);
+        }
+    };
+    collect(nullptr, 1);
+    return layout;
 }
 
-void MainWindow::numberChildItems(QTreeWidgetItem *parent, const QString &parentPath) {
-    for (int i = 0; i < parent->childCount(); ++i) {
-        QTreeWidgetItem *child = parent->child(i);
-        QString newPath = parentPath + "." + QString::number(i + 1);
-        child->setText(0, newPath);
+void MainWindow::applyTreeChanges(const QVector<TreeChange> &changes) {
+    // Элементы дерева по идентификатору; категории и шаблоны нумеруются независимо
+    QHash<int, QTreeWidgetItem *> categoryItems;
+    for (QTreeWidgetItem *item : treeFilterItems) {
+        if (item && item->data(0, Qt::UserRole + 1).toBool()) {
+            categoryItems.insert(item->data(0, Qt::UserRole).toInt(), item);
+        }
+    }
+    auto itemFor = [this, &categoryItems](const TreeChange &change) {
+        return change.isCategory ? categoryItems.value(change.itemId) : templateItems.value(change.itemId);
+    };
+
+    // Перенос элементов сворачивает ветки, поэтому раскрытые запоминаются заранее
+    QSet<QTreeWidgetItem *> expanded;
+    for (QTreeWidgetItem *item : treeFilterItems) {
+        if (item && item->isExpanded()) expanded.insert(item);
+    }
 
-        int itemId = child->data(0, Qt::UserRole).toInt();
-        int parentId = parent->data(0, Qt::UserRole).toInt();
-        int depth = newPath.count('.') + 1;
+    QSet<int> removedCategories;
+    for (const TreeChange &change : changes) {
+        if (change.removed && change.isCategory) removedCategories.insert(change.itemId);
+    }
+
+    // Сначала дети переходят к новому родителю, затем удаляются верхние из удалённых элементов
+    QHash<QTreeWidgetItem *, int> positions;
+    QSet<QTreeWidgetItem *> parents;
+    QSet<QTreeWidgetItem *> unpacked;   // Категории, содержимое которых перенесено к другому родителю
+    for (const TreeChange &change : changes) {
+        QTreeWidgetItem *item = itemFor(change);
+        if (change.removed || !item) continue;   // Шаблон может быть скрыт фильтром
+
+        QTreeWidgetItem *parent = change.parentId == 0 ? nullptr : categoryItems.value(change.parentId);
+        if (item->parent() != parent) {
+            if (item->parent()) {
+                unpacked.insert(item->parent());
+                item->parent()->removeChild(item);
+            } else {
+                categoryTreeWidget->takeTopLevelItem(categoryTreeWidget->indexOfTopLevelItem(item));
+            }
+            if (parent) {
+                parent->addChild(item);
+            } else {
+                categoryTreeWidget->addTopLevelItem(item);
+            }
+            treeFilterIndex.moveNode(item->data(1, Qt::UserRole).toInt(),
+                                     parent ? parent->data(1, Qt::UserRole).toInt() : -1);
+        }
+        positions.insert(item, change.position);
+        parents.insert(parent);
+    }
 
-        dbHandler->updateNumerationDB(itemId, parentId, newPath, depth);
+    for (const TreeChange &change : changes) {
+        if (!change.removed) continue;
+        if (!change.isCategory) {
+            // Шаблоны удалённой категории удаляются вместе с ней
+            QTreeWidgetItem *item = templateItems.take(change.itemId);
+            QTreeWidgetItem *parent = item ? item->parent() : nullptr;
+            if (item && !(parent && removedCategories.contains(parent->data(0, Qt::UserRole).toInt()))) {
+                removeTreeFilterNodes(item);
+                delete item;
+            }
+            continue;
+        }
+        QTreeWidgetItem *item = categoryItems.value(change.itemId);
+        QTreeWidgetItem *parent = item ? item->parent() : nullptr;
+        if (!item || (parent && removedCategories.contains(parent->data(0, Qt::UserRole).toInt()))) {
+            continue;
+        }
+
+        // Удалённое вместе с категорией содержимое вычитается из сводок предков;
+        // при распаковке содержимое осталось у того же родителя
+        if (!unpacked.contains(item)) {
+            const int templateCount = item->data(2, Qt::UserRole).toInt();
+            const int approvedCount = item->data(2, Qt::UserRole + 1).toInt();
+            const qint64 cellCount = item->data(2, Qt::UserRole + 2).toLongLong();
+            for (QTreeWidgetItem *ancestor = parent; ancestor; ancestor = ancestor->parent()) {
+                setCategoryProgress(ancestor, ancestor->data(2, Qt::UserRole).toInt() - templateCount,
+                                    ancestor->data(2, Qt::UserRole + 1).toInt() - approvedCount,
+                                    ancestor->data(2, Qt::UserRole + 2).toLongLong() - cellCount);
+            }
+        }
+        removeTreeFilterNodes(item);
+        delete item;
+    }
+
+    // Дети затронутых родителей упорядочиваются по новым позициям, номера пересчитываются по ветке
+    std::function<void(QTreeWidgetItem *)> renumberChildren = [&](QTreeWidgetItem *parent) {
+        const QString prefix = parent ? parent->text(0) + "." : QString();
+        const int count = parent ? parent->childCount() : categoryTreeWidget->topLevelItemCount();
+        for (int i = 0; i < count; ++i) {
+            QTreeWidgetItem *child = parent ? parent->child(i) : categoryTreeWidget->topLevelItem(i);
+            const QString position = positions.contains(child) ? QString::number(positions.value(child))
+                                                               : child->text(0).section('.', -1);
+            if (child->text(0) != prefix + position) {
+                child->setText(0, prefix + position);
+                updateTreeFilterNode(child);
+            }
+            renumberChildren(child);
+        }
+    };
+    for (QTreeWidgetItem *parent : parents) {
+        QList<QTreeWidgetItem *> children = parent ? parent->takeChildren() : QList<QTreeWidgetItem *>();
+        if (!parent) {
+            while (categoryTreeWidget->topLevelItemCount() > 0) {
+                children.append(categoryTreeWidget->takeTopLevelItem(0));
+            }
+        }
+        // Непереставленные элементы сохраняют позицию из своего номера
+        auto positionOf = [&positions](QTreeWidgetItem *item) {
+            return positions.contains(item) ? positions.value(item) : item->text(0).section('.', -1).toInt();
+        };
+        std::stable_sort(children.begin(), children.end(), [&positionOf](QTreeWidgetItem *a, QTreeWidgetItem *b) {
+            return positionOf(a) < positionOf(b);
+        });
+        if (parent) {
+            parent->addChildren(children);
+        } else {
+            categoryTreeWidget->addTopLevelItems(children);
+        }
+        renumberChildren(parent);
+    }
 
-        numberChildItems(child, newPath);  // Рекурсивный вызов
+    // Индекс фильтра поправлен по ходу: переносы, номера и удалённые узлы
+    for (QTreeWidgetItem *item : treeFilterItems) {
+        if (item && expanded.contains(item)) item->setExpanded(true);
     }
+    applyTreeFilter(treeFilterField->text());
 }
 
 //
 void MainWindow::showContextMenu(const QPoint &pos)
 {
+    if (readOnlyMode) return;
+
     QTreeWidgetItem* selectedItem = categoryTreeWidget->itemAt(pos);
     QMenu contextMenu(this);
 
@@ -407,8 +1678,31 @@ void MainWindow::showContextMenu(const QPoint &pos)
                 createCategoryOrTemplate(false);
             });
             contextMenu.addAction("Удалить категорию", this, &MainWindow::deleteCategoryOrTemplate);
+            contextMenu.addSeparator();
+            contextMenu.addAction("Утвердить все шаблоны", this, [this]() {
+                setApprovedForSelectedCategory(true);
+            });
+            contextMenu.addAction("Снять утверждение со всех шаблонов", this, [this]() {
+                setApprovedForSelectedCategory(false);
+            });
         } else {
             contextMenu.addAction("Удалить шаблон", this, &MainWindow::deleteCategoryOrTemplate);
+            contextMenu.addSeparator();
+
+            const int templateId = selectedItem->data(0, Qt::UserRole).toInt();
+            const QString name = selectedItem->text(1);
+            contextMenu.addAction("Выбрать для сравнения", this, [this, templateId, name]() {
+                comparisonTemplateId = templateId;
+                comparisonTemplateName = name;
+            });
+            if (comparisonTemplateId > 0 && comparisonTemplateId != templateId) {
+                contextMenu.addAction(QString("Сравнить с «%1»").arg(comparisonTemplateName), this, [this, templateId, name]() {
+                    compareTemplates(comparisonTemplateId, comparisonTemplateName, templateId, name);
+                });
+            }
+            contextMenu.addAction("Сравнить с предыдущей ревизией", this, [this, templateId, name]() {
+                compareWithPreviousRevision(templateId, name);
+            });
         }
     } else {
         // Клик вне элементов - добавляем корневую категорию
@@ -421,6 +1715,7 @@ void MainWindow::showContextMenu(const QPoint &pos)
 }
 
 void MainWindow::createCategoryOrTemplate(bool isCategory) {
+    OperationScope scope("Создание элемента");
     QString title = isCategory ? "Создать категорию" : "Создать шаблон";
     QString prompt = isCategory ? "Введите название категории:" : "Введите название шаблона:";
     QString name = QInputDialog::getText(this, title, prompt);
@@ -439,10 +1734,12 @@ void MainWindow::createCategoryOrTemplate(bool isCategory) {
     }
 
     bool success = false;
+    int newId = 0;
+    int position = 0;
     if (isCategory) {
-        success = dbHandler->getCategoryManager()->createCategory(name, parentId, projectId);
+        success = dbHandler->getCategoryManager()->createCategory(name, parentId, projectId, &newId, &position);
     } else {
-        success = dbHandler->getTemplateManager()->createTemplate(parentId, name);
+        success = dbHandler->getTemplateManager()->createTemplate(parentId, name, &newId, &position);
     }
 
     if (!success) {
@@ -450,11 +1747,37 @@ void MainWindow::createCategoryOrTemplate(bool isCategory) {
         return;
     }
 
-    loadCategoriesAndTemplates(); // Обновляем дерево категорий и шаблонов
+    if (isCategory) {
+        refreshReplicaItems({newId}, {});
+    } else {
+        refreshReplicaItems({}, {newId});
+    }
+
+    // Новый элемент получает последнюю позицию в ряду родителя и добавляется в конец ветки
+    QTreeWidgetItem *item = parentItem ? new QTreeWidgetItem(parentItem) : new QTreeWidgetItem(categoryTreeWidget);
+    item->setText(0, parentItem ? parentItem->text(0) + "." + QString::number(position) : QString::number(position));
+    item->setText(1, name);
+    item->setData(0, Qt::UserRole, QVariant::fromValue(newId));
+    item->setData(0, Qt::UserRole + 1, isCategory);
+    if (isCategory) {
+        setCategoryProgress(item, 0, 0, 0);
+    } else {
+        item->setData(0, Qt::UserRole + 2, false);
+        item->setForeground(1, QBrush(Qt::red));
+        templateItems.insert(newId, item);
+        for (QTreeWidgetItem *ancestor = parentItem; ancestor; ancestor = ancestor->parent()) {
+            setCategoryProgress(ancestor, ancestor->data(2, Qt::UserRole).toInt() + 1,
+                                ancestor->data(2, Qt::UserRole + 1).toInt(),
+                                ancestor->data(2, Qt::UserRole + 2).toLongLong());
+        }
+    }
+    addTreeFilterNode(item);
+    applyTreeFilter(treeFilterField->text());
 }
 
 void MainWindow::deleteCategoryOrTemplate()
 {
+    OperationScope scope("Удаление элемента");
     QTreeWidgetItem* selectedItem = categoryTreeWidget->currentItem();
     if (!selectedItem) return;
 
@@ -478,32 +1801,29 @@ void MainWindow::deleteCategoryOrTemplate()
         if (msgBox.clickedButton() == cancelButton) {
             return;
         }
-        else if (msgBox.clickedButton() == deleteButton) {
-            // Удаляем вместе с дочерними (в БД)
-            dbHandler->getCategoryManager()->deleteCategory(itemId, /*deleteChildren=*/true);
-            // Обновляем дерево
-            loadCategoriesAndTemplates();
-        }
-        else if (msgBox.clickedButton() == unpackButton) {
-            // "Распаковать" = перенести всех детей на верхний уровень (parent_id=NULL)
-            // 1) В БД: для каждого дочернего category/template делаем update parent_id = NULL
-            // 2) В дереве: переносим их как top-level
-            while (selectedItem->childCount() > 0) {
-                QTreeWidgetItem* child = selectedItem->takeChild(0);
-                int childId = child->data(0, Qt::UserRole).toInt();
-                bool childIsCategory = child->data(0, Qt::UserRole + 1).toBool();
-
-                if (childIsCategory) {
-                    dbHandler->updateParentId(childId, /*newParent=*/-1);
-                } else {
-                    dbHandler->updateParentId(childId, /*newParent=*/-1);
-                }
-                // Перенести в дерево как top-level
-                categoryTreeWidget->addTopLevelItem(child);
+        else if (msgBox.clickedButton() == deleteButton || msgBox.clickedButton() == unpackButton) {
+            // Удаление поддерева или перенос детей к родителю на место категории выполняет
+            // серверная функция; она же нумерует соседей и возвращает затронутые элементы.
+            // Для отмены сохраняются строки поддерева (или одной категории) и прежние положения
+            const bool deleteAll = msgBox.clickedButton() == deleteButton;
+            CategoryManager *categories = dbHandler->getCategoryManager();
+            QVector<TreeChange> changes;
+            bool ok = editStructure(deleteAll ? "Удаление категории" : "Распаковка категории",
+                                    [this, itemId, deleteAll](QVector<RemovedRows> &rows) {
+                return dbHandler->getEditJournal()->captureCategory(itemId, deleteAll, rows);
+            }, [categories, itemId, deleteAll, &changes]() {
+                return categories->deleteCategory(itemId, deleteAll, &changes);
+            }, [categories, itemId, deleteAll]() {
+                return categories->deleteCategory(itemId, deleteAll);
+            });
+            if (!ok) {
+                QMessageBox::warning(this, "Ошибка", deleteAll ? "Не удалось удалить категорию."
+                                                               : "Не удалось распаковать категорию.");
+                return;
             }
-            // Теперь удаляем саму категорию без детей
-            dbHandler->getCategoryManager()->deleteCategory(itemId, /*deleteChildren=*/false);
-            loadCategoriesAndTemplates();
+
+            refreshReplicaItems(changes);
+            applyTreeChanges(changes);
         }
     }
     else {
@@ -515,12 +1835,38 @@ void MainWindow::deleteCategoryOrTemplate()
             QMessageBox::Yes | QMessageBox::No
             );
         if (reply == QMessageBox::Yes) {
-            bool ok = dbHandler->getTemplateManager()->deleteTemplate(itemId);
+            // Сервер удаляет шаблон и нумерует только его соседей, дерево правится по результату
+            CategoryManager *categories = dbHandler->getCategoryManager();
+            QVector<TreeChange> changes;
+            bool ok = editStructure("Удаление шаблона", [this, itemId](QVector<RemovedRows> &rows) {
+                return dbHandler->getEditJournal()->captureTemplate(itemId, rows);
+            }, [categories, itemId, &changes]() {
+                return categories->deleteTemplate(itemId, &changes);
+            }, [categories, itemId]() {
+                return categories->deleteTemplate(itemId);
+            });
             if (!ok) {
                 QMessageBox::warning(this, "Ошибка",
                                      "Не удалось удалить шаблон из базы данных!");
+                return;
             }
-            loadCategoriesAndTemplates();
+
+            // Агрегаты предков пересчитаны триггерами; читаются только их строки
+            QVector<int> ancestorIds;
+            QHash<int, QTreeWidgetItem *> ancestors;
+            for (QTreeWidgetItem *ancestor = selectedItem->parent(); ancestor; ancestor = ancestor->parent()) {
+                ancestorIds.append(ancestor->data(0, Qt::UserRole).toInt());
+                ancestors.insert(ancestorIds.last(), ancestor);
+            }
+            QVector<Category> stats;
+            if (categories->getCategoryStats(ancestorIds, stats)) {
+                for (const Category &category : stats) {
+                    setCategoryProgress(ancestors.value(category.categoryId), category.templateCount,
+                                        category.approvedCount, category.cellCount);
+                }
+            }
+            refreshReplicaItems(changes);
+            applyTreeChanges(changes);
         }
     }
 }
@@ -528,6 +1874,7 @@ void MainWindow::deleteCategoryOrTemplate()
 
 //
 void MainWindow::editHeader(int column) {
+    OperationScope scope("Изменение заголовка");
     if (column < 0 || !templateTableWidget) {
         qDebug() << "Некорректный столбец для редактирования.";
         return;
@@ -544,6 +1891,7 @@ void MainWindow::editHeader(int column) {
     // Получаем текущий заголовок столбца
     QTableWidgetItem *headerItem = templateTableWidget->horizontalHeaderItem(column);
     QString currentHeader = headerItem ? headerItem->text() : tr("Новый столбец");
+    const QString savedHeader = headerItem ? headerItem->text() : QString();
 
     // Открываем кастомный диалог для редактирования заголовка
     DialogEditName dialog(currentHeader, this);
@@ -560,16 +1908,18 @@ void MainWindow::editHeader(int column) {
             }
 
             // Сохраняем изменения в базе данных
-            if (!dbHandler->getTableManager()->updateColumnHeader(templateId, column, newHeader)) {
+            if (!tableStore()->updateColumnHeader(templateId, column, newHeader)) {
                 qDebug() << "Ошибка обновления заголовка столбца в базе данных.";
             } else {
                 qDebug() << "Заголовок столбца успешно обновлен в базе данных.";
+                undoStack->push(new HeaderCommand(this, templateId, column, savedHeader, newHeader));
             }
         }
     }
 }
 
 void MainWindow::addRowOrColumn(const QString &type) {
+    OperationScope scope("Добавление строки или столбца");
     // Проверка выбранного шаблона
     QList<QTreeWidgetItem *> selectedItems = categoryTreeWidget->selectedItems();
     if (selectedItems.isEmpty()) {
@@ -596,10 +1946,11 @@ void MainWindow::addRowOrColumn(const QString &type) {
     }
 
     // Добавление строки или столбца в базу данных
-    if (!dbHandler->getTableManager()->createRowOrColumn(templateId, type, header, newOrder)) {
+    if (!tableStore()->createRowOrColumn(templateId, type, header, newOrder)) {
         qDebug() << QString("Ошибка добавления %1 в базу данных.").arg(type);
         return;
     }
+    undoStack->push(new GridLineCommand(this, templateId, true, type, newOrder, header, {}));
 
     // Обновление интерфейса
     if (type == "row") {
@@ -621,6 +1972,7 @@ void MainWindow::addRowOrColumn(const QString &type) {
 }
 
 void MainWindow::deleteRowOrColumn(const QString &type) {
+    OperationScope scope("Удаление строки или столбца");
     int currentIndex = (type == "row") ? templateTableWidget->currentRow() : templateTableWidget->currentColumn();
     if (currentIndex < 0) {
         qDebug() << QString("Не выбран %1 для удаления.").arg(type == "row" ? "строка" : "столбец");
@@ -636,11 +1988,27 @@ void MainWindow::deleteRowOrColumn(const QString &type) {
 
     int templateId = selectedItems.first()->data(0, Qt::UserRole).toInt();
 
+    // Содержимое удаляемой линии для отмены берётся из сохранённой сетки
+    QHash<int, TemplateGrid> grids;
+    templateStore()->getGridsForTemplates({templateId}, grids);
+    const TemplateGrid grid = grids.value(templateId);
+    QString header;
+    QVector<QString> cells;
+    if (type == "row") {
+        cells = grid.cells.value(currentIndex);
+    } else {
+        header = grid.headers.value(currentIndex);
+        for (const QVector<QString> &row : grid.cells) {
+            cells.append(row.value(currentIndex));
+        }
+    }
+
     // Удаляем строку или столбец в базе данных
-    if (!dbHandler->getTableManager()->deleteRowOrColumn(templateId, currentIndex, type)) {
+    if (!tableStore()->deleteRowOrColumn(templateId, currentIndex, type)) {
         qDebug() << QString("Ошибка удаления %1 из базы данных.").arg(type == "row" ? "строки" : "столбца");
         return;
     }
+    undoStack->push(new GridLineCommand(this, templateId, false, type, currentIndex, header, cells));
 
     // Обновляем интерфейс
     if (type == "row") {
@@ -653,6 +2021,7 @@ void MainWindow::deleteRowOrColumn(const QString &type) {
 }
 
 void MainWindow::saveTableData() {
+    OperationScope scope("Сохранение шаблона");
     QList<QTreeWidgetItem *> selectedItems = categoryTreeWidget->selectedItems();
     if (selectedItems.isEmpty()) {
         qDebug() << "Нет выбранного шаблона.";
@@ -684,17 +2053,41 @@ void MainWindow::saveTableData() {
     QString notes = notesField->toPlainText();
     QString programmingNotes = notesProgrammingField->toPlainText();
 
+    // Прежнее состояние для журнала отмены
+    QHash<int, TemplateGrid> savedGrids;
+    templateStore()->getGridsForTemplates({templateId}, savedGrids);
+    const QStringList notesBefore = {templateStore()->getNotesForTemplate(templateId),
+                                     templateStore()->getProgrammingNotesForTemplate(templateId)};
+
+    // В локальной копии сетка и заметки сохраняются одной транзакцией SQLite
+    bool localTransaction = replica.isOpen() && replica.database().transaction();
+
     // Сохранение данных таблицы
-    if (!dbHandler->getTableManager()->saveDataTableTemplate(templateId, columnHeaders, tableData)) {
+    if (!tableStore()->saveDataTableTemplate(templateId, columnHeaders, tableData)) {
         qDebug() << "Ошибка сохранения данных таблицы.";
+        if (localTransaction) replica.database().rollback();
         return;
     }
 
     // Сохранение заметок и программных заметок
-    if (!dbHandler->getTemplateManager()->updateTemplate(templateId, std::nullopt, notes, programmingNotes)) {
+    if (!templateStore()->updateTemplate(templateId, std::nullopt, notes, programmingNotes)) {
         qDebug() << "Ошибка сохранения заметок.";
+        if (localTransaction) replica.database().rollback();
+        return;
+    }
+
+    if (localTransaction && !replica.database().commit()) {
+        qDebug() << "Ошибка сохранения в локальную копию:" << replica.database().lastError().text();
         return;
     }
 
     qDebug() << "Данные таблицы, заметки и программные заметки успешно сохранены.";
+
+    SaveGridCommand *command = new SaveGridCommand(this, templateId, savedGrids.value(templateId),
+                                                   {columnHeaders, tableData}, notesBefore, {notes, programmingNotes});
+    if (command->isEmpty()) {
+        delete command;
+    } else {
+        undoStack->push(command);
+    }
 }
@@ -2,6 +2,9 @@
 #define MAINWINDOW_H
 
 #include "databasehandler.h"
+#include "treefilterindex.h"
+#include "projectsnapshot.h"
+#include "localreplica.h"
 #include <QMainWindow>
 #include <QSqlDatabase>
 #include <QTreeWidget>
@@ -11,6 +14,19 @@
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QComboBox>
+#include <QCheckBox>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QHash>
+#include <QPointer>
+#include <QDialog>
+#include <functional>
+
+class DialogValidation;
+
+class QThread;
+class QUndoStack;
+class ReplicaSync;
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -23,19 +39,31 @@ public:
     // Настройка интерфейса
     void setupUI();
 
+    // Запуск: снимок проекта для чтения, затем подключение к БД
+    bool openSnapshotAtStartup();
+    void connectAndRefresh();
+    void finishConnecting(bool serverReady);
+    void setReadOnlyMode(bool readOnly);
+    void refreshSnapshot(int projectId);
+    static QString snapshotPath(int projectId);
+
     // Загрузка
     void loadProjects();
     void onProjectSelected(int index);
     void loadCategoriesAndTemplates();
-    void loadTableTemplate(int templateId);
+    // rowOrders/columnOrders - порядковые номера строк и столбцов загруженной сетки
+    void loadTableTemplate(int templateId, QVector<int> *rowOrders = nullptr, QVector<int> *columnOrders = nullptr);
     void loadCategoriesForCategory(const Category &category, QTreeWidgetItem *parentItem, const QString &parentPath);
     void loadCategoriesForProject(int projectId, QTreeWidgetItem *parentItem, const QString &parentPath);
     void loadTemplatesForCategory(int categoryId, QTreeWidgetItem *parentItem, const QString &parentPath);
+    void pruneEmptyCategory(QTreeWidgetItem *categoryItem);   // Удаляет ветку без шаблонов
+    void setCategoryProgress(QTreeWidgetItem *categoryItem, int templateCount, int approvedCount, qint64 cellCount);
 
     // Взаимодействия со списком ТЛГ
     void showContextMenu(const QPoint &pos);
     void createCategoryOrTemplate(bool isCategory);
     void deleteCategoryOrTemplate();
+    void setApprovedForSelectedCategory(bool approved);
 
     // Обработка кликов
     void onCategoryOrTemplateSelected(QTreeWidgetItem *item, int column);
@@ -43,11 +71,80 @@ public:
     void onCheckButtonClicked();
 
     // Функции для нумерации
-    void updateNumbering();
-    void numberChildItems(QTreeWidgetItem *parent, const QString &prefix);
-    void updateNumberingFromItem(QTreeWidgetItem *parentItem);
+    void updateNumbering(const QString &text = "Перенумерация");   // Порядок из дерева интерфейса
+    QVector<TreePlacement> treeLayout() const;
+    void applyTreeChanges(const QVector<TreeChange> &changes);  // Правка дерева без перезагрузки
     void dropEvent(QDropEvent *event);  // Переопределение перетаскивания
 
+    // Быстрый фильтр дерева
+    void rebuildTreeFilterIndex();
+    void updateTreeFilterNode(QTreeWidgetItem *item);
+    void addTreeFilterNode(QTreeWidgetItem *item);       // Новый элемент под уже проиндексированным родителем
+    void removeTreeFilterNodes(QTreeWidgetItem *item);   // Элемент вместе с поддеревом
+    void applyTreeFilter(const QString &text);
+
+    // Полнотекстовый поиск
+    void runSearch();
+    void onSearchResultActivated(QListWidgetItem *item);
+    void openTemplateAtCell(int templateId, int rowOrder, int columnOrder);
+
+    // Импорт CSV/TSV в фоновом потоке
+    void importCsv(bool directory);
+
+    // Пакетный экспорт проекта в RTF/HTML
+    void exportProject();
+
+    // Перенос проекта в формате JSON Lines
+    void exportProjectJsonl();
+    void importProjectJsonl();
+
+    // Выполнение операции с БД в пуле потоков на отдельном соединении
+    void runInBackground(const QString &title,
+                         const std::function<bool(QSqlDatabase &)> &job,
+                         const std::function<void(bool)> &done);
+
+    // Поиск и замена на сервере
+    void openFindReplaceDialog();
+
+    // Сравнение сеток бок о бок
+    void compareTemplates(int leftTemplateId, const QString &leftTitle, int rightTemplateId, const QString &rightTitle);
+    void compareWithPreviousRevision(int templateId, const QString &name);
+
+    // Проверка целостности проекта и пакетное исправление найденного
+    void validateProject();
+    void fixProject(int projectId);
+    void compactNumbering();                // Сплошная нумерация проекта на сервере
+
+    // Статистика запросов по операциям и медленные запросы
+    void openDiagnostics();
+    void setTracingEnabled(bool enabled);   // Запись интервалов в Chrome trace JSON
+    void traceTablePaint();                 // Отрисовка таблицы внутри интервала трассировки
+
+    // Локальная реплика проекта (SQLite) с фоновой синхронизацией
+    bool openLocalReplica(int projectId, bool online);
+    void closeLocalReplica();
+    void refreshReplicaStructure();         // Полное перечитывание структуры (импорт, замена)
+    void refreshReplicaItems(const QSet<int> &categoryIds, const QSet<int> &templateIds);
+    void refreshReplicaItems(const QVector<TreeChange> &changes);
+    void onReplicaConflict(int templateId);
+
+    // Источники данных: локальная реплика, если она открыта, иначе сервер
+    CategoryManager *categoryStore();
+    TemplateManager *templateStore();
+    TableManager *tableStore();
+
+    // Журнал отмены: соединения, на которых выполняются команды, и обновление интерфейса
+    QSqlDatabase serverDatabase() const;
+    QSqlDatabase editDatabase();            // Локальная копия, если открыта, иначе сервер
+    DatabaseHandler *databaseHandler() const;
+    int currentTemplateId() const;          // 0, если шаблон не выбран
+    void reloadTree();
+    void renameTreeItem(int itemId, bool isCategory, const QString &name);
+    bool editStructure(const QString &text,
+                       const std::function<bool(QVector<RemovedRows> &)> &capture,
+                       const std::function<bool()> &edit,
+                       const std::function<bool()> &removal);
+
     // Взаимодействия с таблицей
     void editHeader(int column);
     void addRowOrColumn(const QString &type);
@@ -62,7 +159,28 @@ private:
     DatabaseHandler *dbHandler; // Обработчик базы данных
 
     QComboBox *projectComboBox;         // Выбор проекта
+    QCheckBox *unapprovedFilterCheckBox; // Фильтр: только неутвержденные шаблоны
+    ProjectSnapshot snapshot;           // Снимок проекта, открытый при запуске
+    bool readOnlyMode = false;          // Данные берутся из снимка, изменения запрещены
+    QVector<Category> loadedCategories; // Категории загружаемого проекта
+    QHash<int, QVector<Template>> loadedTemplates; // Шаблоны загружаемого проекта по категориям
+    LocalReplica replica;               // Локальная копия выбранного проекта
+    QThread *syncThread = nullptr;      // Поток фоновой синхронизации реплики
+    ReplicaSync *replicaSync = nullptr;
+    QAction *localReplicaAction;        // Включение работы через локальную копию
+    QPointer<QDialog> diagnosticsDialog; // Окно диагностики запросов
+    QPointer<DialogValidation> validationDialog;
+    int comparisonTemplateId = 0;       // Шаблон, выбранный для сравнения
+    QUndoStack *undoStack;              // Отмена и повтор изменений дерева и таблиц
+    QString comparisonTemplateName;
+
     QTreeWidget *categoryTreeWidget;    // Иерархический вид категорий и шаблонов
+    QHash<int, QTreeWidgetItem*> templateItems; // Элементы шаблонов в дереве по ID
+    QLineEdit *treeFilterField;         // Фильтр дерева по названию и нумерации
+    TreeFilterIndex treeFilterIndex;    // Триграммный индекс элементов дерева
+    QVector<QTreeWidgetItem*> treeFilterItems; // Элементы дерева по номеру узла индекса
+    QLineEdit *searchField;             // Строка полнотекстового поиска
+    QListWidget *searchResultsList;     // Результаты поиска
     QTableWidget *templateTableWidget;  // Таблица данных
     QTextEdit *notesField;              // Поле для заметок
     QTextEdit *notesProgrammingField;   // Поле для программных заметок
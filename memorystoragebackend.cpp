@@ -0,0 +1,399 @@
+#include "memorystoragebackend.h"
+#include <QDebug>
+#include <QPair>
+#include <algorithm>
+#include <tuple>
+
+QString MemoryStorageBackend::backendName() const {
+    return "memory";
+}
+
+bool MemoryStorageBackend::createProject(const QString &name, int *newProjectId) {
+    int projectId = nextProjectId++;
+    projects.insert(projectId, name);
+    if (newProjectId) *newProjectId = projectId;
+    return true;
+}
+
+bool MemoryStorageBackend::deleteProject(int projectId) {
+    if (!projects.remove(projectId)) return false;
+
+    for (auto it = templates.begin(); it != templates.end();) {
+        if (it->projectId == projectId) {
+            categoryTemplates.remove(it->info.categoryId);
+            it = templates.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = categories.begin(); it != categories.end();) {
+        it = it->projectId == projectId ? categories.erase(it) : std::next(it);
+    }
+    return true;
+}
+
+QVector<Project> MemoryStorageBackend::getProjects() {
+    QVector<Project> result;
+    for (auto it = projects.constBegin(); it != projects.constEnd(); ++it) {
+        result.append({it.key(), it.value()});
+    }
+    return result;
+}
+
+bool MemoryStorageBackend::createCategory(const QString &name, int parentId, int projectId, int *newCategoryId) {
+    int depth = 1;     // Корневые категории имеют глубину 1, как в БД
+    if (parentId != -1) {
+        auto parent = categories.constFind(parentId);
+        if (parent == categories.constEnd()) {
+            qDebug() << "Ошибка получения глубины родительской категории:" << parentId;
+            return false;
+        }
+        depth = parent->depth + 1;
+    }
+
+    // Корневые категории хранятся с parentId = 0, как NULL при чтении из БД
+    const int storedParentId = parentId == -1 ? 0 : parentId;
+    // Подкатегории и шаблоны одного родителя нумеруются общим рядом
+    int position = 0;
+    for (const Category &category : categories) {
+        if (category.projectId == projectId && category.parentId == storedParentId) {
+            position = qMax(position, category.position);
+        }
+    }
+    for (int templateId : categoryTemplates.value(storedParentId)) {
+        position = qMax(position, templates[templateId].info.position);
+    }
+
+    Category category;
+    category.categoryId = nextCategoryId++;
+    category.name = name;
+    category.parentId = storedParentId;
+    category.position = position + 1;
+    category.depth = depth;
+    category.projectId = projectId;
+    category.templateCount = 0;
+    category.approvedCount = 0;
+    category.cellCount = 0;
+    categories.insert(category.categoryId, category);
+
+    if (newCategoryId) *newCategoryId = category.categoryId;
+    return true;
+}
+
+bool MemoryStorageBackend::updateCategory(int categoryId, const QString &newName) {
+    auto it = categories.find(categoryId);
+    if (it == categories.end()) return false;
+    it->name = newName;
+    return true;
+}
+
+QVector<int> MemoryStorageBackend::subtree(int categoryId) const {
+    QHash<int, QVector<int>> children;
+    for (const Category &category : categories) {
+        children[category.parentId].append(category.categoryId);
+    }
+
+    QVector<int> result = {categoryId};
+    for (int i = 0; i < result.size(); ++i) {
+        result += children.value(result[i]);
+    }
+    return result;
+}
+
+void MemoryStorageBackend::moveTemplate(int templateId, int categoryId) {
+    StoredTemplate &stored = templates[templateId];
+    categoryTemplates[stored.info.categoryId].removeOne(templateId);
+    stored.info.categoryId = categoryId;
+    categoryTemplates[categoryId].append(templateId);
+}
+
+void MemoryStorageBackend::renumberChildren(int projectId, int parentId, int unpackedId) {
+    struct Sibling {
+        bool isCategory;
+        int itemId;
+        int base;       // Положение в ряду родителя (у детей распакованной категории - её положение)
+        int sub;        // Положение внутри распакованной категории
+    };
+
+    const int unpackedPosition = categories.value(unpackedId).position;
+    QVector<Sibling> siblings;
+    for (const Category &category : categories) {
+        if (category.projectId == projectId && category.parentId == parentId && category.categoryId != unpackedId) {
+            siblings.append({true, category.categoryId, category.position, 0});
+        } else if (unpackedId != 0 && category.parentId == unpackedId) {
+            siblings.append({true, category.categoryId, unpackedPosition, category.position});
+        }
+    }
+    if (parentId != 0) {
+        for (int templateId : categoryTemplates.value(parentId)) {
+            siblings.append({false, templateId, templates[templateId].info.position, 0});
+        }
+    }
+    if (unpackedId != 0) {
+        for (int templateId : categoryTemplates.value(unpackedId)) {
+            siblings.append({false, templateId, unpackedPosition, templates[templateId].info.position});
+        }
+    }
+
+    // Порядок как в БД: сначала подкатегории, затем шаблоны
+    std::sort(siblings.begin(), siblings.end(), [](const Sibling &a, const Sibling &b) {
+        return std::make_tuple(!a.isCategory, a.base, a.sub, a.itemId) <
+               std::make_tuple(!b.isCategory, b.base, b.sub, b.itemId);
+    });
+
+    for (int i = 0; i < siblings.size(); ++i) {
+        if (siblings[i].isCategory) {
+            Category &category = categories[siblings[i].itemId];
+            category.parentId = parentId;
+            category.position = i + 1;
+        } else {
+            if (templates[siblings[i].itemId].info.categoryId != parentId) moveTemplate(siblings[i].itemId, parentId);
+            templates[siblings[i].itemId].info.position = i + 1;
+        }
+    }
+}
+
+bool MemoryStorageBackend::deleteCategory(int categoryId, bool deleteAll) {
+    auto it = categories.constFind(categoryId);
+    if (it == categories.constEnd()) return false;
+    const int parentId = it->parentId;
+    const int projectId = it->projectId;
+
+    if (deleteAll) {
+        for (int id : subtree(categoryId)) {
+            for (int templateId : categoryTemplates.take(id)) {
+                templates.remove(templateId);
+            }
+            categories.remove(id);
+        }
+        renumberChildren(projectId, parentId);
+        return true;
+    }
+
+    // Шаблоны корневой категории перенести некуда: на верхнем уровне только категории
+    if (parentId == 0 && !categoryTemplates.value(categoryId).isEmpty()) {
+        qDebug() << "Нельзя распаковать корневую категорию с шаблонами:" << categoryId;
+        return false;
+    }
+
+    // Глубина поддеревьев считается от родителя заново; subtree() перечисляет
+    // категории по уровням, поэтому родитель каждой уже пересчитан
+    const int parentDepth = parentId == 0 ? 0 : categories.value(parentId).depth;
+    for (int id : subtree(categoryId).mid(1)) {
+        Category &category = categories[id];
+        category.depth = (category.parentId == categoryId ? parentDepth : categories.value(category.parentId).depth) + 1;
+    }
+
+    // Содержимое переходит к родителю на место категории
+    renumberChildren(projectId, parentId, categoryId);
+    categoryTemplates.remove(categoryId);
+    categories.remove(categoryId);
+    return true;
+}
+
+QVector<Category> MemoryStorageBackend::getCategoriesByProject(int projectId) {
+    QVector<Category> result;
+    QHash<int, int> indexById;
+    for (const Category &category : categories) {
+        if (category.projectId != projectId) continue;
+        Category copy = category;
+        copy.templateCount = 0;
+        copy.approvedCount = 0;
+        copy.cellCount = 0;
+        indexById.insert(copy.categoryId, result.size());
+        result.append(copy);
+    }
+
+    // Итоги шаблонов категории добавляются ей и всем её предкам
+    for (auto it = categoryTemplates.constBegin(); it != categoryTemplates.constEnd(); ++it) {
+        int templateCount = 0;
+        int approvedCount = 0;
+        qint64 cellCount = 0;
+        for (int templateId : it.value()) {
+            const StoredTemplate &stored = templates[templateId];
+            ++templateCount;
+            approvedCount += stored.info.isApproved ? 1 : 0;
+            for (const QVector<QString> &row : stored.grid.cells) cellCount += row.size();
+        }
+        for (int id = it.key(); indexById.contains(id);) {
+            Category &category = result[indexById[id]];
+            category.templateCount += templateCount;
+            category.approvedCount += approvedCount;
+            category.cellCount += cellCount;
+            if (category.parentId == id) break;
+            id = category.parentId;
+        }
+    }
+
+    std::stable_sort(result.begin(), result.end(), [](const Category &a, const Category &b) {
+        return a.position < b.position;
+    });
+    return result;
+}
+
+bool MemoryStorageBackend::updateNumeration(int itemId, int parentId, const QString &numeration, int depth) {
+    int position = numeration.split(".").last().toInt();
+
+    // Как и в БД, идентификатор сначала ищется среди категорий
+    auto category = categories.find(itemId);
+    if (category != categories.end()) {
+        category->position = position;
+        category->depth = depth;
+        category->parentId = parentId == -1 ? 0 : parentId;
+        return true;
+    }
+
+    auto stored = templates.find(itemId);
+    if (stored == templates.end()) return false;
+    stored->info.position = position;
+    return true;
+}
+
+bool MemoryStorageBackend::renumberProject(int projectId) {
+    QHash<int, QVector<QPair<int, bool>>> children;     // Ряды детей по родителю: элемент и признак категории
+    for (const Category &category : categories) {
+        if (category.projectId == projectId) children[category.parentId].append({category.categoryId, true});
+    }
+    for (auto it = categoryTemplates.constBegin(); it != categoryTemplates.constEnd(); ++it) {
+        if (it.key() == 0 || !categories.contains(it.key()) || categories[it.key()].projectId != projectId) continue;
+        for (int templateId : it.value()) children[it.key()].append({templateId, false});
+    }
+
+    // Обход от верхнего уровня; порядок как в БД: сначала подкатегории, затем шаблоны
+    auto positionOf = [this](const QPair<int, bool> &item) {
+        return item.second ? categories[item.first].position : templates[item.first].info.position;
+    };
+    QVector<QPair<int, int>> parents = {{0, 0}};
+    for (int i = 0; i < parents.size(); ++i) {
+        QVector<QPair<int, bool>> &siblings = children[parents[i].first];
+        std::sort(siblings.begin(), siblings.end(), [&positionOf](const QPair<int, bool> &a, const QPair<int, bool> &b) {
+            return std::make_tuple(!a.second, positionOf(a), a.first) < std::make_tuple(!b.second, positionOf(b), b.first);
+        });
+        for (int j = 0; j < siblings.size(); ++j) {
+            if (siblings[j].second) {
+                Category &category = categories[siblings[j].first];
+                category.position = j + 1;
+                category.depth = parents[i].second + 1;
+                parents.append({category.categoryId, category.depth});
+            } else {
+                templates[siblings[j].first].info.position = j + 1;
+            }
+        }
+    }
+    return true;
+}
+
+bool MemoryStorageBackend::createTemplate(int categoryId, const QString &templateName, int *newTemplateId) {
+    auto category = categories.constFind(categoryId);
+    if (category == categories.constEnd()) {
+        qDebug() << "Ошибка: категория с ID" << categoryId << "не существует.";
+        return false;
+    }
+
+    int position = 0;
+    for (int templateId : categoryTemplates.value(categoryId)) {
+        position = qMax(position, templates[templateId].info.position);
+    }
+    for (const Category &child : categories) {
+        if (child.parentId == categoryId) position = qMax(position, child.position);
+    }
+
+    StoredTemplate stored;
+    stored.info = {nextTemplateId++, templateName, QString(), QString(), position + 1, categoryId, false};
+    stored.projectId = category->projectId;
+    templates.insert(stored.info.templateId, stored);
+    categoryTemplates[categoryId].append(stored.info.templateId);
+
+    if (newTemplateId) *newTemplateId = stored.info.templateId;
+    return true;
+}
+
+bool MemoryStorageBackend::updateTemplate(int templateId,
+                                          const std::optional<QString> &name,
+                                          const std::optional<QString> &notes,
+                                          const std::optional<QString> &programmingNotes) {
+    auto it = templates.find(templateId);
+    if (it == templates.end()) return false;
+    if (name) it->info.name = *name;
+    if (notes) it->info.notes = *notes;
+    if (programmingNotes) it->info.programmingNotes = *programmingNotes;
+    return true;
+}
+
+bool MemoryStorageBackend::deleteTemplate(int templateId) {
+    auto it = templates.find(templateId);
+    if (it == templates.end()) return false;
+    categoryTemplates[it->info.categoryId].removeOne(templateId);
+    templates.erase(it);
+    return true;
+}
+
+bool MemoryStorageBackend::setTemplateApproved(int templateId, bool approved) {
+    auto it = templates.find(templateId);
+    if (it == templates.end()) return false;
+    it->info.isApproved = approved;
+    return true;
+}
+
+QVector<Template> MemoryStorageBackend::getTemplatesForCategory(int categoryId, bool onlyUnapproved) {
+    QVector<Template> result;
+    for (int templateId : categoryTemplates.value(categoryId)) {
+        const Template &info = templates[templateId].info;
+        if (!onlyUnapproved || !info.isApproved) result.append(info);
+    }
+    std::stable_sort(result.begin(), result.end(), [](const Template &a, const Template &b) {
+        return a.position < b.position;
+    });
+    return result;
+}
+
+bool MemoryStorageBackend::getTemplateGrid(int templateId, TemplateGrid &grid) {
+    auto it = templates.constFind(templateId);
+    if (it == templates.constEnd()) return false;
+    grid = it->grid;
+    return true;
+}
+
+bool MemoryStorageBackend::saveTemplateGrid(int templateId, const TemplateGrid &grid) {
+    auto it = templates.find(templateId);
+    if (it == templates.end()) return false;
+    it->grid = grid;
+    strings.intern(it->grid);
+    return true;
+}
+
+QVector<SearchResult> MemoryStorageBackend::search(int projectId, const QString &text, int limit) {
+    QVector<SearchResult> results;
+    const QString needle = text.trimmed();
+    if (needle.isEmpty()) return results;
+
+    // Фрагмент вокруг первого совпадения с выделением, как у ts_headline
+    auto snippet = [&needle](const QString &content, int at) {
+        int from = qMax(0, at - 40);
+        return content.mid(from, at - from).toHtmlEscaped() + "<b>" +
+               content.mid(at, needle.size()).toHtmlEscaped() + "</b>" +
+               content.mid(at + needle.size(), 40).toHtmlEscaped();
+    };
+
+    for (const StoredTemplate &stored : templates) {
+        if (stored.projectId != projectId) continue;
+
+        const QString header = stored.info.name + ' ' + stored.info.notes + ' ' + stored.info.programmingNotes;
+        int at = header.indexOf(needle, 0, Qt::CaseInsensitive);
+        if (at >= 0) {
+            results.append({stored.info.templateId, stored.info.name, -1, -1, 1.0, snippet(header, at)});
+            if (results.size() >= limit) return results;
+        }
+
+        for (int row = 0; row < stored.grid.cells.size(); ++row) {
+            for (int column = 0; column < stored.grid.cells[row].size(); ++column) {
+                const QString &content = stored.grid.cells[row][column];
+                at = content.indexOf(needle, 0, Qt::CaseInsensitive);
+                if (at < 0) continue;
+                results.append({stored.info.templateId, stored.info.name, row, column, 1.0, snippet(content, at)});
+                if (results.size() >= limit) return results;
+            }
+        }
+    }
+    return results;
+}
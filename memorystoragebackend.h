@@ -0,0 +1,63 @@
+#ifndef MEMORYSTORAGEBACKEND_H
+#define MEMORYSTORAGEBACKEND_H
+
+#include <QHash>
+#include <QMap>
+#include "storagebackend.h"
+#include "stringpool.h"
+
+// Хранилище в памяти процесса без ввода-вывода.
+// Агрегаты категорий считаются при чтении дерева, поиск - по подстроке без учёта регистра.
+class MemoryStorageBackend : public StorageBackend {
+public:
+    QString backendName() const override;
+
+    bool createProject(const QString &name, int *newProjectId = nullptr) override;
+    bool deleteProject(int projectId) override;
+    QVector<Project> getProjects() override;
+
+    bool createCategory(const QString &name, int parentId, int projectId, int *newCategoryId = nullptr) override;
+    bool updateCategory(int categoryId, const QString &newName) override;
+    bool deleteCategory(int categoryId, bool deleteAll) override;
+    QVector<Category> getCategoriesByProject(int projectId) override;
+    bool updateNumeration(int itemId, int parentId, const QString &numeration, int depth) override;
+    bool renumberProject(int projectId) override;
+
+    bool createTemplate(int categoryId, const QString &templateName, int *newTemplateId = nullptr) override;
+    bool updateTemplate(int templateId,
+                        const std::optional<QString> &name,
+                        const std::optional<QString> &notes,
+                        const std::optional<QString> &programmingNotes) override;
+    bool deleteTemplate(int templateId) override;
+    bool setTemplateApproved(int templateId, bool approved) override;
+    QVector<Template> getTemplatesForCategory(int categoryId, bool onlyUnapproved = false) override;
+
+    bool getTemplateGrid(int templateId, TemplateGrid &grid) override;
+    bool saveTemplateGrid(int templateId, const TemplateGrid &grid) override;
+
+    QVector<SearchResult> search(int projectId, const QString &text, int limit = 100) override;
+
+private:
+    struct StoredTemplate {
+        Template info;
+        int projectId;
+        TemplateGrid grid;
+    };
+
+    QVector<int> subtree(int categoryId) const;     // Категория и все её потомки
+    void moveTemplate(int templateId, int categoryId);
+    // Сплошная нумерация детей родителя (0 - верхний уровень): сначала подкатегории, затем
+    // шаблоны; дети распакованной категории встают на её место и переходят к родителю
+    void renumberChildren(int projectId, int parentId, int unpackedId = 0);
+
+    QMap<int, QString> projects;
+    QHash<int, Category> categories;
+    QHash<int, StoredTemplate> templates;
+    QHash<int, QVector<int>> categoryTemplates;     // Шаблоны по категориям
+    StringPool strings;                             // Общие тексты сеток; не сокращается при удалении
+    int nextProjectId = 1;
+    int nextCategoryId = 1;
+    int nextTemplateId = 1;
+};
+
+#endif // MEMORYSTORAGEBACKEND_H
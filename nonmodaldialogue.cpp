@@ -1,4 +1,71 @@
 #include "nonmodaldialogue.h"
+#include "queryexecutor.h"
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QTimer>
+#include <QAbstractTableModel>
+#include <QScrollBar>
+#include <QBrush>
+#include <algorithm>
+
+namespace {
+
+// Одна сторона сравнения: строки и столбцы в порядке GridDiff, пустые места - серые
+class GridDiffModel : public QAbstractTableModel {
+public:
+    GridDiffModel(const TemplateGrid &grid, const GridDiff &diff, bool leftSide, QObject *parent)
+        : QAbstractTableModel(parent), grid(grid), diff(diff), leftSide(leftSide) {}
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override {
+        return parent.isValid() ? 0 : diff.rows.size();
+    }
+
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override {
+        return parent.isValid() ? 0 : diff.columns.size();
+    }
+
+    QVariant data(const QModelIndex &index, int role) const override {
+        const DiffLine &row = diff.rows[index.row()];
+        const DiffLine &column = diff.columns[index.column()];
+        const int gridRow = leftSide ? row.left : row.right;
+        const int gridColumn = leftSide ? column.left : column.right;
+
+        if (role == Qt::DisplayRole) {
+            if (gridRow < 0 || gridColumn < 0 || gridRow >= grid.cells.size()
+                || gridColumn >= grid.cells[gridRow].size()) {
+                return QVariant();
+            }
+            return grid.cells[gridRow][gridColumn];
+        }
+        if (role == Qt::BackgroundRole) {
+            if (gridRow < 0 || gridColumn < 0) return QBrush(QColor(235, 235, 235));
+            if (row.kind == DiffKind::Deleted || column.kind == DiffKind::Deleted) return QBrush(QColor(255, 205, 205));
+            if (row.kind == DiffKind::Inserted || column.kind == DiffKind::Inserted) return QBrush(QColor(205, 240, 205));
+            if (std::binary_search(row.changedColumns.begin(), row.changedColumns.end(), index.column())) {
+                return QBrush(QColor(255, 235, 160));
+            }
+            if (row.kind == DiffKind::Moved || column.kind == DiffKind::Moved) return QBrush(QColor(210, 225, 255));
+        }
+        return QVariant();
+    }
+
+    QVariant headerData(int section, Qt::Orientation orientation, int role) const override {
+        if (role != Qt::DisplayRole) return QVariant();
+        if (orientation == Qt::Vertical) {
+            const int gridRow = leftSide ? diff.rows[section].left : diff.rows[section].right;
+            return gridRow < 0 ? QVariant() : QVariant(gridRow + 1);
+        }
+        const int gridColumn = leftSide ? diff.columns[section].left : diff.columns[section].right;
+        return gridColumn < 0 || gridColumn >= grid.headers.size() ? QVariant() : QVariant(grid.headers[gridColumn]);
+    }
+
+private:
+    TemplateGrid grid;
+    const GridDiff &diff;
+    bool leftSide;
+};
+
+} // namespace
 
 DialogEditName::DialogEditName(const QString &currentName, QWidget *parent)
     : QDialog(parent) {
@@ -22,3 +89,285 @@ DialogEditName::DialogEditName(const QString &currentName, QWidget *parent)
 QString DialogEditName::getNewName() const {
     return nameEdit->text();
 }
+
+DialogFindReplace::DialogFindReplace(QWidget *parent)
+    : QDialog(parent) {
+    setWindowTitle(tr("Найти и заменить"));
+
+    findEdit = new QLineEdit(this);
+    findEdit->setPlaceholderText(tr("Найти"));
+    replaceEdit = new QLineEdit(this);
+    replaceEdit->setPlaceholderText(tr("Заменить на"));
+
+    regexCheckBox = new QCheckBox(tr("Регулярное выражение"), this);
+
+    scopeComboBox = new QComboBox(this);
+    scopeComboBox->addItems({tr("Весь проект"), tr("Выбранная категория"), tr("Выбранный шаблон")});
+
+    statusLabel = new QLabel(this);
+
+    previewButton = new QPushButton(tr("Подсчитать совпадения"), this);
+    replaceButton = new QPushButton(tr("Заменить все"), this);
+    closeButton = new QPushButton(tr("Закрыть"), this);
+
+    connect(previewButton, &QPushButton::clicked, this, &DialogFindReplace::previewRequested);
+    connect(replaceButton, &QPushButton::clicked, this, &DialogFindReplace::replaceRequested);
+    connect(closeButton, &QPushButton::clicked, this, &DialogFindReplace::reject);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(findEdit);
+    layout->addWidget(replaceEdit);
+    layout->addWidget(regexCheckBox);
+    layout->addWidget(scopeComboBox);
+    layout->addWidget(statusLabel);
+    layout->addWidget(previewButton);
+    layout->addWidget(replaceButton);
+    layout->addWidget(closeButton);
+}
+
+QString DialogFindReplace::findText() const {
+    return findEdit->text();
+}
+
+QString DialogFindReplace::replaceText() const {
+    return replaceEdit->text();
+}
+
+bool DialogFindReplace::useRegex() const {
+    return regexCheckBox->isChecked();
+}
+
+int DialogFindReplace::scopeIndex() const {
+    return scopeComboBox->currentIndex();
+}
+
+void DialogFindReplace::setStatusText(const QString &text) {
+    statusLabel->setText(text);
+}
+
+DialogDiagnostics::DialogDiagnostics(QWidget *parent)
+    : QDialog(parent) {
+    setWindowTitle(tr("Диагностика запросов"));
+    setAttribute(Qt::WA_DeleteOnClose);
+
+    operationsTable = new QTableWidget(this);
+    operationsTable->setColumnCount(8);
+    operationsTable->setHorizontalHeaderLabels({tr("Операция"), tr("Вызовов"), tr("Запросов/вызов"), tr("Строк/вызов"),
+                                                tr("Среднее, мс"), tr("p50, мс"), tr("p95, мс"), tr("Макс., мс")});
+    operationsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    operationsTable->setSortingEnabled(true);
+    operationsTable->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+
+    slowQueriesTable = new QTableWidget(this);
+    slowQueriesTable->setColumnCount(5);
+    slowQueriesTable->setHorizontalHeaderLabels({tr("Время"), tr("Операция"), tr("мс"), tr("Запрос"), tr("Параметры")});
+    slowQueriesTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    slowQueriesTable->horizontalHeader()->setSectionResizeMode(3, QHeaderView::Stretch);
+
+    thresholdSpinBox = new QSpinBox(this);
+    thresholdSpinBox->setRange(1, 60000);
+    thresholdSpinBox->setSuffix(tr(" мс"));
+    thresholdSpinBox->setValue(qRound(QueryStats::instance().slowThresholdMs()));
+    connect(thresholdSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, [](int ms) {
+        QueryStats::instance().setSlowThresholdMs(ms);
+    });
+
+    resetButton = new QPushButton(tr("Сбросить"), this);
+    closeButton = new QPushButton(tr("Закрыть"), this);
+    connect(resetButton, &QPushButton::clicked, this, [this]() {
+        QueryStats::instance().reset();
+        refresh();
+    });
+    connect(closeButton, &QPushButton::clicked, this, &DialogDiagnostics::close);
+
+    // Пока окно открыто, статистика обновляется раз в секунду
+    QTimer *refreshTimer = new QTimer(this);
+    connect(refreshTimer, &QTimer::timeout, this, &DialogDiagnostics::refresh);
+    refreshTimer->start(1000);
+
+    QHBoxLayout *buttonLayout = new QHBoxLayout;
+    buttonLayout->addWidget(new QLabel(tr("Порог медленного запроса:"), this));
+    buttonLayout->addWidget(thresholdSpinBox);
+    buttonLayout->addStretch();
+    buttonLayout->addWidget(resetButton);
+    buttonLayout->addWidget(closeButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(new QLabel(tr("Операции"), this));
+    layout->addWidget(operationsTable, 1);
+    layout->addWidget(new QLabel(tr("Медленные запросы"), this));
+    layout->addWidget(slowQueriesTable, 1);
+    layout->addLayout(buttonLayout);
+
+    resize(900, 600);
+    refresh();
+}
+
+void DialogDiagnostics::refresh() {
+    auto numberItem = [](double value, int precision) {
+        QTableWidgetItem *item = new QTableWidgetItem;
+        item->setData(Qt::DisplayRole, precision == 0 ? QVariant(qRound64(value)) : QVariant(qRound(value * 10) / 10.0));
+        item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        return item;
+    };
+
+    const QVector<OperationStats> operations = QueryStats::instance().operations();
+    operationsTable->setSortingEnabled(false);
+    operationsTable->setRowCount(operations.size());
+    for (int i = 0; i < operations.size(); ++i) {
+        const OperationStats &operation = operations[i];
+        const double calls = qMax<qint64>(1, operation.calls);
+        operationsTable->setItem(i, 0, new QTableWidgetItem(operation.name));
+        operationsTable->setItem(i, 1, numberItem(operation.calls, 0));
+        operationsTable->setItem(i, 2, numberItem(operation.queries / calls, 1));
+        operationsTable->setItem(i, 3, numberItem(operation.rows / calls, 1));
+        operationsTable->setItem(i, 4, numberItem(operation.totalMs / calls, 1));
+        operationsTable->setItem(i, 5, numberItem(operation.percentileMs(0.5), 1));
+        operationsTable->setItem(i, 6, numberItem(operation.percentileMs(0.95), 1));
+        operationsTable->setItem(i, 7, numberItem(operation.maxMs, 1));
+    }
+    operationsTable->setSortingEnabled(true);
+
+    const QVector<SlowQuery> slowQueries = QueryStats::instance().slowQueries();
+    slowQueriesTable->setRowCount(slowQueries.size());
+    for (int i = 0; i < slowQueries.size(); ++i) {
+        const SlowQuery &slowQuery = slowQueries[i];
+        slowQueriesTable->setItem(i, 0, new QTableWidgetItem(slowQuery.at.toString("HH:mm:ss")));
+        slowQueriesTable->setItem(i, 1, new QTableWidgetItem(slowQuery.operation));
+        slowQueriesTable->setItem(i, 2, numberItem(slowQuery.ms, 1));
+        slowQueriesTable->setItem(i, 3, new QTableWidgetItem(slowQuery.sql.simplified()));
+        slowQueriesTable->setItem(i, 4, new QTableWidgetItem(slowQuery.parameters));
+    }
+}
+
+DialogValidation::DialogValidation(QWidget *parent)
+    : QDialog(parent) {
+    setWindowTitle(tr("Проверка проекта"));
+    setAttribute(Qt::WA_DeleteOnClose);
+
+    issuesTable = new QTableWidget(this);
+    issuesTable->setColumnCount(3);
+    issuesTable->setHorizontalHeaderLabels({tr("Проверка"), tr("Идентификатор"), tr("Описание")});
+    issuesTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    issuesTable->horizontalHeader()->setSectionResizeMode(2, QHeaderView::Stretch);
+
+    summaryLabel = new QLabel(this);
+    fixButton = new QPushButton(tr("Исправить"), this);
+    closeButton = new QPushButton(tr("Закрыть"), this);
+    connect(fixButton, &QPushButton::clicked, this, &DialogValidation::fixRequested);
+    connect(closeButton, &QPushButton::clicked, this, &DialogValidation::close);
+
+    QHBoxLayout *buttonLayout = new QHBoxLayout;
+    buttonLayout->addWidget(summaryLabel, 1);
+    buttonLayout->addWidget(fixButton);
+    buttonLayout->addWidget(closeButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(issuesTable, 1);
+    layout->addLayout(buttonLayout);
+
+    resize(800, 500);
+}
+
+void DialogValidation::setIssues(const QVector<ValidationIssue> &issues, const QString &status) {
+    currentIssues = issues;
+
+    int fixable = 0;
+    issuesTable->setRowCount(issues.size());
+    for (int i = 0; i < issues.size(); ++i) {
+        const ValidationIssue &issue = issues[i];
+        QTableWidgetItem *checkItem = new QTableWidgetItem(issue.check);
+        if (!ProjectValidator::isFixable(issue.check)) {
+            checkItem->setToolTip(tr("Исправляется только вручную"));
+            checkItem->setForeground(QBrush(Qt::darkRed));
+        } else {
+            ++fixable;
+        }
+        QTableWidgetItem *idItem = new QTableWidgetItem;
+        idItem->setData(Qt::DisplayRole, issue.itemId);
+        issuesTable->setItem(i, 0, checkItem);
+        issuesTable->setItem(i, 1, idItem);
+        issuesTable->setItem(i, 2, new QTableWidgetItem(issue.message));
+    }
+
+    QString summary = issues.isEmpty() ? tr("Нарушений не найдено.")
+                                       : tr("Нарушений: %1, исправимых автоматически: %2.").arg(issues.size()).arg(fixable);
+    if (!status.isEmpty()) {
+        summary = status + ' ' + summary;
+    }
+    summaryLabel->setText(summary);
+    fixButton->setEnabled(fixable > 0);
+}
+
+QVector<ValidationIssue> DialogValidation::issues() const {
+    return currentIssues;
+}
+
+DialogGridDiff::DialogGridDiff(const QString &leftTitle, const TemplateGrid &left,
+                               const QString &rightTitle, const TemplateGrid &right,
+                               const GridDiff &diff, QWidget *parent)
+    : QDialog(parent), diff(diff) {
+    setWindowTitle(tr("Сравнение: %1 и %2").arg(leftTitle, rightTitle));
+    setAttribute(Qt::WA_DeleteOnClose);
+
+    // Модели читают diff диалога, поэтому создаются после его копирования
+    leftView = new QTableView(this);
+    leftView->setModel(new GridDiffModel(left, this->diff, true, this));
+    rightView = new QTableView(this);
+    rightView->setModel(new GridDiffModel(right, this->diff, false, this));
+    for (QTableView *view : {leftView, rightView}) {
+        view->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        view->setSelectionBehavior(QAbstractItemView::SelectRows);
+        view->verticalHeader()->setDefaultSectionSize(view->fontMetrics().height() + 6);
+    }
+
+    // Строки и столбцы обеих сторон выровнены, поэтому прокрутка общая
+    connect(leftView->verticalScrollBar(), &QScrollBar::valueChanged, rightView->verticalScrollBar(), &QScrollBar::setValue);
+    connect(rightView->verticalScrollBar(), &QScrollBar::valueChanged, leftView->verticalScrollBar(), &QScrollBar::setValue);
+    connect(leftView->horizontalScrollBar(), &QScrollBar::valueChanged, rightView->horizontalScrollBar(), &QScrollBar::setValue);
+    connect(rightView->horizontalScrollBar(), &QScrollBar::valueChanged, leftView->horizontalScrollBar(), &QScrollBar::setValue);
+
+    nextButton = new QPushButton(tr("Следующее отличие"), this);
+    nextButton->setEnabled(!this->diff.isEmpty());
+    closeButton = new QPushButton(tr("Закрыть"), this);
+    connect(nextButton, &QPushButton::clicked, this, &DialogGridDiff::showNextChange);
+    connect(closeButton, &QPushButton::clicked, this, &DialogGridDiff::close);
+
+    QHBoxLayout *titleLayout = new QHBoxLayout;
+    titleLayout->addWidget(new QLabel(leftTitle, this), 1);
+    titleLayout->addWidget(new QLabel(rightTitle, this), 1);
+
+    QHBoxLayout *viewLayout = new QHBoxLayout;
+    viewLayout->addWidget(leftView);
+    viewLayout->addWidget(rightView);
+
+    QHBoxLayout *buttonLayout = new QHBoxLayout;
+    buttonLayout->addWidget(new QLabel(this->diff.summary(), this), 1);
+    buttonLayout->addWidget(nextButton);
+    buttonLayout->addWidget(closeButton);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addLayout(titleLayout);
+    layout->addLayout(viewLayout, 1);
+    layout->addLayout(buttonLayout);
+
+    resize(1200, 700);
+}
+
+void DialogGridDiff::showNextChange() {
+    if (diff.rows.isEmpty()) return;
+
+    // Поиск по кругу от строки после текущей
+    const int current = rightView->currentIndex().isValid() ? rightView->currentIndex().row() : -1;
+    for (int step = 1; step <= diff.rows.size(); ++step) {
+        const int row = (current + step) % diff.rows.size();
+        if (diff.rows[row].kind == DiffKind::Equal) continue;
+
+        const int column = diff.rows[row].changedColumns.isEmpty() ? 0 : diff.rows[row].changedColumns.first();
+        for (QTableView *view : {leftView, rightView}) {
+            view->setCurrentIndex(view->model()->index(row, column));
+            view->scrollTo(view->model()->index(row, column), QAbstractItemView::PositionAtCenter);
+        }
+        return;
+    }
+}
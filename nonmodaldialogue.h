@@ -5,6 +5,14 @@
 #include <QLineEdit>
 #include <QPushButton>
 #include <QVBoxLayout>
+#include <QCheckBox>
+#include <QComboBox>
+#include <QLabel>
+#include <QSpinBox>
+#include <QTableWidget>
+#include <QTableView>
+#include "griddiff.h"
+#include "projectvalidator.h"
 
 class DialogEditName : public QDialog {
     Q_OBJECT
@@ -20,4 +28,90 @@ private:
     QPushButton *cancelButton;
 };
 
+class DialogFindReplace : public QDialog {
+    Q_OBJECT
+
+public:
+    explicit DialogFindReplace(QWidget *parent = nullptr);
+
+    QString findText() const;
+    QString replaceText() const;
+    bool useRegex() const;
+    int scopeIndex() const;     // 0 - проект, 1 - выбранная категория, 2 - выбранный шаблон
+
+    void setStatusText(const QString &text);
+
+signals:
+    void previewRequested();
+    void replaceRequested();
+
+private:
+    QLineEdit *findEdit;
+    QLineEdit *replaceEdit;
+    QCheckBox *regexCheckBox;
+    QComboBox *scopeComboBox;
+    QLabel *statusLabel;
+    QPushButton *previewButton;
+    QPushButton *replaceButton;
+    QPushButton *closeButton;
+};
+
+// Статистика запросов по операциям и журнал медленных запросов
+class DialogDiagnostics : public QDialog {
+    Q_OBJECT
+
+public:
+    explicit DialogDiagnostics(QWidget *parent = nullptr);
+
+public slots:
+    void refresh();
+
+private:
+    QTableWidget *operationsTable;
+    QTableWidget *slowQueriesTable;
+    QSpinBox *thresholdSpinBox;
+    QPushButton *resetButton;
+    QPushButton *closeButton;
+};
+
+// Результат проверки проекта; исправление выполняет главное окно по сигналу fixRequested
+class DialogValidation : public QDialog {
+    Q_OBJECT
+
+public:
+    explicit DialogValidation(QWidget *parent = nullptr);
+
+    void setIssues(const QVector<ValidationIssue> &issues, const QString &status = QString());
+    QVector<ValidationIssue> issues() const;
+
+signals:
+    void fixRequested();
+
+private:
+    QVector<ValidationIssue> currentIssues;
+    QTableWidget *issuesTable;
+    QLabel *summaryLabel;
+    QPushButton *fixButton;
+    QPushButton *closeButton;
+};
+
+// Сравнение двух сеток бок о бок: строки выровнены, прокрутка общая
+class DialogGridDiff : public QDialog {
+    Q_OBJECT
+
+public:
+    DialogGridDiff(const QString &leftTitle, const TemplateGrid &left,
+                   const QString &rightTitle, const TemplateGrid &right,
+                   const GridDiff &diff, QWidget *parent = nullptr);
+
+private:
+    void showNextChange();
+
+    GridDiff diff;
+    QTableView *leftView;
+    QTableView *rightView;
+    QPushButton *nextButton;
+    QPushButton *closeButton;
+};
+
 #endif // NONMODALDIALOGUE_H
@@ -0,0 +1,122 @@
+#include "pgcopy.h"
+#include <QSqlDriver>
+#include <QVariant>
+#include <QDebug>
+#include <libpq-fe.h>
+
+namespace {
+const int FlushThreshold = 256 * 1024;
+}
+
+PgCopyWriter::PgCopyWriter(QSqlDatabase &db)
+    : conn(nullptr), active(false) {
+    // Драйвер QPSQL отдаёт нативное соединение libpq
+    QVariant handle = db.driver() ? db.driver()->handle() : QVariant();
+    if (handle.isValid() && qstrcmp(handle.typeName(), "PGconn*") == 0) {
+        conn = *static_cast<PGconn **>(handle.data());
+    }
+}
+
+PgCopyWriter::~PgCopyWriter() {
+    abort();
+}
+
+void PgCopyWriter::abort() {
+    if (!active) return;
+
+    // Незавершённый COPY отменяем, чтобы соединение осталось рабочим
+    PQputCopyEnd(conn, "aborted");
+    while (PGresult *result = PQgetResult(conn)) {
+        PQclear(result);
+    }
+    active = false;
+    buffer.clear();
+}
+
+bool PgCopyWriter::begin(const QString &copyStatement) {
+    if (!conn) {
+        error = "Соединение не является соединением PostgreSQL";
+        return false;
+    }
+
+    PGresult *result = PQexec(conn, copyStatement.toUtf8().constData());
+    bool ok = PQresultStatus(result) == PGRES_COPY_IN;
+    if (!ok) {
+        error = QString::fromUtf8(PQerrorMessage(conn));
+    }
+    PQclear(result);
+
+    active = ok;
+    buffer.clear();
+    return ok;
+}
+
+bool PgCopyWriter::writeRow(const QStringList &fields) {
+    for (int i = 0; i < fields.size(); ++i) {
+        if (i > 0) buffer.append('\t');
+        appendEscaped(buffer, fields[i]);
+    }
+    buffer.append('\n');
+
+    return buffer.size() < FlushThreshold || flush();
+}
+
+bool PgCopyWriter::writeValues(const QVariantList &fields) {
+    for (int i = 0; i < fields.size(); ++i) {
+        if (i > 0) buffer.append('\t');
+        if (fields[i].isNull()) {
+            buffer.append("\\N");
+        } else {
+            appendEscaped(buffer, fields[i].toString());
+        }
+    }
+    buffer.append('\n');
+
+    return buffer.size() < FlushThreshold || flush();
+}
+
+bool PgCopyWriter::end() {
+    if (!active) return false;
+
+    bool ok = flush() && PQputCopyEnd(conn, nullptr) == 1;
+    active = false;
+
+    // Итог COPY (в том числе ошибки ограничений и триггеров) приходит здесь
+    while (PGresult *result = PQgetResult(conn)) {
+        if (PQresultStatus(result) != PGRES_COMMAND_OK) {
+            error = QString::fromUtf8(PQresultErrorMessage(result));
+            ok = false;
+        }
+        PQclear(result);
+    }
+    return ok;
+}
+
+QString PgCopyWriter::lastError() const {
+    return error;
+}
+
+bool PgCopyWriter::flush() {
+    if (buffer.isEmpty()) return true;
+
+    if (PQputCopyData(conn, buffer.constData(), buffer.size()) != 1) {
+        error = QString::fromUtf8(PQerrorMessage(conn));
+        return false;
+    }
+    buffer.clear();
+    return true;
+}
+
+void PgCopyWriter::appendEscaped(QByteArray &buffer, const QString &value) {
+    // Текстовый формат COPY: экранируем обратную косую черту и управляющие символы
+    const QByteArray utf8 = value.toUtf8();
+    for (char ch : utf8) {
+        switch (ch) {
+        case '\\': buffer.append("\\\\"); break;
+        case '\t': buffer.append("\\t"); break;
+        case '\n': buffer.append("\\n"); break;
+        case '\r': buffer.append("\\r"); break;
+        default: buffer.append(ch); break;
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef PGCOPY_H
+#define PGCOPY_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVariantList>
+#include <QSqlDatabase>
+
+typedef struct pg_conn PGconn;
+
+// Потоковая загрузка строк через COPY ... FROM STDIN на соединении QPSQL.
+// Строки копятся в небольшом буфере и отправляются порциями, поэтому объём
+// загружаемых данных не ограничен памятью.
+class PgCopyWriter {
+public:
+    explicit PgCopyWriter(QSqlDatabase &db);
+    ~PgCopyWriter();
+
+    // copyStatement вида "COPY table (col1, col2) FROM STDIN"
+    bool begin(const QString &copyStatement);
+    bool writeRow(const QStringList &fields);
+    bool writeValues(const QVariantList &fields);   // Пустой QVariant записывается как NULL
+    bool end();
+    void abort();   // Прерывает незавершённый COPY, чтобы на соединении можно было выполнить ROLLBACK
+
+    QString lastError() const;
+
+private:
+    bool flush();
+    static void appendEscaped(QByteArray &buffer, const QString &value);
+
+    PGconn *conn;
+    QByteArray buffer;
+    bool active;
+    QString error;
+};
+
+#endif // PGCOPY_H
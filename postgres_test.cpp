@@ -0,0 +1,115 @@
+#include "databasehandler.h"
+#include <QtTest>
+#include <QDateTime>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <memory>
+
+// Сценарии, которым нужен сервер PostgreSQL. База задаётся переменными окружения
+// AUTOTLG_TEST_DATABASE (отдельная тестовая база, без неё тесты пропускаются),
+// AUTOTLG_TEST_HOST, AUTOTLG_TEST_PORT, AUTOTLG_TEST_USER и AUTOTLG_TEST_PASSWORD
+class PostgresTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void revertsFindReplace();
+    void revertsFindReplaceWithoutHistory();
+
+private:
+    QString cellText();
+
+    std::unique_ptr<DatabaseHandler> handler;
+    int projectId = 0;
+    int templateId = 0;
+};
+
+void PostgresTest::initTestCase() {
+    const QString dbName = qEnvironmentVariable("AUTOTLG_TEST_DATABASE");
+    if (dbName.isEmpty())
+        QSKIP("AUTOTLG_TEST_DATABASE не задана");
+
+    handler = std::make_unique<DatabaseHandler>();
+    const int port = qEnvironmentVariableIsSet("AUTOTLG_TEST_PORT")
+                         ? qEnvironmentVariableIntValue("AUTOTLG_TEST_PORT") : 5432;
+    QVERIFY(handler->connectToDatabase(dbName,
+                                       qEnvironmentVariable("AUTOTLG_TEST_USER", "postgres"),
+                                       qEnvironmentVariable("AUTOTLG_TEST_PASSWORD"),
+                                       qEnvironmentVariable("AUTOTLG_TEST_HOST", "localhost"),
+                                       port));
+}
+
+void PostgresTest::init() {
+    const QString name = QString("test_%1").arg(QDateTime::currentMSecsSinceEpoch());
+    QVERIFY(handler->getProjectManager()->createProject(name, &projectId));
+
+    int categoryId = 0;
+    QVERIFY(handler->getCategoryManager()->createCategory("Категория", 0, projectId, &categoryId));
+    QVERIFY(handler->getTemplateManager()->createTemplate(categoryId, "Шаблон", &templateId));
+}
+
+void PostgresTest::cleanup() {
+    if (projectId > 0)
+        handler->getProjectManager()->deleteProject(projectId);
+    projectId = 0;
+    templateId = 0;
+}
+
+QString PostgresTest::cellText() {
+    TemplateGrid grid;
+    if (!handler->getTemplateManager()->getGridForTemplate(templateId, grid) || grid.cells.isEmpty())
+        return QString();
+    return grid.cells[0].value(0);
+}
+
+void PostgresTest::revertsFindReplace() {
+    QVERIFY(handler->getTableManager()->saveDataTableTemplate(
+        templateId, QVector<QString>{"Параметр"}, QVector<QVector<QString>>{{"напряжение 27 В"}}));
+
+    ReplaceCounts counts;
+    QVERIFY(handler->getSearchManager()->findReplace(ReplaceScope::Template, templateId,
+                                                     "27", "28", false, false, counts));
+    QCOMPARE(counts.cells, 1);
+    QCOMPARE(cellText(), QString("напряжение 28 В"));
+
+    RevisionManager *revisions = handler->getRevisionManager();
+    const QVector<TemplateRevision> history = revisions->listRevisions(templateId);
+    QCOMPARE(history.size(), 2);
+
+    QVERIFY(revisions->revert(templateId, history.last().revision));
+    QCOMPARE(cellText(), QString("напряжение 27 В"));
+}
+
+// Сетка записана в обход истории (данные до появления ревизий): перед заменой
+// сохраняется исходная сетка, и к ней можно вернуться
+void PostgresTest::revertsFindReplaceWithoutHistory() {
+    QSqlDatabase db = QSqlDatabase::database(handler->connectionName());
+    QSqlQuery query(db);
+    QVERIFY2(query.exec(QString("INSERT INTO table_column (template_id, column_order, header) VALUES (%1, 0, 'Параметр')")
+                            .arg(templateId)), qPrintable(query.lastError().text()));
+    QVERIFY2(query.exec(QString("INSERT INTO table_row (template_id, row_order) VALUES (%1, 0)")
+                            .arg(templateId)), qPrintable(query.lastError().text()));
+    QVERIFY2(query.exec(QString("INSERT INTO table_cell (template_id, row_order, column_order, content) "
+                                "VALUES (%1, 0, 0, 'напряжение 27 В')").arg(templateId)),
+             qPrintable(query.lastError().text()));
+
+    RevisionManager *revisions = handler->getRevisionManager();
+    QVERIFY(revisions->listRevisions(templateId).isEmpty());
+
+    ReplaceCounts counts;
+    QVERIFY(handler->getSearchManager()->findReplace(ReplaceScope::Template, templateId,
+                                                     "27", "28", false, false, counts));
+    QCOMPARE(cellText(), QString("напряжение 28 В"));
+
+    const QVector<TemplateRevision> history = revisions->listRevisions(templateId);
+    QCOMPARE(history.size(), 2);
+
+    QVERIFY(revisions->revert(templateId, history.last().revision));
+    QCOMPARE(cellText(), QString("напряжение 27 В"));
+}
+
+QTEST_GUILESS_MAIN(PostgresTest)
+#include "postgres_test.moc"
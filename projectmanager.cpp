@@ -1,29 +1,47 @@
-#include "ProjectManager.h"
+#include "projectmanager.h"
+#include "queryexecutor.h"
+#include "revisionmanager.h"
+#include "tracing.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QDebug>
+#include <QFile>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <functional>
+#include "pgcopy.h"
+
+namespace {
+const int CursorBatchSize = 5000;
+}
 
 ProjectManager::ProjectManager(QSqlDatabase &db, QObject *parent)
     : QObject(parent), db(db) {}
 
-bool ProjectManager::createProject(const QString &name) {
+bool ProjectManager::createProject(const QString &name, int *newProjectId) {
+    TRACE_SCOPE("manager", "ProjectManager::createProject");
     QSqlQuery query(db);
-    query.prepare("INSERT INTO project (name) VALUES (:name)");
+    query.prepare("INSERT INTO project (name) VALUES (:name) RETURNING project_id");
     query.bindValue(":name", name);
-    if (!query.exec()) {
+    if (!execQuery(query) || !query.next()) {
         qDebug() << "Ошибка создания проекта:" << query.lastError().text();
         return false;
     }
+    if (newProjectId) {
+        *newProjectId = query.value(0).toInt();
+    }
     return true;
 }
 
 bool ProjectManager::updateProject(int projectId, const QString &newName) {
+    TRACE_SCOPE("manager", "ProjectManager::updateProject");
     QSqlQuery query(db);
     query.prepare("UPDATE project SET name = :name WHERE project_id = :projectId");
     query.bindValue(":name", newName);
     query.bindValue(":projectId", projectId);
 
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка обновления проекта:" << query.lastError().text();
         return false;
     }
@@ -31,11 +49,12 @@ bool ProjectManager::updateProject(int projectId, const QString &newName) {
 }
 
 bool ProjectManager::deleteProject(int projectId) {
+    TRACE_SCOPE("manager", "ProjectManager::deleteProject");
     QSqlQuery query(db);
     query.prepare("DELETE FROM project WHERE project_id = :projectId");
     query.bindValue(":projectId", projectId);
 
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка удаления проекта:" << query.lastError().text();
         return false;
     }
@@ -44,9 +63,10 @@ bool ProjectManager::deleteProject(int projectId) {
 
 
 QVector<Project> ProjectManager::getProjects() const {
+    TRACE_SCOPE("manager", "ProjectManager::getProjects");
     QVector<Project> projects;
     QSqlQuery query(db);
-    query.exec("SELECT project_id, name FROM project");
+    execQuery(query, "SELECT project_id, name FROM project");
 
     while (query.next()) {
         Project project;
@@ -56,3 +76,302 @@ QVector<Project> ProjectManager::getProjects() const {
     }
     return projects;
 }
+
+bool ProjectManager::exportProject(int projectId, const QString &filePath) {
+    TRACE_SCOPE("manager", "ProjectManager::exportProject");
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Не удалось создать файл экспорта проекта:" << filePath;
+        return false;
+    }
+
+    // При любой ошибке неполный файл удаляется, чтобы его не приняли за выгрузку
+    auto discardFile = [&file]() {
+        file.close();
+        file.remove();
+        return false;
+    };
+
+    // Все записи читаются из одного снимка данных; курсорам нужна транзакция
+    ReadSnapshot snapshot(db);
+    if (!snapshot.isStarted()) {
+        qDebug() << "Ошибка начала транзакции экспорта проекта:" << db.lastError();
+        return discardFile();
+    }
+    QSqlQuery query(db);
+
+    auto writeLine = [&file](const QJsonObject &object) {
+        QByteArray line = QJsonDocument(object).toJson(QJsonDocument::Compact);
+        line.append('\n');
+        if (file.write(line) != line.size()) {
+            qDebug() << "Ошибка записи файла экспорта проекта:" << file.fileName() << file.errorString();
+            return false;
+        }
+        return true;
+    };
+
+    // Чтение курсором порциями: в памяти не больше CursorBatchSize строк
+    auto streamCursor = [this](const QString &sql, const std::function<bool(const QSqlQuery &)> &handler) {
+        QSqlQuery cursor(db);
+        if (!execQuery(cursor, "DECLARE project_export NO SCROLL CURSOR FOR " + sql)) {
+            qDebug() << "Ошибка открытия курсора экспорта проекта:" << cursor.lastError();
+            return false;
+        }
+
+        QSqlQuery fetch(db);
+        fetch.setForwardOnly(true);
+        while (true) {
+            if (!execQuery(fetch, QString("FETCH FORWARD %1 FROM project_export").arg(CursorBatchSize))) {
+                qDebug() << "Ошибка чтения курсора экспорта проекта:" << fetch.lastError();
+                return false;
+            }
+            int fetched = 0;
+            while (fetch.next()) {
+                if (!handler(fetch)) return false;
+                ++fetched;
+            }
+            if (fetched == 0) break;
+        }
+        return execQuery(cursor, "CLOSE project_export");
+    };
+
+    const QString id = QString::number(projectId);
+    bool ok = false;
+
+    query.prepare("SELECT name FROM project WHERE project_id = :projectId");
+    query.bindValue(":projectId", projectId);
+    if (!execQuery(query) || !query.next()) {
+        qDebug() << "Проект для экспорта не найден:" << query.lastError();
+        return discardFile();
+    }
+    ok = writeLine({{"type", "project"}, {"id", projectId}, {"name", query.value(0).toString()}});
+
+    // Категории выводятся от корня вглубь, чтобы родитель всегда шёл раньше потомков
+    ok = ok && streamCursor(
+        "WITH RECURSIVE tree AS ( "
+        "    SELECT category_id, 0 AS level FROM category WHERE project_id = " + id + " AND parent_id IS NULL "
+        "    UNION ALL "
+        "    SELECT c.category_id, tree.level + 1 FROM category c INNER JOIN tree ON c.parent_id = tree.category_id "
+        ") "
+        "SELECT c.category_id, c.name, c.parent_id, c.position, c.depth "
+        "FROM category c INNER JOIN tree ON tree.category_id = c.category_id "
+        "ORDER BY tree.level, c.position",
+        [&writeLine](const QSqlQuery &row) {
+            return writeLine({{"type", "category"}, {"id", row.value(0).toInt()}, {"name", row.value(1).toString()},
+                       {"parent", row.value(2).isNull() ? -1 : row.value(2).toInt()},
+                       {"position", row.value(3).toInt()}, {"depth", row.value(4).toInt()}});
+        });
+
+    ok = ok && streamCursor(
+        "SELECT template_id, category_id, name, notes, programming_notes, position, is_approved "
+        "FROM table_template WHERE project_id = " + id + " ORDER BY template_id",
+        [&writeLine](const QSqlQuery &row) {
+            return writeLine({{"type", "template"}, {"id", row.value(0).toInt()}, {"category", row.value(1).toInt()},
+                       {"name", row.value(2).toString()}, {"notes", row.value(3).toString()},
+                       {"programmingNotes", row.value(4).toString()}, {"position", row.value(5).toInt()},
+                       {"approved", row.value(6).toBool()}});
+        });
+
+    ok = ok && streamCursor(
+        "SELECT c.template_id, c.column_order, c.header FROM grid_column c "
+        "INNER JOIN table_template t ON t.template_id = c.template_id WHERE t.project_id = " + id,
+        [&writeLine](const QSqlQuery &row) {
+            return writeLine({{"type", "column"}, {"template", row.value(0).toInt()},
+                       {"order", row.value(1).toInt()}, {"header", row.value(2).toString()}});
+        });
+
+    ok = ok && streamCursor(
+        "SELECT r.template_id, r.row_order FROM grid_row r "
+        "INNER JOIN table_template t ON t.template_id = r.template_id WHERE t.project_id = " + id,
+        [&writeLine](const QSqlQuery &row) {
+            return writeLine({{"type", "row"}, {"template", row.value(0).toInt()}, {"order", row.value(1).toInt()}});
+        });
+
+    ok = ok && streamCursor(
+        "SELECT c.template_id, c.row_order, c.column_order, c.content FROM grid_cell c "
+        "INNER JOIN table_template t ON t.template_id = c.template_id WHERE t.project_id = " + id,
+        [&writeLine](const QSqlQuery &row) {
+            return writeLine({{"type", "cell"}, {"template", row.value(0).toInt()}, {"row", row.value(1).toInt()},
+                       {"column", row.value(2).toInt()}, {"content", row.value(3).toString()}});
+        });
+
+    if (!ok) {
+        return discardFile();
+    }
+
+    // Сброс буфера и закрытие: переполнение диска обнаруживается только здесь
+    const bool flushed = file.flush();
+    file.close();
+    if (!flushed || file.error() != QFileDevice::NoError) {
+        qDebug() << "Ошибка записи файла экспорта проекта:" << file.fileName() << file.errorString();
+        file.remove();
+        return false;
+    }
+    return true;
+}
+
+bool ProjectManager::importProject(const QString &filePath, int *newProjectId) {
+    TRACE_SCOPE("manager", "ProjectManager::importProject");
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Не удалось открыть файл импорта проекта:" << filePath;
+        return false;
+    }
+
+    // Проект загружается целиком или не загружается вовсе
+    if (!db.transaction()) {
+        qDebug() << "Ошибка начала транзакции импорта проекта:" << db.lastError();
+        return false;
+    }
+
+    QSqlQuery query(db);
+    PgCopyWriter writer(db);
+    auto fail = [this, &writer](const QString &message) {
+        qDebug() << "Ошибка импорта проекта:" << message;
+        writer.abort();
+        db.rollback();
+        return false;
+    };
+
+    // Категории и шаблоны сначала копируются во временные таблицы со старыми ID
+    if (!execQuery(query, "CREATE TEMP TABLE import_category (old_id INTEGER, name TEXT, parent_old_id INTEGER, "
+                    "position INTEGER, depth INTEGER) ON COMMIT DROP") ||
+        !execQuery(query, "CREATE TEMP TABLE import_template (old_id INTEGER, category_old_id INTEGER, name TEXT, "
+                    "notes TEXT, programming_notes TEXT, position INTEGER, is_approved BOOLEAN) ON COMMIT DROP")) {
+        return fail(query.lastError().text());
+    }
+
+    int projectId = -1;
+    QString currentType;            // Тип записей, для которых открыт COPY
+    QHash<int, int> templateMap;    // Старый ID шаблона -> новый
+    bool structureLoaded = false;
+
+    // Перенос категорий и шаблонов в рабочие таблицы с новыми ID набором операторов
+    auto loadStructure = [&]() {
+        const QString id = QString::number(projectId);
+        const QStringList statements = {
+            "CREATE TEMP TABLE category_map ON COMMIT DROP AS "
+            "SELECT old_id, nextval(pg_get_serial_sequence('category', 'category_id'))::int AS new_id "
+            "FROM import_category",
+            "INSERT INTO category (category_id, name, parent_id, position, depth, project_id) "
+            "SELECT m.new_id, i.name, pm.new_id, i.position, i.depth, " + id + " "
+            "FROM import_category i "
+            "INNER JOIN category_map m ON m.old_id = i.old_id "
+            "LEFT JOIN category_map pm ON pm.old_id = NULLIF(i.parent_old_id, -1)",
+            "CREATE TEMP TABLE template_map ON COMMIT DROP AS "
+            "SELECT old_id, nextval(pg_get_serial_sequence('table_template', 'template_id'))::int AS new_id "
+            "FROM import_template",
+            "INSERT INTO table_template (template_id, category_id, project_id, name, notes, programming_notes, "
+            "                            position, is_approved) "
+            "SELECT tm.new_id, cm.new_id, " + id + ", i.name, i.notes, i.programming_notes, i.position, i.is_approved "
+            "FROM import_template i "
+            "INNER JOIN template_map tm ON tm.old_id = i.old_id "
+            "INNER JOIN category_map cm ON cm.old_id = i.category_old_id"
+        };
+        for (const QString &statement : statements) {
+            if (!execQuery(query, statement)) return false;
+        }
+
+        // Карта нужна клиенту для потоковой загрузки сеток
+        if (!execQuery(query, "SELECT tm.old_id, tm.new_id FROM template_map tm "
+                        "INNER JOIN table_template t ON t.template_id = tm.new_id")) {
+            return false;
+        }
+        while (query.next()) {
+            templateMap.insert(query.value(0).toInt(), query.value(1).toInt());
+        }
+        structureLoaded = true;
+        return true;
+    };
+
+    static const QHash<QString, QString> copyStatements = {
+        {"category", "COPY import_category (old_id, name, parent_old_id, position, depth) FROM STDIN"},
+        {"template", "COPY import_template (old_id, category_old_id, name, notes, programming_notes, "
+                     "position, is_approved) FROM STDIN"},
+        {"column", "COPY table_column (template_id, column_order, header) FROM STDIN"},
+        {"row", "COPY table_row (template_id, row_order) FROM STDIN"},
+        {"cell", "COPY table_cell (template_id, row_order, column_order, content) FROM STDIN"}
+    };
+
+    // Записи одного типа идут подряд, поэтому COPY переключается только на границах типов
+    auto switchType = [&](const QString &type) {
+        if (type == currentType) return true;
+        if (!copyStatements.contains(type)) {
+            writer.abort();
+            return false;
+        }
+        if (!currentType.isEmpty() && !writer.end()) return false;
+        currentType = type;
+
+        bool gridType = (type == "column" || type == "row" || type == "cell");
+        if (gridType && !structureLoaded && !loadStructure()) return false;
+        return writer.begin(copyStatements.value(type));
+    };
+
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty()) continue;
+
+        QJsonObject object = QJsonDocument::fromJson(line).object();
+        QString type = object.value("type").toString();
+
+        if (type == "project") {
+            query.prepare("INSERT INTO project (name) VALUES (:name) RETURNING project_id");
+            query.bindValue(":name", object.value("name").toString());
+            if (!currentType.isEmpty() || !execQuery(query) || !query.next()) {
+                return fail("ошибка создания проекта " + query.lastError().text());
+            }
+            projectId = query.value(0).toInt();
+            continue;
+        }
+
+        if (projectId < 0) return fail("в начале файла нет записи проекта");
+        if (!switchType(type)) return fail(QString("тип записи %1: %2").arg(type, writer.lastError() + query.lastError().text()));
+
+        QStringList fields;
+        if (type == "category") {
+            fields = {QString::number(object.value("id").toInt()), object.value("name").toString(),
+                      QString::number(object.value("parent").toInt(-1)),
+                      QString::number(object.value("position").toInt()), QString::number(object.value("depth").toInt())};
+        } else if (type == "template") {
+            fields = {QString::number(object.value("id").toInt()), QString::number(object.value("category").toInt()),
+                      object.value("name").toString(), object.value("notes").toString(),
+                      object.value("programmingNotes").toString(), QString::number(object.value("position").toInt()),
+                      object.value("approved").toBool() ? "t" : "f"};
+        } else {
+            // Записи сеток шаблонов, не попавших в проект, пропускаем
+            int templateId = templateMap.value(object.value("template").toInt(), -1);
+            if (templateId < 0) continue;
+
+            if (type == "column") {
+                fields = {QString::number(templateId), QString::number(object.value("order").toInt()),
+                          object.value("header").toString()};
+            } else if (type == "row") {
+                fields = {QString::number(templateId), QString::number(object.value("order").toInt())};
+            } else {
+                fields = {QString::number(templateId), QString::number(object.value("row").toInt()),
+                          QString::number(object.value("column").toInt()), object.value("content").toString()};
+            }
+        }
+
+        if (!writer.writeRow(fields)) return fail(writer.lastError());
+    }
+
+    if (!currentType.isEmpty() && !writer.end()) return fail(writer.lastError());
+    if (projectId < 0) return fail("файл не содержит проекта");
+    if (!structureLoaded && !loadStructure()) return fail(query.lastError().text());
+
+    // Загруженные сетки - первые ревизии шаблонов, одной вставкой
+    QVector<int> importedTemplates;
+    importedTemplates.reserve(templateMap.size());
+    for (int templateId : templateMap) importedTemplates.append(templateId);
+    if (!RevisionManager(db).recordSnapshots(importedTemplates)) return fail("не удалось записать ревизии шаблонов");
+
+    if (!db.commit()) return fail(db.lastError().text());
+
+    if (newProjectId) {
+        *newProjectId = projectId;
+    }
+    qDebug() << "Проект импортирован, шаблонов:" << templateMap.size();
+    return true;
+}
@@ -17,12 +17,18 @@ class ProjectManager : public QObject {
 public:
     explicit ProjectManager(QSqlDatabase &db, QObject *parent = nullptr);
 
-    bool createProject(const QString &name);
+    bool createProject(const QString &name, int *newProjectId = nullptr);
     bool updateProject(int projectId, const QString &newName);
     bool deleteProject(int projectId);
 
     QVector<Project> getProjects() const;
 
+    // Перенос проекта между базами в формате JSON Lines (по объекту на строку).
+    // Экспорт читает данные курсором, импорт переназначает идентификаторы и
+    // загружает сетки через COPY, поэтому расход памяти не зависит от размера проекта.
+    bool exportProject(int projectId, const QString &filePath);
+    bool importProject(const QString &filePath, int *newProjectId = nullptr);
+
 private:
     QSqlDatabase &db;
 };
@@ -0,0 +1,443 @@
+#include "projectsnapshot.h"
+#include "queryexecutor.h"
+#include <QDateTime>
+#include <QSaveFile>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace {
+
+// Формат рассчитан на little-endian платформы; записи выровнены по 8 байт
+const char Magic[8] = {'A', 'T', 'L', 'G', 'S', 'N', 'A', 'P'};
+const quint32 FormatVersion = 1;
+const int GridBatchSize = 200;
+
+struct SnapshotHeader {
+    char magic[8];
+    quint32 version;
+    qint32 projectId;
+    qint64 createdAt;
+    quint32 projectName;
+    quint32 stringCount;
+    quint64 stringIndexOffset;  // (stringCount + 1) смещений quint64 внутри блока строк
+    quint64 stringDataOffset;
+    quint32 categoryCount;
+    quint32 templateCount;
+    quint64 categoryOffset;
+    quint64 templateOffset;     // Шаблоны отсортированы по (categoryId, position)
+    quint64 gridIndexOffset;    // GridIndexEntry для каждого шаблона в том же порядке
+};
+
+struct CategoryRecord {
+    qint32 categoryId;
+    qint32 parentId;
+    qint32 position;
+    qint32 depth;
+    qint32 templateCount;
+    qint32 approvedCount;
+    qint64 cellCount;
+    quint32 name;
+    quint32 reserved;
+};
+
+struct TemplateRecord {
+    qint32 templateId;
+    qint32 categoryId;
+    qint32 position;
+    quint32 flags;              // Бит 0 - шаблон утверждён
+    quint32 name;
+    quint32 notes;
+    quint32 programmingNotes;
+    quint32 reserved;
+};
+
+struct GridIndexEntry {
+    quint64 offset;             // Номера строк: columnCount заголовков, затем rowCount * columnCount ячеек
+    quint32 columnCount;
+    quint32 rowCount;
+};
+
+static_assert(sizeof(SnapshotHeader) == 80, "Неожиданный размер заголовка снимка");
+static_assert(sizeof(CategoryRecord) == 40, "Неожиданный размер записи категории");
+static_assert(sizeof(TemplateRecord) == 32, "Неожиданный размер записи шаблона");
+static_assert(sizeof(GridIndexEntry) == 16, "Неожиданный размер индекса сетки");
+
+// Массив count элементов по offset целиком лежит в файле размера size и выровнен;
+// проверка не переполняется при любых значениях из повреждённого файла
+bool arrayFits(quint64 offset, quint64 count, quint64 itemSize, quint64 alignment, quint64 size) {
+    return offset % alignment == 0 && offset <= size && count <= (size - offset) / itemSize;
+}
+
+// Таблица уникальных строк, заполняемая при записи
+class StringTable {
+public:
+    quint32 intern(const QString &text) {
+        auto found = ids.constFind(text);
+        if (found != ids.constEnd()) return found.value();
+
+        quint32 id = quint32(strings.size());
+        ids.insert(text, id);
+        strings.append(text);
+        return id;
+    }
+
+    const QVector<QString> &all() const { return strings; }
+
+private:
+    QHash<QString, quint32> ids;
+    QVector<QString> strings;
+};
+
+template <typename T>
+void writeRaw(QSaveFile &file, const T &value) {
+    file.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+void alignTo(QSaveFile &file, int alignment) {
+    static const char zeros[8] = {};
+    qint64 padding = (alignment - file.pos() % alignment) % alignment;
+    file.write(zeros, padding);
+}
+
+}
+
+ProjectSnapshot::~ProjectSnapshot() {
+    close();
+}
+
+bool ProjectSnapshot::write(QSqlDatabase &db, int projectId, const QString &filePath) {
+    ReadSnapshot consistentRead(db);    // Дерево, шаблоны и сетки - из одного снимка данных
+    QSqlQuery query(db);
+    query.prepare("SELECT name FROM project WHERE project_id = :projectId");
+    query.bindValue(":projectId", projectId);
+    if (!execQuery(query) || !query.next()) {
+        qDebug() << "Проект для снимка не найден:" << query.lastError();
+        return false;
+    }
+    const QString projectName = query.value(0).toString();
+
+    QVector<Category> categories = CategoryManager(db).getCategoriesByProject(projectId);
+
+    query.prepare("SELECT template_id, category_id, position, is_approved, name, notes, programming_notes "
+                  "FROM table_template WHERE project_id = :projectId ORDER BY category_id, position");
+    query.bindValue(":projectId", projectId);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка загрузки шаблонов для снимка:" << query.lastError();
+        return false;
+    }
+
+    StringTable strings;
+    QVector<quint32> categoryNames;
+    for (const Category &category : categories) {
+        categoryNames.append(strings.intern(category.name));
+    }
+
+    QVector<TemplateRecord> templates;
+    while (query.next()) {
+        TemplateRecord record = {};
+        record.templateId = query.value(0).toInt();
+        record.categoryId = query.value(1).toInt();
+        record.position = query.value(2).toInt();
+        record.flags = query.value(3).toBool() ? 1u : 0u;
+        record.name = strings.intern(query.value(4).toString());
+        record.notes = strings.intern(query.value(5).toString());
+        record.programmingNotes = strings.intern(query.value(6).toString());
+        templates.append(record);
+    }
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Не удалось создать файл снимка:" << filePath;
+        return false;
+    }
+
+    SnapshotHeader header = {};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = FormatVersion;
+    header.projectId = projectId;
+    header.createdAt = QDateTime::currentMSecsSinceEpoch();
+    header.projectName = strings.intern(projectName);
+    writeRaw(file, header);     // Окончательный заголовок перезаписывается в конце
+
+    // Сетки пишутся порциями, чтобы не держать весь проект в памяти
+    TemplateManager templateManager(db);
+    QVector<GridIndexEntry> gridIndex(templates.size());
+    for (int start = 0; start < templates.size(); start += GridBatchSize) {
+        QVector<int> ids;
+        for (int i = start; i < qMin(start + GridBatchSize, int(templates.size())); ++i) {
+            ids.append(templates[i].templateId);
+        }
+
+        QHash<int, TemplateGrid> grids;
+        if (!templateManager.getGridsForTemplates(ids, grids)) {
+            file.cancelWriting();
+            return false;
+        }
+
+        for (int i = start; i < start + ids.size(); ++i) {
+            const TemplateGrid grid = grids.value(templates[i].templateId);
+            GridIndexEntry &entry = gridIndex[i];
+            entry.offset = quint64(file.pos());
+            entry.columnCount = quint32(grid.headers.size());
+            entry.rowCount = quint32(grid.cells.size());
+
+            for (const QString &headerText : grid.headers) {
+                writeRaw(file, strings.intern(headerText));
+            }
+            for (const QVector<QString> &row : grid.cells) {
+                for (quint32 col = 0; col < entry.columnCount; ++col) {
+                    writeRaw(file, strings.intern(col < quint32(row.size()) ? row[col] : QString()));
+                }
+            }
+        }
+    }
+
+    // Таблица строк: смещения, затем данные UTF-8
+    QVector<QByteArray> encoded;
+    encoded.reserve(strings.all().size());
+    for (const QString &text : strings.all()) {
+        encoded.append(text.toUtf8());
+    }
+
+    alignTo(file, 8);
+    header.stringCount = quint32(encoded.size());
+    header.stringIndexOffset = quint64(file.pos());
+    quint64 offset = 0;
+    for (const QByteArray &bytes : encoded) {
+        writeRaw(file, offset);
+        offset += quint64(bytes.size());
+    }
+    writeRaw(file, offset);
+    header.stringDataOffset = quint64(file.pos());
+    for (const QByteArray &bytes : encoded) {
+        file.write(bytes);
+    }
+
+    alignTo(file, 8);
+    header.categoryCount = quint32(categories.size());
+    header.categoryOffset = quint64(file.pos());
+    for (int i = 0; i < categories.size(); ++i) {
+        const Category &category = categories[i];
+        CategoryRecord record = {};
+        record.categoryId = category.categoryId;
+        record.parentId = category.parentId;
+        record.position = category.position;
+        record.depth = category.depth;
+        record.templateCount = category.templateCount;
+        record.approvedCount = category.approvedCount;
+        record.cellCount = category.cellCount;
+        record.name = categoryNames[i];
+        writeRaw(file, record);
+    }
+
+    header.templateCount = quint32(templates.size());
+    header.templateOffset = quint64(file.pos());
+    for (const TemplateRecord &record : templates) {
+        writeRaw(file, record);
+    }
+
+    header.gridIndexOffset = quint64(file.pos());
+    for (const GridIndexEntry &entry : gridIndex) {
+        writeRaw(file, entry);
+    }
+
+    file.seek(0);
+    writeRaw(file, header);
+    return file.commit();
+}
+
+bool ProjectSnapshot::open(const QString &filePath) {
+    close();
+
+    file.setFileName(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    size = file.size();
+    data = size >= qint64(sizeof(SnapshotHeader)) ? file.map(0, size) : nullptr;
+    if (!data) {
+        close();
+        return false;
+    }
+
+    if (!validate()) {
+        qDebug() << "Файл снимка повреждён или имеет другую версию:" << filePath;
+        close();
+        return false;
+    }
+
+    const SnapshotHeader *header = reinterpret_cast<const SnapshotHeader *>(data);
+
+    const TemplateRecord *records = reinterpret_cast<const TemplateRecord *>(data + header->templateOffset);
+    templateIndexById.reserve(int(header->templateCount));
+    for (quint32 i = 0; i < header->templateCount; ++i) {
+        templateIndexById.insert(records[i].templateId, int(i));
+    }
+    return true;
+}
+
+bool ProjectSnapshot::validate() const {
+    // Все смещения и длины проверяются до первого обращения: чтение за пределами
+    // отображения при повреждённом файле завершило бы программу
+    const quint64 fileSize = quint64(size);
+    const SnapshotHeader *header = reinterpret_cast<const SnapshotHeader *>(data);
+    if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->version != FormatVersion) {
+        return false;
+    }
+    if (!arrayFits(header->categoryOffset, header->categoryCount, sizeof(CategoryRecord), 8, fileSize) ||
+        !arrayFits(header->templateOffset, header->templateCount, sizeof(TemplateRecord), 8, fileSize) ||
+        !arrayFits(header->gridIndexOffset, header->templateCount, sizeof(GridIndexEntry), 8, fileSize) ||
+        !arrayFits(header->stringIndexOffset, quint64(header->stringCount) + 1, sizeof(quint64), 8, fileSize) ||
+        header->stringDataOffset > fileSize) {
+        return false;
+    }
+
+    // Смещения строк не убывают и не выходят за конец файла
+    const quint64 *offsets = reinterpret_cast<const quint64 *>(data + header->stringIndexOffset);
+    const quint64 stringDataSize = fileSize - header->stringDataOffset;
+    for (quint32 i = 0; i < header->stringCount; ++i) {
+        if (offsets[i] > offsets[i + 1] || offsets[i + 1] > stringDataSize ||
+            offsets[i + 1] - offsets[i] > quint64(INT_MAX)) {
+            return false;
+        }
+    }
+
+    // Сетка: columnCount заголовков и rowCount * columnCount ячеек
+    const GridIndexEntry *grids = reinterpret_cast<const GridIndexEntry *>(data + header->gridIndexOffset);
+    for (quint32 i = 0; i < header->templateCount; ++i) {
+        const quint64 ids = (quint64(grids[i].rowCount) + 1) * grids[i].columnCount;
+        if (!arrayFits(grids[i].offset, ids, sizeof(quint32), 4, fileSize) ||
+            grids[i].rowCount > quint32(INT_MAX) || grids[i].columnCount > quint32(INT_MAX)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ProjectSnapshot::close() {
+    if (data) {
+        file.unmap(const_cast<uchar *>(data));
+        data = nullptr;
+    }
+    if (file.isOpen()) {
+        file.close();
+    }
+    size = 0;
+    templateIndexById.clear();
+}
+
+bool ProjectSnapshot::isOpen() const {
+    return data != nullptr;
+}
+
+int ProjectSnapshot::projectId() const {
+    return data ? reinterpret_cast<const SnapshotHeader *>(data)->projectId : -1;
+}
+
+QString ProjectSnapshot::projectName() const {
+    return data ? stringAt(reinterpret_cast<const SnapshotHeader *>(data)->projectName) : QString();
+}
+
+qint64 ProjectSnapshot::createdAt() const {
+    return data ? reinterpret_cast<const SnapshotHeader *>(data)->createdAt : 0;
+}
+
+QString ProjectSnapshot::stringAt(quint32 index) const {
+    const SnapshotHeader *header = reinterpret_cast<const SnapshotHeader *>(data);
+    if (index >= header->stringCount) return QString();
+
+    const quint64 *offsets = reinterpret_cast<const quint64 *>(data + header->stringIndexOffset);
+    const char *text = reinterpret_cast<const char *>(data + header->stringDataOffset + offsets[index]);
+    return QString::fromUtf8(text, int(offsets[index + 1] - offsets[index]));
+}
+
+QVector<Category> ProjectSnapshot::categories() const {
+    QVector<Category> result;
+    if (!data) return result;
+
+    const SnapshotHeader *header = reinterpret_cast<const SnapshotHeader *>(data);
+    const CategoryRecord *records = reinterpret_cast<const CategoryRecord *>(data + header->categoryOffset);
+    result.reserve(int(header->categoryCount));
+    for (quint32 i = 0; i < header->categoryCount; ++i) {
+        const CategoryRecord &record = records[i];
+        result.append({record.categoryId, stringAt(record.name), record.parentId, record.position,
+                       record.depth, header->projectId, record.templateCount, record.approvedCount,
+                       record.cellCount});
+    }
+    return result;
+}
+
+Template ProjectSnapshot::templateAt(int index) const {
+    const SnapshotHeader *header = reinterpret_cast<const SnapshotHeader *>(data);
+    const TemplateRecord &record = reinterpret_cast<const TemplateRecord *>(data + header->templateOffset)[index];
+    return {record.templateId, stringAt(record.name), stringAt(record.notes), stringAt(record.programmingNotes),
+            record.position, record.categoryId, (record.flags & 1u) != 0};
+}
+
+QVector<Template> ProjectSnapshot::templates() const {
+    QVector<Template> result;
+    if (!data) return result;
+
+    const SnapshotHeader *header = reinterpret_cast<const SnapshotHeader *>(data);
+    result.reserve(int(header->templateCount));
+    for (quint32 i = 0; i < header->templateCount; ++i) {
+        result.append(templateAt(int(i)));
+    }
+    return result;
+}
+
+QVector<Template> ProjectSnapshot::templatesForCategory(int categoryId) const {
+    QVector<Template> result;
+    if (!data) return result;
+
+    // Шаблоны отсортированы по категории: диапазон находим двоичным поиском
+    const SnapshotHeader *header = reinterpret_cast<const SnapshotHeader *>(data);
+    const TemplateRecord *begin = reinterpret_cast<const TemplateRecord *>(data + header->templateOffset);
+    const TemplateRecord *end = begin + header->templateCount;
+    const TemplateRecord *first = std::lower_bound(begin, end, categoryId, [](const TemplateRecord &record, int id) {
+        return record.categoryId < id;
+    });
+
+    for (const TemplateRecord *record = first; record != end && record->categoryId == categoryId; ++record) {
+        result.append(templateAt(int(record - begin)));
+    }
+    return result;
+}
+
+bool ProjectSnapshot::templateById(int templateId, Template &result) const {
+    auto found = templateIndexById.constFind(templateId);
+    if (!data || found == templateIndexById.constEnd()) return false;
+
+    result = templateAt(found.value());
+    return true;
+}
+
+bool ProjectSnapshot::loadGrid(int templateId, TemplateGrid &grid) const {
+    grid = TemplateGrid();
+    auto found = templateIndexById.constFind(templateId);
+    if (!data || found == templateIndexById.constEnd()) return false;
+
+    const SnapshotHeader *header = reinterpret_cast<const SnapshotHeader *>(data);
+    const GridIndexEntry &entry = reinterpret_cast<const GridIndexEntry *>(data + header->gridIndexOffset)[found.value()];
+    const quint32 *ids = reinterpret_cast<const quint32 *>(data + entry.offset);
+
+    grid.headers.reserve(int(entry.columnCount));
+    for (quint32 col = 0; col < entry.columnCount; ++col) {
+        grid.headers.append(stringAt(*ids++));
+    }
+
+    grid.cells.resize(int(entry.rowCount));
+    for (quint32 row = 0; row < entry.rowCount; ++row) {
+        QVector<QString> &cells = grid.cells[int(row)];
+        cells.reserve(int(entry.columnCount));
+        for (quint32 col = 0; col < entry.columnCount; ++col) {
+            cells.append(stringAt(*ids++));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef PROJECTSNAPSHOT_H
+#define PROJECTSNAPSHOT_H
+
+#include <QFile>
+#include <QHash>
+#include <QSqlDatabase>
+#include <QString>
+#include <QVector>
+#include "categorymanager.h"
+#include "templatemanager.h"
+
+// Компактный двоичный снимок проекта для мгновенного запуска в режиме только для чтения.
+// Файл отображается в память (mmap): таблица строк, массивы категорий и шаблонов
+// и сетки шаблонов с индексом смещений. Строки хранятся один раз и адресуются номером.
+class ProjectSnapshot {
+public:
+    ProjectSnapshot() = default;
+    ~ProjectSnapshot();
+
+    ProjectSnapshot(const ProjectSnapshot &) = delete;
+    ProjectSnapshot &operator=(const ProjectSnapshot &) = delete;
+
+    // Запись снимка из БД (через временный файл, заменяемый атомарно)
+    static bool write(QSqlDatabase &db, int projectId, const QString &filePath);
+
+    bool open(const QString &filePath);
+    void close();
+    bool isOpen() const;
+
+    int projectId() const;
+    QString projectName() const;
+    qint64 createdAt() const;   // Время создания снимка, мс с начала эпохи
+
+    QVector<Category> categories() const;
+    QVector<Template> templates() const;    // Все шаблоны, сгруппированные по категориям
+    QVector<Template> templatesForCategory(int categoryId) const;
+    bool templateById(int templateId, Template &result) const;
+    bool loadGrid(int templateId, TemplateGrid &grid) const;
+
+private:
+    bool validate() const;      // Заголовок, границы массивов и смещения строк отображённого файла
+    QString stringAt(quint32 index) const;
+    Template templateAt(int index) const;
+
+    QFile file;
+    const uchar *data = nullptr;
+    qint64 size = 0;
+    QHash<int, int> templateIndexById;
+};
+
+#endif // PROJECTSNAPSHOT_H
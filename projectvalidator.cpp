@@ -0,0 +1,386 @@
+#include "projectvalidator.h"
+#include "categorymanager.h"
+#include "revisionmanager.h"
+#include "queryexecutor.h"
+#include "tracing.h"
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QStringList>
+#include <QtConcurrent>
+#include <QDebug>
+
+namespace {
+
+// Форма сетки шаблона без текста ячеек: порядковые номера, заголовки и число ячеек по столбцам.
+// Повторы номеров ищет запрос duplicate_grid_position: в упакованной сетке их не бывает
+struct GridShape {
+    int templateId = 0;
+    QVector<int> columnOrders;
+    QVector<QString> headers;
+    QHash<int, int> cellsPerColumn;
+};
+
+QVector<ValidationIssue> checkShape(const GridShape &shape) {
+    QVector<ValidationIssue> issues;
+
+    int emptyHeaders = 0;
+    for (const QString &header : shape.headers) {
+        if (header.trimmed().isEmpty()) ++emptyHeaders;
+    }
+    if (emptyHeaders > 0) {
+        issues.append({"empty_header", shape.templateId, QString("пустых заголовков столбцов: %1").arg(emptyHeaders)});
+    }
+
+    // Недостающие ячейки читаются как пустые (новый столбец добавляется без ячеек),
+    // нарушением считаются только ячейки правее последнего столбца
+    int lastColumn = -1;
+    for (int column : shape.columnOrders) lastColumn = qMax(lastColumn, column);
+
+    int extraCells = 0;
+    for (auto it = shape.cellsPerColumn.constBegin(); it != shape.cellsPerColumn.constEnd(); ++it) {
+        if (it.key() > lastColumn) extraCells += it.value();
+    }
+    if (extraCells > 0) {
+        issues.append({"ragged_grid", shape.templateId,
+                       QString("ячеек правее последнего столбца: %1").arg(extraCells)});
+    }
+    return issues;
+}
+
+QString idArray(const QVector<int> &ids) {
+    QStringList list;
+    for (int id : ids) list.append(QString::number(id));
+    return "{" + list.join(',') + "}";
+}
+
+} // namespace
+
+ProjectValidator::ProjectValidator(QSqlDatabase &db) : db(db) {}
+
+bool ProjectValidator::validate(int projectId, QVector<ValidationIssue> &issues) {
+    TRACE_SCOPE("manager", "ProjectValidator::validate");
+    ReadSnapshot consistentRead(db);    // Все проверки видят одно состояние проекта
+    // Каждый запрос возвращает идентификатор элемента и подробность для сообщения
+    struct Check {
+        QString name;
+        QString sql;
+        QString message;
+    };
+
+    // Соседи по дереву: подкатегории и шаблоны с общим владельцем
+    const QString siblingsSql =
+        "WITH project_categories AS ( "
+        "    SELECT category_id, parent_id, position FROM category WHERE project_id = :projectId "
+        "), siblings AS ( "
+        "    SELECT parent_id AS owner_id, position, category_id AS item_id, TRUE AS is_category "
+        "    FROM project_categories "
+        "    UNION ALL "
+        "    SELECT t.category_id, t.position, t.template_id, FALSE FROM table_template t "
+        "    INNER JOIN project_categories c ON c.category_id = t.category_id "
+        ") ";
+
+    const QVector<Check> checks = {
+        {"orphan_category",
+         "SELECT c.category_id, c.parent_id FROM category c "
+         "LEFT JOIN category p ON p.category_id = c.parent_id "
+         "WHERE c.project_id = :projectId AND c.parent_id IS NOT NULL "
+         "AND (p.category_id IS NULL OR p.project_id <> c.project_id)",
+         "родительская категория %1 отсутствует или принадлежит другому проекту"},
+        {"category_cycle",
+         "WITH RECURSIVE walk AS ( "
+         "    SELECT category_id AS start_id, parent_id, 1 AS steps FROM category WHERE project_id = :projectId "
+         "    UNION ALL "
+         "    SELECT w.start_id, c.parent_id, w.steps + 1 FROM walk w "
+         "    INNER JOIN category c ON c.category_id = w.parent_id "
+         "    WHERE w.parent_id <> w.start_id AND w.steps < 1000 "
+         ") "
+         "SELECT start_id, MAX(steps) FROM walk WHERE parent_id = start_id GROUP BY start_id",
+         "категория входит в цикл длиной %1"},
+        // Подкатегории и шаблоны категории нумеруются одной последовательностью, поэтому
+        // повторы ищутся среди всех соседей; совпадение с категорией относится к категориям
+        {"duplicate_category_position",
+         siblingsSql +
+         "SELECT MIN(item_id) FILTER (WHERE is_category), position FROM siblings "
+         "GROUP BY owner_id, position HAVING COUNT(*) > 1 AND bool_or(is_category)",
+         "несколько категорий или шаблонов одного уровня на позиции %1"},
+        {"wrong_depth",
+         "WITH RECURSIVE levels AS ( "
+         "    SELECT category_id, 1 AS level FROM category WHERE project_id = :projectId AND parent_id IS NULL "
+         "    UNION ALL "
+         "    SELECT c.category_id, l.level + 1 FROM category c "
+         "    INNER JOIN levels l ON c.parent_id = l.category_id WHERE l.level < 1000 "
+         ") "
+         "SELECT c.category_id, c.depth FROM category c "
+         "INNER JOIN levels l ON l.category_id = c.category_id WHERE c.depth IS DISTINCT FROM l.level",
+         "глубина %1 не совпадает с положением в дереве"},
+        {"orphan_template",
+         "SELECT t.template_id, t.category_id FROM table_template t "
+         "LEFT JOIN category c ON c.category_id = t.category_id "
+         "WHERE t.project_id = :projectId AND (c.category_id IS NULL OR c.project_id <> t.project_id)",
+         "категория %1 отсутствует или принадлежит другому проекту"},
+        {"duplicate_template_position",
+         siblingsSql +
+         "SELECT MIN(item_id), position FROM siblings "
+         "GROUP BY owner_id, position HAVING COUNT(*) > 1 AND NOT bool_or(is_category)",
+         "несколько шаблонов одной категории на позиции %1"},
+        {"cell_outside_grid",
+         "SELECT t.template_id, COUNT(*) FROM table_template t "
+         "INNER JOIN grid_cell c ON c.template_id = t.template_id "
+         "WHERE t.project_id = :projectId "
+         "AND (NOT EXISTS (SELECT 1 FROM grid_row r WHERE r.template_id = c.template_id AND r.row_order = c.row_order) "
+         "  OR NOT EXISTS (SELECT 1 FROM grid_column k WHERE k.template_id = c.template_id "
+         "                 AND k.column_order = c.column_order)) "
+         "GROUP BY t.template_id",
+         "ячеек вне строк и столбцов сетки: %1"},
+        {"stale_cell_count",
+         "SELECT t.template_id, t.cell_count FROM table_template t "
+         "WHERE t.project_id = :projectId "
+         "AND t.cell_count <> (SELECT COUNT(*) FROM grid_cell c WHERE c.template_id = t.template_id)",
+         "сохранённое число ячеек %1 не совпадает с фактическим"},
+        {"mixed_grid_format",
+         "SELECT t.template_id, COUNT(c.template_id) FROM table_template t "
+         "INNER JOIN template_grid g ON g.template_id = t.template_id "
+         "LEFT JOIN table_cell c ON c.template_id = t.template_id "
+         "WHERE t.project_id = :projectId "
+         "AND (c.template_id IS NOT NULL "
+         "  OR EXISTS (SELECT 1 FROM table_row r WHERE r.template_id = t.template_id) "
+         "  OR EXISTS (SELECT 1 FROM table_column k WHERE k.template_id = t.template_id)) "
+         "GROUP BY t.template_id",
+         "упакованная сетка и построчные данные одновременно (ячеек: %1)"}
+    };
+
+    if (!validateGridPositions(projectId, issues)) {
+        return false;
+    }
+    for (const Check &check : checks) {
+        if (!runCheck(check.name, check.sql, check.message, projectId, issues)) {
+            return false;
+        }
+    }
+    return checkGridShapes(projectId, issues);
+}
+
+bool ProjectValidator::validateGridPositions(int projectId, QVector<ValidationIssue> &issues) {
+    TRACE_SCOPE("manager", "ProjectValidator::validateGridPositions");
+    // Только построчные таблицы первой версии схемы: проверка работает и до миграции ключей
+    return runCheck("duplicate_grid_position",
+                    "SELECT d.template_id, SUM(d.extra) FROM ( "
+                    "    SELECT template_id, COUNT(*) - 1 AS extra FROM table_cell "
+                    "    GROUP BY template_id, row_order, column_order HAVING COUNT(*) > 1 "
+                    "    UNION ALL "
+                    "    SELECT template_id, COUNT(*) - 1 FROM table_row "
+                    "    GROUP BY template_id, row_order HAVING COUNT(*) > 1 "
+                    "    UNION ALL "
+                    "    SELECT template_id, COUNT(*) - 1 FROM table_column "
+                    "    GROUP BY template_id, column_order HAVING COUNT(*) > 1 "
+                    ") d INNER JOIN table_template t ON t.template_id = d.template_id "
+                    "WHERE t.project_id = :projectId GROUP BY d.template_id",
+                    "лишних записей на занятых позициях сетки: %1", projectId, issues);
+}
+
+bool ProjectValidator::checkGridShapes(int projectId, QVector<ValidationIssue> &issues) {
+    TRACE_SCOPE("manager", "ProjectValidator::checkGridShapes");
+    // Два запроса на проект; текст ячеек не читается, только число ячеек в столбце
+    QHash<int, int> indexById;
+    QVector<GridShape> shapes;
+    auto shapeFor = [&indexById, &shapes](int templateId) -> GridShape & {
+        auto it = indexById.find(templateId);
+        if (it == indexById.end()) {
+            it = indexById.insert(templateId, shapes.size());
+            shapes.append(GridShape());
+            shapes.last().templateId = templateId;
+        }
+        return shapes[it.value()];
+    };
+
+    const QString statements[] = {
+        "SELECT k.template_id, k.column_order, k.header FROM grid_column k "
+        "INNER JOIN table_template t ON t.template_id = k.template_id WHERE t.project_id = :projectId",
+        "SELECT c.template_id, c.column_order, COUNT(*) FROM grid_cell c "
+        "INNER JOIN table_template t ON t.template_id = c.template_id WHERE t.project_id = :projectId "
+        "GROUP BY c.template_id, c.column_order"
+    };
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    for (int i = 0; i < 2; ++i) {
+        query.prepare(statements[i]);
+        query.bindValue(":projectId", projectId);
+        if (!execQuery(query)) {
+            qDebug() << "Ошибка чтения формы сеток:" << query.lastError();
+            return false;
+        }
+        while (query.next()) {
+            GridShape &shape = shapeFor(query.value(0).toInt());
+            if (i == 0) {
+                shape.columnOrders.append(query.value(1).toInt());
+                shape.headers.append(query.value(2).toString());
+            } else {
+                shape.cellsPerColumn.insert(query.value(1).toInt(), query.value(2).toInt());
+            }
+        }
+    }
+
+    // Проверка шаблонов распределяется по всем ядрам
+    const QVector<QVector<ValidationIssue>> found =
+        QtConcurrent::blockingMapped<QVector<QVector<ValidationIssue>>>(shapes, checkShape);
+    for (const QVector<ValidationIssue> &templateIssues : found) {
+        issues += templateIssues;
+    }
+    return true;
+}
+
+bool ProjectValidator::isFixable(const QString &check) {
+    static const QSet<QString> fixable = {
+        "orphan_category", "wrong_depth", "duplicate_category_position", "duplicate_template_position",
+        "duplicate_grid_position",
+        "cell_outside_grid", "mixed_grid_format", "ragged_grid", "stale_cell_count"
+    };
+    return fixable.contains(check);
+}
+
+bool ProjectValidator::fix(int projectId, const QVector<ValidationIssue> &issues, int *fixed) {
+    TRACE_SCOPE("manager", "ProjectValidator::fix");
+    QMap<QString, QVector<int>> idsByCheck;
+    int count = 0;
+    for (const ValidationIssue &issue : issues) {
+        if (isFixable(issue.check)) {
+            idsByCheck[issue.check].append(issue.itemId);
+            ++count;
+        }
+    }
+
+    // После правки ячеек число ячеек пересчитывается и для этих шаблонов
+    for (const QString &check : {QString("cell_outside_grid"), QString("mixed_grid_format"), QString("ragged_grid")}) {
+        if (idsByCheck.contains(check)) {
+            idsByCheck["stale_cell_count"] += idsByCheck.value(check);
+        }
+    }
+
+    // Категории, поднятые в корень, тоже получают позицию и глубину при уплотнении
+    for (const QString &check : {QString("orphan_category"), QString("wrong_depth"),
+                                 QString("duplicate_category_position"), QString("duplicate_template_position")}) {
+        if (idsByCheck.contains(check)) {
+            idsByCheck["tree_numbering"] += idsByCheck.value(check);
+        }
+    }
+
+    // Порядок важен: сначала родители, затем нумерация; число ячеек - последним
+    struct Fix {
+        QString check;
+        QStringList statements;     // С параметром :ids или :projectId; пусто - уплотнение нумерации
+    };
+    const QVector<Fix> fixes = {
+        {"orphan_category", {
+            "UPDATE category SET parent_id = NULL WHERE category_id = ANY(CAST(:ids AS INTEGER[]))"}},
+        // Глубина и позиции исправляются уплотнением нумерации всего проекта
+        {"tree_numbering", {}},
+        // На позиции остаётся одна запись: ячейка с самым длинным текстом, столбец с непустым
+        // заголовком; среди равных - первая по физическому расположению (выбор произвольный)
+        {"duplicate_grid_position", {
+            "DELETE FROM table_cell c USING ( "
+            "    SELECT ctid, ROW_NUMBER() OVER (PARTITION BY template_id, row_order, column_order "
+            "                                    ORDER BY length(COALESCE(content, '')) DESC, ctid) AS n "
+            "    FROM table_cell WHERE template_id = ANY(CAST(:ids AS INTEGER[]))) d "
+            "WHERE c.ctid = d.ctid AND d.n > 1",
+            "DELETE FROM table_row r USING ( "
+            "    SELECT ctid, ROW_NUMBER() OVER (PARTITION BY template_id, row_order ORDER BY ctid) AS n "
+            "    FROM table_row WHERE template_id = ANY(CAST(:ids AS INTEGER[]))) d "
+            "WHERE r.ctid = d.ctid AND d.n > 1",
+            "DELETE FROM table_column k USING ( "
+            "    SELECT ctid, ROW_NUMBER() OVER (PARTITION BY template_id, column_order "
+            "                                    ORDER BY COALESCE(header, '') = '', ctid) AS n "
+            "    FROM table_column WHERE template_id = ANY(CAST(:ids AS INTEGER[]))) d "
+            "WHERE k.ctid = d.ctid AND d.n > 1"}},
+        {"cell_outside_grid", {
+            "DELETE FROM table_cell c WHERE c.template_id = ANY(CAST(:ids AS INTEGER[])) "
+            "AND (NOT EXISTS (SELECT 1 FROM table_row r WHERE r.template_id = c.template_id AND r.row_order = c.row_order) "
+            "  OR NOT EXISTS (SELECT 1 FROM table_column k WHERE k.template_id = c.template_id "
+            "                 AND k.column_order = c.column_order))"}},
+        // Читатели берут упакованную сетку, поэтому построчные остатки удаляются
+        {"mixed_grid_format", {
+            "DELETE FROM table_cell WHERE template_id = ANY(CAST(:ids AS INTEGER[]))",
+            "DELETE FROM table_row WHERE template_id = ANY(CAST(:ids AS INTEGER[]))",
+            "DELETE FROM table_column WHERE template_id = ANY(CAST(:ids AS INTEGER[]))"}},
+        // Ячейки правее последнего столбца удаляются - построчно и в упакованных сетках;
+        // недостающие ячейки не добавляются, они и так читаются как пустые
+        {"ragged_grid", {
+            "DELETE FROM table_cell c WHERE c.template_id = ANY(CAST(:ids AS INTEGER[])) "
+            "AND NOT EXISTS (SELECT 1 FROM table_column k WHERE k.template_id = c.template_id "
+            "                AND k.column_order = c.column_order)",
+            // Каждая строка собирается заново из своих первых columns ячеек
+            "UPDATE template_grid g SET data = jsonb_set(g.data, '{rows}', COALESCE(( "
+            "    SELECT jsonb_agg(( "
+            "        SELECT COALESCE(jsonb_agg(r.cells -> (k.i - 1) ORDER BY k.i), '[]'::jsonb) "
+            "        FROM generate_series(1, LEAST(f.columns, jsonb_array_length(r.cells))) AS k (i)) ORDER BY r.ord) "
+            "    FROM jsonb_array_elements(g.data -> 'rows') WITH ORDINALITY AS r (cells, ord)), '[]'::jsonb)) "
+            "FROM (SELECT template_id, jsonb_array_length(data -> 'headers') AS columns FROM template_grid_full) f "
+            "WHERE f.template_id = g.template_id AND g.template_id = ANY(CAST(:ids AS INTEGER[]))"}},
+        {"stale_cell_count", {
+            "UPDATE table_template t SET cell_count = (SELECT COUNT(*) FROM grid_cell c WHERE c.template_id = t.template_id) "
+            "WHERE t.template_id = ANY(CAST(:ids AS INTEGER[]))"}}
+    };
+
+    // Исправления сеток попадают в историю шаблонов: исходная сетка шаблонов без истории
+    // до исправлений и полная сетка после них, всё в одной транзакции
+    QSet<int> gridFixes;
+    for (const QString &check : {QString("duplicate_grid_position"), QString("cell_outside_grid"),
+                                 QString("mixed_grid_format"), QString("ragged_grid")}) {
+        for (int templateId : idsByCheck.value(check)) gridFixes.insert(templateId);
+    }
+    const QVector<int> gridTemplates(gridFixes.begin(), gridFixes.end());
+    WriteTransaction transaction(db);
+    RevisionManager revisions(db);
+    if (!transaction.isStarted() || !revisions.recordSnapshots(gridTemplates, true)) {
+        return false;
+    }
+
+    QSqlQuery query(db);
+    for (const Fix &fix : fixes) {
+        if (!idsByCheck.contains(fix.check)) continue;
+
+        if (fix.statements.isEmpty()) {
+            if (!CategoryManager(db).renumberProject(projectId)) return false;
+            continue;
+        }
+        for (const QString &statement : fix.statements) {
+            query.prepare(statement);
+            if (statement.contains(":projectId")) {
+                query.bindValue(":projectId", projectId);
+            } else {
+                query.bindValue(":ids", idArray(idsByCheck.value(fix.check)));
+            }
+            if (!execQuery(query)) {
+                qDebug() << "Ошибка исправления" << fix.check << ":" << query.lastError();
+                return false;
+            }
+        }
+    }
+
+    if (!revisions.recordSnapshots(gridTemplates) || !transaction.commit()) {
+        return false;
+    }
+    if (fixed) *fixed = count;
+    return true;
+}
+
+bool ProjectValidator::runCheck(const QString &check, const QString &sql, const QString &message,
+                                int projectId, QVector<ValidationIssue> &issues) {
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare(sql);
+    query.bindValue(":projectId", projectId);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка проверки" << check << ":" << query.lastError();
+        return false;
+    }
+
+    while (query.next()) {
+        issues.append({check, query.value(0).toInt(), message.arg(query.value(1).toString())});
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef PROJECTVALIDATOR_H
+#define PROJECTVALIDATOR_H
+
+#include <QSqlDatabase>
+#include <QString>
+#include <QVector>
+
+// Нарушение целостности данных проекта
+struct ValidationIssue {
+    QString check;      // Имя проверки, например "orphan_category"
+    int itemId;         // Идентификатор категории или шаблона
+    QString message;
+};
+
+// Проверка целостности проекта: ссылки дерева, позиции и глубина соседей, согласованность
+// сеток. Связи проверяются запросами по всему проекту, форма сеток - в памяти параллельно
+// по шаблонам. validate() данные не изменяет; fix() исправляет найденное пакетно.
+class ProjectValidator {
+public:
+    ProjectValidator(QSqlDatabase &db);
+
+    bool validate(int projectId, QVector<ValidationIssue> &issues);
+    // Повторы позиций в построчных сетках; не требует миграций после первой
+    bool validateGridPositions(int projectId, QVector<ValidationIssue> &issues);
+
+    // Один оператор на вид нарушения; вызывать в транзакции. fixed - число исправленных нарушений
+    bool fix(int projectId, const QVector<ValidationIssue> &issues, int *fixed = nullptr);
+    static bool isFixable(const QString &check);
+
+private:
+    bool runCheck(const QString &check, const QString &sql, const QString &message,
+                  int projectId, QVector<ValidationIssue> &issues);
+    bool checkGridShapes(int projectId, QVector<ValidationIssue> &issues);
+
+    QSqlDatabase &db;
+};
+
+#endif // PROJECTVALIDATOR_H
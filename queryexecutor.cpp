@@ -0,0 +1,288 @@
+#include "queryexecutor.h"
+#include "tracing.h"
+#include <QMutexLocker>
+#include <QSettings>
+#include <QSqlDriver>
+#include <QSqlError>
+#include <QtMath>
+#include <QVariant>
+#include <QDebug>
+#include <libpq-fe.h>
+#include <sqlite3.h>
+
+namespace {
+thread_local OperationScope *currentScope = nullptr;
+const QString UnscopedOperation = "(вне операции)";
+
+QString formatParameters(const QSqlQuery &query) {
+    QStringList parts;
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    const QVariantList values = query.boundValues();
+    for (int i = 0; i < values.size(); ++i) {
+        parts << QString("$%1=%2").arg(i + 1).arg(values[i].isNull() ? "NULL" : values[i].toString().left(200));
+    }
+#else
+    const QMap<QString, QVariant> values = query.boundValues();
+    for (auto it = values.constBegin(); it != values.constEnd(); ++it) {
+        parts << QString("%1=%2").arg(it.key(), it.value().isNull() ? "NULL" : it.value().toString().left(200));
+    }
+#endif
+    return parts.join(", ");
+}
+
+int affectedRows(const QSqlQuery &query) {
+    // size() известен не всем драйверам (SQLite возвращает -1)
+    return query.isSelect() ? qMax(0, query.size()) : qMax(0, query.numRowsAffected());
+}
+}
+
+//
+bool execQuery(QSqlQuery &query) {
+    TraceSpan span("sql", "exec");
+    if (span.isActive()) span.setDetail(query.lastQuery());
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = query.exec();
+    QueryStats::instance().recordQuery(query, timer.nsecsElapsed() / 1e6, ok ? affectedRows(query) : 0);
+    return ok;
+}
+
+bool execQuery(QSqlQuery &query, const QString &sql) {
+    TraceSpan span("sql", "exec");
+    if (span.isActive()) span.setDetail(sql);
+    QElapsedTimer timer;
+    timer.start();
+    bool ok = query.exec(sql);
+    QueryStats::instance().recordQuery(query, timer.nsecsElapsed() / 1e6, ok ? affectedRows(query) : 0);
+    return ok;
+}
+
+//
+const QVector<double> OperationStats::BucketBounds = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000};
+
+double OperationStats::percentileMs(double fraction) const {
+    const qint64 target = qCeil(calls * fraction);
+    qint64 seen = 0;
+    for (int i = 0; i < histogram.size(); ++i) {
+        seen += histogram[i];
+        if (seen >= target && seen > 0) {
+            return i < BucketBounds.size() ? BucketBounds[i] : maxMs;
+        }
+    }
+    return maxMs;
+}
+
+//
+QueryStats::QueryStats()
+    : slowThreshold(QSettings().value("diagnostics/slowQueryMs", 100.0).toDouble()) {}
+
+QueryStats &QueryStats::instance() {
+    static QueryStats stats;
+    return stats;
+}
+
+QVector<OperationStats> QueryStats::operations() const {
+    QMutexLocker locker(&mutex);
+    QVector<OperationStats> result;
+    result.reserve(stats.size());
+    for (const OperationStats &operation : stats) result.append(operation);
+    return result;
+}
+
+QVector<SlowQuery> QueryStats::slowQueries() const {
+    QMutexLocker locker(&mutex);
+
+    // Из кольцевого буфера - от новых к старым
+    QVector<SlowQuery> result;
+    result.reserve(slowLog.size());
+    for (int i = 1; i <= slowLog.size(); ++i) {
+        result.append(slowLog[(slowLogNext - i + slowLog.size()) % slowLog.size()]);
+    }
+    return result;
+}
+
+void QueryStats::reset() {
+    QMutexLocker locker(&mutex);
+    stats.clear();
+    slowLog.clear();
+    slowLogNext = 0;
+}
+
+double QueryStats::slowThresholdMs() const {
+    QMutexLocker locker(&mutex);
+    return slowThreshold;
+}
+
+void QueryStats::setSlowThresholdMs(double ms) {
+    QMutexLocker locker(&mutex);
+    slowThreshold = ms;
+    QSettings().setValue("diagnostics/slowQueryMs", ms);
+}
+
+void QueryStats::recordQuery(const QSqlQuery &query, double ms, int rows) {
+    OperationScope *scope = currentScope;
+    if (scope) {
+        ++scope->queries;
+        scope->rows += rows;
+    } else {
+        // Запрос вне операции считается отдельным вызовом
+        recordOperation(UnscopedOperation, ms, 1, rows);
+    }
+
+    QMutexLocker locker(&mutex);
+    if (ms < slowThreshold) return;
+
+    SlowQuery entry{QDateTime::currentDateTime(), scope ? scope->name() : UnscopedOperation,
+                    query.lastQuery(), formatParameters(query), ms};
+    if (slowLog.size() < SlowLogCapacity) {
+        slowLog.append(entry);
+    } else {
+        slowLog[slowLogNext] = entry;
+    }
+    slowLogNext = (slowLogNext + 1) % SlowLogCapacity;
+    locker.unlock();
+
+    qDebug() << "Медленный запрос" << qRound(ms) << "мс:" << entry.operation << entry.sql << entry.parameters;
+}
+
+void QueryStats::recordOperation(const QString &name, double ms, int queries, qint64 rows) {
+    QMutexLocker locker(&mutex);
+    OperationStats &operation = stats[name];
+    if (operation.histogram.isEmpty()) {
+        operation.name = name;
+        operation.histogram.resize(OperationStats::BucketBounds.size() + 1);
+    }
+
+    ++operation.calls;
+    operation.queries += queries;
+    operation.rows += rows;
+    operation.totalMs += ms;
+    operation.maxMs = qMax(operation.maxMs, ms);
+
+    int bucket = 0;
+    while (bucket < OperationStats::BucketBounds.size() && ms > OperationStats::BucketBounds[bucket]) ++bucket;
+    ++operation.histogram[bucket];
+}
+
+//
+OperationScope::OperationScope(const QString &name)
+    : operationName(name), parent(currentScope) {
+    timer.start();
+    currentScope = this;
+}
+
+OperationScope::~OperationScope() {
+    currentScope = parent;
+    if (parent) {
+        parent->queries += queries;
+        parent->rows += rows;
+    }
+    QueryStats::instance().recordOperation(operationName, timer.nsecsElapsed() / 1e6, queries, rows);
+}
+
+OperationScope *OperationScope::current() {
+    return currentScope;
+}
+
+//
+namespace {
+// Соединение libpq или nullptr для других драйверов
+PGconn *pgConnection(const QSqlDatabase &db) {
+    QVariant handle = db.driver()->handle();
+    if (handle.isValid() && qstrcmp(handle.typeName(), "PGconn*") == 0) {
+        return *static_cast<PGconn **>(handle.data());
+    }
+    return nullptr;
+}
+
+// Открыта ли на соединении транзакция. QPSQL и QSQLITE об этом не сообщают,
+// поэтому состояние берётся у libpq или sqlite3 по дескриптору драйвера
+bool inTransaction(const QSqlDatabase &db) {
+    QVariant handle = db.driver()->handle();
+    if (!handle.isValid()) return false;
+    if (qstrcmp(handle.typeName(), "PGconn*") == 0) {
+        PGconn *conn = *static_cast<PGconn **>(handle.data());
+        return conn && PQtransactionStatus(conn) != PQTRANS_IDLE;
+    }
+    if (qstrcmp(handle.typeName(), "sqlite3*") == 0) {
+        sqlite3 *conn = *static_cast<sqlite3 **>(handle.data());
+        return conn && !sqlite3_get_autocommit(conn);  // Вне транзакции SQLite в режиме автофиксации
+    }
+    return false;
+}
+}
+
+ReadSnapshot::ReadSnapshot(QSqlDatabase db) : db(db) {
+    if (!db.isOpen()) return;
+
+    if (inTransaction(db)) {
+        started = true;
+        return;
+    }
+
+    if (!db.transaction()) {
+        qDebug() << "Ошибка начала транзакции чтения:" << db.lastError().text();
+        return;
+    }
+    started = active = true;
+
+    if (pgConnection(db)) {
+        QSqlQuery query(db);
+        if (!execQuery(query, "SET TRANSACTION ISOLATION LEVEL REPEATABLE READ, READ ONLY")) {
+            // Прерванная транзакция не даст выполнить чтение, поэтому читаем без неё
+            qDebug() << "Ошибка установки уровня изоляции чтения:" << query.lastError();
+            db.rollback();
+            started = active = false;
+        }
+    }
+}
+
+ReadSnapshot::~ReadSnapshot() {
+    // Транзакция только читала данные, фиксация и откат равноценны
+    if (active && !db.commit()) {
+        db.rollback();
+    }
+}
+
+//
+WriteTransaction::WriteTransaction(QSqlDatabase db) : db(db) {
+    if (inTransaction(db)) {
+        started = true;     // Изменение входит во внешнюю транзакцию
+        return;
+    }
+    if (db.transaction()) {
+        started = active = true;
+    } else {
+        qDebug() << "Ошибка начала транзакции:" << db.lastError().text();
+    }
+}
+
+WriteTransaction::~WriteTransaction() {
+    if (active) {
+        db.rollback();
+    }
+}
+
+bool WriteTransaction::commit() {
+    if (!active) return started;
+    active = false;
+    if (!db.commit()) {
+        qDebug() << "Ошибка фиксации транзакции:" << db.lastError().text();
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+
+bool WriteTransaction::lockRows(const QString &table, const QString &keyColumn, int key) {
+    // SQLite блокирует базу целиком при первой записи, построчных блокировок в нём нет
+    if (!pgConnection(db)) return true;
+    QSqlQuery query(db);
+    query.prepare(QString("SELECT 1 FROM %1 WHERE %2 = :key FOR UPDATE").arg(table, keyColumn));
+    query.bindValue(":key", key);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка блокировки записей" << table << ":" << query.lastError();
+        return false;
+    }
+    return true;
+}
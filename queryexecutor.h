@@ -0,0 +1,135 @@
+#ifndef QUERYEXECUTOR_H
+#define QUERYEXECUTOR_H
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QString>
+#include <QVector>
+
+// Выполнение запроса с замером времени. Все запросы менеджеров идут через эти
+// функции: время, число строк и обращение к серверу относятся к текущей
+// логической операции (OperationScope), медленные запросы попадают в журнал.
+bool execQuery(QSqlQuery &query);
+bool execQuery(QSqlQuery &query, const QString &sql);
+
+// Статистика одной логической операции ("Открытие шаблона" и т.п.)
+struct OperationStats {
+    static const QVector<double> BucketBounds;  // Верхние границы интервалов гистограммы, мс
+
+    QString name;
+    qint64 calls = 0;
+    qint64 queries = 0;         // Обращений к серверу за все вызовы
+    qint64 rows = 0;            // Прочитано или изменено строк за все вызовы
+    double totalMs = 0;
+    double maxMs = 0;
+    QVector<qint64> histogram;  // Число вызовов по интервалам BucketBounds (+ последний - выше всех)
+
+    double percentileMs(double fraction) const;   // Оценка по верхней границе интервала
+};
+
+struct SlowQuery {
+    QDateTime at;
+    QString operation;
+    QString sql;
+    QString parameters;
+    double ms;
+};
+
+// Накопленная статистика процесса, общая для всех потоков
+class QueryStats {
+public:
+    static QueryStats &instance();
+
+    QVector<OperationStats> operations() const;
+    QVector<SlowQuery> slowQueries() const;
+    void reset();
+
+    double slowThresholdMs() const;
+    void setSlowThresholdMs(double ms);
+
+    void recordQuery(const QSqlQuery &query, double ms, int rows);
+    void recordOperation(const QString &name, double ms, int queries, qint64 rows);
+
+private:
+    QueryStats();
+
+    static const int SlowLogCapacity = 200;
+
+    mutable QMutex mutex;
+    QHash<QString, OperationStats> stats;
+    QVector<SlowQuery> slowLog;     // Кольцевой буфер последних медленных запросов
+    int slowLogNext = 0;
+    double slowThreshold;
+};
+
+// Логическая операция на время жизни объекта. Вложенные операции учитываются
+// отдельно и добавляют свои запросы к внешней.
+class OperationScope {
+public:
+    explicit OperationScope(const QString &name);
+    ~OperationScope();
+
+    OperationScope(const OperationScope &) = delete;
+    OperationScope &operator=(const OperationScope &) = delete;
+
+    static OperationScope *current();
+    QString name() const { return operationName; }
+
+private:
+    friend class QueryStats;
+
+    QString operationName;
+    QElapsedTimer timer;
+    OperationScope *parent;
+    int queries = 0;
+    qint64 rows = 0;
+};
+
+// Согласованное чтение несколькими запросами на время жизни объекта: на сервере
+// транзакция REPEATABLE READ READ ONLY, в SQLite обычная транзакция. Если соединение
+// уже находится в транзакции, чтение идёт в ней и объект ничего не делает.
+class ReadSnapshot {
+public:
+    explicit ReadSnapshot(QSqlDatabase db);
+    ~ReadSnapshot();
+
+    ReadSnapshot(const ReadSnapshot &) = delete;
+    ReadSnapshot &operator=(const ReadSnapshot &) = delete;
+
+    // Чтение идёт в транзакции (своей или внешней); иначе каждый запрос видит свои данные
+    bool isStarted() const { return started; }
+
+private:
+    QSqlDatabase db;
+    bool started = false;
+    bool active = false;
+};
+
+// Изменение из нескольких запросов на время жизни объекта. Если соединение уже
+// находится в транзакции, изменение входит в неё, и commit() ничего не фиксирует.
+// Без вызова commit() начатая объектом транзакция откатывается.
+class WriteTransaction {
+public:
+    explicit WriteTransaction(QSqlDatabase db);
+    ~WriteTransaction();
+
+    WriteTransaction(const WriteTransaction &) = delete;
+    WriteTransaction &operator=(const WriteTransaction &) = delete;
+
+    bool isStarted() const { return started; }
+    bool commit();
+
+    // Блокировка изменяемых записей до конца транзакции (SELECT ... FOR UPDATE на сервере)
+    bool lockRows(const QString &table, const QString &keyColumn, int key);
+
+private:
+    QSqlDatabase db;
+    bool started = false;   // Запросы выполняются внутри транзакции
+    bool active = false;    // Транзакция начата этим объектом
+};
+
+#endif // QUERYEXECUTOR_H
@@ -0,0 +1,321 @@
+#include "replicasync.h"
+#include "queryexecutor.h"
+#include "localreplica.h"
+#include "pgcopy.h"
+#include "revisionmanager.h"
+#include <QHash>
+#include <QSet>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+
+namespace {
+
+const int SyncIntervalMs = 3000;
+const int BatchSize = 50;
+const int MaxBatchesPerRound = 20;
+
+struct JournalEntry {
+    int templateId;
+    int baseVersion;
+    int seq;
+};
+
+struct LocalTemplate {
+    QString name;
+    QVariant notes;             // NULL переносится на сервер как NULL
+    QVariant programmingNotes;
+    bool isApproved;
+};
+
+const QStringList GridTables = {"table_column", "table_row", "table_cell"};
+const QString GridColumns[] = {
+    "template_id, column_order, header",
+    "template_id, row_order",
+    "template_id, row_order, column_order, content"
+};
+
+} // namespace
+
+ReplicaSync::ReplicaSync(const QString &sourceConnectionName, const QString &replicaPath, QObject *parent)
+    : QObject(parent), sourceConnectionName(sourceConnectionName), replicaPath(replicaPath),
+      serverConnectionName(QString("sync_server_%1").arg(quintptr(this))),
+      localConnectionName(QString("sync_local_%1").arg(quintptr(this))) {}
+
+ReplicaSync::~ReplicaSync() {
+    closeConnections();
+}
+
+void ReplicaSync::start() {
+    // Собственные соединения рабочего потока
+    server = QSqlDatabase::cloneDatabase(sourceConnectionName, serverConnectionName);
+    local = QSqlDatabase::addDatabase("QSQLITE", localConnectionName);
+    local.setDatabaseName(replicaPath);
+    local.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+
+    if (!local.open() || !LocalReplica::prepareSchema(local)) {
+        emit failed("Ошибка открытия локальной реплики: " + local.lastError().text());
+        closeConnections();
+        return;
+    }
+
+    timer = new QTimer(this);
+    timer->setInterval(SyncIntervalMs);
+    connect(timer, &QTimer::timeout, this, &ReplicaSync::syncNow);
+    timer->start();
+    syncNow();
+}
+
+void ReplicaSync::stop() {
+    if (timer) timer->stop();
+    closeConnections();
+}
+
+void ReplicaSync::closeConnections() {
+    if (server.isValid()) {
+        server.close();
+        server = QSqlDatabase();
+        QSqlDatabase::removeDatabase(serverConnectionName);
+    }
+    if (local.isValid()) {
+        local.close();
+        local = QSqlDatabase();
+        QSqlDatabase::removeDatabase(localConnectionName);
+    }
+}
+
+void ReplicaSync::syncNow() {
+    if (!local.isOpen()) return;
+
+    // Без сервера правки просто копятся в журнале до следующей попытки
+    if (!server.isOpen() && !server.open()) {
+        return;
+    }
+
+    int total = 0;
+    for (int batch = 0; batch < MaxBatchesPerRound; ++batch) {
+        int pushed = 0;
+        if (!pushBatch(pushed)) {
+            // Соединение переоткрывается на следующем шаге таймера
+            server.close();
+            break;
+        }
+        if (pushed == 0) break;
+        total += pushed;
+    }
+
+    if (total > 0) {
+        QSqlQuery query(local);
+        int pending = (execQuery(query, "SELECT COUNT(*) FROM sync_journal") && query.next()) ? query.value(0).toInt() : 0;
+        emit synced(total, pending);
+    }
+}
+
+bool ReplicaSync::pushBatch(int &pushed) {
+    pushed = 0;
+
+    // Шаг 1: журнал и состояние шаблонов читаются из реплики одним снимком
+    QVector<JournalEntry> entries;
+    QHash<int, LocalTemplate> templates;
+    QHash<QString, QVector<QVariantList>> gridRows;
+
+    if (!local.transaction()) {
+        emit failed("Ошибка чтения локальной реплики: " + local.lastError().text());
+        return false;
+    }
+    QSqlQuery query(local);
+    query.prepare("SELECT template_id, base_version, seq FROM sync_journal WHERE conflict = 0 "
+                  "ORDER BY template_id LIMIT :limit");
+    query.bindValue(":limit", BatchSize);
+    if (!execQuery(query)) {
+        local.rollback();
+        emit failed("Ошибка чтения журнала реплики: " + query.lastError().text());
+        return false;
+    }
+    QStringList ids;
+    while (query.next()) {
+        entries.append({query.value(0).toInt(), query.value(1).toInt(), query.value(2).toInt()});
+        ids.append(QString::number(entries.last().templateId));
+    }
+    if (entries.isEmpty()) {
+        local.commit();
+        return true;
+    }
+
+    const QString idList = ids.join(',');
+    execQuery(query, "SELECT template_id, name, notes, programming_notes, is_approved FROM table_template "
+               "WHERE template_id IN (" + idList + ")");
+    while (query.next()) {
+        templates.insert(query.value(0).toInt(), {query.value(1).toString(), query.value(2),
+                                                  query.value(3), query.value(4).toBool()});
+    }
+    for (int i = 0; i < GridTables.size(); ++i) {
+        execQuery(query, QString("SELECT %1 FROM %2 WHERE template_id IN (%3)").arg(GridColumns[i], GridTables[i], idList));
+        QVector<QVariantList> &rows = gridRows[GridTables[i]];
+        const int columnCount = GridColumns[i].count(',') + 1;
+        while (query.next()) {
+            // Значения хранятся как есть, чтобы NULL не превратился в пустую строку
+            QVariantList row;
+            for (int col = 0; col < columnCount; ++col) row.append(query.value(col));
+            rows.append(row);
+        }
+    }
+    local.commit();
+
+    // Шаг 2: проверка версий и запись на сервер в одной транзакции
+    QVector<JournalEntry> accepted;
+    QVector<int> conflicts;
+    QVector<int> dropped;
+    QHash<int, int> newVersions;
+
+    auto failServer = [this](const QString &message) {
+        server.rollback();
+        emit failed("Ошибка синхронизации: " + message);
+        return false;
+    };
+
+    if (!server.transaction()) {
+        emit failed("Ошибка синхронизации: " + server.lastError().text());
+        return false;
+    }
+
+    QSqlQuery serverQuery(server);
+    const QString idArray = "{" + idList + "}";
+    serverQuery.prepare("SELECT template_id, version FROM table_template "
+                        "WHERE template_id = ANY(CAST(:ids AS INTEGER[])) FOR UPDATE");
+    serverQuery.bindValue(":ids", idArray);
+    if (!execQuery(serverQuery)) return failServer(serverQuery.lastError().text());
+    QHash<int, int> serverVersions;
+    while (serverQuery.next()) {
+        serverVersions.insert(serverQuery.value(0).toInt(), serverQuery.value(1).toInt());
+    }
+
+    QStringList acceptedIds;
+    for (const JournalEntry &entry : entries) {
+        if (!templates.contains(entry.templateId)) {
+            dropped.append(entry.templateId);       // Шаблона больше нет в реплике
+        } else if (!serverVersions.contains(entry.templateId) ||
+                   serverVersions.value(entry.templateId) != entry.baseVersion) {
+            conflicts.append(entry.templateId);     // Шаблон изменён или удалён на сервере
+        } else {
+            accepted.append(entry);
+            acceptedIds.append(QString::number(entry.templateId));
+        }
+    }
+
+    if (!accepted.isEmpty()) {
+        const QString acceptedArray = "{" + acceptedIds.join(',') + "}";
+        QSet<int> acceptedSet;
+        QVector<int> acceptedTemplates;
+        for (const JournalEntry &entry : accepted) acceptedTemplates.append(entry.templateId);
+
+        // Серверная сетка шаблонов без истории сохраняется до замены локальной
+        RevisionManager revisions(server);
+        if (!revisions.recordSnapshots(acceptedTemplates, true)) {
+            return failServer("не удалось записать ревизии шаблонов");
+        }
+
+        serverQuery.prepare("UPDATE table_template SET name = :name, notes = :notes, "
+                            "programming_notes = :programmingNotes, is_approved = :approved "
+                            "WHERE template_id = :templateId");
+        for (const JournalEntry &entry : accepted) {
+            const LocalTemplate &tmpl = templates[entry.templateId];
+            serverQuery.bindValue(":name", tmpl.name);
+            serverQuery.bindValue(":notes", tmpl.notes);
+            serverQuery.bindValue(":programmingNotes", tmpl.programmingNotes);
+            serverQuery.bindValue(":approved", tmpl.isApproved);
+            serverQuery.bindValue(":templateId", entry.templateId);
+            if (!execQuery(serverQuery)) return failServer(serverQuery.lastError().text());
+            acceptedSet.insert(entry.templateId);
+        }
+
+        // Сетки заменяются целиком: удаление одним оператором на таблицу и загрузка через COPY
+        for (const QString &table : {QString("table_cell"), QString("table_row"), QString("table_column")}) {
+            serverQuery.prepare(QString("DELETE FROM %1 WHERE template_id = ANY(CAST(:ids AS INTEGER[]))").arg(table));
+            serverQuery.bindValue(":ids", acceptedArray);
+            if (!execQuery(serverQuery)) return failServer(serverQuery.lastError().text());
+        }
+
+        PgCopyWriter writer(server);
+        for (int i = 0; i < GridTables.size(); ++i) {
+            if (!writer.begin(QString("COPY %1 (%2) FROM STDIN").arg(GridTables[i], GridColumns[i]))) {
+                return failServer(writer.lastError());
+            }
+            for (const QVariantList &row : gridRows.value(GridTables[i])) {
+                if (!acceptedSet.contains(row.first().toInt())) continue;
+                if (!writer.writeValues(row)) {
+                    writer.abort();
+                    return failServer(writer.lastError());
+                }
+            }
+            if (!writer.end()) return failServer(writer.lastError());
+        }
+
+        // Шаблоны, упакованные на сервере, упаковываются заново из только что загруженных строк
+        serverQuery.prepare("SELECT pack_template_grids(ARRAY(SELECT template_id FROM template_grid "
+                            "WHERE template_id = ANY(CAST(:ids AS INTEGER[]))))");
+        serverQuery.bindValue(":ids", acceptedArray);
+        if (!execQuery(serverQuery)) return failServer(serverQuery.lastError().text());
+        if (!revisions.recordSnapshots(acceptedTemplates)) {
+            return failServer("не удалось записать ревизии шаблонов");
+        }
+
+        serverQuery.prepare("SELECT template_id, version FROM table_template "
+                            "WHERE template_id = ANY(CAST(:ids AS INTEGER[]))");
+        serverQuery.bindValue(":ids", acceptedArray);
+        if (!execQuery(serverQuery)) return failServer(serverQuery.lastError().text());
+        while (serverQuery.next()) {
+            newVersions.insert(serverQuery.value(0).toInt(), serverQuery.value(1).toInt());
+        }
+    }
+
+    if (!server.commit()) {
+        return failServer(server.lastError().text());
+    }
+
+    // Шаг 3: отметки в журнале реплики. Если шаблон правили во время отправки,
+    // запись остаётся и отправится снова уже от новой серверной версии
+    if (!local.transaction()) {
+        emit failed("Ошибка обновления журнала реплики: " + local.lastError().text());
+        return false;
+    }
+    QSqlQuery update(local);
+    for (const JournalEntry &entry : accepted) {
+        const int version = newVersions.value(entry.templateId);
+        update.prepare("UPDATE table_template SET version = :version WHERE template_id = :templateId");
+        update.bindValue(":version", version);
+        update.bindValue(":templateId", entry.templateId);
+        execQuery(update);
+
+        update.prepare("DELETE FROM sync_journal WHERE template_id = :templateId AND seq = :seq");
+        update.bindValue(":templateId", entry.templateId);
+        update.bindValue(":seq", entry.seq);
+        execQuery(update);
+        if (update.numRowsAffected() == 0) {
+            update.prepare("UPDATE sync_journal SET base_version = :version WHERE template_id = :templateId");
+            update.bindValue(":version", version);
+            update.bindValue(":templateId", entry.templateId);
+            execQuery(update);
+        }
+    }
+    for (int templateId : conflicts) {
+        update.prepare("UPDATE sync_journal SET conflict = 1 WHERE template_id = :templateId");
+        update.bindValue(":templateId", templateId);
+        execQuery(update);
+    }
+    for (int templateId : dropped) {
+        update.prepare("DELETE FROM sync_journal WHERE template_id = :templateId");
+        update.bindValue(":templateId", templateId);
+        execQuery(update);
+    }
+    if (!local.commit()) {
+        emit failed("Ошибка обновления журнала реплики: " + local.lastError().text());
+        return false;
+    }
+
+    for (int templateId : conflicts) {
+        emit conflict(templateId);
+    }
+    pushed = accepted.size();
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef REPLICASYNC_H
+#define REPLICASYNC_H
+
+#include <QObject>
+#include <QSqlDatabase>
+#include <QTimer>
+
+// Фоновая отправка изменений локальной реплики в PostgreSQL.
+// Объект переносится в рабочий поток и открывает там собственные соединения
+// с сервером и с файлом реплики. Изменённые шаблоны отправляются пакетами
+// в одной транзакции; шаблон, версия которого на сервере ушла вперёд
+// от версии, с которой начаты локальные правки, отмечается как конфликт.
+class ReplicaSync : public QObject {
+    Q_OBJECT
+
+public:
+    ReplicaSync(const QString &sourceConnectionName, const QString &replicaPath, QObject *parent = nullptr);
+    ~ReplicaSync();
+
+public slots:
+    void start();
+    void stop();
+    void syncNow();
+
+signals:
+    void synced(int pushedTemplates, int pendingTemplates);
+    void conflict(int templateId);
+    void failed(const QString &message);
+
+private:
+    bool pushBatch(int &pushed);
+    void closeConnections();
+
+    QString sourceConnectionName;
+    QString replicaPath;
+    QString serverConnectionName;
+    QString localConnectionName;
+    QSqlDatabase server;
+    QSqlDatabase local;
+    QTimer *timer = nullptr;
+};
+
+#endif // REPLICASYNC_H
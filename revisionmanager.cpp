@@ -0,0 +1,238 @@
+#include "revisionmanager.h"
+#include "tablemanager.h"
+#include "queryexecutor.h"
+#include "tracing.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QStringList>
+#include <QDebug>
+
+namespace {
+
+int columnCount(const TemplateGrid &grid) {
+    int columns = grid.headers.size();
+    for (const QVector<QString> &row : grid.cells) {
+        columns = qMax(columns, int(row.size()));
+    }
+    return columns;
+}
+
+QString cellAt(const TemplateGrid &grid, int row, int column) {
+    if (row >= grid.cells.size() || column >= grid.cells[row].size()) return QString();
+    return grid.cells[row][column];
+}
+
+// Изменения: размеры новой сетки, заголовки (если изменились) и ячейки [строка, столбец, текст],
+// отличающиеся от предыдущей сетки. Ячейки за пределами предыдущей сетки считаются пустыми
+QJsonObject makeDelta(const TemplateGrid &previous, const TemplateGrid &current, int &changedCells) {
+    const int rows = current.cells.size();
+    const int columns = columnCount(current);
+
+    QJsonObject delta{{"rows", rows}, {"columns", columns}};
+    if (current.headers != previous.headers) {
+        QJsonArray headers;
+        for (const QString &header : current.headers) headers.append(header);
+        delta.insert("headers", headers);
+    }
+
+    QJsonArray cells;
+    for (int row = 0; row < rows; ++row) {
+        for (int column = 0; column < columns; ++column) {
+            const QString text = cellAt(current, row, column);
+            if (text != cellAt(previous, row, column)) {
+                cells.append(QJsonArray{row, column, text});
+            }
+        }
+    }
+    changedCells = cells.size();
+    delta.insert("cells", cells);
+    return delta;
+}
+
+void applyDelta(TemplateGrid &grid, const QJsonObject &delta) {
+    const int rows = delta.value("rows").toInt();
+    const int columns = delta.value("columns").toInt();
+
+    if (delta.contains("headers")) {
+        grid.headers.clear();
+        for (const QJsonValue &header : delta.value("headers").toArray()) {
+            grid.headers.append(header.toString());
+        }
+    }
+    grid.cells.resize(rows);
+    for (QVector<QString> &row : grid.cells) {
+        row.resize(columns);
+    }
+
+    for (const QJsonValue &value : delta.value("cells").toArray()) {
+        const QJsonArray cell = value.toArray();
+        const int row = cell.at(0).toInt();
+        const int column = cell.at(1).toInt();
+        if (row < rows && column < columns) {
+            grid.cells[row][column] = cell.at(2).toString();
+        }
+    }
+}
+
+} // namespace
+
+RevisionManager::RevisionManager(QSqlDatabase &db) : db(db) {}
+
+int RevisionManager::latestRevision(int templateId) {
+    QSqlQuery query(db);
+    query.prepare("SELECT COALESCE(MAX(revision), 0) FROM template_revision WHERE template_id = :templateId");
+    query.bindValue(":templateId", templateId);
+
+    if (!execQuery(query) || !query.next()) {
+        qDebug() << "Ошибка чтения последней ревизии:" << query.lastError();
+        return -1;
+    }
+    return query.value(0).toInt();
+}
+
+bool RevisionManager::recordRevision(int templateId, const TemplateGrid &grid, int *revision) {
+    TRACE_SCOPE("manager", "RevisionManager::recordRevision");
+    // Номер выдаётся под блокировкой шаблона: одновременные сохранения выстраиваются
+    // в очередь и не получают одинаковый номер. Внутри транзакции сохранения сетки
+    // ревизия фиксируется вместе с ней
+    WriteTransaction transaction(db);
+    if (!transaction.isStarted() || !transaction.lockRows("table_template", "template_id", templateId)) {
+        return false;
+    }
+
+    const int latest = latestRevision(templateId);
+    if (latest < 0) return false;
+
+    TemplateGrid previous;
+    if (latest > 0 && !reconstruct(templateId, latest, previous)) {
+        return false;
+    }
+
+    int changedCells = 0;
+    const QJsonObject delta = makeDelta(previous, grid, changedCells);
+    const bool sameShape = previous.cells.size() == grid.cells.size() && columnCount(previous) == columnCount(grid);
+    if (latest > 0 && changedCells == 0 && sameShape && !delta.contains("headers")) {
+        if (revision) *revision = latest;
+        return true;    // Сохранение без изменений не создаёт ревизию
+    }
+
+    const int next = latest + 1;
+    const QString deltaData = QString::fromUtf8(QJsonDocument(delta).toJson(QJsonDocument::Compact));
+    const QString snapshotData = TemplateManager::packGrid(grid);
+    const bool isSnapshot = latest == 0 || next % SnapshotInterval == 1 || deltaData.size() >= snapshotData.size();
+
+    // Номер вычисляется в самом запросе; под блокировкой он совпадает с next
+    QSqlQuery query(db);
+    query.prepare("INSERT INTO template_revision (template_id, revision, is_snapshot, changed_cells, data) "
+                  "SELECT :templateId, COALESCE(MAX(revision), 0) + 1, :isSnapshot, :changedCells, :data "
+                  "FROM template_revision WHERE template_id = :templateId2");
+    query.bindValue(":templateId", templateId);
+    query.bindValue(":templateId2", templateId);
+    query.bindValue(":isSnapshot", isSnapshot);
+    query.bindValue(":changedCells", changedCells);
+    query.bindValue(":data", isSnapshot ? snapshotData : deltaData);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка записи ревизии шаблона:" << query.lastError();
+        return false;
+    }
+
+    if (!transaction.commit()) return false;
+    if (revision) *revision = next;
+    return true;
+}
+
+bool RevisionManager::recordSnapshots(const QVector<int> &templateIds, bool onlyWithoutHistory) {
+    TRACE_SCOPE("manager", "RevisionManager::recordSnapshots");
+    if (templateIds.isEmpty()) return true;
+
+    QStringList ids;
+    for (int templateId : templateIds) ids.append(QString::number(templateId));
+
+    QSqlQuery query(db);
+    query.prepare("SELECT record_grid_revisions(CAST(:ids AS INTEGER[]), :onlyWithoutHistory)");
+    query.bindValue(":ids", "{" + ids.join(',') + "}");
+    query.bindValue(":onlyWithoutHistory", onlyWithoutHistory);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка записи пакетных ревизий:" << query.lastError();
+        return false;
+    }
+    return true;
+}
+
+QVector<TemplateRevision> RevisionManager::listRevisions(int templateId) {
+    TRACE_SCOPE("manager", "RevisionManager::listRevisions");
+    QVector<TemplateRevision> revisions;
+    QSqlQuery query(db);
+    query.prepare("SELECT revision, created_at, is_snapshot, changed_cells FROM template_revision "
+                  "WHERE template_id = :templateId ORDER BY revision DESC");
+    query.bindValue(":templateId", templateId);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка загрузки ревизий шаблона:" << query.lastError();
+        return revisions;
+    }
+
+    while (query.next()) {
+        revisions.append({
+            query.value(0).toInt(),
+            query.value(1).toDateTime(),
+            query.value(2).toBool(),
+            query.value(3).toInt()
+        });
+    }
+    return revisions;
+}
+
+bool RevisionManager::reconstruct(int templateId, int revision, TemplateGrid &grid) {
+    TRACE_SCOPE("manager", "RevisionManager::reconstruct");
+    // Ближайшая полная сетка не позже ревизии и изменения после неё одним запросом
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+    query.prepare("SELECT is_snapshot, data FROM template_revision "
+                  "WHERE template_id = :templateId AND revision <= :revision "
+                  "AND revision >= (SELECT MAX(revision) FROM template_revision "
+                  "                 WHERE template_id = :templateId2 AND revision <= :revision2 AND is_snapshot) "
+                  "ORDER BY revision");
+    query.bindValue(":templateId", templateId);
+    query.bindValue(":revision", revision);
+    query.bindValue(":templateId2", templateId);
+    query.bindValue(":revision2", revision);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка загрузки ревизии шаблона:" << query.lastError();
+        return false;
+    }
+
+    bool found = false;
+    while (query.next()) {
+        const QString data = query.value(1).toString();
+        if (query.value(0).toBool()) {
+            if (!TemplateManager::unpackGrid(data, grid)) {
+                qDebug() << "Повреждена полная сетка ревизии шаблона" << templateId;
+                return false;
+            }
+            found = true;
+        } else if (found) {
+            applyDelta(grid, QJsonDocument::fromJson(data.toUtf8()).object());
+        }
+    }
+
+    if (!found) {
+        qDebug() << "Ревизия" << revision << "шаблона" << templateId << "не найдена";
+    }
+    return found;
+}
+
+bool RevisionManager::revert(int templateId, int revision) {
+    TRACE_SCOPE("manager", "RevisionManager::revert");
+    TemplateGrid grid;
+    if (!reconstruct(templateId, revision, grid)) {
+        return false;
+    }
+    return TableManager(db).saveDataTableTemplate(templateId, grid.headers, grid.cells);
+}
@@ -0,0 +1,48 @@
+#ifndef REVISIONMANAGER_H
+#define REVISIONMANAGER_H
+
+#include <QDateTime>
+#include <QSqlDatabase>
+#include <QString>
+#include <QVector>
+#include "templatemanager.h"
+
+// Запись истории сетки шаблона
+struct TemplateRevision {
+    int revision;
+    QDateTime createdAt;
+    bool isSnapshot;        // Полная сетка; иначе изменения относительно предыдущей ревизии
+    int changedCells;
+};
+
+// История сеток шаблонов. Каждое сохранение добавляет ревизию с изменёнными ячейками
+// относительно предыдущей; раз в SnapshotInterval ревизий (или когда изменения не меньше
+// самой сетки) сохраняется полная сетка, так что восстановление читает не больше
+// SnapshotInterval записей.
+class RevisionManager {
+public:
+    RevisionManager(QSqlDatabase &db);
+
+    // Новая ревизия, если сетка отличается от последней сохранённой
+    bool recordRevision(int templateId, const TemplateGrid &grid, int *revision = nullptr);
+
+    // Полные ревизии текущих сеток многих шаблонов одной вставкой на сервере (PostgreSQL).
+    // Пакетная правка вызывает её дважды в своей транзакции: до изменения с onlyWithoutHistory,
+    // чтобы у шаблонов без истории осталась исходная сетка, и после изменения для всех шаблонов
+    bool recordSnapshots(const QVector<int> &templateIds, bool onlyWithoutHistory = false);
+
+    QVector<TemplateRevision> listRevisions(int templateId);   // От новых к старым
+    bool reconstruct(int templateId, int revision, TemplateGrid &grid);
+
+    // Возврат сетки к ревизии; сам возврат сохраняется как новая ревизия
+    bool revert(int templateId, int revision);
+
+    static const int SnapshotInterval = 20;
+
+private:
+    int latestRevision(int templateId);     // 0 - истории нет, -1 - ошибка
+
+    QSqlDatabase &db;
+};
+
+#endif // REVISIONMANAGER_H
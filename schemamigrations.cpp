@@ -0,0 +1,742 @@
+#include "schemamigrations.h"
+
+namespace {
+
+// Внешний ключ добавляется без проверки существующих строк (NOT VALID): старые сироты
+// остаются видны проверке проекта, а новые записи проверяются сразу
+QString addForeignKey(const QString &name, const QString &table, const QString &column,
+                      const QString &refTable, const QString &refColumn) {
+    return QString(
+        "DO $$ "
+        "BEGIN "
+        "    IF NOT EXISTS (SELECT 1 FROM pg_constraint WHERE conname = '%1') THEN "
+        "        ALTER TABLE %2 ADD CONSTRAINT %1 FOREIGN KEY (%3) "
+        "            REFERENCES %4 (%5) ON DELETE CASCADE NOT VALID; "
+        "    END IF; "
+        "END $$").arg(name, table, column, refTable, refColumn);
+}
+
+QString addPrimaryKey(const QString &table, const QString &column) {
+    return QString(
+        "DO $$ "
+        "BEGIN "
+        "    IF NOT EXISTS (SELECT 1 FROM pg_constraint "
+        "                   WHERE conrelid = '%1'::regclass AND contype = 'p') THEN "
+        "        ALTER TABLE %1 ADD PRIMARY KEY (%2); "
+        "    END IF; "
+        "END $$").arg(table, column);
+}
+
+// Уникальность позиции проверяется в конце транзакции: перенумерация строк и столбцов
+// сдвигает порядковые номера по одной записи и временно даёт совпадения
+QString addPositionKey(const QString &name, const QString &table, const QString &columns) {
+    return QString(
+        "DO $$ "
+        "BEGIN "
+        "    IF NOT EXISTS (SELECT 1 FROM pg_constraint WHERE conname = '%1') THEN "
+        "        ALTER TABLE %2 ADD CONSTRAINT %1 UNIQUE (%3) DEFERRABLE INITIALLY DEFERRED; "
+        "    END IF; "
+        "END $$").arg(name, table, columns);
+}
+
+} // namespace
+
+const QVector<SchemaMigration> &schemaMigrations() {
+    // Порядок и номера не меняются: новые изменения схемы добавляются в конец списка.
+    // Миграции 1-5 повторяют прежнюю идемпотентную подготовку схемы, поэтому
+    // безопасно применяются к базам, созданным до появления журнала миграций
+    static const QVector<SchemaMigration> migrations = {
+        {1, "Базовые таблицы", {
+            "CREATE TABLE IF NOT EXISTS project (project_id SERIAL PRIMARY KEY, name TEXT)",
+            "CREATE TABLE IF NOT EXISTS category ("
+            "    category_id SERIAL PRIMARY KEY, name TEXT, parent_id INTEGER, "
+            "    position INTEGER, depth INTEGER, project_id INTEGER)",
+            "CREATE TABLE IF NOT EXISTS table_template ("
+            "    template_id SERIAL PRIMARY KEY, category_id INTEGER, name TEXT, "
+            "    position INTEGER, notes TEXT, programming_notes TEXT)",
+            "CREATE TABLE IF NOT EXISTS table_column (template_id INTEGER NOT NULL, column_order INTEGER, header TEXT)",
+            "CREATE TABLE IF NOT EXISTS table_row (template_id INTEGER NOT NULL, row_order INTEGER)",
+            "CREATE TABLE IF NOT EXISTS table_cell ("
+            "    template_id INTEGER NOT NULL, row_order INTEGER, column_order INTEGER, content TEXT)"
+        }},
+
+        // Статус утверждения шаблона и проект для фильтрации на сервере
+        {2, "Утверждение шаблонов", {
+            "ALTER TABLE table_template ADD COLUMN IF NOT EXISTS is_approved BOOLEAN NOT NULL DEFAULT FALSE",
+            "ALTER TABLE table_template ADD COLUMN IF NOT EXISTS project_id INTEGER",
+            "UPDATE table_template t SET project_id = c.project_id "
+            "FROM category c WHERE c.category_id = t.category_id AND t.project_id IS NULL",
+            "CREATE INDEX IF NOT EXISTS idx_table_template_project_approved "
+            "ON table_template (project_id, is_approved)"
+        }},
+
+        // Агрегаты по поддеревьям категорий, поддерживаемые триггерами
+        {3, "Агрегаты категорий", {
+            "ALTER TABLE table_template ADD COLUMN IF NOT EXISTS cell_count INTEGER NOT NULL DEFAULT 0",
+            "CREATE TABLE IF NOT EXISTS category_stats ("
+            "    category_id INTEGER PRIMARY KEY REFERENCES category (category_id) ON DELETE CASCADE, "
+            "    template_count INTEGER NOT NULL DEFAULT 0, "
+            "    approved_count INTEGER NOT NULL DEFAULT 0, "
+            "    cell_count BIGINT NOT NULL DEFAULT 0)",
+            // Применение приращений к категории и всем её предкам
+            "CREATE OR REPLACE FUNCTION category_stats_apply(p_category_id INTEGER, d_templates INTEGER, "
+            "                                                d_approved INTEGER, d_cells BIGINT) "
+            "RETURNS void LANGUAGE plpgsql AS $$ "
+            "BEGIN "
+            "    IF p_category_id IS NULL OR (d_templates = 0 AND d_approved = 0 AND d_cells = 0) THEN "
+            "        RETURN; "
+            "    END IF; "
+            "    WITH RECURSIVE ancestors AS ( "
+            "        SELECT category_id, parent_id FROM category WHERE category_id = p_category_id "
+            "        UNION ALL "
+            "        SELECT c.category_id, c.parent_id FROM category c "
+            "        INNER JOIN ancestors a ON c.category_id = a.parent_id "
+            "    ) "
+            "    INSERT INTO category_stats AS s (category_id, template_count, approved_count, cell_count) "
+            "    SELECT category_id, d_templates, d_approved, d_cells FROM ancestors "
+            "    ON CONFLICT (category_id) DO UPDATE SET "
+            "        template_count = s.template_count + EXCLUDED.template_count, "
+            "        approved_count = s.approved_count + EXCLUDED.approved_count, "
+            "        cell_count = s.cell_count + EXCLUDED.cell_count; "
+            "END $$",
+            // Создание, удаление, перемещение и утверждение шаблона
+            "CREATE OR REPLACE FUNCTION table_template_stats_trigger() RETURNS trigger LANGUAGE plpgsql AS $$ "
+            "BEGIN "
+            "    IF TG_OP = 'UPDATE' AND OLD.category_id IS NOT DISTINCT FROM NEW.category_id THEN "
+            "        PERFORM category_stats_apply(NEW.category_id, 0, "
+            "                                     NEW.is_approved::int - OLD.is_approved::int, "
+            "                                     NEW.cell_count - OLD.cell_count); "
+            "        RETURN NULL; "
+            "    END IF; "
+            "    IF TG_OP IN ('UPDATE', 'DELETE') THEN "
+            "        PERFORM category_stats_apply(OLD.category_id, -1, -OLD.is_approved::int, -OLD.cell_count); "
+            "    END IF; "
+            "    IF TG_OP IN ('UPDATE', 'INSERT') THEN "
+            "        PERFORM category_stats_apply(NEW.category_id, 1, NEW.is_approved::int, NEW.cell_count); "
+            "    END IF; "
+            "    RETURN NULL; "
+            "END $$",
+            // Количество ячеек шаблона пересчитывается один раз на оператор
+            "CREATE OR REPLACE FUNCTION table_cell_count_insert_trigger() RETURNS trigger LANGUAGE plpgsql AS $$ "
+            "BEGIN "
+            "    UPDATE table_template t SET cell_count = t.cell_count + n.cnt "
+            "    FROM (SELECT template_id, COUNT(*) AS cnt FROM new_cells GROUP BY template_id) n "
+            "    WHERE t.template_id = n.template_id; "
+            "    RETURN NULL; "
+            "END $$",
+            "CREATE OR REPLACE FUNCTION table_cell_count_delete_trigger() RETURNS trigger LANGUAGE plpgsql AS $$ "
+            "BEGIN "
+            "    UPDATE table_template t SET cell_count = t.cell_count - o.cnt "
+            "    FROM (SELECT template_id, COUNT(*) AS cnt FROM old_cells GROUP BY template_id) o "
+            "    WHERE t.template_id = o.template_id; "
+            "    RETURN NULL; "
+            "END $$",
+            // Перенос категории переносит её итоги от старых предков к новым
+            "CREATE OR REPLACE FUNCTION category_stats_move_trigger() RETURNS trigger LANGUAGE plpgsql AS $$ "
+            "DECLARE "
+            "    s category_stats%ROWTYPE; "
+            "BEGIN "
+            "    IF OLD.parent_id IS NOT DISTINCT FROM NEW.parent_id THEN "
+            "        RETURN NULL; "
+            "    END IF; "
+            "    SELECT * INTO s FROM category_stats WHERE category_id = NEW.category_id; "
+            "    IF NOT FOUND THEN "
+            "        RETURN NULL; "
+            "    END IF; "
+            "    PERFORM category_stats_apply(OLD.parent_id, -s.template_count, -s.approved_count, -s.cell_count); "
+            "    PERFORM category_stats_apply(NEW.parent_id, s.template_count, s.approved_count, s.cell_count); "
+            "    RETURN NULL; "
+            "END $$",
+            "DROP TRIGGER IF EXISTS table_template_stats ON table_template",
+            "DROP TRIGGER IF EXISTS table_cell_count_insert ON table_cell",
+            "DROP TRIGGER IF EXISTS table_cell_count_delete ON table_cell",
+            "DROP TRIGGER IF EXISTS category_stats_move ON category",
+            // Первичное заполнение агрегатов для уже существующих данных
+            "DO $$ "
+            "BEGIN "
+            "    IF NOT EXISTS (SELECT 1 FROM category_stats) THEN "
+            "        UPDATE table_template t SET cell_count = c.cnt "
+            "        FROM (SELECT template_id, COUNT(*) AS cnt FROM table_cell GROUP BY template_id) c "
+            "        WHERE c.template_id = t.template_id; "
+            "        INSERT INTO category_stats (category_id, template_count, approved_count, cell_count) "
+            "        WITH RECURSIVE closure AS ( "
+            "            SELECT category_id AS ancestor_id, category_id FROM category "
+            "            UNION ALL "
+            "            SELECT cl.ancestor_id, c.category_id FROM category c "
+            "            INNER JOIN closure cl ON c.parent_id = cl.category_id "
+            "        ) "
+            "        SELECT cl.ancestor_id, COUNT(t.template_id), "
+            "               COUNT(t.template_id) FILTER (WHERE t.is_approved), COALESCE(SUM(t.cell_count), 0) "
+            "        FROM closure cl LEFT JOIN table_template t ON t.category_id = cl.category_id "
+            "        GROUP BY cl.ancestor_id; "
+            "    END IF; "
+            "END $$",
+            "CREATE TRIGGER table_template_stats "
+            "AFTER INSERT OR DELETE OR UPDATE OF category_id, is_approved, cell_count ON table_template "
+            "FOR EACH ROW EXECUTE FUNCTION table_template_stats_trigger()",
+            "CREATE TRIGGER table_cell_count_insert AFTER INSERT ON table_cell "
+            "REFERENCING NEW TABLE AS new_cells FOR EACH STATEMENT EXECUTE FUNCTION table_cell_count_insert_trigger()",
+            "CREATE TRIGGER table_cell_count_delete AFTER DELETE ON table_cell "
+            "REFERENCING OLD TABLE AS old_cells FOR EACH STATEMENT EXECUTE FUNCTION table_cell_count_delete_trigger()",
+            "CREATE TRIGGER category_stats_move AFTER UPDATE OF parent_id ON category "
+            "FOR EACH ROW EXECUTE FUNCTION category_stats_move_trigger()"
+        }},
+
+        // Полнотекстовый поиск: tsvector-столбцы, заполняемые триггерами, и GIN-индексы
+        {4, "Полнотекстовый поиск", {
+            "DO $$ "
+            "BEGIN "
+            "    IF NOT EXISTS (SELECT 1 FROM information_schema.columns "
+            "                   WHERE table_name = 'table_template' AND column_name = 'search_vector') THEN "
+            "        ALTER TABLE table_template ADD COLUMN search_vector tsvector; "
+            "        UPDATE table_template SET search_vector = "
+            "            setweight(to_tsvector('russian', COALESCE(name, '')), 'A') || "
+            "            setweight(to_tsvector('russian', COALESCE(notes, '')), 'B') || "
+            "            setweight(to_tsvector('russian', COALESCE(programming_notes, '')), 'C'); "
+            "    END IF; "
+            "    IF NOT EXISTS (SELECT 1 FROM information_schema.columns "
+            "                   WHERE table_name = 'table_cell' AND column_name = 'search_vector') THEN "
+            "        ALTER TABLE table_cell ADD COLUMN search_vector tsvector; "
+            "        UPDATE table_cell SET search_vector = to_tsvector('russian', COALESCE(content, '')); "
+            "    END IF; "
+            "END $$",
+            "CREATE OR REPLACE FUNCTION table_template_search_trigger() RETURNS trigger LANGUAGE plpgsql AS $$ "
+            "BEGIN "
+            "    NEW.search_vector := "
+            "        setweight(to_tsvector('russian', COALESCE(NEW.name, '')), 'A') || "
+            "        setweight(to_tsvector('russian', COALESCE(NEW.notes, '')), 'B') || "
+            "        setweight(to_tsvector('russian', COALESCE(NEW.programming_notes, '')), 'C'); "
+            "    RETURN NEW; "
+            "END $$",
+            "CREATE OR REPLACE FUNCTION table_cell_search_trigger() RETURNS trigger LANGUAGE plpgsql AS $$ "
+            "BEGIN "
+            "    NEW.search_vector := to_tsvector('russian', COALESCE(NEW.content, '')); "
+            "    RETURN NEW; "
+            "END $$",
+            "DROP TRIGGER IF EXISTS table_template_search ON table_template",
+            "DROP TRIGGER IF EXISTS table_cell_search ON table_cell",
+            "CREATE TRIGGER table_template_search "
+            "BEFORE INSERT OR UPDATE OF name, notes, programming_notes ON table_template "
+            "FOR EACH ROW EXECUTE FUNCTION table_template_search_trigger()",
+            "CREATE TRIGGER table_cell_search BEFORE INSERT OR UPDATE OF content ON table_cell "
+            "FOR EACH ROW EXECUTE FUNCTION table_cell_search_trigger()",
+            "CREATE INDEX IF NOT EXISTS idx_table_template_search ON table_template USING GIN (search_vector)",
+            "CREATE INDEX IF NOT EXISTS idx_table_cell_search ON table_cell USING GIN (search_vector)"
+        }},
+
+        // Версия содержимого шаблона для обнаружения конфликтов при синхронизации локальной реплики
+        {5, "Версии шаблонов", {
+            "ALTER TABLE table_template ADD COLUMN IF NOT EXISTS version INTEGER NOT NULL DEFAULT 0",
+            "CREATE OR REPLACE FUNCTION table_template_version_trigger() RETURNS trigger LANGUAGE plpgsql AS $$ "
+            "BEGIN "
+            "    NEW.version := OLD.version + 1; "
+            "    RETURN NEW; "
+            "END $$",
+            // Изменения сетки повышают версию один раз на оператор
+            "CREATE OR REPLACE FUNCTION template_content_version_trigger() RETURNS trigger LANGUAGE plpgsql AS $$ "
+            "BEGIN "
+            "    UPDATE table_template SET version = version + 1 "
+            "    WHERE template_id IN (SELECT DISTINCT template_id FROM changed_rows); "
+            "    RETURN NULL; "
+            "END $$",
+            "DROP TRIGGER IF EXISTS table_template_version ON table_template",
+            "DROP TRIGGER IF EXISTS table_cell_version_update ON table_cell",
+            "DROP TRIGGER IF EXISTS table_column_version_insert ON table_column",
+            "DROP TRIGGER IF EXISTS table_column_version_update ON table_column",
+            "DROP TRIGGER IF EXISTS table_column_version_delete ON table_column",
+            "DROP TRIGGER IF EXISTS table_row_version_insert ON table_row",
+            "DROP TRIGGER IF EXISTS table_row_version_delete ON table_row",
+            // Вставка и удаление ячеек меняют cell_count и тем самым версию шаблона
+            "CREATE TRIGGER table_template_version "
+            "BEFORE UPDATE OF name, notes, programming_notes, is_approved, cell_count ON table_template "
+            "FOR EACH ROW EXECUTE FUNCTION table_template_version_trigger()",
+            "CREATE TRIGGER table_cell_version_update AFTER UPDATE ON table_cell "
+            "REFERENCING NEW TABLE AS changed_rows FOR EACH STATEMENT EXECUTE FUNCTION template_content_version_trigger()",
+            "CREATE TRIGGER table_column_version_insert AFTER INSERT ON table_column "
+            "REFERENCING NEW TABLE AS changed_rows FOR EACH STATEMENT EXECUTE FUNCTION template_content_version_trigger()",
+            "CREATE TRIGGER table_column_version_update AFTER UPDATE ON table_column "
+            "REFERENCING NEW TABLE AS changed_rows FOR EACH STATEMENT EXECUTE FUNCTION template_content_version_trigger()",
+            "CREATE TRIGGER table_column_version_delete AFTER DELETE ON table_column "
+            "REFERENCING OLD TABLE AS changed_rows FOR EACH STATEMENT EXECUTE FUNCTION template_content_version_trigger()",
+            "CREATE TRIGGER table_row_version_insert AFTER INSERT ON table_row "
+            "REFERENCING NEW TABLE AS changed_rows FOR EACH STATEMENT EXECUTE FUNCTION template_content_version_trigger()",
+            "CREATE TRIGGER table_row_version_delete AFTER DELETE ON table_row "
+            "REFERENCING OLD TABLE AS changed_rows FOR EACH STATEMENT EXECUTE FUNCTION template_content_version_trigger()"
+        }},
+
+        // Ключи и составные индексы под основные запросы: сетка шаблона читается
+        // по (template_id, row_order, column_order), дерево - по (project_id, parent_id, position)
+        {6, "Ключи и индексы", {
+            addPrimaryKey("project", "project_id"),
+            addPrimaryKey("category", "category_id"),
+            addPrimaryKey("table_template", "template_id"),
+            // Повторы позиций от старых версий миграция не удаляет: она останавливается со списком
+            // повторов, исправляет их проверка проекта (autotlg-cli --no-migrate repair <projectId>)
+            "DO $$ "
+            "DECLARE "
+            "    v_report TEXT; "
+            "BEGIN "
+            "    SELECT string_agg(d.line, '; ') INTO v_report FROM ( "
+            "        SELECT format('проект %s, шаблон %s: %s', t.project_id, d.template_id, d.place) AS line "
+            "        FROM ( "
+            "            SELECT template_id, format('ячейка %s:%s x%s', row_order, column_order, COUNT(*)) AS place "
+            "            FROM table_cell GROUP BY template_id, row_order, column_order HAVING COUNT(*) > 1 "
+            "            UNION ALL "
+            "            SELECT template_id, format('строка %s x%s', row_order, COUNT(*)) "
+            "            FROM table_row GROUP BY template_id, row_order HAVING COUNT(*) > 1 "
+            "            UNION ALL "
+            "            SELECT template_id, format('столбец %s x%s', column_order, COUNT(*)) "
+            "            FROM table_column GROUP BY template_id, column_order HAVING COUNT(*) > 1 "
+            "        ) d LEFT JOIN table_template t ON t.template_id = d.template_id "
+            "        ORDER BY 1 LIMIT 50 "
+            "    ) d; "
+            "    IF v_report IS NOT NULL THEN "
+            "        RAISE EXCEPTION 'Повторяющиеся позиции в сетках шаблонов: %', v_report "
+            "            USING HINT = 'Исправьте повторы: autotlg-cli --no-migrate repair <projectId>'; "
+            "    END IF; "
+            "END $$",
+            addPositionKey("table_cell_position_key", "table_cell", "template_id, row_order, column_order"),
+            addPositionKey("table_row_position_key", "table_row", "template_id, row_order"),
+            addPositionKey("table_column_position_key", "table_column", "template_id, column_order"),
+            "CREATE INDEX IF NOT EXISTS idx_category_tree ON category (project_id, parent_id, position)",
+            "CREATE INDEX IF NOT EXISTS idx_category_parent ON category (parent_id)",
+            "CREATE INDEX IF NOT EXISTS idx_table_template_category ON table_template (category_id, position)",
+            addForeignKey("category_project_fk", "category", "project_id", "project", "project_id"),
+            addForeignKey("category_parent_fk", "category", "parent_id", "category", "category_id"),
+            addForeignKey("table_template_category_fk", "table_template", "category_id", "category", "category_id"),
+            addForeignKey("table_template_project_fk", "table_template", "project_id", "project", "project_id"),
+            addForeignKey("table_column_template_fk", "table_column", "template_id", "table_template", "template_id"),
+            addForeignKey("table_row_template_fk", "table_row", "template_id", "table_template", "template_id"),
+            addForeignKey("table_cell_template_fk", "table_cell", "template_id", "table_template", "template_id")
+        }},
+
+        // Упакованная сетка: заголовки и строки шаблона одной записью JSONB {"headers": [...], "rows": [[...]]}.
+        // Шаблон хранится либо построчно, либо в template_grid, но не одновременно
+        {7, "Упакованные сетки шаблонов", {
+            "CREATE TABLE IF NOT EXISTS template_grid ("
+            "    template_id INTEGER PRIMARY KEY REFERENCES table_template (template_id) ON DELETE CASCADE, "
+            "    format_version SMALLINT NOT NULL DEFAULT 1, "
+            "    data JSONB NOT NULL, "
+            "    search_vector tsvector)",
+            "CREATE OR REPLACE FUNCTION template_grid_search_trigger() RETURNS trigger LANGUAGE plpgsql AS $$ "
+            "BEGIN "
+            "    NEW.search_vector := jsonb_to_tsvector('russian', NEW.data, '[\"string\"]'); "
+            "    RETURN NEW; "
+            "END $$",
+            // Обновление cell_count, даже нулевое, повышает версию шаблона
+            "CREATE OR REPLACE FUNCTION template_grid_cell_count(p_data JSONB) RETURNS INTEGER "
+            "LANGUAGE sql IMMUTABLE AS $$ "
+            "    SELECT COALESCE(SUM(jsonb_array_length(r)), 0)::int FROM jsonb_array_elements(p_data -> 'rows') r "
+            "$$",
+            "CREATE OR REPLACE FUNCTION template_grid_count_trigger() RETURNS trigger LANGUAGE plpgsql AS $$ "
+            "BEGIN "
+            "    IF TG_OP IN ('UPDATE', 'INSERT') THEN "
+            "        UPDATE table_template SET cell_count = cell_count + template_grid_cell_count(NEW.data) "
+            "            - CASE WHEN TG_OP = 'UPDATE' THEN template_grid_cell_count(OLD.data) ELSE 0 END "
+            "        WHERE template_id = NEW.template_id; "
+            "    ELSE "
+            "        UPDATE table_template SET cell_count = cell_count - template_grid_cell_count(OLD.data) "
+            "        WHERE template_id = OLD.template_id; "
+            "    END IF; "
+            "    RETURN NULL; "
+            "END $$",
+            "DROP TRIGGER IF EXISTS template_grid_search ON template_grid",
+            "DROP TRIGGER IF EXISTS template_grid_count ON template_grid",
+            "CREATE TRIGGER template_grid_search BEFORE INSERT OR UPDATE OF data ON template_grid "
+            "FOR EACH ROW EXECUTE FUNCTION template_grid_search_trigger()",
+            "CREATE TRIGGER template_grid_count AFTER INSERT OR DELETE OR UPDATE OF data ON template_grid "
+            "FOR EACH ROW EXECUTE FUNCTION template_grid_count_trigger()",
+            "CREATE INDEX IF NOT EXISTS idx_template_grid_search ON template_grid USING GIN (search_vector)",
+
+            // Сетки обоих форматов в построчном виде для выгрузки, реплики и проверок
+            "CREATE OR REPLACE VIEW grid_column AS "
+            "SELECT template_id, column_order, header FROM table_column "
+            "UNION ALL "
+            "SELECT g.template_id, (h.ord - 1)::int, h.header FROM template_grid g "
+            "CROSS JOIN LATERAL jsonb_array_elements_text(g.data -> 'headers') WITH ORDINALITY AS h (header, ord)",
+            "CREATE OR REPLACE VIEW grid_row AS "
+            "SELECT template_id, row_order FROM table_row "
+            "UNION ALL "
+            "SELECT g.template_id, (r.ord - 1)::int FROM template_grid g "
+            "CROSS JOIN LATERAL jsonb_array_elements(g.data -> 'rows') WITH ORDINALITY AS r (cells, ord)",
+            "CREATE OR REPLACE VIEW grid_cell AS "
+            "SELECT template_id, row_order, column_order, content FROM table_cell "
+            "UNION ALL "
+            "SELECT g.template_id, (r.ord - 1)::int, (c.ord - 1)::int, c.content FROM template_grid g "
+            "CROSS JOIN LATERAL jsonb_array_elements(g.data -> 'rows') WITH ORDINALITY AS r (cells, ord) "
+            "CROSS JOIN LATERAL jsonb_array_elements_text(r.cells) WITH ORDINALITY AS c (content, ord)",
+
+            // Перевод между форматами на сервере. Ячейки вне строк и столбцов шаблона
+            // при упаковке отбрасываются, как и при загрузке построчной сетки.
+            // ON CONFLICT нужен отправке реплики: она загружает строки уже упакованных
+            // шаблонов и упаковывает их заново поверх прежней записи; convertProjectGrids
+            // передаёт только шаблоны без упакованной сетки
+            "CREATE OR REPLACE FUNCTION pack_template_grids(p_ids INTEGER[]) RETURNS INTEGER "
+            "LANGUAGE plpgsql AS $$ "
+            "DECLARE "
+            "    packed INTEGER; "
+            "BEGIN "
+            "    INSERT INTO template_grid AS g (template_id, format_version, data) "
+            "    SELECT t.template_id, 1, jsonb_build_object( "
+            "        'headers', COALESCE((SELECT jsonb_agg(COALESCE(k.header, '') ORDER BY k.column_order) "
+            "                             FROM table_column k WHERE k.template_id = t.template_id), '[]'::jsonb), "
+            "        'rows', COALESCE((SELECT jsonb_agg(( "
+            "                SELECT COALESCE(jsonb_agg(COALESCE(c.content, '') ORDER BY k.column_order), '[]'::jsonb) "
+            "                FROM table_column k "
+            "                LEFT JOIN table_cell c ON c.template_id = k.template_id "
+            "                    AND c.row_order = r.row_order AND c.column_order = k.column_order "
+            "                WHERE k.template_id = t.template_id) ORDER BY r.row_order) "
+            "            FROM table_row r WHERE r.template_id = t.template_id), '[]'::jsonb)) "
+            "    FROM table_template t WHERE t.template_id = ANY(p_ids) "
+            "    ON CONFLICT (template_id) DO UPDATE SET format_version = EXCLUDED.format_version, data = EXCLUDED.data; "
+            "    GET DIAGNOSTICS packed = ROW_COUNT; "
+            "    DELETE FROM table_cell WHERE template_id = ANY(p_ids); "
+            "    DELETE FROM table_row WHERE template_id = ANY(p_ids); "
+            "    DELETE FROM table_column WHERE template_id = ANY(p_ids); "
+            "    RETURN packed; "
+            "END $$",
+            "CREATE OR REPLACE FUNCTION unpack_template_grids(p_ids INTEGER[]) RETURNS INTEGER "
+            "LANGUAGE plpgsql AS $$ "
+            "DECLARE "
+            "    unpacked INTEGER; "
+            "BEGIN "
+            "    INSERT INTO table_column (template_id, column_order, header) "
+            "    SELECT g.template_id, (h.ord - 1)::int, h.header FROM template_grid g "
+            "    CROSS JOIN LATERAL jsonb_array_elements_text(g.data -> 'headers') WITH ORDINALITY AS h (header, ord) "
+            "    WHERE g.template_id = ANY(p_ids); "
+            "    INSERT INTO table_row (template_id, row_order) "
+            "    SELECT g.template_id, (r.ord - 1)::int FROM template_grid g "
+            "    CROSS JOIN LATERAL jsonb_array_elements(g.data -> 'rows') WITH ORDINALITY AS r (cells, ord) "
+            "    WHERE g.template_id = ANY(p_ids); "
+            "    INSERT INTO table_cell (template_id, row_order, column_order, content) "
+            "    SELECT g.template_id, (r.ord - 1)::int, (c.ord - 1)::int, c.content FROM template_grid g "
+            "    CROSS JOIN LATERAL jsonb_array_elements(g.data -> 'rows') WITH ORDINALITY AS r (cells, ord) "
+            "    CROSS JOIN LATERAL jsonb_array_elements_text(r.cells) WITH ORDINALITY AS c (content, ord) "
+            "    WHERE g.template_id = ANY(p_ids); "
+            "    DELETE FROM template_grid WHERE template_id = ANY(p_ids); "
+            "    GET DIAGNOSTICS unpacked = ROW_COUNT; "
+            "    RETURN unpacked; "
+            "END $$"
+        }},
+
+        // Общие наборы заголовков упакованных сеток, адресуемые по SHA-256 содержимого.
+        // Записывающие по-прежнему передают полный JSON: заголовки выносит триггер
+        {8, "Общие наборы заголовков", {
+            "CREATE TABLE IF NOT EXISTS grid_header_set ("
+            "    header_set_id SERIAL PRIMARY KEY, "
+            "    digest TEXT NOT NULL UNIQUE, "
+            "    headers JSONB NOT NULL)",
+            "ALTER TABLE template_grid ADD COLUMN IF NOT EXISTS header_set_id INTEGER "
+            "REFERENCES grid_header_set (header_set_id)",
+            "CREATE INDEX IF NOT EXISTS idx_template_grid_header_set ON template_grid (header_set_id)",
+            "CREATE OR REPLACE FUNCTION template_grid_headers_trigger() RETURNS trigger LANGUAGE plpgsql AS $$ "
+            "DECLARE "
+            "    v_digest TEXT; "
+            "BEGIN "
+            "    IF NOT (NEW.data ? 'headers') THEN "
+            "        RETURN NEW; "
+            "    END IF; "
+            "    v_digest := encode(sha256(convert_to((NEW.data -> 'headers')::text, 'UTF8')), 'hex'); "
+            "    INSERT INTO grid_header_set AS hs (digest, headers) VALUES (v_digest, NEW.data -> 'headers') "
+            "    ON CONFLICT (digest) DO UPDATE SET digest = hs.digest "
+            "    RETURNING header_set_id INTO NEW.header_set_id; "
+            "    NEW.data := NEW.data - 'headers'; "
+            "    RETURN NEW; "
+            "END $$",
+            // Имя задаёт порядок BEFORE-триггеров: заголовки выносятся до расчёта search_vector
+            "DROP TRIGGER IF EXISTS template_grid_headers ON template_grid",
+            "CREATE TRIGGER template_grid_headers BEFORE INSERT OR UPDATE OF data ON template_grid "
+            "FOR EACH ROW EXECUTE FUNCTION template_grid_headers_trigger()",
+            "UPDATE template_grid SET data = data WHERE data ? 'headers'",
+
+            // Упакованная сетка с подставленными заголовками - для всех читающих
+            "CREATE OR REPLACE VIEW template_grid_full AS "
+            "SELECT g.template_id, g.format_version, "
+            "       CASE WHEN hs.header_set_id IS NULL THEN g.data "
+            "            ELSE jsonb_set(g.data, '{headers}', hs.headers) END AS data "
+            "FROM template_grid g LEFT JOIN grid_header_set hs ON hs.header_set_id = g.header_set_id",
+            "CREATE OR REPLACE VIEW grid_column AS "
+            "SELECT template_id, column_order, header FROM table_column "
+            "UNION ALL "
+            "SELECT g.template_id, (h.ord - 1)::int, h.header FROM template_grid_full g "
+            "CROSS JOIN LATERAL jsonb_array_elements_text(g.data -> 'headers') WITH ORDINALITY AS h (header, ord)",
+            "CREATE OR REPLACE FUNCTION unpack_template_grids(p_ids INTEGER[]) RETURNS INTEGER "
+            "LANGUAGE plpgsql AS $$ "
+            "DECLARE "
+            "    unpacked INTEGER; "
+            "BEGIN "
+            "    INSERT INTO table_column (template_id, column_order, header) "
+            "    SELECT g.template_id, (h.ord - 1)::int, h.header FROM template_grid_full g "
+            "    CROSS JOIN LATERAL jsonb_array_elements_text(g.data -> 'headers') WITH ORDINALITY AS h (header, ord) "
+            "    WHERE g.template_id = ANY(p_ids); "
+            "    INSERT INTO table_row (template_id, row_order) "
+            "    SELECT g.template_id, (r.ord - 1)::int FROM template_grid g "
+            "    CROSS JOIN LATERAL jsonb_array_elements(g.data -> 'rows') WITH ORDINALITY AS r (cells, ord) "
+            "    WHERE g.template_id = ANY(p_ids); "
+            "    INSERT INTO table_cell (template_id, row_order, column_order, content) "
+            "    SELECT g.template_id, (r.ord - 1)::int, (c.ord - 1)::int, c.content FROM template_grid g "
+            "    CROSS JOIN LATERAL jsonb_array_elements(g.data -> 'rows') WITH ORDINALITY AS r (cells, ord) "
+            "    CROSS JOIN LATERAL jsonb_array_elements_text(r.cells) WITH ORDINALITY AS c (content, ord) "
+            "    WHERE g.template_id = ANY(p_ids); "
+            "    DELETE FROM template_grid WHERE template_id = ANY(p_ids); "
+            "    GET DIAGNOSTICS unpacked = ROW_COUNT; "
+            // Наборы, на которые больше никто не ссылается
+            "    DELETE FROM grid_header_set hs "
+            "    WHERE NOT EXISTS (SELECT 1 FROM template_grid g WHERE g.header_set_id = hs.header_set_id); "
+            "    RETURN unpacked; "
+            "END $$"
+        }},
+
+        // История сеток: полные сетки и изменения ячеек между сохранениями
+        {9, "Ревизии шаблонов", {
+            "CREATE TABLE IF NOT EXISTS template_revision ("
+            "    template_id INTEGER NOT NULL REFERENCES table_template (template_id) ON DELETE CASCADE, "
+            "    revision INTEGER NOT NULL, "
+            "    is_snapshot BOOLEAN NOT NULL, "
+            "    changed_cells INTEGER NOT NULL DEFAULT 0, "
+            "    data JSONB NOT NULL, "
+            "    created_at TIMESTAMPTZ NOT NULL DEFAULT now(), "
+            "    PRIMARY KEY (template_id, revision))"
+        }},
+        {10, "Удаление и распаковка категорий на сервере", {
+            // Сплошная нумерация детей родителя: сначала подкатегории, затем шаблоны. Дети
+            // распаковываемой категории встают на её место и переходят к родителю
+            "CREATE OR REPLACE FUNCTION renumber_category_children(p_project_id INTEGER, p_parent_id INTEGER, "
+            "                                                      p_unpacked_id INTEGER) "
+            "RETURNS void LANGUAGE plpgsql AS $$ "
+            "DECLARE "
+            "    v_position INTEGER; "
+            "BEGIN "
+            "    SELECT position INTO v_position FROM category WHERE category_id = p_unpacked_id; "
+            "    WITH siblings AS ( "
+            "        SELECT TRUE AS is_category, category_id AS item_id, position AS base, 0 AS sub FROM category "
+            "        WHERE project_id = p_project_id AND parent_id IS NOT DISTINCT FROM p_parent_id "
+            "          AND category_id IS DISTINCT FROM p_unpacked_id "
+            "        UNION ALL "
+            "        SELECT FALSE, template_id, position, 0 FROM table_template "
+            "        WHERE p_parent_id IS NOT NULL AND category_id = p_parent_id "
+            "        UNION ALL "
+            "        SELECT TRUE, category_id, v_position, position FROM category WHERE parent_id = p_unpacked_id "
+            "        UNION ALL "
+            "        SELECT FALSE, template_id, v_position, position FROM table_template WHERE category_id = p_unpacked_id "
+            "    ), "
+            "    numbered AS ( "
+            "        SELECT is_category, item_id, "
+            "               ROW_NUMBER() OVER (ORDER BY is_category DESC, base NULLS LAST, sub NULLS LAST, item_id)::int AS position "
+            "        FROM siblings "
+            "    ), "
+            "    moved_categories AS ( "
+            "        UPDATE category c SET parent_id = p_parent_id, position = n.position FROM numbered n "
+            "        WHERE n.is_category AND c.category_id = n.item_id "
+            "          AND (c.position IS DISTINCT FROM n.position OR c.parent_id IS DISTINCT FROM p_parent_id) "
+            "        RETURNING c.category_id "
+            "    ) "
+            "    UPDATE table_template t SET category_id = p_parent_id, position = n.position FROM numbered n "
+            "    WHERE NOT n.is_category AND t.template_id = n.item_id "
+            "      AND (t.position IS DISTINCT FROM n.position OR t.category_id IS DISTINCT FROM p_parent_id); "
+            "END $$",
+            // Итоговое положение детей родителя и перенесённых поддеревьев для правки дерева на клиенте
+            "CREATE OR REPLACE FUNCTION category_children_placement(p_project_id INTEGER, p_parent_id INTEGER, "
+            "                                                       p_subtree INTEGER[]) "
+            "RETURNS TABLE (item_id INTEGER, is_category BOOLEAN, removed BOOLEAN, parent_id INTEGER, "
+            "               position INTEGER, depth INTEGER) "
+            "LANGUAGE sql STABLE AS $$ "
+            "    SELECT c.category_id, TRUE, FALSE, COALESCE(c.parent_id, 0), c.position, c.depth FROM category c "
+            "    WHERE c.project_id = p_project_id "
+            "      AND (c.parent_id IS NOT DISTINCT FROM p_parent_id OR c.category_id = ANY(p_subtree)) "
+            "    UNION ALL "
+            "    SELECT t.template_id, FALSE, FALSE, t.category_id, t.position, 0 FROM table_template t "
+            "    WHERE p_parent_id IS NOT NULL AND t.category_id = p_parent_id "
+            "$$",
+            // Удаление категории вместе с поддеревом и шаблонами; соседи уплотняются
+            "CREATE OR REPLACE FUNCTION delete_category_tree(p_category_id INTEGER) "
+            "RETURNS TABLE (item_id INTEGER, is_category BOOLEAN, removed BOOLEAN, parent_id INTEGER, "
+            "               position INTEGER, depth INTEGER) "
+            "LANGUAGE plpgsql AS $$ "
+            "#variable_conflict use_column "
+            "DECLARE "
+            "    v_parent_id INTEGER; "
+            "    v_project_id INTEGER; "
+            "    v_categories INTEGER[]; "
+            "    v_templates INTEGER[]; "
+            "BEGIN "
+            "    SELECT c.parent_id, c.project_id INTO v_parent_id, v_project_id FROM category c "
+            "    WHERE c.category_id = p_category_id FOR UPDATE; "
+            "    IF NOT FOUND THEN "
+            "        RAISE EXCEPTION 'Категория % не найдена', p_category_id; "
+            "    END IF; "
+            "    WITH RECURSIVE subcategories AS ( "
+            "        SELECT category_id FROM category WHERE category_id = p_category_id "
+            "        UNION ALL "
+            "        SELECT c.category_id FROM category c "
+            "        INNER JOIN subcategories s ON c.parent_id = s.category_id "
+            "    ) "
+            "    SELECT array_agg(category_id) INTO v_categories FROM subcategories; "
+            "    WITH removed_templates AS ( "
+            "        DELETE FROM table_template WHERE category_id = ANY(v_categories) RETURNING template_id "
+            "    ) "
+            "    SELECT COALESCE(array_agg(template_id), '{}') INTO v_templates FROM removed_templates; "
+            "    DELETE FROM category WHERE category_id = ANY(v_categories); "
+            "    PERFORM renumber_category_children(v_project_id, v_parent_id, NULL); "
+            "    RETURN QUERY "
+            "        SELECT unnest(v_categories), TRUE, TRUE, NULL::INTEGER, NULL::INTEGER, NULL::INTEGER "
+            "        UNION ALL "
+            "        SELECT unnest(v_templates), FALSE, TRUE, NULL::INTEGER, NULL::INTEGER, NULL::INTEGER "
+            "        UNION ALL "
+            "        SELECT * FROM category_children_placement(v_project_id, v_parent_id, '{}'); "
+            "END $$",
+            // Распаковка: дети переходят к родителю на место категории, глубина поддеревьев
+            // уменьшается; шаблоны корневой категории перенести некуда
+            "CREATE OR REPLACE FUNCTION unpack_category(p_category_id INTEGER) "
+            "RETURNS TABLE (item_id INTEGER, is_category BOOLEAN, removed BOOLEAN, parent_id INTEGER, "
+            "               position INTEGER, depth INTEGER) "
+            "LANGUAGE plpgsql AS $$ "
+            "#variable_conflict use_column "
+            "DECLARE "
+            "    v_parent_id INTEGER; "
+            "    v_project_id INTEGER; "
+            "    v_depth INTEGER; "
+            "    v_subtree INTEGER[]; "
+            "BEGIN "
+            "    SELECT c.parent_id, c.project_id INTO v_parent_id, v_project_id FROM category c "
+            "    WHERE c.category_id = p_category_id FOR UPDATE; "
+            "    IF NOT FOUND THEN "
+            "        RAISE EXCEPTION 'Категория % не найдена', p_category_id; "
+            "    END IF; "
+            "    IF v_parent_id IS NULL AND EXISTS (SELECT 1 FROM table_template WHERE category_id = p_category_id) THEN "
+            "        RAISE EXCEPTION 'Нельзя распаковать корневую категорию % с шаблонами', p_category_id; "
+            "    END IF; "
+            "    SELECT COALESCE((SELECT c.depth FROM category c WHERE c.category_id = v_parent_id), 0) INTO v_depth; "
+            "    WITH RECURSIVE levels AS ( "
+            "        SELECT category_id, v_depth + 1 AS level FROM category WHERE parent_id = p_category_id "
+            "        UNION ALL "
+            "        SELECT c.category_id, l.level + 1 FROM category c "
+            "        INNER JOIN levels l ON c.parent_id = l.category_id WHERE l.level < 1000 "
+            "    ), "
+            "    updated AS ( "
+            "        UPDATE category c SET depth = l.level FROM levels l "
+            "        WHERE c.category_id = l.category_id RETURNING c.category_id "
+            "    ) "
+            "    SELECT COALESCE(array_agg(category_id), '{}') INTO v_subtree FROM updated; "
+            "    PERFORM renumber_category_children(v_project_id, v_parent_id, p_category_id); "
+            "    DELETE FROM category WHERE category_id = p_category_id; "
+            "    RETURN QUERY "
+            "        SELECT p_category_id, TRUE, TRUE, NULL::INTEGER, NULL::INTEGER, NULL::INTEGER "
+            "        UNION ALL "
+            "        SELECT * FROM category_children_placement(v_project_id, v_parent_id, v_subtree); "
+            "END $$"
+        }},
+        {11, "Удаление шаблона на сервере", {
+            // Сетки и ревизии удаляются каскадом; нумеруются только соседи шаблона
+            "CREATE OR REPLACE FUNCTION delete_template(p_template_id INTEGER) "
+            "RETURNS TABLE (item_id INTEGER, is_category BOOLEAN, removed BOOLEAN, parent_id INTEGER, "
+            "               position INTEGER, depth INTEGER) "
+            "LANGUAGE plpgsql AS $$ "
+            "#variable_conflict use_column "
+            "DECLARE "
+            "    v_category_id INTEGER; "
+            "    v_project_id INTEGER; "
+            "BEGIN "
+            "    DELETE FROM table_template t WHERE t.template_id = p_template_id "
+            "    RETURNING t.category_id, t.project_id INTO v_category_id, v_project_id; "
+            "    IF NOT FOUND THEN "
+            "        RAISE EXCEPTION 'Шаблон % не найден', p_template_id; "
+            "    END IF; "
+            "    PERFORM renumber_category_children(v_project_id, v_category_id, NULL); "
+            "    RETURN QUERY "
+            "        SELECT p_template_id, FALSE, TRUE, v_category_id, NULL::INTEGER, NULL::INTEGER "
+            "        UNION ALL "
+            "        SELECT * FROM category_children_placement(v_project_id, v_category_id, '{}'); "
+            "END $$"
+        }},
+        // Ревизии для пакетных правок сеток (замена, импорт, синхронизация, исправления):
+        // полные сетки всех шаблонов одной вставкой
+        {12, "Пакетные ревизии сеток", {
+            // Сетка шаблона в формате полной ревизии: упакованная или собранная из строк
+            "CREATE OR REPLACE FUNCTION grid_json(p_template_id INTEGER) RETURNS JSONB "
+            "LANGUAGE sql STABLE AS $$ "
+            "SELECT COALESCE( "
+            "    (SELECT data FROM template_grid_full WHERE template_id = p_template_id), "
+            "    jsonb_build_object( "
+            "        'headers', COALESCE((SELECT jsonb_agg(COALESCE(header, '') ORDER BY column_order) "
+            "                             FROM table_column WHERE template_id = p_template_id), '[]'::jsonb), "
+            "        'rows', COALESCE((SELECT jsonb_agg(( "
+            "                SELECT COALESCE(jsonb_agg(COALESCE(c.content, '') ORDER BY k.column_order), '[]'::jsonb) "
+            "                FROM table_column k LEFT JOIN table_cell c ON c.template_id = k.template_id "
+            "                    AND c.row_order = r.row_order AND c.column_order = k.column_order "
+            "                WHERE k.template_id = p_template_id) ORDER BY r.row_order) "
+            "            FROM table_row r WHERE r.template_id = p_template_id), '[]'::jsonb))) "
+            "$$",
+            // Блокировки берутся в порядке сохранения сетки: template_grid, затем table_template.
+            // При p_missing_only ревизия пишется только шаблонам без истории - так перед
+            // пакетной правкой сохраняется исходная сетка. changed_cells - число ячеек сетки
+            "CREATE OR REPLACE FUNCTION record_grid_revisions(p_ids INTEGER[], p_missing_only BOOLEAN) "
+            "RETURNS INTEGER LANGUAGE plpgsql AS $$ "
+            "DECLARE "
+            "    recorded INTEGER; "
+            "BEGIN "
+            "    PERFORM 1 FROM template_grid WHERE template_id = ANY(p_ids) ORDER BY template_id FOR UPDATE; "
+            "    PERFORM 1 FROM table_template WHERE template_id = ANY(p_ids) ORDER BY template_id FOR UPDATE; "
+            "    INSERT INTO template_revision (template_id, revision, is_snapshot, changed_cells, data) "
+            "    SELECT t.template_id, COALESCE(MAX(r.revision), 0) + 1, TRUE, t.cell_count, grid_json(t.template_id) "
+            "    FROM table_template t LEFT JOIN template_revision r ON r.template_id = t.template_id "
+            "    WHERE t.template_id = ANY(p_ids) "
+            "    GROUP BY t.template_id, t.cell_count "
+            "    HAVING NOT p_missing_only OR COUNT(r.revision) = 0; "
+            "    GET DIAGNOSTICS recorded = ROW_COUNT; "
+            "    RETURN recorded; "
+            "END $$"
+        }},
+
+        // Наборы заголовков, на которые перестала ссылаться сетка (правка заголовков,
+        // удаление шаблона, распаковка), удаляются тем же оператором. Набор, который
+        // одновременно выбирает другая транзакция, заблокирован ею и пропускается
+        {13, "Удаление неиспользуемых наборов заголовков", {
+            "CREATE OR REPLACE FUNCTION template_grid_header_sets_cleanup() RETURNS trigger LANGUAGE plpgsql AS $$ "
+            "BEGIN "
+            "    DELETE FROM grid_header_set WHERE header_set_id IN ( "
+            "        SELECT hs.header_set_id FROM grid_header_set hs "
+            "        WHERE hs.header_set_id IN (SELECT header_set_id FROM old_grids) "
+            "          AND NOT EXISTS (SELECT 1 FROM template_grid g WHERE g.header_set_id = hs.header_set_id) "
+            "        FOR UPDATE SKIP LOCKED); "
+            "    RETURN NULL; "
+            "END $$",
+            // Таблицы переходов допускаются только у триггеров с одним событием
+            "DROP TRIGGER IF EXISTS template_grid_header_sets_update ON template_grid",
+            "DROP TRIGGER IF EXISTS template_grid_header_sets_delete ON template_grid",
+            "CREATE TRIGGER template_grid_header_sets_update AFTER UPDATE ON template_grid "
+            "REFERENCING OLD TABLE AS old_grids FOR EACH STATEMENT EXECUTE FUNCTION template_grid_header_sets_cleanup()",
+            "CREATE TRIGGER template_grid_header_sets_delete AFTER DELETE ON template_grid "
+            "REFERENCING OLD TABLE AS old_grids FOR EACH STATEMENT EXECUTE FUNCTION template_grid_header_sets_cleanup()",
+            "DELETE FROM grid_header_set hs "
+            "WHERE NOT EXISTS (SELECT 1 FROM template_grid g WHERE g.header_set_id = hs.header_set_id)"
+        }}
+    };
+    return migrations;
+}
+
+const QVector<RequiredIndex> &requiredIndexes() {
+    static const QVector<RequiredIndex> indexes = {
+        {"idx_table_cell_position", "table_cell", {"template_id", "row_order", "column_order"}},
+        {"idx_table_row_position", "table_row", {"template_id", "row_order"}},
+        {"idx_table_column_position", "table_column", {"template_id", "column_order"}},
+        {"idx_category_tree", "category", {"project_id", "parent_id", "position"}},
+        {"idx_category_parent", "category", {"parent_id"}},
+        {"idx_table_template_category", "table_template", {"category_id", "position"}},
+        {"idx_table_template_project_approved", "table_template", {"project_id", "is_approved"}}
+    };
+    return indexes;
+}
+
+const QStringList &requiredForeignKeys() {
+    static const QStringList keys = {
+        "category_project_fk",
+        "category_parent_fk",
+        "table_template_category_fk",
+        "table_template_project_fk",
+        "table_column_template_fk",
+        "table_row_template_fk",
+        "table_cell_template_fk"
+    };
+    return keys;
+}
@@ -0,0 +1,27 @@
+#ifndef SCHEMAMIGRATIONS_H
+#define SCHEMAMIGRATIONS_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Шаг изменения схемы PostgreSQL; номер версии записывается в schema_migrations
+struct SchemaMigration {
+    int version;
+    QString description;
+    QStringList statements;
+};
+
+// Индекс, без которого основные запросы переходят на полный просмотр таблицы.
+// Подходит любой индекс, ведущие столбцы которого совпадают с columns
+struct RequiredIndex {
+    QString name;       // Имя индекса, создаваемого при отсутствии подходящего
+    QString table;
+    QStringList columns;
+};
+
+const QVector<SchemaMigration> &schemaMigrations();   // По возрастанию версии
+const QVector<RequiredIndex> &requiredIndexes();
+const QStringList &requiredForeignKeys();
+
+#endif // SCHEMAMIGRATIONS_H
@@ -0,0 +1,254 @@
+#include "searchmanager.h"
+#include "queryexecutor.h"
+#include "revisionmanager.h"
+#include "tracing.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+#include <optional>
+
+SearchManager::SearchManager(QSqlDatabase &db) : db(db) {}
+
+namespace {
+// Маркеры выделения для ts_headline: фрагмент экранируется на клиенте,
+// и только после этого маркеры заменяются на теги
+const QChar startMark(0xE000);
+const QChar stopMark(0xE001);
+}
+
+QVector<SearchResult> SearchManager::search(int projectId, const QString &text, int limit) const {
+    TRACE_SCOPE("manager", "SearchManager::search");
+    QVector<SearchResult> results;
+    if (text.trimmed().isEmpty()) {
+        return results;
+    }
+
+    QSqlQuery query(db);
+
+    // Совпадения ищутся по GIN-индексам, ранжируются и обрезаются до limit,
+    // а дорогой ts_headline считается только для оставшихся строк
+    query.prepare(
+        "WITH q AS ( "
+        "    SELECT websearch_to_tsquery('russian', :text) AS query, "
+        "           CAST(:projectId AS INTEGER) AS project_id "
+        "), "
+        "matches AS ( "
+        "    SELECT t.template_id, t.name, -1 AS row_order, -1 AS column_order, "
+        "           concat_ws(' ', t.name, t.notes, t.programming_notes) AS content, "
+        "           ts_rank(t.search_vector, q.query) AS rank "
+        "    FROM table_template t, q "
+        "    WHERE t.project_id = q.project_id AND t.search_vector @@ q.query "
+        "    UNION ALL "
+        "    SELECT c.template_id, t.name, c.row_order, c.column_order, c.content, "
+        "           ts_rank(c.search_vector, q.query) AS rank "
+        "    FROM table_cell c "
+        "    INNER JOIN table_template t ON t.template_id = c.template_id, q "
+        "    WHERE t.project_id = q.project_id AND c.search_vector @@ q.query "
+        "    UNION ALL "
+        // Упакованные сетки: индекс отбирает шаблоны, ячейки проверяются после разворачивания
+        "    SELECT g.template_id, t.name, (r.ord - 1)::int, (c.ord - 1)::int, c.content, "
+        "           ts_rank(to_tsvector('russian', c.content), q.query) AS rank "
+        "    FROM q, template_grid g "
+        "    INNER JOIN table_template t ON t.template_id = g.template_id "
+        "    CROSS JOIN LATERAL jsonb_array_elements(g.data -> 'rows') WITH ORDINALITY AS r (cells, ord) "
+        "    CROSS JOIN LATERAL jsonb_array_elements_text(r.cells) WITH ORDINALITY AS c (content, ord) "
+        "    WHERE t.project_id = q.project_id AND g.search_vector @@ q.query "
+        "    AND to_tsvector('russian', c.content) @@ q.query "
+        "    ORDER BY rank DESC "
+        "    LIMIT :limit "
+        ") "
+        "SELECT m.template_id, m.name, m.row_order, m.column_order, m.rank, "
+        "       ts_headline('russian', translate(m.content, :marks, ''), q.query, :options) "
+        "FROM matches m, q "
+        "ORDER BY m.rank DESC"
+        );
+    query.bindValue(":text", text);
+    query.bindValue(":projectId", projectId);
+    query.bindValue(":limit", limit);
+    // Маркеры, случайно оказавшиеся в тексте, удаляются до построения фрагмента
+    query.bindValue(":marks", QString(startMark) + stopMark);
+    query.bindValue(":options", QString("StartSel=\"%1\", StopSel=\"%2\", MaxFragments=2, MaxWords=20, MinWords=5")
+                                    .arg(startMark).arg(stopMark));
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка полнотекстового поиска:" << query.lastError();
+        return results;
+    }
+
+    while (query.next()) {
+        // Содержимое ячеек выводится как RichText, поэтому разметка из него не должна попасть в метку
+        QString snippet = query.value(5).toString().toHtmlEscaped();
+        snippet.replace(startMark, QLatin1String("<b>")).replace(stopMark, QLatin1String("</b>"));
+        results.append({
+            query.value(0).toInt(),
+            query.value(1).toString(),
+            query.value(2).toInt(),
+            query.value(3).toInt(),
+            query.value(4).toDouble(),
+            snippet
+        });
+    }
+
+    return results;
+}
+
+bool SearchManager::findReplace(ReplaceScope scope, int scopeId,
+                                const QString &find, const QString &replacement,
+                                bool useRegex, bool dryRun, ReplaceCounts &counts) {
+    TRACE_SCOPE("manager", "SearchManager::findReplace");
+    counts = ReplaceCounts();
+    if (find.isEmpty()) {
+        qDebug() << "Пустая строка поиска для замены.";
+        return false;
+    }
+
+    // Выражения совпадения и замены для произвольного столбца
+    auto matchExpr = [useRegex](const QString &column) {
+        return useRegex ? QString("%1 ~ p.find").arg(column)
+                        : QString("strpos(%1, p.find) > 0").arg(column);
+    };
+    auto replaceExpr = [useRegex](const QString &column) {
+        return useRegex ? QString("regexp_replace(%1, p.find, p.repl, 'g')").arg(column)
+                        : QString("replace(%1, p.find, p.repl)").arg(column);
+    };
+
+    QString scopeCondition;
+    switch (scope) {
+    case ReplaceScope::Project:
+        scopeCondition = "t.project_id = p.scope_id";
+        break;
+    case ReplaceScope::Category:
+        scopeCondition = "t.category_id IN (SELECT category_id FROM subcategories)";
+        break;
+    case ReplaceScope::Template:
+        scopeCondition = "t.template_id = p.scope_id";
+        break;
+    }
+
+    QString sql =
+        "WITH RECURSIVE params AS ( "
+        "    SELECT CAST(:find AS TEXT) AS find, CAST(:replacement AS TEXT) AS repl, "
+        "           CAST(:scopeId AS INTEGER) AS scope_id "
+        "), "
+        "subcategories AS ( "
+        "    SELECT category_id FROM category, params p WHERE category_id = p.scope_id "
+        "    UNION ALL "
+        "    SELECT c.category_id FROM category c "
+        "    INNER JOIN subcategories s ON c.parent_id = s.category_id "
+        "), "
+        "targets AS ( "
+        "    SELECT t.template_id FROM table_template t, params p WHERE " + scopeCondition +
+        "), "
+        // Совпадения в упакованных сетках считаются по снимку до замены
+        "packed_matches AS ( "
+        "    SELECT g.template_id, "
+        "        (SELECT COUNT(*) FROM jsonb_array_elements(g.data -> 'rows') AS r (cells), "
+        "                              jsonb_array_elements_text(r.cells) AS c (v), params p "
+        "         WHERE " + matchExpr("c.v") + ") AS cells, "
+        "        (SELECT COUNT(*) FROM jsonb_array_elements_text(g.data -> 'headers') AS h (v), params p "
+        "         WHERE " + matchExpr("h.v") + ") AS headers "
+        "    FROM template_grid_full g WHERE g.template_id IN (SELECT template_id FROM targets) "
+        ")";
+
+    auto bindParams = [&](QSqlQuery &query) {
+        query.bindValue(":find", find);
+        query.bindValue(":replacement", replacement);
+        query.bindValue(":scopeId", scopeId);
+    };
+
+    // Замена, ревизии изменённых сеток и их исходное состояние фиксируются вместе
+    std::optional<WriteTransaction> transaction;
+    QVector<int> changedGrids;
+    if (!dryRun) {
+        transaction.emplace(db);
+        if (!transaction->isStarted()) return false;
+
+        // Шаблоны, сетки которых изменит замена, определяются до неё
+        QSqlQuery matched(db);
+        matched.prepare(sql +
+            " SELECT t.template_id FROM targets t, params p "
+            "WHERE EXISTS (SELECT 1 FROM table_cell c WHERE c.template_id = t.template_id AND " + matchExpr("c.content") + ") "
+            "OR EXISTS (SELECT 1 FROM table_column h WHERE h.template_id = t.template_id AND " + matchExpr("h.header") + ") "
+            "OR t.template_id IN (SELECT template_id FROM packed_matches WHERE cells > 0 OR headers > 0)");
+        bindParams(matched);
+        if (!execQuery(matched)) {
+            qDebug() << "Ошибка поиска изменяемых сеток:" << matched.lastError();
+            return false;
+        }
+        while (matched.next()) changedGrids.append(matched.value(0).toInt());
+
+        if (!RevisionManager(db).recordSnapshots(changedGrids, true)) return false;
+    }
+
+    sql += ", ";
+    if (dryRun) {
+        sql +=
+            "cells AS ( "
+            "    SELECT 1 FROM table_cell c, params p "
+            "    WHERE c.template_id IN (SELECT template_id FROM targets) AND " + matchExpr("c.content") +
+            "), "
+            "headers AS ( "
+            "    SELECT 1 FROM table_column h, params p "
+            "    WHERE h.template_id IN (SELECT template_id FROM targets) AND " + matchExpr("h.header") +
+            "), "
+            "notes AS ( "
+            "    SELECT 1 FROM table_template n, params p "
+            "    WHERE n.template_id IN (SELECT template_id FROM targets) "
+            "    AND (" + matchExpr("n.notes") + " OR " + matchExpr("n.programming_notes") + ") "
+            ") ";
+    } else {
+        sql +=
+            "cells AS ( "
+            "    UPDATE table_cell c SET content = " + replaceExpr("c.content") + " FROM params p "
+            "    WHERE c.template_id IN (SELECT template_id FROM targets) AND " + matchExpr("c.content") +
+            "    RETURNING 1 "
+            "), "
+            "headers AS ( "
+            "    UPDATE table_column h SET header = " + replaceExpr("h.header") + " FROM params p "
+            "    WHERE h.template_id IN (SELECT template_id FROM targets) AND " + matchExpr("h.header") +
+            "    RETURNING 1 "
+            "), "
+            "notes AS ( "
+            "    UPDATE table_template n SET notes = " + replaceExpr("n.notes") + ", "
+            "           programming_notes = " + replaceExpr("n.programming_notes") + " FROM params p "
+            "    WHERE n.template_id IN (SELECT template_id FROM targets) "
+            "    AND (" + matchExpr("n.notes") + " OR " + matchExpr("n.programming_notes") + ") "
+            "    RETURNING 1 "
+            "), "
+            // Упакованная сетка пересобирается с заменой в каждом заголовке и ячейке;
+            // изменённые заголовки попадают в новый общий набор, чужие сетки не меняются
+            "packed AS ( "
+            "    UPDATE template_grid g SET data = jsonb_build_object( "
+            "        'headers', COALESCE((SELECT jsonb_agg(" + replaceExpr("h.v") + " ORDER BY h.ord) "
+            "            FROM jsonb_array_elements_text(f.data -> 'headers') WITH ORDINALITY AS h (v, ord)), '[]'::jsonb), "
+            "        'rows', COALESCE((SELECT jsonb_agg(( "
+            "                SELECT COALESCE(jsonb_agg(" + replaceExpr("c.v") + " ORDER BY c.ord), '[]'::jsonb) "
+            "                FROM jsonb_array_elements_text(r.cells) WITH ORDINALITY AS c (v, ord)) ORDER BY r.ord) "
+            "            FROM jsonb_array_elements(g.data -> 'rows') WITH ORDINALITY AS r (cells, ord)), '[]'::jsonb)) "
+            "    FROM params p, packed_matches m, template_grid_full f "
+            "    WHERE m.template_id = g.template_id AND f.template_id = g.template_id "
+            "    AND (m.cells > 0 OR m.headers > 0) "
+            "    RETURNING 1 "
+            ") ";
+    }
+
+    sql += "SELECT (SELECT COUNT(*) FROM cells) + (SELECT COALESCE(SUM(cells), 0) FROM packed_matches), "
+           "       (SELECT COUNT(*) FROM headers) + (SELECT COALESCE(SUM(headers), 0) FROM packed_matches), "
+           "       (SELECT COUNT(*) FROM notes)";
+
+    QSqlQuery query(db);
+    query.prepare(sql);
+    bindParams(query);
+
+    if (!execQuery(query) || !query.next()) {
+        qDebug() << "Ошибка поиска и замены:" << query.lastError();
+        return false;
+    }
+
+    counts.cells = query.value(0).toInt();
+    counts.headers = query.value(1).toInt();
+    counts.notes = query.value(2).toInt();
+    if (dryRun) return true;
+
+    return RevisionManager(db).recordSnapshots(changedGrids) && transaction->commit();
+}
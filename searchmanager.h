@@ -0,0 +1,47 @@
+#ifndef SEARCHMANAGER_H
+#define SEARCHMANAGER_H
+
+#include <QVector>
+#include <QString>
+#include <QSqlDatabase>
+
+struct SearchResult {
+    int templateId;
+    QString templateName;
+    int rowOrder;       // -1, если совпадение в названии или заметках шаблона
+    int columnOrder;    // -1, если совпадение в названии или заметках шаблона
+    double rank;
+    QString snippet;    // Экранированный фрагмент с выделенными совпадениями (<b>...</b>)
+};
+
+// Область поиска и замены
+enum class ReplaceScope {
+    Project,
+    Category,   // Категория вместе со всеми подкатегориями
+    Template
+};
+
+struct ReplaceCounts {
+    int cells = 0;
+    int headers = 0;
+    int notes = 0;      // Шаблоны, у которых изменились заметки или программные заметки
+};
+
+class SearchManager {
+public:
+    SearchManager(QSqlDatabase &db);
+
+    // Полнотекстовый поиск по названиям, заметкам и ячейкам шаблонов проекта
+    QVector<SearchResult> search(int projectId, const QString &text, int limit = 100) const;
+
+    // Поиск и замена в ячейках, заголовках и заметках одним оператором.
+    // При dryRun ничего не изменяется, в counts возвращается число совпадений.
+    bool findReplace(ReplaceScope scope, int scopeId,
+                     const QString &find, const QString &replacement,
+                     bool useRegex, bool dryRun, ReplaceCounts &counts);
+
+private:
+    QSqlDatabase &db;
+};
+
+#endif // SEARCHMANAGER_H
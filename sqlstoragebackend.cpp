@@ -0,0 +1,640 @@
+#include "sqlstoragebackend.h"
+#include "queryexecutor.h"
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QStringList>
+#include <QDebug>
+#include <QHash>
+#include <QPair>
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
+namespace {
+
+// Элемент ряда детей одного родителя при нумерации
+struct Sibling {
+    bool isCategory;
+    int itemId;
+    QVariant base;      // Положение в ряду родителя (у детей распакованной категории - её положение)
+    QVariant sub;       // Положение внутри распакованной категории
+};
+
+// Порядок как на сервере: ORDER BY is_category DESC, base NULLS LAST, sub NULLS LAST, item_id
+void sortSiblings(QVector<Sibling> &siblings) {
+    auto sortKey = [](const Sibling &sibling) {
+        auto nullsLast = [](const QVariant &value) {
+            return value.isNull() ? std::numeric_limits<int>::max() : value.toInt();
+        };
+        return std::make_tuple(!sibling.isCategory, nullsLast(sibling.base), nullsLast(sibling.sub), sibling.itemId);
+    };
+    std::sort(siblings.begin(), siblings.end(), [&sortKey](const Sibling &a, const Sibling &b) {
+        return sortKey(a) < sortKey(b);
+    });
+}
+
+} // namespace
+
+SqlStorageBackend::SqlStorageBackend(QSqlDatabase &db)
+    : db(db), projectManager(db), categoryManager(db), templateManager(db), tableManager(db) {}
+
+bool SqlStorageBackend::createProject(const QString &name, int *newProjectId) {
+    return projectManager.createProject(name, newProjectId);
+}
+
+bool SqlStorageBackend::deleteProject(int projectId) {
+    return projectManager.deleteProject(projectId);
+}
+
+QVector<Project> SqlStorageBackend::getProjects() {
+    return projectManager.getProjects();
+}
+
+bool SqlStorageBackend::createCategory(const QString &name, int parentId, int projectId, int *newCategoryId) {
+    return categoryManager.createCategory(name, parentId, projectId, newCategoryId);
+}
+
+bool SqlStorageBackend::updateCategory(int categoryId, const QString &newName) {
+    return categoryManager.updateCategory(categoryId, newName);
+}
+
+bool SqlStorageBackend::deleteCategory(int categoryId, bool deleteAll) {
+    return categoryManager.deleteCategory(categoryId, deleteAll);
+}
+
+QVector<Category> SqlStorageBackend::getCategoriesByProject(int projectId) {
+    return categoryManager.getCategoriesByProject(projectId);
+}
+
+bool SqlStorageBackend::updateNumeration(int itemId, int parentId, const QString &numeration, int depth) {
+    return categoryManager.updateNumeration(itemId, parentId, numeration, depth);
+}
+
+bool SqlStorageBackend::renumberProject(int projectId) {
+    return categoryManager.renumberProject(projectId);
+}
+
+bool SqlStorageBackend::createTemplate(int categoryId, const QString &templateName, int *newTemplateId) {
+    return templateManager.createTemplate(categoryId, templateName, newTemplateId);
+}
+
+bool SqlStorageBackend::updateTemplate(int templateId,
+                                       const std::optional<QString> &name,
+                                       const std::optional<QString> &notes,
+                                       const std::optional<QString> &programmingNotes) {
+    return templateManager.updateTemplate(templateId, name, notes, programmingNotes);
+}
+
+bool SqlStorageBackend::deleteTemplate(int templateId) {
+    return templateManager.deleteTemplate(templateId);
+}
+
+bool SqlStorageBackend::setTemplateApproved(int templateId, bool approved) {
+    return templateManager.setTemplateApproved(templateId, approved);
+}
+
+QVector<Template> SqlStorageBackend::getTemplatesForCategory(int categoryId, bool onlyUnapproved) {
+    return templateManager.getTemplatesForCategory(categoryId, onlyUnapproved);
+}
+
+bool SqlStorageBackend::getTemplateGrid(int templateId, TemplateGrid &grid) {
+    return templateManager.getGridForTemplate(templateId, grid);
+}
+
+bool SqlStorageBackend::saveTemplateGrid(int templateId, const TemplateGrid &grid) {
+    // Вне явной транзакции сетка сохраняется атомарно в собственной
+    bool ownTransaction = !inTransaction && db.transaction();
+
+    if (!tableManager.saveDataTableTemplate(templateId, grid.headers, grid.cells)) {
+        if (ownTransaction) db.rollback();
+        return false;
+    }
+    return !ownTransaction || db.commit();
+}
+
+bool SqlStorageBackend::beginTransaction() {
+    inTransaction = db.transaction();
+    return inTransaction;
+}
+
+bool SqlStorageBackend::commitTransaction() {
+    inTransaction = false;
+    return db.commit();
+}
+
+void SqlStorageBackend::rollbackTransaction() {
+    inTransaction = false;
+    db.rollback();
+}
+
+//
+PostgresStorageBackend::PostgresStorageBackend(QSqlDatabase &db)
+    : SqlStorageBackend(db), searchManager(db) {}
+
+QString PostgresStorageBackend::backendName() const {
+    return "postgres";
+}
+
+bool PostgresStorageBackend::getTemplateGrid(int templateId, TemplateGrid &grid) {
+    QHash<int, TemplateGrid> grids;
+    if (!templateManager.getGridsForTemplates({templateId}, grids)) {
+        return false;
+    }
+    grid = grids.value(templateId);
+    return true;
+}
+
+QVector<SearchResult> PostgresStorageBackend::search(int projectId, const QString &text, int limit) {
+    return searchManager.search(projectId, text, limit);
+}
+
+//
+SqliteStorageBackend::SqliteStorageBackend(QSqlDatabase &db)
+    : SqlStorageBackend(db) {}
+
+bool SqliteStorageBackend::prepareSchema(QSqlDatabase &db) {
+    QSqlQuery query(db);
+
+    // WAL позволяет читать файл из другого соединения, пока идёт запись
+    execQuery(query, "PRAGMA journal_mode = WAL");
+    execQuery(query, "PRAGMA synchronous = NORMAL");
+
+    const QStringList statements = {
+        "CREATE TABLE IF NOT EXISTS project (project_id INTEGER PRIMARY KEY, name TEXT)",
+        "CREATE TABLE IF NOT EXISTS category (category_id INTEGER PRIMARY KEY, name TEXT, parent_id INTEGER, "
+        "position INTEGER, depth INTEGER, project_id INTEGER)",
+        "CREATE INDEX IF NOT EXISTS idx_category_project ON category (project_id, position)",
+        "CREATE TABLE IF NOT EXISTS category_stats (category_id INTEGER PRIMARY KEY, "
+        "template_count INTEGER NOT NULL DEFAULT 0, approved_count INTEGER NOT NULL DEFAULT 0, "
+        "cell_count INTEGER NOT NULL DEFAULT 0)",
+        "CREATE TABLE IF NOT EXISTS table_template (template_id INTEGER PRIMARY KEY, category_id INTEGER, "
+        "project_id INTEGER, name TEXT, position INTEGER, notes TEXT, programming_notes TEXT, "
+        "is_approved INTEGER NOT NULL DEFAULT 0, version INTEGER NOT NULL DEFAULT 0)",
+        "CREATE INDEX IF NOT EXISTS idx_table_template_category ON table_template (category_id, position)",
+        "CREATE INDEX IF NOT EXISTS idx_table_template_project ON table_template (project_id)",
+        "CREATE TABLE IF NOT EXISTS table_column (template_id INTEGER NOT NULL, column_order INTEGER, header TEXT)",
+        "CREATE INDEX IF NOT EXISTS idx_table_column_template ON table_column (template_id, column_order)",
+        "CREATE TABLE IF NOT EXISTS table_row (template_id INTEGER NOT NULL, row_order INTEGER)",
+        "CREATE INDEX IF NOT EXISTS idx_table_row_template ON table_row (template_id, row_order)",
+        "CREATE TABLE IF NOT EXISTS table_cell (template_id INTEGER NOT NULL, row_order INTEGER, "
+        "column_order INTEGER, content TEXT)",
+        "CREATE INDEX IF NOT EXISTS idx_table_cell_template ON table_cell (template_id, row_order, column_order)",
+        // Упаковка сеток выполняется только на сервере; таблица нужна общим запросам менеджеров
+        "CREATE TABLE IF NOT EXISTS template_grid (template_id INTEGER PRIMARY KEY, "
+        "format_version INTEGER NOT NULL DEFAULT 1, data TEXT NOT NULL)",
+        "CREATE VIEW IF NOT EXISTS template_grid_full AS SELECT template_id, format_version, data FROM template_grid",
+        "CREATE TABLE IF NOT EXISTS template_revision (template_id INTEGER NOT NULL, revision INTEGER NOT NULL, "
+        "is_snapshot INTEGER NOT NULL, changed_cells INTEGER NOT NULL DEFAULT 0, data TEXT NOT NULL, "
+        "created_at TEXT NOT NULL DEFAULT (strftime('%Y-%m-%dT%H:%M:%S', 'now')), "
+        "PRIMARY KEY (template_id, revision))"
+    };
+
+    for (const QString &statement : statements) {
+        if (!execQuery(query, statement)) {
+            qDebug() << "Ошибка подготовки схемы SQLite:" << query.lastError().text() << statement;
+            return false;
+        }
+    }
+    return true;
+}
+
+QString SqliteStorageBackend::backendName() const {
+    return "sqlite";
+}
+
+bool SqliteStorageBackend::createProject(const QString &name, int *newProjectId) {
+    QSqlQuery query(db);
+    query.prepare("INSERT INTO project (name) VALUES (:name)");
+    query.bindValue(":name", name);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка создания проекта:" << query.lastError().text();
+        return false;
+    }
+    if (newProjectId) {
+        *newProjectId = query.lastInsertId().toInt();
+    }
+    return true;
+}
+
+bool SqliteStorageBackend::createCategory(const QString &name, int parentId, int projectId, int *newCategoryId) {
+    QSqlQuery query(db);
+    int depth = 1;     // Корневые категории имеют глубину 1, как и на сервере
+
+    if (parentId != -1) {
+        query.prepare("SELECT depth FROM category WHERE category_id = :parentId");
+        query.bindValue(":parentId", parentId);
+        if (!execQuery(query) || !query.next()) {
+            qDebug() << "Ошибка получения глубины родительской категории:" << query.lastError();
+            return false;
+        }
+        depth = query.value(0).toInt() + 1;
+
+        // Подкатегории и шаблоны одного родителя нумеруются общим рядом
+        query.prepare("SELECT COALESCE(MAX(position), 0) + 1 FROM ( "
+                      "    SELECT position FROM category WHERE parent_id = :parentId "
+                      "    UNION ALL "
+                      "    SELECT position FROM table_template WHERE category_id = :parentId2)");
+        query.bindValue(":parentId", parentId);
+        query.bindValue(":parentId2", parentId);
+    } else {
+        query.prepare("SELECT COALESCE(MAX(position), 0) + 1 FROM category "
+                      "WHERE project_id = :projectId AND parent_id IS NULL");
+        query.bindValue(":projectId", projectId);
+    }
+    if (!execQuery(query) || !query.next()) {
+        qDebug() << "Ошибка определения позиции категории:" << query.lastError();
+        return false;
+    }
+    const int position = query.value(0).toInt();
+
+    query.prepare("INSERT INTO category (name, parent_id, position, depth, project_id) "
+                  "VALUES (:name, :parentId, :position, :depth, :projectId)");
+    query.bindValue(":name", name);
+    query.bindValue(":parentId", parentId == -1 ? QVariant() : parentId);
+    query.bindValue(":position", position);
+    query.bindValue(":depth", depth);
+    query.bindValue(":projectId", projectId);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка создания категории:" << query.lastError();
+        return false;
+    }
+    if (newCategoryId) {
+        *newCategoryId = query.lastInsertId().toInt();
+    }
+    return true;
+}
+
+QVector<Category> SqliteStorageBackend::getCategoriesByProject(int projectId) {
+    // Триггеров category_stats нет: итоги шаблонов собираются по цепочке предков при чтении
+    QVector<Category> categories;
+    QSqlQuery query(db);
+    query.prepare(
+        "WITH RECURSIVE ancestry (category_id, ancestor_id) AS ( "
+        "    SELECT category_id, category_id FROM category WHERE project_id = :projectId "
+        "    UNION ALL "
+        "    SELECT a.category_id, c.parent_id FROM ancestry a "
+        "    INNER JOIN category c ON c.category_id = a.ancestor_id WHERE c.parent_id IS NOT NULL "
+        "), totals AS ( "
+        "    SELECT a.ancestor_id AS category_id, COUNT(*) AS template_count, "
+        "           SUM(t.is_approved) AS approved_count, "
+        "           SUM((SELECT COUNT(*) FROM table_cell x WHERE x.template_id = t.template_id)) AS cell_count "
+        "    FROM ancestry a INNER JOIN table_template t ON t.category_id = a.category_id "
+        "    GROUP BY a.ancestor_id "
+        ") "
+        "SELECT c.category_id, c.name, c.parent_id, c.position, c.depth, c.project_id, "
+        "       COALESCE(s.template_count, 0), COALESCE(s.approved_count, 0), COALESCE(s.cell_count, 0) "
+        "FROM category c LEFT JOIN totals s ON s.category_id = c.category_id "
+        "WHERE c.project_id = :projectId2 ORDER BY c.position");
+    query.bindValue(":projectId", projectId);
+    query.bindValue(":projectId2", projectId);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка загрузки категорий:" << query.lastError().text();
+        return categories;
+    }
+
+    while (query.next()) {
+        Category category;
+        category.categoryId = query.value(0).toInt();
+        category.name = query.value(1).toString();
+        category.parentId = query.value(2).toInt();
+        category.position = query.value(3).toInt();
+        category.depth = query.value(4).toInt();
+        category.projectId = query.value(5).toInt();
+        category.templateCount = query.value(6).toInt();
+        category.approvedCount = query.value(7).toInt();
+        category.cellCount = query.value(8).toLongLong();
+        categories.append(category);
+    }
+    return categories;
+}
+
+bool SqliteStorageBackend::createTemplate(int categoryId, const QString &templateName, int *newTemplateId) {
+    QSqlQuery query(db);
+    query.prepare("SELECT project_id, (SELECT COALESCE(MAX(position), 0) + 1 FROM ( "
+                  "    SELECT position FROM table_template WHERE category_id = :categoryId "
+                  "    UNION ALL "
+                  "    SELECT position FROM category WHERE parent_id = :categoryId2)) "
+                  "FROM category WHERE category_id = :categoryId3");
+    query.bindValue(":categoryId", categoryId);
+    query.bindValue(":categoryId2", categoryId);
+    query.bindValue(":categoryId3", categoryId);
+    if (!execQuery(query) || !query.next()) {
+        qDebug() << "Ошибка: категория с ID" << categoryId << "не существует." << query.lastError();
+        return false;
+    }
+    const QVariant projectId = query.value(0);
+    const int position = query.value(1).toInt();
+
+    query.prepare("INSERT INTO table_template (category_id, project_id, name, position, notes, programming_notes) "
+                  "VALUES (:categoryId, :projectId, :name, :position, '', '')");
+    query.bindValue(":categoryId", categoryId);
+    query.bindValue(":projectId", projectId);
+    query.bindValue(":name", templateName);
+    query.bindValue(":position", position);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка добавления шаблона в базу данных:" << query.lastError();
+        return false;
+    }
+    if (newTemplateId) {
+        *newTemplateId = query.lastInsertId().toInt();
+    }
+    return true;
+}
+
+bool SqliteStorageBackend::deleteProject(int projectId) {
+    const QStringList statements = {
+        "DELETE FROM table_cell WHERE template_id IN (SELECT template_id FROM table_template WHERE project_id = :projectId)",
+        "DELETE FROM table_row WHERE template_id IN (SELECT template_id FROM table_template WHERE project_id = :projectId)",
+        "DELETE FROM table_column WHERE template_id IN (SELECT template_id FROM table_template WHERE project_id = :projectId)",
+        "DELETE FROM template_grid WHERE template_id IN (SELECT template_id FROM table_template WHERE project_id = :projectId)",
+        "DELETE FROM template_revision WHERE template_id IN (SELECT template_id FROM table_template WHERE project_id = :projectId)",
+        "DELETE FROM table_template WHERE project_id = :projectId",
+        "DELETE FROM category_stats WHERE category_id IN (SELECT category_id FROM category WHERE project_id = :projectId)",
+        "DELETE FROM category WHERE project_id = :projectId",
+        "DELETE FROM project WHERE project_id = :projectId"
+    };
+
+    QSqlQuery query(db);
+    for (const QString &statement : statements) {
+        query.prepare(statement);
+        query.bindValue(":projectId", projectId);
+        if (!execQuery(query)) {
+            qDebug() << "Ошибка удаления проекта:" << query.lastError().text();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SqliteStorageBackend::deleteCategory(int categoryId, bool deleteAll) {
+    // Серверных функций дерева в SQLite нет: поддерево и распаковка - несколькими запросами
+    // в одной транзакции (вне явной транзакции - в собственной)
+    bool ownTransaction = !inTransaction && db.transaction();
+
+    const bool ok = deleteAll ? deleteSubtree(categoryId) : unpackCategory(categoryId);
+    if (!ownTransaction) return ok;
+    if (ok && db.commit()) return true;
+    db.rollback();
+    return false;
+}
+
+bool SqliteStorageBackend::deleteSubtree(int categoryId) {
+    QSqlQuery query(db);
+    query.prepare("SELECT parent_id, project_id FROM category WHERE category_id = :categoryId");
+    query.bindValue(":categoryId", categoryId);
+    if (!execQuery(query) || !query.next()) {
+        qDebug() << "Ошибка получения родительской категории:" << query.lastError();
+        return false;
+    }
+    const QVariant parentId = query.value(0);
+    const int projectId = query.value(1).toInt();
+
+    // Сетки шаблонов поддерева удаляются до удаления самих шаблонов, шаблоны - до категорий
+    const QString templatesOfSubtree = "template_id IN (SELECT template_id FROM table_template "
+                                       "WHERE category_id IN (SELECT category_id FROM subcategories))";
+    const QString subtree = "category_id IN (SELECT category_id FROM subcategories)";
+    const QVector<QPair<QString, QString>> deletions = {
+        {"table_cell", templatesOfSubtree}, {"table_row", templatesOfSubtree},
+        {"table_column", templatesOfSubtree}, {"template_grid", templatesOfSubtree},
+        {"template_revision", templatesOfSubtree}, {"table_template", subtree}, {"category", subtree}
+    };
+    for (const auto &deletion : deletions) {
+        query.prepare(QString(
+            "WITH RECURSIVE subcategories AS ( "
+            "    SELECT category_id FROM category WHERE category_id = :categoryId "
+            "    UNION ALL "
+            "    SELECT c.category_id FROM category c "
+            "    INNER JOIN subcategories s ON c.parent_id = s.category_id "
+            ") "
+            "DELETE FROM %1 WHERE %2").arg(deletion.first, deletion.second));
+        query.bindValue(":categoryId", categoryId);
+        if (!execQuery(query)) {
+            qDebug() << "Ошибка удаления категории и её содержимого:" << deletion.first << query.lastError();
+            return false;
+        }
+    }
+
+    // Оставшиеся соседи нумеруются без пропуска
+    return renumberChildren(projectId, parentId);
+}
+
+bool SqliteStorageBackend::unpackCategory(int categoryId) {
+    QSqlQuery query(db);
+    query.prepare("SELECT c.parent_id, c.project_id, COALESCE(p.depth, 0) FROM category c "
+                  "LEFT JOIN category p ON p.category_id = c.parent_id WHERE c.category_id = :categoryId");
+    query.bindValue(":categoryId", categoryId);
+
+    if (!execQuery(query) || !query.next()) {
+        qDebug() << "Ошибка получения родительской категории:" << query.lastError();
+        return false;
+    }
+
+    const QVariant parentId = query.value(0);   // NULL у корневой категории
+    const int projectId = query.value(1).toInt();
+    const int parentDepth = query.value(2).toInt();
+
+    // Шаблоны корневой категории перенести некуда: на верхнем уровне только категории
+    if (parentId.isNull()) {
+        query.prepare("SELECT EXISTS (SELECT 1 FROM table_template WHERE category_id = :categoryId)");
+        query.bindValue(":categoryId", categoryId);
+        if (!execQuery(query) || !query.next()) {
+            qDebug() << "Ошибка проверки шаблонов категории:" << query.lastError();
+            return false;
+        }
+        if (query.value(0).toBool()) {
+            qDebug() << "Нельзя распаковать корневую категорию с шаблонами:" << categoryId;
+            return false;
+        }
+    }
+
+    // Глубина поддеревьев распаковываемой категории считается от родителя заново
+    query.prepare("WITH RECURSIVE levels (category_id, level) AS ( "
+                  "    SELECT category_id, :parentDepth + 1 FROM category WHERE parent_id = :categoryId "
+                  "    UNION ALL "
+                  "    SELECT c.category_id, l.level + 1 FROM category c "
+                  "    INNER JOIN levels l ON c.parent_id = l.category_id "
+                  ") "
+                  "UPDATE category SET depth = (SELECT l.level FROM levels l WHERE l.category_id = category.category_id) "
+                  "WHERE category_id IN (SELECT category_id FROM levels)");
+    query.bindValue(":parentDepth", parentDepth);
+    query.bindValue(":categoryId", categoryId);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка пересчёта глубины категорий:" << query.lastError();
+        return false;
+    }
+
+    if (!renumberChildren(projectId, parentId, categoryId)) return false;
+
+    query.prepare("DELETE FROM category WHERE category_id = :categoryId");
+    query.bindValue(":categoryId", categoryId);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка удаления категории:" << query.lastError();
+        return false;
+    }
+    return true;
+}
+
+bool SqliteStorageBackend::renumberChildren(int projectId, const QVariant &parentId, int unpackedId) {
+    QSqlQuery query(db);
+    query.prepare("SELECT 1, category_id, position, 0 FROM category "
+                  "WHERE project_id = :projectId AND parent_id IS :parentId AND category_id <> :unpackedId "
+                  "UNION ALL "
+                  "SELECT 0, template_id, position, 0 FROM table_template WHERE category_id = :parentId2 "
+                  "UNION ALL "
+                  "SELECT 1, category_id, (SELECT position FROM category WHERE category_id = :unpackedId2), position "
+                  "FROM category WHERE parent_id = :unpackedId3 "
+                  "UNION ALL "
+                  "SELECT 0, template_id, (SELECT position FROM category WHERE category_id = :unpackedId4), position "
+                  "FROM table_template WHERE category_id = :unpackedId5");
+    query.bindValue(":projectId", projectId);
+    query.bindValue(":parentId", parentId);
+    query.bindValue(":parentId2", parentId);
+    query.bindValue(":unpackedId", unpackedId);
+    query.bindValue(":unpackedId2", unpackedId);
+    query.bindValue(":unpackedId3", unpackedId);
+    query.bindValue(":unpackedId4", unpackedId);
+    query.bindValue(":unpackedId5", unpackedId);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка чтения детей категории:" << query.lastError();
+        return false;
+    }
+
+    QVector<Sibling> siblings;
+    while (query.next()) {
+        siblings.append({query.value(0).toBool(), query.value(1).toInt(), query.value(2), query.value(3)});
+    }
+
+    sortSiblings(siblings);
+
+    for (int i = 0; i < siblings.size(); ++i) {
+        query.prepare(siblings[i].isCategory
+                          ? "UPDATE category SET parent_id = :parentId, position = :position WHERE category_id = :itemId"
+                          : "UPDATE table_template SET category_id = :parentId, position = :position WHERE template_id = :itemId");
+        query.bindValue(":parentId", parentId);
+        query.bindValue(":position", i + 1);
+        query.bindValue(":itemId", siblings[i].itemId);
+        if (!execQuery(query)) {
+            qDebug() << "Ошибка нумерации детей категории:" << query.lastError();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SqliteStorageBackend::renumberProject(int projectId) {
+    // Запрос менеджера изменяет строки внутри WITH, чего SQLite не умеет: порядок считается
+    // здесь, записываются только строки с изменившейся позицией или глубиной
+    QSqlQuery query(db);
+    query.prepare("SELECT category_id, COALESCE(parent_id, 0), position, depth FROM category "
+                  "WHERE project_id = :projectId");
+    query.bindValue(":projectId", projectId);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка чтения категорий проекта:" << query.lastError();
+        return false;
+    }
+
+    QHash<int, QVector<Sibling>> children;      // Ряды детей по родителю, 0 - верхний уровень
+    QHash<int, int> oldDepths;
+    while (query.next()) {
+        const int categoryId = query.value(0).toInt();
+        children[query.value(1).toInt()].append({true, categoryId, query.value(2), 0});
+        oldDepths.insert(categoryId, query.value(3).toInt());
+    }
+
+    query.prepare("SELECT template_id, category_id, position FROM table_template WHERE project_id = :projectId");
+    query.bindValue(":projectId", projectId);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка чтения шаблонов проекта:" << query.lastError();
+        return false;
+    }
+    while (query.next()) {
+        children[query.value(1).toInt()].append({false, query.value(0).toInt(), query.value(2), 0});
+    }
+
+    bool ownTransaction = !inTransaction && db.transaction();
+    auto fail = [this, ownTransaction, &query]() {
+        qDebug() << "Ошибка уплотнения позиций проекта:" << query.lastError();
+        if (ownTransaction) db.rollback();
+        return false;
+    };
+
+    // Обход от верхнего уровня: глубина категории на единицу больше глубины родителя
+    QVector<QPair<int, int>> parents = {{0, 0}};
+    for (int i = 0; i < parents.size(); ++i) {
+        const int parentId = parents[i].first;
+        const int depth = parents[i].second + 1;
+        QVector<Sibling> &siblings = children[parentId];
+        sortSiblings(siblings);
+
+        for (int j = 0; j < siblings.size(); ++j) {
+            const Sibling &sibling = siblings[j];
+            const int position = j + 1;
+            if (sibling.isCategory) {
+                parents.append({sibling.itemId, depth});
+                if (!sibling.base.isNull() && sibling.base.toInt() == position
+                    && oldDepths.value(sibling.itemId) == depth) continue;
+                query.prepare("UPDATE category SET position = :position, depth = :depth WHERE category_id = :itemId");
+                query.bindValue(":depth", depth);
+            } else {
+                if (!sibling.base.isNull() && sibling.base.toInt() == position) continue;
+                query.prepare("UPDATE table_template SET position = :position WHERE template_id = :itemId");
+            }
+            query.bindValue(":position", position);
+            query.bindValue(":itemId", sibling.itemId);
+            if (!execQuery(query)) return fail();
+        }
+    }
+    return !ownTransaction || db.commit();
+}
+
+QVector<SearchResult> SqliteStorageBackend::search(int projectId, const QString &text, int limit) {
+    QVector<SearchResult> results;
+    const QString needle = text.trimmed();
+    if (needle.isEmpty()) {
+        return results;
+    }
+
+    QSqlQuery query(db);
+    query.prepare(
+        "SELECT template_id, name, row_order, column_order, content FROM ( "
+        "    SELECT t.template_id, t.name, -1 AS row_order, -1 AS column_order, "
+        "           t.name || ' ' || COALESCE(t.notes, '') || ' ' || COALESCE(t.programming_notes, '') AS content "
+        "    FROM table_template t WHERE t.project_id = :projectId "
+        "    UNION ALL "
+        "    SELECT c.template_id, t.name, c.row_order, c.column_order, c.content "
+        "    FROM table_cell c INNER JOIN table_template t ON t.template_id = c.template_id "
+        "    WHERE t.project_id = :projectId2 "
+        ") WHERE content LIKE :pattern ESCAPE '\\' LIMIT :limit");
+    QString pattern = needle;
+    pattern.replace("\\", "\\\\").replace("%", "\\%").replace("_", "\\_");
+    query.bindValue(":projectId", projectId);
+    query.bindValue(":projectId2", projectId);
+    query.bindValue(":pattern", "%" + pattern + "%");
+    query.bindValue(":limit", limit);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка поиска:" << query.lastError();
+        return results;
+    }
+
+    while (query.next()) {
+        // Фрагмент вокруг первого совпадения с выделением, как у ts_headline
+        const QString content = query.value(4).toString();
+        int at = qMax(0, content.indexOf(needle, 0, Qt::CaseInsensitive));
+        int from = qMax(0, at - 40);
+        QString snippet = content.mid(from, at - from).toHtmlEscaped() + "<b>" +
+                          content.mid(at, needle.size()).toHtmlEscaped() + "</b>" +
+                          content.mid(at + needle.size(), 40).toHtmlEscaped();
+
+        results.append({
+            query.value(0).toInt(),
+            query.value(1).toString(),
+            query.value(2).toInt(),
+            query.value(3).toInt(),
+            1.0,
+            snippet
+        });
+    }
+    return results;
+}
@@ -0,0 +1,93 @@
+#ifndef SQLSTORAGEBACKEND_H
+#define SQLSTORAGEBACKEND_H
+
+#include <QSqlDatabase>
+#include "storagebackend.h"
+#include "tablemanager.h"
+
+// Общая часть SQL-хранилищ: вызовы переадресуются существующим менеджерам,
+// работающим с переданным соединением. Соединение открывает и закрывает вызывающий.
+class SqlStorageBackend : public StorageBackend {
+public:
+    explicit SqlStorageBackend(QSqlDatabase &db);
+
+    bool createProject(const QString &name, int *newProjectId = nullptr) override;
+    bool deleteProject(int projectId) override;
+    QVector<Project> getProjects() override;
+
+    bool createCategory(const QString &name, int parentId, int projectId, int *newCategoryId = nullptr) override;
+    bool updateCategory(int categoryId, const QString &newName) override;
+    bool deleteCategory(int categoryId, bool deleteAll) override;
+    QVector<Category> getCategoriesByProject(int projectId) override;
+    bool updateNumeration(int itemId, int parentId, const QString &numeration, int depth) override;
+    bool renumberProject(int projectId) override;
+
+    bool createTemplate(int categoryId, const QString &templateName, int *newTemplateId = nullptr) override;
+    bool updateTemplate(int templateId,
+                        const std::optional<QString> &name,
+                        const std::optional<QString> &notes,
+                        const std::optional<QString> &programmingNotes) override;
+    bool deleteTemplate(int templateId) override;
+    bool setTemplateApproved(int templateId, bool approved) override;
+    QVector<Template> getTemplatesForCategory(int categoryId, bool onlyUnapproved = false) override;
+
+    bool getTemplateGrid(int templateId, TemplateGrid &grid) override;
+    bool saveTemplateGrid(int templateId, const TemplateGrid &grid) override;
+
+    bool beginTransaction() override;
+    bool commitTransaction() override;
+    void rollbackTransaction() override;
+
+protected:
+    QSqlDatabase &db;
+    ProjectManager projectManager;
+    CategoryManager categoryManager;
+    TemplateManager templateManager;
+    TableManager tableManager;
+    bool inTransaction = false;
+};
+
+// Рабочая база PostgreSQL: полнотекстовый поиск по tsvector и выборка сеток по массиву идентификаторов
+class PostgresStorageBackend : public SqlStorageBackend {
+public:
+    explicit PostgresStorageBackend(QSqlDatabase &db);
+
+    QString backendName() const override;
+    bool getTemplateGrid(int templateId, TemplateGrid &grid) override;
+    QVector<SearchResult> search(int projectId, const QString &text, int limit = 100) override;
+
+private:
+    SearchManager searchManager;
+};
+
+// Файл SQLite со схемой локальной реплики. Запросы, которые в менеджерах написаны
+// для PostgreSQL (RETURNING, триггерные агрегаты), заменены переносимыми: новые
+// идентификаторы берутся из lastInsertId, агрегаты категорий считаются при чтении.
+// Внешних ключей нет, поэтому зависимые строки удаляются явно. Поиск - по подстроке (LIKE).
+class SqliteStorageBackend : public SqlStorageBackend {
+public:
+    explicit SqliteStorageBackend(QSqlDatabase &db);
+
+    // Таблицы проекта в SQLite (используется и локальной репликой)
+    static bool prepareSchema(QSqlDatabase &db);
+
+    QString backendName() const override;
+    bool createProject(const QString &name, int *newProjectId = nullptr) override;
+    bool deleteProject(int projectId) override;
+    bool createCategory(const QString &name, int parentId, int projectId, int *newCategoryId = nullptr) override;
+    bool deleteCategory(int categoryId, bool deleteAll) override;
+    QVector<Category> getCategoriesByProject(int projectId) override;
+    bool renumberProject(int projectId) override;
+    bool createTemplate(int categoryId, const QString &templateName, int *newTemplateId = nullptr) override;
+    QVector<SearchResult> search(int projectId, const QString &text, int limit = 100) override;
+
+private:
+    bool deleteSubtree(int categoryId);
+    bool unpackCategory(int categoryId);
+    // Сплошная нумерация детей родителя, как renumber_category_children на сервере:
+    // сначала подкатегории, затем шаблоны; дети распакованной категории встают на её место
+    // и переходят к родителю
+    bool renumberChildren(int projectId, const QVariant &parentId, int unpackedId = 0);
+};
+
+#endif // SQLSTORAGEBACKEND_H
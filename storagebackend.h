@@ -0,0 +1,60 @@
+#ifndef STORAGEBACKEND_H
+#define STORAGEBACKEND_H
+
+#include <QString>
+#include <QVector>
+#include <optional>
+#include "projectmanager.h"
+#include "categorymanager.h"
+#include "templatemanager.h"
+#include "searchmanager.h"
+
+// Хранилище проектов, категорий и шаблонов независимо от СУБД.
+// Реализации: PostgresStorageBackend (рабочая база), SqliteStorageBackend
+// (локальный файл) и MemoryStorageBackend (без ввода-вывода, для тестов
+// и как нулевая точка отсчёта в замерах). Семантика методов совпадает
+// с одноимёнными методами менеджеров.
+class StorageBackend {
+public:
+    virtual ~StorageBackend() = default;
+
+    virtual QString backendName() const = 0;
+
+    // Проекты
+    virtual bool createProject(const QString &name, int *newProjectId = nullptr) = 0;
+    virtual bool deleteProject(int projectId) = 0;
+    virtual QVector<Project> getProjects() = 0;
+
+    // Категории
+    virtual bool createCategory(const QString &name, int parentId, int projectId, int *newCategoryId = nullptr) = 0;
+    virtual bool updateCategory(int categoryId, const QString &newName) = 0;
+    virtual bool deleteCategory(int categoryId, bool deleteAll) = 0;
+    virtual QVector<Category> getCategoriesByProject(int projectId) = 0;
+    virtual bool updateNumeration(int itemId, int parentId, const QString &numeration, int depth) = 0;
+    // Сплошная нумерация всего проекта и глубина категорий; меняются только сдвинутые элементы
+    virtual bool renumberProject(int projectId) = 0;
+
+    // Шаблоны
+    virtual bool createTemplate(int categoryId, const QString &templateName, int *newTemplateId = nullptr) = 0;
+    virtual bool updateTemplate(int templateId,
+                                const std::optional<QString> &name,
+                                const std::optional<QString> &notes,
+                                const std::optional<QString> &programmingNotes) = 0;
+    virtual bool deleteTemplate(int templateId) = 0;
+    virtual bool setTemplateApproved(int templateId, bool approved) = 0;
+    virtual QVector<Template> getTemplatesForCategory(int categoryId, bool onlyUnapproved = false) = 0;
+
+    // Сетка шаблона загружается и сохраняется целиком
+    virtual bool getTemplateGrid(int templateId, TemplateGrid &grid) = 0;
+    virtual bool saveTemplateGrid(int templateId, const TemplateGrid &grid) = 0;
+
+    // Поиск по названиям, заметкам и ячейкам шаблонов проекта
+    virtual QVector<SearchResult> search(int projectId, const QString &text, int limit = 100) = 0;
+
+    // Группировка изменений в одну транзакцию (в памяти - без действия)
+    virtual bool beginTransaction() { return true; }
+    virtual bool commitTransaction() { return true; }
+    virtual void rollbackTransaction() {}
+};
+
+#endif // STORAGEBACKEND_H
@@ -0,0 +1,265 @@
+#include "memorystoragebackend.h"
+#include "sqlstoragebackend.h"
+#include <QtTest>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <memory>
+
+// Общие сценарии хранилищ без сервера: каждый тест выполняется для хранилища
+// в памяти и для SQLite в памяти процесса, результаты должны совпадать
+class StorageBackendTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void initTestCase_data();
+    void init();
+    void cleanup();
+
+    void createsTreeWithSharedNumbering();
+    void savesAndReloadsGrid();
+    void filtersUnapprovedTemplates();
+    void updatesTemplateFields();
+    void countsSubtreeAggregates();
+    void renumbersProject();
+    void unpacksCategoryIntoParent();
+    void deletesCategorySubtree();
+    void searchesNamesAndCells();
+    void deletesProject();
+
+private:
+    // Проект с корневой категорией, подкатегорией и двумя шаблонами в корневой
+    void createProject();
+
+    QString connectionName;
+    std::unique_ptr<QSqlDatabase> db;
+    std::unique_ptr<StorageBackend> backend;
+
+    int projectId = 0;
+    int rootId = 0;
+    int childId = 0;
+    int firstTemplateId = 0;
+    int secondTemplateId = 0;
+};
+
+void StorageBackendTest::initTestCase_data() {
+    QTest::addColumn<QString>("backendName");
+    QTest::newRow("memory") << QString("memory");
+    QTest::newRow("sqlite") << QString("sqlite");
+}
+
+void StorageBackendTest::init() {
+    QFETCH_GLOBAL(QString, backendName);
+
+    if (backendName == "sqlite") {
+        connectionName = QString("storage_test_%1").arg(QTest::currentTestFunction());
+        db = std::make_unique<QSqlDatabase>(QSqlDatabase::addDatabase("QSQLITE", connectionName));
+        db->setDatabaseName(":memory:");
+        QVERIFY2(db->open(), qPrintable(db->lastError().text()));
+        QVERIFY(SqliteStorageBackend::prepareSchema(*db));
+        backend = std::make_unique<SqliteStorageBackend>(*db);
+    } else {
+        backend = std::make_unique<MemoryStorageBackend>();
+    }
+    QCOMPARE(backend->backendName(), backendName);
+
+    createProject();
+}
+
+void StorageBackendTest::cleanup() {
+    backend.reset();
+    if (db) {
+        db->close();
+        db.reset();
+        QSqlDatabase::removeDatabase(connectionName);
+    }
+}
+
+void StorageBackendTest::createProject() {
+    QVERIFY(backend->createProject("Проект", &projectId));
+    QVERIFY(backend->createCategory("Корень", -1, projectId, &rootId));
+    QVERIFY(backend->createCategory("Подкатегория", rootId, projectId, &childId));
+    QVERIFY(backend->createTemplate(rootId, "Первый", &firstTemplateId));
+    QVERIFY(backend->createTemplate(rootId, "Второй", &secondTemplateId));
+    QVERIFY(projectId > 0 && rootId > 0 && childId > 0);
+    QVERIFY(firstTemplateId > 0 && secondTemplateId != firstTemplateId);
+}
+
+void StorageBackendTest::createsTreeWithSharedNumbering() {
+    const QVector<Project> projects = backend->getProjects();
+    QCOMPARE(projects.size(), 1);
+    QCOMPARE(projects[0].name, QString("Проект"));
+
+    // Обе категории первые в своём ряду, порядок между ними не задан
+    const QVector<Category> categories = backend->getCategoriesByProject(projectId);
+    QCOMPARE(categories.size(), 2);
+    for (const Category &category : categories) {
+        QCOMPARE(category.position, 1);
+        QCOMPARE(category.projectId, projectId);
+        if (category.categoryId == rootId) {
+            QCOMPARE(category.parentId, 0);
+            QCOMPARE(category.depth, 1);
+        } else {
+            QCOMPARE(category.categoryId, childId);
+            QCOMPARE(category.parentId, rootId);
+            QCOMPARE(category.depth, 2);
+        }
+    }
+
+    // Подкатегория занимает позицию 1, шаблоны нумеруются после неё
+    const QVector<Template> templates = backend->getTemplatesForCategory(rootId);
+    QCOMPARE(templates.size(), 2);
+    QCOMPARE(templates[0].templateId, firstTemplateId);
+    QCOMPARE(templates[0].position, 2);
+    QCOMPARE(templates[1].position, 3);
+    QVERIFY(!templates[0].isApproved);
+}
+
+void StorageBackendTest::savesAndReloadsGrid() {
+    TemplateGrid grid;
+    grid.headers = {"Параметр", "Значение"};
+    grid.cells = {{"Скорость", "10"}, {"Высота", "200"}};
+    QVERIFY(backend->saveTemplateGrid(firstTemplateId, grid));
+
+    TemplateGrid loaded;
+    QVERIFY(backend->getTemplateGrid(firstTemplateId, loaded));
+    QCOMPARE(loaded.headers, grid.headers);
+    QCOMPARE(loaded.cells, grid.cells);
+
+    // Повторное сохранение заменяет сетку целиком
+    grid.headers = {"Параметр"};
+    grid.cells = {{"Давление"}};
+    QVERIFY(backend->saveTemplateGrid(firstTemplateId, grid));
+    QVERIFY(backend->getTemplateGrid(firstTemplateId, loaded));
+    QCOMPARE(loaded.headers, grid.headers);
+    QCOMPARE(loaded.cells, grid.cells);
+}
+
+void StorageBackendTest::filtersUnapprovedTemplates() {
+    QVERIFY(backend->setTemplateApproved(firstTemplateId, true));
+
+    const QVector<Template> all = backend->getTemplatesForCategory(rootId);
+    QCOMPARE(all.size(), 2);
+    QVERIFY(all[0].isApproved);
+
+    const QVector<Template> unapproved = backend->getTemplatesForCategory(rootId, true);
+    QCOMPARE(unapproved.size(), 1);
+    QCOMPARE(unapproved[0].templateId, secondTemplateId);
+}
+
+void StorageBackendTest::updatesTemplateFields() {
+    QVERIFY(backend->updateTemplate(firstTemplateId, QString("Переименован"), QString("Заметка"), std::nullopt));
+
+    const QVector<Template> templates = backend->getTemplatesForCategory(rootId);
+    QCOMPARE(templates[0].name, QString("Переименован"));
+    QCOMPARE(templates[0].notes, QString("Заметка"));
+    QCOMPARE(templates[0].programmingNotes, QString());
+}
+
+void StorageBackendTest::countsSubtreeAggregates() {
+    int nestedId = 0;
+    QVERIFY(backend->createTemplate(childId, "Вложенный", &nestedId));
+    QVERIFY(backend->setTemplateApproved(nestedId, true));
+
+    TemplateGrid grid;
+    grid.headers = {"A", "B", "C"};
+    grid.cells = {{"1", "2", "3"}, {"4", "5", "6"}};
+    QVERIFY(backend->saveTemplateGrid(nestedId, grid));
+
+    // Итоги подкатегории входят в итоги корневой
+    for (const Category &category : backend->getCategoriesByProject(projectId)) {
+        if (category.categoryId == rootId) {
+            QCOMPARE(category.templateCount, 3);
+            QCOMPARE(category.approvedCount, 1);
+            QCOMPARE(category.cellCount, qint64(6));
+        } else {
+            QCOMPARE(category.templateCount, 1);
+            QCOMPARE(category.approvedCount, 1);
+            QCOMPARE(category.cellCount, qint64(6));
+        }
+    }
+}
+
+void StorageBackendTest::renumbersProject() {
+    // Пропуски в нумерации и неверная глубина, как после ручной правки
+    QVERIFY(backend->updateNumeration(childId, rootId, "1.5", 4));
+    QVERIFY(backend->updateNumeration(secondTemplateId, rootId, "1.9", 2));
+    QVERIFY(backend->renumberProject(projectId));
+
+    for (const Category &category : backend->getCategoriesByProject(projectId)) {
+        QCOMPARE(category.position, 1);
+        QCOMPARE(category.depth, category.categoryId == rootId ? 1 : 2);
+    }
+    QHash<int, int> positions;
+    for (const Template &tmpl : backend->getTemplatesForCategory(rootId)) positions.insert(tmpl.templateId, tmpl.position);
+    QCOMPARE(positions.value(firstTemplateId), 2);
+    QCOMPARE(positions.value(secondTemplateId), 3);
+}
+
+void StorageBackendTest::unpacksCategoryIntoParent() {
+    int grandchildId = 0;
+    int nestedId = 0;
+    QVERIFY(backend->createCategory("Вложенная", childId, projectId, &grandchildId));
+    QVERIFY(backend->createTemplate(childId, "Вложенный", &nestedId));
+    QVERIFY(backend->deleteCategory(childId, false));
+
+    // Вложенная категория поднимается на уровень и встаёт на место распакованной
+    const QVector<Category> categories = backend->getCategoriesByProject(projectId);
+    QCOMPARE(categories.size(), 2);
+    for (const Category &category : categories) {
+        if (category.categoryId == rootId) continue;
+        QCOMPARE(category.categoryId, grandchildId);
+        QCOMPARE(category.parentId, rootId);
+        QCOMPARE(category.depth, 2);
+        QCOMPARE(category.position, 1);
+    }
+
+    // Шаблоны распакованной категории идут перед шаблонами родителя, нумерация сплошная
+    QHash<int, int> positions;
+    for (const Template &tmpl : backend->getTemplatesForCategory(rootId)) positions.insert(tmpl.templateId, tmpl.position);
+    QCOMPARE(positions.size(), 3);
+    QCOMPARE(positions.value(nestedId), 2);
+    QCOMPARE(positions.value(firstTemplateId), 3);
+    QCOMPARE(positions.value(secondTemplateId), 4);
+}
+
+void StorageBackendTest::deletesCategorySubtree() {
+    int nestedId = 0;
+    QVERIFY(backend->createTemplate(childId, "Вложенный", &nestedId));
+    QVERIFY(backend->deleteCategory(rootId, true));
+
+    QVERIFY(backend->getCategoriesByProject(projectId).isEmpty());
+    QVERIFY(backend->getTemplatesForCategory(rootId).isEmpty());
+    QVERIFY(backend->getTemplatesForCategory(childId).isEmpty());
+}
+
+void StorageBackendTest::searchesNamesAndCells() {
+    TemplateGrid grid;
+    grid.headers = {"Параметр"};
+    grid.cells = {{"напряжение 27 В"}};
+    QVERIFY(backend->saveTemplateGrid(secondTemplateId, grid));
+
+    QVector<SearchResult> results = backend->search(projectId, "напряжение");
+    QCOMPARE(results.size(), 1);
+    QCOMPARE(results[0].templateId, secondTemplateId);
+    QCOMPARE(results[0].rowOrder, 0);
+    QCOMPARE(results[0].columnOrder, 0);
+    QVERIFY(results[0].snippet.contains("<b>напряжение</b>"));
+
+    // Совпадение в названии шаблона отмечается строкой -1
+    results = backend->search(projectId, "Первый");
+    QCOMPARE(results.size(), 1);
+    QCOMPARE(results[0].templateId, firstTemplateId);
+    QCOMPARE(results[0].rowOrder, -1);
+
+    QVERIFY(backend->search(projectId, "отсутствует").isEmpty());
+}
+
+void StorageBackendTest::deletesProject() {
+    QVERIFY(backend->deleteProject(projectId));
+    QVERIFY(backend->getProjects().isEmpty());
+    QVERIFY(backend->getCategoriesByProject(projectId).isEmpty());
+    QVERIFY(backend->getTemplatesForCategory(rootId).isEmpty());
+}
+
+QTEST_GUILESS_MAIN(StorageBackendTest)
+#include "storagebackend_test.moc"
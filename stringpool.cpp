@@ -0,0 +1,34 @@
+#include "stringpool.h"
+
+QString StringPool::intern(const QString &text) {
+    // Пустые строки и так разделяют общий буфер
+    if (text.isEmpty()) return QString();
+    return *strings.insert(text);
+}
+
+QVector<QString> StringPool::internHeaders(const QVector<QString> &headers) {
+    QVector<QString> shared = headers;
+    for (QString &header : shared) {
+        header = intern(header);
+    }
+    return *headerSets.insert(shared);
+}
+
+void StringPool::intern(TemplateGrid &grid) {
+    grid.headers = internHeaders(grid.headers);
+
+    for (QVector<QString> &row : grid.cells) {
+        for (QString &cell : row) {
+            cell = intern(cell);
+        }
+    }
+}
+
+int StringPool::size() const {
+    return strings.size();
+}
+
+void StringPool::clear() {
+    strings.clear();
+    headerSets.clear();
+}
@@ -0,0 +1,26 @@
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+#include <QSet>
+#include <QString>
+#include <QVector>
+#include "templatemanager.h"
+
+// Общие копии одинаковых строк: повторяющиеся заголовки и тексты ячеек разных шаблонов
+// ссылаются на один буфер QString (неявное разделение данных), одинаковые наборы
+// заголовков - на один QVector. Не потокобезопасен: у каждого загрузчика свой пул.
+class StringPool {
+public:
+    QString intern(const QString &text);
+    QVector<QString> internHeaders(const QVector<QString> &headers);
+    void intern(TemplateGrid &grid);
+
+    int size() const;       // Число уникальных строк
+    void clear();
+
+private:
+    QSet<QString> strings;
+    QSet<QVector<QString>> headerSets;
+};
+
+#endif // STRINGPOOL_H
@@ -1,18 +1,61 @@
-#include "tableManager.h"
+#include "tablemanager.h"
+#include "templatemanager.h"
+#include "revisionmanager.h"
+#include "queryexecutor.h"
+#include "tracing.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <optional>
 
 TableManager::TableManager(QSqlDatabase &db) : db(db) {}
 
+bool TableManager::editPackedGrid(int templateId, bool &packed, const std::function<bool(TemplateGrid &)> &edit) {
+    // Сетка читается под блокировкой записи template_grid, чтобы одновременные
+    // правки не затирали друг друга, и сохраняется в той же транзакции вместе с ревизией
+    WriteTransaction transaction(db);
+    if (!transaction.isStarted() || !transaction.lockRows("template_grid", "template_id", templateId)) {
+        return false;
+    }
+
+    TemplateGrid grid;
+    TemplateManager templates(db);
+    if (!templates.getPackedGrid(templateId, grid, packed)) return false;
+    if (!packed) return transaction.commit();
+
+    return edit(grid) && templates.storePackedGrid(templateId, grid) &&
+           RevisionManager(db).recordRevision(templateId, grid) && transaction.commit();
+}
+
 bool TableManager::createRowOrColumn(int templateId, const QString &type, const QString &header, int &newOrder) {
+    TRACE_SCOPE("manager", "TableManager::createRowOrColumn");
+
+    // Упакованная сетка меняется целиком одной записью
+    bool packed = false;
+    const bool edited = editPackedGrid(templateId, packed, [&](TemplateGrid &grid) {
+        if (type == "column") {
+            grid.headers.append(header);
+            for (QVector<QString> &row : grid.cells) row.append(QString());
+            newOrder = grid.headers.size() - 1;
+        } else if (type == "row") {
+            grid.cells.append(QVector<QString>(grid.headers.size()));
+            newOrder = grid.cells.size() - 1;
+        }
+        return true;
+    });
+    if (!edited || packed) return edited;
+
+    // Построчная правка и ревизия записываются одной транзакцией под блокировкой шаблона
+    WriteTransaction transaction(db);
+    if (!transaction.isStarted() || !transaction.lockRows("table_template", "template_id", templateId)) {
+        return false;
+    }
     QSqlQuery query(db);
 
     if (type == "column") {
         query.prepare("SELECT COALESCE(MAX(column_order), 0) + 1 FROM table_column WHERE template_id = :templateId");
         query.bindValue(":templateId", templateId);
 
-        if (!query.exec() || !query.next()) {
+        if (!execQuery(query) || !query.next()) {
             qDebug() << "Ошибка получения позиции для нового столбца:" << query.lastError();
             return false;
         }
@@ -28,7 +71,7 @@ bool TableManager::createRowOrColumn(int templateId, const QString &type, const
         query.prepare("SELECT COALESCE(MAX(row_order), 0) + 1 FROM table_row WHERE template_id = :templateId");
         query.bindValue(":templateId", templateId);
 
-        if (!query.exec() || !query.next()) {
+        if (!execQuery(query) || !query.next()) {
             qDebug() << "Ошибка получения позиции для новой строки:" << query.lastError();
             return false;
         }
@@ -40,16 +83,48 @@ bool TableManager::createRowOrColumn(int templateId, const QString &type, const
         query.bindValue(":rowOrder", newOrder);
     }
 
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка добавления в таблицу:" << query.lastError();
         return false;
     }
 
-    return true;
+    return recordRevision(templateId) && transaction.commit();
 }
 
 bool TableManager::updateOrder(const QString &type, int templateId, const QVector<int> &newOrder) {
-    QSqlQuery query(db);
+    TRACE_SCOPE("manager", "TableManager::updateOrder");
+
+    bool packed = false;
+    const bool edited = editPackedGrid(templateId, packed, [&](TemplateGrid &grid) {
+        const int count = type == "row" ? grid.cells.size() : grid.headers.size();
+        if (newOrder.size() != count) {
+            qDebug() << "Новый порядок не совпадает с размером упакованной сетки:" << newOrder.size() << count;
+            return false;
+        }
+        for (int order : newOrder) {
+            if (order < 0 || order >= count) {
+                qDebug() << "Неверный порядковый номер в новом порядке:" << order;
+                return false;
+            }
+        }
+
+        TemplateGrid reordered = grid;
+        for (int i = 0; i < newOrder.size(); ++i) {
+            if (type == "row") {
+                reordered.cells[i] = grid.cells[newOrder[i]];
+            } else {
+                reordered.headers[i] = grid.headers[newOrder[i]];
+                for (int row = 0; row < grid.cells.size(); ++row) {
+                    if (newOrder[i] < grid.cells[row].size() && i < reordered.cells[row].size()) {
+                        reordered.cells[row][i] = grid.cells[row][newOrder[i]];
+                    }
+                }
+            }
+        }
+        grid = reordered;
+        return true;
+    });
+    if (!edited || packed) return edited;
 
     QString tableName, orderColumn;
     if (type == "row") {
@@ -63,6 +138,12 @@ bool TableManager::updateOrder(const QString &type, int templateId, const QVecto
         return false;
     }
 
+    WriteTransaction transaction(db);
+    if (!transaction.isStarted() || !transaction.lockRows("table_template", "template_id", templateId)) {
+        return false;
+    }
+    QSqlQuery query(db);
+
     // Обновляем порядок для каждого элемента
     for (int i = 0; i < newOrder.size(); ++i) {
         query.prepare(QString("UPDATE %1 SET %2 = :newOrder WHERE template_id = :templateId AND %2 = :currentOrder")
@@ -71,32 +152,66 @@ bool TableManager::updateOrder(const QString &type, int templateId, const QVecto
         query.bindValue(":currentOrder", newOrder[i]);
         query.bindValue(":newOrder", i);
 
-        if (!query.exec()) {
+        if (!execQuery(query)) {
             qDebug() << "Ошибка обновления" << orderColumn << "в" << tableName << ":" << query.lastError();
             return false;
         }
     }
 
-    return true;
+    return recordRevision(templateId) && transaction.commit();
 }
 
 bool TableManager::updateColumnHeader(int templateId, int columnOrder, const QString &newHeader) {
+    TRACE_SCOPE("manager", "TableManager::updateColumnHeader");
+
+    bool packed = false;
+    const bool edited = editPackedGrid(templateId, packed, [&](TemplateGrid &grid) {
+        if (columnOrder < 0 || columnOrder >= grid.headers.size()) {
+            qDebug() << "Столбец" << columnOrder << "отсутствует в упакованной сетке";
+            return false;
+        }
+        grid.headers[columnOrder] = newHeader;
+        return true;
+    });
+    if (!edited || packed) return edited;
+
+    WriteTransaction transaction(db);
+    if (!transaction.isStarted() || !transaction.lockRows("table_template", "template_id", templateId)) {
+        return false;
+    }
     QSqlQuery query(db);
     query.prepare("UPDATE table_column SET header = :newHeader WHERE template_id = :templateId AND column_order = :columnOrder");
     query.bindValue(":newHeader", newHeader);
     query.bindValue(":templateId", templateId);
     query.bindValue(":columnOrder", columnOrder);
 
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка обновления заголовка столбца:" << query.lastError();
         return false;
     }
 
-    return true;
+    return recordRevision(templateId) && transaction.commit();
 }
 
 bool TableManager::deleteRowOrColumn(int templateId, int order, const QString &type) {
-    QSqlQuery query(db);
+    TRACE_SCOPE("manager", "TableManager::deleteRowOrColumn");
+
+    bool packed = false;
+    const bool edited = editPackedGrid(templateId, packed, [&](TemplateGrid &grid) {
+        if (type == "row" && order >= 0 && order < grid.cells.size()) {
+            grid.cells.remove(order);
+        } else if (type == "column" && order >= 0 && order < grid.headers.size()) {
+            grid.headers.remove(order);
+            for (QVector<QString> &row : grid.cells) {
+                if (order < row.size()) row.remove(order);
+            }
+        } else {
+            qDebug() << "Неверный тип или номер для удаления из упакованной сетки:" << type << order;
+            return false;
+        }
+        return true;
+    });
+    if (!edited || packed) return edited;
 
     QString tableName, orderColumn, relatedTable;
     if (type == "row") {
@@ -112,13 +227,19 @@ bool TableManager::deleteRowOrColumn(int templateId, int order, const QString &t
         return false;
     }
 
+    WriteTransaction transaction(db);
+    if (!transaction.isStarted() || !transaction.lockRows("table_template", "template_id", templateId)) {
+        return false;
+    }
+    QSqlQuery query(db);
+
     // Шаг 1: Удаляем строку или столбец из основной таблицы
     query.prepare(QString("DELETE FROM %1 WHERE template_id = :templateId AND %2 = :order")
                       .arg(tableName, orderColumn));
     query.bindValue(":templateId", templateId);
     query.bindValue(":order", order);
 
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка удаления из" << tableName << ":" << query.lastError();
         return false;
     }
@@ -129,7 +250,7 @@ bool TableManager::deleteRowOrColumn(int templateId, int order, const QString &t
     query.bindValue(":templateId", templateId);
     query.bindValue(":order", order);
 
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка удаления связанных данных из" << relatedTable << ":" << query.lastError();
         return false;
     }
@@ -140,17 +261,32 @@ bool TableManager::deleteRowOrColumn(int templateId, int order, const QString &t
     query.bindValue(":templateId", templateId);
     query.bindValue(":order", order);
 
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка обновления порядка в" << tableName << ":" << query.lastError();
         return false;
     }
 
-    return true;
+    return recordRevision(templateId) && transaction.commit();
 }
 
 bool TableManager::saveDataTableTemplate(int templateId,
                                          const std::optional<QVector<QString>> &headers = std::nullopt,
                                          const std::optional<QVector<QVector<QString>>> &cellData = std::nullopt) {
+    TRACE_SCOPE("manager", "TableManager::saveDataTableTemplate");
+
+    bool packed = false;
+    const bool edited = editPackedGrid(templateId, packed, [&](TemplateGrid &grid) {
+        if (headers) grid.headers = *headers;
+        if (cellData) grid.cells = *cellData;
+        return true;
+    });
+    if (!edited || packed) return edited;
+
+    // Строки сетки и ревизия записываются одной транзакцией под блокировкой шаблона
+    WriteTransaction transaction(db);
+    if (!transaction.isStarted() || !transaction.lockRows("table_template", "template_id", templateId)) {
+        return false;
+    }
     QSqlQuery query(db);
 
     // Шаг 1: Обновляем заголовки столбцов, если переданы
@@ -158,7 +294,7 @@ bool TableManager::saveDataTableTemplate(int templateId,
         // Удаляем старую структуру столбцов
         query.prepare("DELETE FROM table_column WHERE template_id = :templateId");
         query.bindValue(":templateId", templateId);
-        if (!query.exec()) {
+        if (!execQuery(query)) {
             qDebug() << "Ошибка удаления столбцов таблицы:" << query.lastError();
             return false;
         }
@@ -170,7 +306,7 @@ bool TableManager::saveDataTableTemplate(int templateId,
             query.bindValue(":columnOrder", col);
             query.bindValue(":header", (*headers)[col]);
 
-            if (!query.exec()) {
+            if (!execQuery(query)) {
                 qDebug() << "Ошибка добавления столбца:" << query.lastError();
                 return false;
             }
@@ -182,14 +318,14 @@ bool TableManager::saveDataTableTemplate(int templateId,
         // Удаляем старую структуру строк и ячеек
         query.prepare("DELETE FROM table_row WHERE template_id = :templateId");
         query.bindValue(":templateId", templateId);
-        if (!query.exec()) {
+        if (!execQuery(query)) {
             qDebug() << "Ошибка удаления строк таблицы:" << query.lastError();
             return false;
         }
 
         query.prepare("DELETE FROM table_cell WHERE template_id = :templateId");
         query.bindValue(":templateId", templateId);
-        if (!query.exec()) {
+        if (!execQuery(query)) {
             qDebug() << "Ошибка удаления ячеек таблицы:" << query.lastError();
             return false;
         }
@@ -200,7 +336,7 @@ bool TableManager::saveDataTableTemplate(int templateId,
             query.bindValue(":templateId", templateId);
             query.bindValue(":rowOrder", row);
 
-            if (!query.exec()) {
+            if (!execQuery(query)) {
                 qDebug() << "Ошибка добавления строки:" << query.lastError();
                 return false;
             }
@@ -212,7 +348,7 @@ bool TableManager::saveDataTableTemplate(int templateId,
                 query.bindValue(":columnOrder", col);
                 query.bindValue(":content", (*cellData)[row][col]);
 
-                if (!query.exec()) {
+                if (!execQuery(query)) {
                     qDebug() << "Ошибка добавления данных ячейки:" << query.lastError();
                     return false;
                 }
@@ -220,6 +356,100 @@ bool TableManager::saveDataTableTemplate(int templateId,
         }
     }
 
-    return true;
+    return recordRevision(templateId, headers, cellData) && transaction.commit();
 }
 
+bool TableManager::updateCells(int templateId, const QVector<GridCellValue> &cells) {
+    TRACE_SCOPE("manager", "TableManager::updateCells");
+
+    auto applyTo = [&cells](TemplateGrid &grid) {
+        for (const GridCellValue &cell : cells) {
+            if (cell.column < 0 || cell.column >= grid.headers.size() || cell.row >= grid.cells.size()) {
+                qDebug() << "Ячейка" << cell.row << cell.column << "отсутствует в сетке";
+                return false;
+            }
+            if (cell.row < 0) {
+                grid.headers[cell.column] = cell.text;
+            } else if (cell.column < grid.cells[cell.row].size()) {
+                grid.cells[cell.row][cell.column] = cell.text;
+            }
+        }
+        return true;
+    };
+
+    bool packed = false;
+    const bool edited = editPackedGrid(templateId, packed, [&](TemplateGrid &grid) {
+        return applyTo(grid);
+    });
+    if (!edited || packed) return edited;
+
+    // Индексы переводятся в порядковые номера, которые при построчном хранении идут с пропусками
+    WriteTransaction transaction(db);
+    TemplateGrid grid;
+    QVector<int> rowOrders, columnOrders;
+    if (!transaction.isStarted() || !transaction.lockRows("table_template", "template_id", templateId) ||
+        !TemplateManager(db).getGridForTemplate(templateId, grid, &rowOrders, &columnOrders) ||
+        !applyTo(grid)) {
+        return false;
+    }
+
+    QSqlQuery headerQuery(db);
+    headerQuery.prepare("UPDATE table_column SET header = :header "
+                        "WHERE template_id = :templateId AND column_order = :columnOrder");
+    QSqlQuery updateQuery(db);
+    updateQuery.prepare("UPDATE table_cell SET content = :content "
+                        "WHERE template_id = :templateId AND row_order = :rowOrder AND column_order = :columnOrder");
+    QSqlQuery insertQuery(db);
+    insertQuery.prepare("INSERT INTO table_cell (template_id, row_order, column_order, content) "
+                        "VALUES (:templateId, :rowOrder, :columnOrder, :content)");
+
+    for (const GridCellValue &cell : cells) {
+        if (cell.row < 0) {
+            headerQuery.bindValue(":header", cell.text);
+            headerQuery.bindValue(":templateId", templateId);
+            headerQuery.bindValue(":columnOrder", columnOrders[cell.column]);
+            if (!execQuery(headerQuery)) {
+                qDebug() << "Ошибка обновления заголовка столбца:" << headerQuery.lastError();
+                return false;
+            }
+            continue;
+        }
+
+        updateQuery.bindValue(":content", cell.text);
+        updateQuery.bindValue(":templateId", templateId);
+        updateQuery.bindValue(":rowOrder", rowOrders[cell.row]);
+        updateQuery.bindValue(":columnOrder", columnOrders[cell.column]);
+        if (!execQuery(updateQuery)) {
+            qDebug() << "Ошибка обновления ячейки:" << updateQuery.lastError();
+            return false;
+        }
+        if (updateQuery.numRowsAffected() > 0) continue;
+
+        // Пустые ячейки могут отсутствовать в table_cell
+        insertQuery.bindValue(":templateId", templateId);
+        insertQuery.bindValue(":rowOrder", rowOrders[cell.row]);
+        insertQuery.bindValue(":columnOrder", columnOrders[cell.column]);
+        insertQuery.bindValue(":content", cell.text);
+        if (!execQuery(insertQuery)) {
+            qDebug() << "Ошибка добавления данных ячейки:" << insertQuery.lastError();
+            return false;
+        }
+    }
+
+    return RevisionManager(db).recordRevision(templateId, grid) && transaction.commit();
+}
+
+bool TableManager::recordRevision(int templateId,
+                                  const std::optional<QVector<QString>> &headers,
+                                  const std::optional<QVector<QVector<QString>>> &cellData) {
+    // Недостающая часть сетки берётся из только что записанных данных
+    TemplateGrid grid;
+    if (!headers || !cellData) {
+        QHash<int, TemplateGrid> grids;
+        if (!TemplateManager(db).getGridsForTemplates({templateId}, grids)) return false;
+        grid = grids.value(templateId);
+    }
+    if (headers) grid.headers = *headers;
+    if (cellData) grid.cells = *cellData;
+    return RevisionManager(db).recordRevision(templateId, grid);
+}
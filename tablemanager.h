@@ -1,8 +1,20 @@
 #ifndef TABLEMANAGER_H
 #define TABLEMANAGER_H
 
+#include <functional>
 #include <optional>
 #include <QSqlDatabase>
+#include <QString>
+#include <QVector>
+
+struct TemplateGrid;
+
+// Новое значение ячейки или заголовка по индексам сетки
+struct GridCellValue {
+    int row;            // -1 - заголовок столбца
+    int column;
+    QString text;
+};
 
 class TableManager {
 public:
@@ -17,8 +29,20 @@ public:
                                const std::optional<QVector<QString>> &headers,
                                const std::optional<QVector<QVector<QString>>> &cellData);
 
+    // Изменение отдельных ячеек и заголовков; остальные ячейки сетки не переписываются
+    bool updateCells(int templateId, const QVector<GridCellValue> &cells);
+
 
 private:
+    // Правка упакованной сетки под блокировкой; packed = false, если шаблон хранится построчно
+    bool editPackedGrid(int templateId, bool &packed, const std::function<bool(TemplateGrid &)> &edit);
+
+    // Каждое изменение сетки добавляет ревизию в историю шаблона;
+    // непереданные части сетки читаются из только что записанных строк
+    bool recordRevision(int templateId,
+                        const std::optional<QVector<QString>> &headers = std::nullopt,
+                        const std::optional<QVector<QVector<QString>>> &cellData = std::nullopt);
+
     QSqlDatabase &db;
 };
 
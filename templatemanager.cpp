@@ -1,45 +1,67 @@
-#include "TemplateManager.h"
+#include "templatemanager.h"
+#include "stringpool.h"
+#include "queryexecutor.h"
+#include "tracing.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <optional>
+#include <QStringList>
+#include <QSet>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 
 TemplateManager::TemplateManager(QSqlDatabase &db) : db(db) {}
 
-bool TemplateManager::createTemplate(int categoryId, const QString &templateName) {
+bool TemplateManager::createTemplate(int categoryId, const QString &templateName, int *newTemplateId,
+                                     int *newPosition) {
+    TRACE_SCOPE("manager", "TemplateManager::createTemplate");
     QSqlQuery query(db);
 
     // Проверяем существование категории
     query.prepare("SELECT 1 FROM category WHERE category_id = :categoryId");
     query.bindValue(":categoryId", categoryId);
 
-    if (!query.exec() || !query.next()) {
+    if (!execQuery(query) || !query.next()) {
         qDebug() << "Ошибка: категория с ID" << categoryId << "не существует.";
         return false;
     }
 
-    // Получаем максимальную позицию среди шаблонов в данной категории
-    query.prepare("SELECT COALESCE(MAX(position), 0) + 1 FROM table_template WHERE category_id = :categoryId");
+    // Шаблоны нумеруются после подкатегорий общим рядом, как в дереве
+    query.prepare("SELECT COALESCE(MAX(position), 0) + 1 FROM ( "
+                  "    SELECT position FROM table_template WHERE category_id = :categoryId "
+                  "    UNION ALL "
+                  "    SELECT position FROM category WHERE parent_id = :categoryId2) s");
     query.bindValue(":categoryId", categoryId);
+    query.bindValue(":categoryId2", categoryId);
 
-    if (!query.exec() || !query.next()) {
+    if (!execQuery(query) || !query.next()) {
         qDebug() << "Ошибка получения максимального position:" << query.lastError();
         return false;
     }
 
-    int newPosition = query.value(0).toInt();
+    int position = query.value(0).toInt();
 
     // Вставляем новый шаблон в таблицу table_template
-    query.prepare("INSERT INTO table_template (category_id, name, position, notes, programming_notes) "
-                  "VALUES (:categoryId, :name, :position, '', '')");
+    query.prepare("INSERT INTO table_template (category_id, project_id, name, position, notes, programming_notes) "
+                  "SELECT category_id, project_id, :name, :position, '', '' "
+                  "FROM category WHERE category_id = :categoryId RETURNING template_id");
     query.bindValue(":categoryId", categoryId);
     query.bindValue(":name", templateName);
-    query.bindValue(":position", newPosition);
+    query.bindValue(":position", position);
 
-    if (!query.exec()) {
+    if (!execQuery(query) || !query.next()) {
         qDebug() << "Ошибка добавления шаблона в базу данных:" << query.lastError();
         return false;
     }
 
+    if (newTemplateId) {
+        *newTemplateId = query.value(0).toInt();
+    }
+    if (newPosition) {
+        *newPosition = position;
+    }
+
     qDebug() << "Шаблон" << templateName << "успешно создан с ID категории" << categoryId;
     return true;
 }
@@ -48,6 +70,7 @@ bool TemplateManager::updateTemplate(int templateId,
                                      const std::optional<QString> &name,
                                      const std::optional<QString> &notes,
                                      const std::optional<QString> &programmingNotes) {
+    TRACE_SCOPE("manager", "TemplateManager::updateTemplate");
     QSqlQuery query(db);
 
     // Формируем запрос динамически, обновляя только заданные поля
@@ -76,7 +99,7 @@ bool TemplateManager::updateTemplate(int templateId,
     query.bindValue(":templateId", templateId);
 
     // Выполнение запроса
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка обновления шаблона:" << query.lastError();
         return false;
     }
@@ -85,34 +108,49 @@ bool TemplateManager::updateTemplate(int templateId,
 }
 
 bool TemplateManager::deleteTemplate(int templateId) {
+    TRACE_SCOPE("manager", "TemplateManager::deleteTemplate");
     QSqlQuery query(db);
 
     // Удаляем связанные данные
     query.prepare("DELETE FROM table_cell WHERE template_id = :templateId");
     query.bindValue(":templateId", templateId);
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка удаления данных из table_cell:" << query.lastError();
         return false;
     }
 
     query.prepare("DELETE FROM table_row WHERE template_id = :templateId");
     query.bindValue(":templateId", templateId);
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка удаления данных из table_row:" << query.lastError();
         return false;
     }
 
     query.prepare("DELETE FROM table_column WHERE template_id = :templateId");
     query.bindValue(":templateId", templateId);
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка удаления данных из table_column:" << query.lastError();
         return false;
     }
 
+    query.prepare("DELETE FROM template_grid WHERE template_id = :templateId");
+    query.bindValue(":templateId", templateId);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка удаления упакованной сетки:" << query.lastError();
+        return false;
+    }
+
+    query.prepare("DELETE FROM template_revision WHERE template_id = :templateId");
+    query.bindValue(":templateId", templateId);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка удаления истории шаблона:" << query.lastError();
+        return false;
+    }
+
     // Удаляем сам шаблон
     query.prepare("DELETE FROM table_template WHERE template_id = :templateId");
     query.bindValue(":templateId", templateId);
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка удаления шаблона:" << query.lastError();
         return false;
     }
@@ -120,14 +158,60 @@ bool TemplateManager::deleteTemplate(int templateId) {
     return true;
 }
 
-QVector<Template> TemplateManager::getTemplatesForCategory(int categoryId) {
+bool TemplateManager::setTemplateApproved(int templateId, bool approved) {
+    TRACE_SCOPE("manager", "TemplateManager::setTemplateApproved");
+    QSqlQuery query(db);
+    query.prepare("UPDATE table_template SET is_approved = :approved WHERE template_id = :templateId");
+    query.bindValue(":approved", approved);
+    query.bindValue(":templateId", templateId);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка изменения статуса утверждения шаблона:" << query.lastError();
+        return false;
+    }
+
+    return true;
+}
+
+bool TemplateManager::setApprovedForCategoryTree(int categoryId, bool approved) {
+    TRACE_SCOPE("manager", "TemplateManager::setApprovedForCategoryTree");
+    QSqlQuery query(db);
+
+    // Одним запросом обновляем шаблоны всего поддерева категории
+    query.prepare(
+        "WITH RECURSIVE subcategories AS ( "
+        "    SELECT category_id FROM category WHERE category_id = :categoryId "
+        "    UNION ALL "
+        "    SELECT c.category_id FROM category c "
+        "    INNER JOIN subcategories s ON c.parent_id = s.category_id "
+        ") "
+        "UPDATE table_template SET is_approved = :approved "
+        "WHERE category_id IN (SELECT category_id FROM subcategories) "
+        "AND is_approved <> :newState"
+        );
+    query.bindValue(":categoryId", categoryId);
+    query.bindValue(":approved", approved);
+    query.bindValue(":newState", approved);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка группового изменения статуса утверждения:" << query.lastError();
+        return false;
+    }
+
+    qDebug() << "Изменён статус утверждения у" << query.numRowsAffected() << "шаблонов.";
+    return true;
+}
+
+QVector<Template> TemplateManager::getTemplatesForCategory(int categoryId, bool onlyUnapproved) {
+    TRACE_SCOPE("manager", "TemplateManager::getTemplatesForCategory");
     QVector<Template> templates;
     QSqlQuery query(db);
-    query.prepare("SELECT template_id, name, notes, programming_notes, position "
-                  "FROM table_template WHERE category_id = :categoryId ORDER BY position");
+    query.prepare(QString("SELECT template_id, name, notes, programming_notes, position, category_id, is_approved "
+                          "FROM table_template WHERE category_id = :categoryId %1 ORDER BY position")
+                      .arg(onlyUnapproved ? "AND NOT is_approved" : ""));
     query.bindValue(":categoryId", categoryId);
 
-    if (!query.exec()) {
+    if (!execQuery(query)) {
         qDebug() << "Ошибка получения шаблонов для категории:" << query.lastError();
         return templates;
     }
@@ -138,122 +222,169 @@ QVector<Template> TemplateManager::getTemplatesForCategory(int categoryId) {
             query.value(1).toString(),
             query.value(2).toString(),
             query.value(3).toString(),
-            query.value(4).toInt()
+            query.value(4).toInt(),
+            query.value(5).toInt(),
+            query.value(6).toBool()
         });
     }
 
     return templates;
 }
 
-QVector<QString> TemplateManager::getColumnHeadersForTemplate(int templateId) {
-    QVector<QString> columnHeaders;
+QVector<Template> TemplateManager::getTemplatesForProject(int projectId, bool onlyUnapproved) {
+    TRACE_SCOPE("manager", "TemplateManager::getTemplatesForProject");
+    QVector<Template> templates;
     QSqlQuery query(db);
-    query.prepare("SELECT header FROM table_column WHERE template_id = :templateId ORDER BY column_order");
-    query.bindValue(":templateId", templateId);
-
-    if (!query.exec()) {
-        qDebug() << "Ошибка загрузки заголовков столбцов:" << query.lastError();
-        return columnHeaders;
+    // Отбор по индексу (project_id, is_approved); шаблоны сгруппированы по категориям
+    query.prepare(QString("SELECT template_id, name, notes, programming_notes, position, category_id, is_approved "
+                          "FROM table_template WHERE project_id = :projectId %1 ORDER BY category_id, position")
+                      .arg(onlyUnapproved ? "AND NOT is_approved" : ""));
+    query.bindValue(":projectId", projectId);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка получения шаблонов проекта:" << query.lastError();
+        return templates;
     }
 
     while (query.next()) {
-        columnHeaders.append(query.value(0).toString());
+        templates.append({
+            query.value(0).toInt(),
+            query.value(1).toString(),
+            query.value(2).toString(),
+            query.value(3).toString(),
+            query.value(4).toInt(),
+            query.value(5).toInt(),
+            query.value(6).toBool()
+        });
     }
-    return columnHeaders;
+
+    return templates;
 }
 
-QVector<int> TemplateManager::getRowOrdersForTemplate(int templateId) {
-    QVector<int> rowOrders;
-    QSqlQuery query(db);
-    query.prepare("SELECT row_order FROM table_row WHERE template_id = :templateId ORDER BY row_order");
-    query.bindValue(":templateId", templateId);
+bool TemplateManager::findMissingTemplates(const QVector<int> &templateIds, QVector<int> &missing) {
+    TRACE_SCOPE("manager", "TemplateManager::findMissingTemplates");
+    missing.clear();
+    if (templateIds.isEmpty()) return true;
 
-    if (!query.exec()) {
-        qDebug() << "Ошибка загрузки строк таблицы:" << query.lastError();
-        return rowOrders;
+    QStringList ids;
+    for (int templateId : templateIds) ids.append(QString::number(templateId));
+
+    QSqlQuery query(db);
+    query.prepare("SELECT template_id FROM table_template WHERE template_id = ANY(CAST(:ids AS INTEGER[]))");
+    query.bindValue(":ids", "{" + ids.join(',') + "}");
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка проверки шаблонов:" << query.lastError();
+        return false;
     }
 
-    while (query.next()) {
-        rowOrders.append(query.value(0).toInt());
+    QSet<int> found;
+    while (query.next()) found.insert(query.value(0).toInt());
+    for (int templateId : templateIds) {
+        if (!found.contains(templateId) && !missing.contains(templateId)) missing.append(templateId);
     }
-    return rowOrders;
+    return true;
 }
 
-QVector<int> TemplateManager::getColumnOrdersForTemplate(int templateId) {
-    QVector<int> columnOrders;
-    QSqlQuery query(db);
-    query.prepare("SELECT column_order FROM table_column WHERE template_id = :templateId ORDER BY column_order");
-    query.bindValue(":templateId", templateId);
+bool TemplateManager::getGridForTemplate(int templateId, TemplateGrid &grid,
+                                         QVector<int> *rowOrders, QVector<int> *columnOrders) {
+    TRACE_SCOPE("manager", "TemplateManager::getGridForTemplate");
+    grid = TemplateGrid();
+    QVector<int> rows, columns;
+    StringPool strings;     // Повторяющиеся тексты ячеек сетки хранятся один раз
 
-    if (!query.exec()) {
-        qDebug() << "Ошибка загрузки столбцов таблицы:" << query.lastError();
-        return columnOrders;
+    // Упакованная сетка читается одной записью, порядковые номера совпадают с индексами
+    bool packed = false;
+    if (!getPackedGrid(templateId, grid, packed)) {
+        return false;
+    }
+    if (packed) {
+        strings.intern(grid);
+        for (int i = 0; i < grid.cells.size(); ++i) rows.append(i);
+        for (int i = 0; i < grid.headers.size(); ++i) columns.append(i);
+        if (rowOrders) *rowOrders = rows;
+        if (columnOrders) *columnOrders = columns;
+        return true;
     }
 
+    // Столбцы вместе с заголовками и порядки строк
+    QSqlQuery query(db);
+    query.prepare("SELECT column_order, header FROM table_column WHERE template_id = :templateId ORDER BY column_order");
+    query.bindValue(":templateId", templateId);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка загрузки заголовков столбцов:" << query.lastError();
+        return false;
+    }
     while (query.next()) {
-        columnOrders.append(query.value(0).toInt());
+        columns.append(query.value(0).toInt());
+        grid.headers.append(query.value(1).toString());
     }
-    return columnOrders;
-}
 
-QVector<QVector<QString>> TemplateManager::getTableData(int templateId) {
-    QVector<QVector<QString>> tableData;
+    query.prepare("SELECT row_order FROM table_row WHERE template_id = :templateId ORDER BY row_order");
+    query.bindValue(":templateId", templateId);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка загрузки строк таблицы:" << query.lastError();
+        return false;
+    }
+    while (query.next()) {
+        rows.append(query.value(0).toInt());
+    }
 
-    // Получаем порядки строк и столбцов
-    QVector<int> rowOrders = getRowOrdersForTemplate(templateId);
-    QVector<int> columnOrders = getColumnOrdersForTemplate(templateId);
+    if (rowOrders) *rowOrders = rows;
+    if (columnOrders) *columnOrders = columns;
 
     // Проверка наличия строк и столбцов
-    if (rowOrders.isEmpty() || columnOrders.isEmpty()) {
+    if (rows.isEmpty() || columns.isEmpty()) {
         qDebug() << "Таблица пуста или отсутствуют строки/столбцы.";
-        return tableData; // Возвращаем пустую таблицу
+        return true; // Пустая таблица
     }
 
+    // Порядковые номера в БД могут идти с пропусками, переводим их в индексы
+    QHash<int, int> rowIndex, columnIndex;
+    for (int i = 0; i < rows.size(); ++i) rowIndex.insert(rows[i], i);
+    for (int i = 0; i < columns.size(); ++i) columnIndex.insert(columns[i], i);
+
     // Инициализация пустой таблицы на основе строк и столбцов
-    tableData.resize(rowOrders.size());
-    for (int row = 0; row < rowOrders.size(); ++row) {
-        tableData[row].resize(columnOrders.size());
+    grid.cells.resize(rows.size());
+    for (QVector<QString> &row : grid.cells) {
+        row.resize(columns.size());
     }
 
     // Получаем данные ячеек
-    QSqlQuery cellQuery(db);
-    cellQuery.prepare(
+    query.prepare(
         "SELECT row_order, column_order, content "
         "FROM table_cell "
         "WHERE template_id = :templateId "
         "ORDER BY row_order, column_order"
         );
-    cellQuery.bindValue(":templateId", templateId);
+    query.bindValue(":templateId", templateId);
 
-    if (!cellQuery.exec()) {
-        qDebug() << "Ошибка загрузки данных таблицы:" << cellQuery.lastError();
-        return tableData;
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка загрузки данных таблицы:" << query.lastError();
+        grid.cells.clear();
+        return false;
     }
 
-    // Заполняем таблицу данными
-    while (cellQuery.next()) {
-        int rowOrder = cellQuery.value(0).toInt();
-        int columnOrder = cellQuery.value(1).toInt();
-        QString content = cellQuery.value(2).toString();
-
-        // Ищем индексы строки и столбца в порядке rowOrders и columnOrders
-        int rowIndex = rowOrders.indexOf(rowOrder);
-        int columnIndex = columnOrders.indexOf(columnOrder);
-
-        if (rowIndex != -1 && columnIndex != -1) {
-            tableData[rowIndex][columnIndex] = content;
+    // Заполняем таблицу данными (включает выборку строк результата с сервера)
+    TRACE_SCOPE("grid", "assemble grid");
+    grid.headers = strings.internHeaders(grid.headers);
+    while (query.next()) {
+        int row = rowIndex.value(query.value(0).toInt(), -1);
+        int column = columnIndex.value(query.value(1).toInt(), -1);
+        if (row != -1 && column != -1) {
+            grid.cells[row][column] = strings.intern(query.value(2).toString());
         }
     }
 
-    return tableData;
+    return true;
 }
 
 QString TemplateManager::getNotesForTemplate(int templateId) {
+    TRACE_SCOPE("manager", "TemplateManager::getNotesForTemplate");
     QSqlQuery query(db);
     query.prepare("SELECT notes FROM table_template WHERE template_id = :templateId");
     query.bindValue(":templateId", templateId);
 
-    if (query.exec() && query.next()) {
+    if (execQuery(query) && query.next()) {
         return query.value(0).toString();
     } else {
         qDebug() << "Ошибка загрузки заметок:" << query.lastError().text();
@@ -262,14 +393,227 @@ QString TemplateManager::getNotesForTemplate(int templateId) {
 }
 
 QString TemplateManager::getProgrammingNotesForTemplate(int templateId) {
+    TRACE_SCOPE("manager", "TemplateManager::getProgrammingNotesForTemplate");
     QSqlQuery query(db);
     query.prepare("SELECT programming_notes FROM table_template WHERE template_id = :templateId");
     query.bindValue(":templateId", templateId);
 
-    if (query.exec() && query.next()) {
+    if (execQuery(query) && query.next()) {
         return query.value(0).toString();
     } else {
         qDebug() << "Ошибка загрузки программных заметок:" << query.lastError().text();
         return QString();
     }
 }
+
+bool TemplateManager::getGridsForTemplates(const QVector<int> &templateIds, QHash<int, TemplateGrid> &grids,
+                                           StringPool *pool) {
+    TRACE_SCOPE("manager", "TemplateManager::getGridsForTemplates");
+    grids.clear();
+    if (templateIds.isEmpty()) return true;
+
+    StringPool localPool;
+    StringPool &strings = pool ? *pool : localPool;
+
+    QStringList ids;
+    for (int templateId : templateIds) {
+        ids.append(QString::number(templateId));
+        grids.insert(templateId, TemplateGrid());
+    }
+    QString idArray = "{" + ids.join(',') + "}";
+
+    QSqlQuery query(db);
+    query.setForwardOnly(true);
+
+    // Упакованные сетки целиком; построчные запросы нужны только остальным шаблонам
+    query.prepare("SELECT template_id, data FROM template_grid_full "
+                  "WHERE template_id = ANY(CAST(:ids AS INTEGER[]))");
+    query.bindValue(":ids", idArray);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка загрузки упакованных сеток:" << query.lastError();
+        return false;
+    }
+    while (query.next()) {
+        const int templateId = query.value(0).toInt();
+        if (!unpackGrid(query.value(1).toString(), grids[templateId])) {
+            qDebug() << "Повреждена упакованная сетка шаблона" << templateId;
+            return false;
+        }
+        strings.intern(grids[templateId]);
+        ids.removeAll(QString::number(templateId));
+    }
+    if (ids.isEmpty()) return true;
+    idArray = "{" + ids.join(',') + "}";
+
+    // Порядковые номера строк и столбцов переводятся в индексы сетки
+    QHash<int, QHash<int, int>> columnIndex;
+    QHash<int, QHash<int, int>> rowIndex;
+
+    query.prepare("SELECT template_id, column_order, header FROM table_column "
+                  "WHERE template_id = ANY(CAST(:ids AS INTEGER[])) ORDER BY template_id, column_order");
+    query.bindValue(":ids", idArray);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка загрузки заголовков столбцов:" << query.lastError();
+        return false;
+    }
+    while (query.next()) {
+        int templateId = query.value(0).toInt();
+        TemplateGrid &grid = grids[templateId];
+        columnIndex[templateId].insert(query.value(1).toInt(), grid.headers.size());
+        grid.headers.append(strings.intern(query.value(2).toString()));
+    }
+
+    query.prepare("SELECT template_id, row_order FROM table_row "
+                  "WHERE template_id = ANY(CAST(:ids AS INTEGER[])) ORDER BY template_id, row_order");
+    query.bindValue(":ids", idArray);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка загрузки строк таблицы:" << query.lastError();
+        return false;
+    }
+    while (query.next()) {
+        int templateId = query.value(0).toInt();
+        TemplateGrid &grid = grids[templateId];
+        rowIndex[templateId].insert(query.value(1).toInt(), grid.cells.size());
+        grid.cells.append(QVector<QString>(grid.headers.size()));
+    }
+
+    query.prepare("SELECT template_id, row_order, column_order, content FROM table_cell "
+                  "WHERE template_id = ANY(CAST(:ids AS INTEGER[]))");
+    query.bindValue(":ids", idArray);
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка загрузки данных таблицы:" << query.lastError();
+        return false;
+    }
+    while (query.next()) {
+        int templateId = query.value(0).toInt();
+        int row = rowIndex[templateId].value(query.value(1).toInt(), -1);
+        int column = columnIndex[templateId].value(query.value(2).toInt(), -1);
+        if (row >= 0 && column >= 0) {
+            grids[templateId].cells[row][column] = strings.intern(query.value(3).toString());
+        }
+    }
+
+    // Одинаковые наборы заголовков построчных сеток
+    for (const QString &id : ids) {
+        TemplateGrid &grid = grids[id.toInt()];
+        grid.headers = strings.internHeaders(grid.headers);
+    }
+
+    return true;
+}
+
+bool TemplateManager::getPackedGrid(int templateId, TemplateGrid &grid, bool &packed) {
+    TRACE_SCOPE("manager", "TemplateManager::getPackedGrid");
+    packed = false;
+    QSqlQuery query(db);
+    query.prepare("SELECT format_version, data FROM template_grid_full WHERE template_id = :templateId");
+    query.bindValue(":templateId", templateId);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка загрузки упакованной сетки:" << query.lastError();
+        return false;
+    }
+    if (!query.next()) {
+        return true;
+    }
+
+    if (query.value(0).toInt() > PackedFormatVersion) {
+        qDebug() << "Неизвестная версия формата сетки" << query.value(0).toInt() << "шаблона" << templateId;
+        return false;
+    }
+    if (!unpackGrid(query.value(1).toString(), grid)) {
+        qDebug() << "Повреждена упакованная сетка шаблона" << templateId;
+        return false;
+    }
+    packed = true;
+    return true;
+}
+
+bool TemplateManager::storePackedGrid(int templateId, const TemplateGrid &grid) {
+    TRACE_SCOPE("manager", "TemplateManager::storePackedGrid");
+    QSqlQuery query(db);
+    query.prepare("UPDATE template_grid SET format_version = :formatVersion, data = :data "
+                  "WHERE template_id = :templateId");
+    query.bindValue(":formatVersion", PackedFormatVersion);
+    query.bindValue(":data", packGrid(grid));
+    query.bindValue(":templateId", templateId);
+
+    if (!execQuery(query)) {
+        qDebug() << "Ошибка сохранения упакованной сетки:" << query.lastError();
+        return false;
+    }
+    // Запись могла быть удалена или распакована другим пользователем
+    if (query.numRowsAffected() == 0) {
+        qDebug() << "Упакованная сетка шаблона" << templateId << "не найдена при сохранении";
+        return false;
+    }
+    return true;
+}
+
+bool TemplateManager::convertProjectGrids(int projectId, GridFormat format, int *converted) {
+    TRACE_SCOPE("manager", "TemplateManager::convertProjectGrids");
+    // Перевод выполняется функциями сервера без передачи сеток клиенту
+    QSqlQuery query(db);
+    if (format == GridFormat::Packed) {
+        query.prepare("SELECT pack_template_grids(ARRAY( "
+                      "    SELECT template_id FROM table_template t WHERE t.project_id = :projectId "
+                      "    AND NOT EXISTS (SELECT 1 FROM template_grid g WHERE g.template_id = t.template_id)))");
+    } else {
+        query.prepare("SELECT unpack_template_grids(ARRAY( "
+                      "    SELECT g.template_id FROM template_grid g "
+                      "    INNER JOIN table_template t ON t.template_id = g.template_id "
+                      "    WHERE t.project_id = :projectId))");
+    }
+    query.bindValue(":projectId", projectId);
+
+    if (!execQuery(query) || !query.next()) {
+        qDebug() << "Ошибка перевода сеток проекта в другой формат:" << query.lastError();
+        return false;
+    }
+    if (converted) {
+        *converted = query.value(0).toInt();
+    }
+    return true;
+}
+
+QString TemplateManager::packGrid(const TemplateGrid &grid) {
+    QJsonArray headers;
+    for (const QString &header : grid.headers) {
+        headers.append(header);
+    }
+    QJsonArray rows;
+    for (const QVector<QString> &row : grid.cells) {
+        QJsonArray cells;
+        for (const QString &cell : row) {
+            cells.append(cell);
+        }
+        rows.append(cells);
+    }
+    return QString::fromUtf8(QJsonDocument(QJsonObject{{"headers", headers}, {"rows", rows}})
+                                 .toJson(QJsonDocument::Compact));
+}
+
+bool TemplateManager::unpackGrid(const QString &data, TemplateGrid &grid) {
+    const QJsonDocument document = QJsonDocument::fromJson(data.toUtf8());
+    if (!document.isObject()) {
+        return false;
+    }
+
+    grid = TemplateGrid();
+    const QJsonObject object = document.object();
+    for (const QJsonValue &header : object.value("headers").toArray()) {
+        grid.headers.append(header.toString());
+    }
+    const QJsonArray rows = object.value("rows").toArray();
+    grid.cells.reserve(rows.size());
+    for (const QJsonValue &row : rows) {
+        const QJsonArray cells = row.toArray();
+        QVector<QString> values;
+        values.reserve(cells.size());
+        for (const QJsonValue &cell : cells) {
+            values.append(cell.toString());
+        }
+        grid.cells.append(values);
+    }
+    return true;
+}
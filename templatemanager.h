@@ -3,9 +3,12 @@
 
 #include <QVector>
 #include <QString>
+#include <QHash>
 #include <optional>
 #include <QSqlDatabase>
 
+class StringPool;
+
 struct Template {
     int templateId;
     QString name;
@@ -13,26 +16,65 @@ struct Template {
     QString programmingNotes;
     int position;
     int categoryId;
+    bool isApproved;
+};
+
+// Сетка шаблона: заголовки столбцов и ячейки по строкам
+struct TemplateGrid {
+    QVector<QString> headers;
+    QVector<QVector<QString>> cells;
+};
+
+// Хранение сетки: построчно (table_column, table_row, table_cell) или одной записью
+// JSONB в template_grid. Порядковые номера упакованной сетки совпадают с индексами
+enum class GridFormat {
+    Rows,
+    Packed
 };
 
 class TemplateManager {
 public:
     TemplateManager(QSqlDatabase &db);
 
-    bool createTemplate(int categoryId, const QString &templateName);
+    bool createTemplate(int categoryId, const QString &templateName, int *newTemplateId = nullptr,
+                        int *newPosition = nullptr);
     bool updateTemplate(int templateId,
                         const std::optional<QString> &name,
                         const std::optional<QString> &notes,
                         const std::optional<QString> &programmingNotes);
     bool deleteTemplate(int templateId);
 
-    QVector<Template> getTemplatesForCategory(int categoryId);    // Получение шаблонов по категории
-    QVector<QString> getColumnHeadersForTemplate(int templateId); // Получение заголовков столбцов в шаблоне
-    QVector<int> getRowOrdersForTemplate(int templateId);         // Получение количества строк для шаблона
-    QVector<int> getColumnOrdersForTemplate(int templateId);      // Получение количества столбцов для шаблона
-    QVector<QStringList> getTableData(int templateId);            // Получение данных таблицы для шаблона
+    // Утверждение
+    bool setTemplateApproved(int templateId, bool approved);
+    bool setApprovedForCategoryTree(int categoryId, bool approved); // Все шаблоны категории и её подкатегорий
+
+    QVector<Template> getTemplatesForCategory(int categoryId, bool onlyUnapproved = false); // Получение шаблонов по категории
+    QVector<Template> getTemplatesForProject(int projectId, bool onlyUnapproved = false);   // Все шаблоны проекта одним запросом
+    bool findMissingTemplates(const QVector<int> &templateIds, QVector<int> &missing);       // Идентификаторы без шаблона
+    // Заголовки и данные одним чтением сетки; порядковые номера строк и столбцов - по запросу
+    bool getGridForTemplate(int templateId, TemplateGrid &grid,
+                            QVector<int> *rowOrders = nullptr, QVector<int> *columnOrders = nullptr);
     QString getNotesForTemplate(int templateId);                  // Получение заметок
     QString getProgrammingNotesForTemplate(int templateId);       // Получение программных заметок
+
+    // Сетки нескольких шаблонов тремя запросами (для пакетных операций).
+    // Одинаковые строки разделяют память в пределах вызова; загрузчик, который держит
+    // сетки нескольких вызовов одновременно, передаёт общий пул
+    bool getGridsForTemplates(const QVector<int> &templateIds, QHash<int, TemplateGrid> &grids,
+                              StringPool *pool = nullptr);
+
+    // Упакованная сетка одним запросом без разделения строк (для правки);
+    // packed = false, если шаблон хранится построчно
+    bool getPackedGrid(int templateId, TemplateGrid &grid, bool &packed);
+    bool storePackedGrid(int templateId, const TemplateGrid &grid);
+
+    // Перевод сеток проекта в другой формат на сервере (только PostgreSQL)
+    bool convertProjectGrids(int projectId, GridFormat format, int *converted = nullptr);
+
+    static QString packGrid(const TemplateGrid &grid);
+    static bool unpackGrid(const QString &data, TemplateGrid &grid);
+
+    static const int PackedFormatVersion = 1;
 private:
     QSqlDatabase &db;
 };
@@ -0,0 +1,142 @@
+#include "tracing.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThread>
+#include <QDebug>
+
+std::atomic<bool> Tracer::enabled{false};
+QMutex Tracer::mutex;
+QElapsedTimer Tracer::clock;
+QVector<Tracer::Event> Tracer::events;
+QHash<quintptr, int> Tracer::threadIndexes;
+QStringList Tracer::threadNames;
+QString Tracer::outputPath;
+qint64 Tracer::droppedEvents = 0;
+
+namespace {
+QString jsonString(const QString &text) {
+    QString escaped;
+    escaped.reserve(text.size() + 2);
+    escaped += '"';
+    for (QChar ch : text) {
+        switch (ch.unicode()) {
+        case '"': escaped += "\\\""; break;
+        case '\\': escaped += "\\\\"; break;
+        case '\n': escaped += "\\n"; break;
+        case '\r': escaped += "\\r"; break;
+        case '\t': escaped += "\\t"; break;
+        default:
+            if (ch.unicode() < 0x20) {
+                escaped += QString("\\u%1").arg(uint(ch.unicode()), 4, 16, QChar('0'));
+            } else {
+                escaped += ch;
+            }
+        }
+    }
+    escaped += '"';
+    return escaped;
+}
+}
+
+void Tracer::start(const QString &filePath) {
+    QMutexLocker locker(&mutex);
+    events.clear();
+    threadIndexes.clear();
+    threadNames.clear();
+    droppedEvents = 0;
+    outputPath = filePath;
+    clock.start();
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+bool Tracer::stop() {
+    QMutexLocker locker(&mutex);
+    if (!enabled.exchange(false)) return false;
+
+    QDir().mkpath(QFileInfo(outputPath).absolutePath());
+    QFile file(outputPath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qDebug() << "Не удалось записать трассировку:" << outputPath;
+        return false;
+    }
+
+    QTextStream out(&file);
+    out.setRealNumberNotation(QTextStream::FixedNotation);
+    out.setRealNumberPrecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    bool first = true;
+    for (int i = 0; i < threadNames.size(); ++i) {
+        out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid
+            << ",\"tid\":" << i << ",\"args\":{\"name\":" << jsonString(threadNames[i]) << "}}";
+        first = false;
+    }
+
+    // Полные события (ph = X), время в микросекундах
+    for (const Event &event : events) {
+        out << (first ? "" : ",\n") << "{\"ph\":\"X\",\"cat\":\"" << event.category << "\",\"name\":\"" << event.name
+            << "\",\"pid\":" << pid << ",\"tid\":" << event.threadIndex
+            << ",\"ts\":" << event.startNs / 1000.0 << ",\"dur\":" << event.durationNs / 1000.0;
+        if (!event.detail.isEmpty()) {
+            out << ",\"args\":{\"detail\":" << jsonString(event.detail) << "}";
+        }
+        out << "}";
+        first = false;
+    }
+    out << "\n]}\n";
+
+    if (droppedEvents > 0) {
+        qDebug() << "Трассировка: пропущено событий сверх лимита:" << droppedEvents;
+    }
+    events.clear();
+    events.squeeze();
+    return out.status() == QTextStream::Ok;
+}
+
+QString Tracer::filePath() {
+    QMutexLocker locker(&mutex);
+    return outputPath;
+}
+
+void Tracer::startFromEnvironment() {
+    const QString path = qEnvironmentVariable("AUTOTLG_TRACE");
+    if (path.isEmpty()) return;
+
+    start(path);
+    qAddPostRoutine([]() { Tracer::stop(); });
+}
+
+qint64 Tracer::nowNs() {
+    return clock.nsecsElapsed();
+}
+
+void Tracer::record(const char *category, const char *name, qint64 startNs, qint64 endNs, const QString &detail) {
+    const quintptr threadId = quintptr(QThread::currentThreadId());
+
+    QMutexLocker locker(&mutex);
+    if (!isEnabled()) return;   // Запись остановлена, пока интервал был открыт
+    if (events.size() >= MaxEvents) {
+        ++droppedEvents;
+        return;
+    }
+
+    auto it = threadIndexes.constFind(threadId);
+    if (it == threadIndexes.constEnd()) {
+        QThread *thread = QThread::currentThread();
+        QString threadName = thread->objectName();
+        if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread()) {
+            threadName = "Главный поток";
+        } else if (threadName.isEmpty()) {
+            threadName = QString("Поток %1").arg(threadNames.size());
+        }
+        it = threadIndexes.insert(threadId, threadNames.size());
+        threadNames.append(threadName);
+    }
+
+    events.append({category, name, startNs, endNs - startNs, it.value(), detail});
+}
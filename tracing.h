@@ -0,0 +1,76 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <atomic>
+
+// Запись интервалов в формате Chrome trace events (открывается в Perfetto и chrome://tracing).
+// Включается во время работы; выключенная запись стоит одной атомарной проверки на интервал.
+class Tracer {
+public:
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    static void start(const QString &filePath);
+    static bool stop();                 // Выключает запись и сохраняет файл
+    static QString filePath();
+
+    // Запуск по переменной окружения AUTOTLG_TRACE=<файл>; файл пишется при выходе из приложения
+    static void startFromEnvironment();
+
+    static qint64 nowNs();
+    static void record(const char *category, const char *name, qint64 startNs, qint64 endNs, const QString &detail);
+
+private:
+    struct Event {
+        const char *category;
+        const char *name;
+        qint64 startNs;
+        qint64 durationNs;
+        int threadIndex;
+        QString detail;
+    };
+
+    static const int MaxEvents = 1000000;   // Ограничение памяти при долгой записи
+
+    static std::atomic<bool> enabled;
+    static QMutex mutex;
+    static QElapsedTimer clock;
+    static QVector<Event> events;
+    static QHash<quintptr, int> threadIndexes;
+    static QStringList threadNames;
+    static QString outputPath;
+    static qint64 droppedEvents;
+};
+
+// Интервал от создания до уничтожения объекта. Имя и категория - строковые литералы.
+class TraceSpan {
+public:
+    TraceSpan(const char *category, const char *name)
+        : category(category), name(name), startNs(Tracer::isEnabled() ? Tracer::nowNs() : -1) {}
+
+    ~TraceSpan() {
+        if (startNs >= 0) Tracer::record(category, name, startNs, Tracer::nowNs(), detail);
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    bool isActive() const { return startNs >= 0; }
+    void setDetail(const QString &text) { detail = text; }   // Вызывать только при isActive()
+
+private:
+    const char *category;
+    const char *name;
+    qint64 startNs;
+    QString detail;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(category, name) TraceSpan TRACE_CONCAT(traceSpan_, __LINE__)(category, name)
+
+#endif // TRACING_H
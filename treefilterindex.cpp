@@ -0,0 +1,132 @@
+#include "treefilterindex.h"
+#include <algorithm>
+#include <iterator>
+
+void TreeFilterIndex::clear() {
+    nodes.clear();
+    postings.clear();
+}
+
+int TreeFilterIndex::addNode(int parentNode, const QString &numeration, const QString &name) {
+    nodes.append({parentNode, (numeration + " " + name).toLower(), false});
+    int node = nodes.size() - 1;
+    indexNode(node);
+    return node;
+}
+
+void TreeFilterIndex::updateNode(int node, const QString &numeration, const QString &name) {
+    if (node < 0 || node >= nodes.size() || nodes[node].removed) return;
+
+    unindexNode(node);
+    nodes[node].text = (numeration + " " + name).toLower();
+    indexNode(node);
+}
+
+void TreeFilterIndex::moveNode(int node, int parentNode) {
+    if (node < 0 || node >= nodes.size() || nodes[node].removed) return;
+    nodes[node].parent = parentNode;
+}
+
+void TreeFilterIndex::removeNode(int node) {
+    if (node < 0 || node >= nodes.size() || nodes[node].removed) return;
+
+    unindexNode(node);
+    nodes[node].removed = true;
+}
+
+QVector<quint64> TreeFilterIndex::trigramsOf(const QString &text) {
+    QVector<quint64> trigrams;
+    for (int i = 0; i + 2 < text.size(); ++i) {
+        trigrams.append((quint64(text[i].unicode()) << 32) |
+                        (quint64(text[i + 1].unicode()) << 16) |
+                        quint64(text[i + 2].unicode()));
+    }
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+    return trigrams;
+}
+
+void TreeFilterIndex::indexNode(int node) {
+    for (quint64 trigram : trigramsOf(nodes[node].text)) {
+        QVector<int> &list = postings[trigram];
+        // Узлы обычно добавляются по возрастанию, поэтому вставка почти всегда в конец
+        auto it = std::lower_bound(list.begin(), list.end(), node);
+        if (it == list.end() || *it != node) {
+            list.insert(it, node);
+        }
+    }
+}
+
+void TreeFilterIndex::unindexNode(int node) {
+    for (quint64 trigram : trigramsOf(nodes[node].text)) {
+        auto found = postings.find(trigram);
+        if (found == postings.end()) continue;
+
+        QVector<int> &list = found.value();
+        auto it = std::lower_bound(list.begin(), list.end(), node);
+        if (it != list.end() && *it == node) {
+            list.erase(it);
+        }
+        if (list.isEmpty()) {
+            postings.erase(found);
+        }
+    }
+}
+
+QVector<int> TreeFilterIndex::match(const QString &text) const {
+    QVector<int> result;
+    QString needle = text.trimmed().toLower();
+    if (needle.isEmpty()) return result;
+
+    QVector<quint64> trigrams = trigramsOf(needle);
+
+    // Для коротких запросов триграмм нет: проверяем все узлы напрямую
+    if (trigrams.isEmpty()) {
+        for (int node = 0; node < nodes.size(); ++node) {
+            if (!nodes[node].removed && nodes[node].text.contains(needle)) {
+                result.append(node);
+            }
+        }
+        return result;
+    }
+
+    // Пересекаем списки, начиная с самого короткого
+    QVector<const QVector<int>*> lists;
+    for (quint64 trigram : trigrams) {
+        auto found = postings.constFind(trigram);
+        if (found == postings.constEnd()) return result;
+        lists.append(&found.value());
+    }
+    std::sort(lists.begin(), lists.end(), [](const QVector<int> *a, const QVector<int> *b) {
+        return a->size() < b->size();
+    });
+
+    QVector<int> candidates = *lists.first();
+    for (int i = 1; i < lists.size() && !candidates.isEmpty(); ++i) {
+        QVector<int> intersection;
+        std::set_intersection(candidates.begin(), candidates.end(),
+                              lists[i]->begin(), lists[i]->end(),
+                              std::back_inserter(intersection));
+        candidates.swap(intersection);
+    }
+
+    // Триграммы дают кандидатов, окончательно проверяем подстроку
+    for (int node : candidates) {
+        if (nodes[node].text.contains(needle)) {
+            result.append(node);
+        }
+    }
+    return result;
+}
+
+QVector<bool> TreeFilterIndex::visibleNodes(const QString &text, const QVector<bool> &excluded) const {
+    QVector<bool> visible(nodes.size(), false);
+    for (int node : match(text)) {
+        if (node < excluded.size() && excluded[node]) continue;
+        // Поднимаемся к корню, пока не встретим уже видимого предка
+        for (int current = node; current >= 0 && !visible[current]; current = nodes[current].parent) {
+            visible[current] = true;
+        }
+    }
+    return visible;
+}
@@ -0,0 +1,42 @@
+#ifndef TREEFILTERINDEX_H
+#define TREEFILTERINDEX_H
+
+#include <QVector>
+#include <QString>
+#include <QHash>
+
+// Индекс для мгновенной фильтрации дерева категорий и шаблонов по названию и нумерации.
+// Узлы адресуются индексами, выданными addNode(); триграммы хранятся в отсортированных
+// списках, поэтому запрос сводится к пересечению нескольких коротких списков.
+class TreeFilterIndex {
+public:
+    void clear();
+
+    int addNode(int parentNode, const QString &numeration, const QString &name);
+    void updateNode(int node, const QString &numeration, const QString &name);
+    void moveNode(int node, int parentNode);
+    void removeNode(int node);      // Номер узла не переиспользуется до clear()
+
+    // Узлы, у которых нумерация или название содержат text (без учёта регистра)
+    QVector<int> match(const QString &text) const;
+
+    // Совпавшие узлы вместе со всеми предками. Узлы, отмеченные в excluded
+    // (скрытые другими фильтрами), не совпадают и не раскрывают предков
+    QVector<bool> visibleNodes(const QString &text, const QVector<bool> &excluded = QVector<bool>()) const;
+
+private:
+    struct Node {
+        int parent;
+        QString text;       // Нумерация и название в нижнем регистре
+        bool removed;
+    };
+
+    static QVector<quint64> trigramsOf(const QString &text);
+    void indexNode(int node);
+    void unindexNode(int node);
+
+    QVector<Node> nodes;
+    QHash<quint64, QVector<int>> postings;  // Триграмма -> отсортированные номера узлов
+};
+
+#endif // TREEFILTERINDEX_H
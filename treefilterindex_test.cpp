@@ -0,0 +1,99 @@
+#include "treefilterindex.h"
+#include <QtTest>
+
+// Индекс фильтра дерева: добавление, перенос, переименование и удаление узлов
+// без полной перестройки
+class TreeFilterIndexTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void init();
+
+    void matchesNumerationAndName();
+    void showsAncestorsOfMatches();
+    void skipsExcludedNodes();
+    void removesNodes();
+    void movesNodes();
+    void updatesNodeText();
+    void addsNodesAfterRemoval();
+
+private:
+    // 1 Двигатели / 1.1 Насосы / 1.2 Шаблон насоса; 2 Электрика
+    TreeFilterIndex index;
+    int engines = -1;
+    int pumps = -1;
+    int pumpTemplate = -1;
+    int electrics = -1;
+};
+
+void TreeFilterIndexTest::init() {
+    index.clear();
+    engines = index.addNode(-1, "1", "Двигатели");
+    pumps = index.addNode(engines, "1.1", "Насосы");
+    pumpTemplate = index.addNode(engines, "1.2", "Шаблон насоса");
+    electrics = index.addNode(-1, "2", "Электрика");
+}
+
+void TreeFilterIndexTest::matchesNumerationAndName() {
+    QCOMPARE(index.match("насос"), QVector<int>({pumps, pumpTemplate}));
+    QCOMPARE(index.match("1.2"), QVector<int>({pumpTemplate}));
+    QCOMPARE(index.match("ЭЛЕКТР"), QVector<int>({electrics}));
+    QVERIFY(index.match("отсутствует").isEmpty());
+}
+
+void TreeFilterIndexTest::showsAncestorsOfMatches() {
+    const QVector<bool> visible = index.visibleNodes("шаблон");
+    QVERIFY(visible[pumpTemplate]);
+    QVERIFY(visible[engines]);
+    QVERIFY(!visible[pumps]);
+    QVERIFY(!visible[electrics]);
+}
+
+void TreeFilterIndexTest::skipsExcludedNodes() {
+    QVector<bool> excluded(4, false);
+    excluded[pumpTemplate] = true;
+    const QVector<bool> visible = index.visibleNodes("шаблон", excluded);
+    QVERIFY(!visible[pumpTemplate]);
+    QVERIFY(!visible[engines]);
+}
+
+void TreeFilterIndexTest::removesNodes() {
+    index.removeNode(pumps);
+    QCOMPARE(index.match("насос"), QVector<int>({pumpTemplate}));
+    // Короткие запросы проверяются без триграмм
+    QVERIFY(!index.match("1.1").contains(pumps));
+
+    // Повторное удаление и правка удалённого узла ничего не меняют
+    index.removeNode(pumps);
+    index.updateNode(pumps, "1.1", "Насосы");
+    QVERIFY(!index.match("насосы").contains(pumps));
+}
+
+void TreeFilterIndexTest::movesNodes() {
+    index.moveNode(pumpTemplate, electrics);
+    const QVector<bool> visible = index.visibleNodes("шаблон");
+    QVERIFY(visible[pumpTemplate]);
+    QVERIFY(visible[electrics]);
+    QVERIFY(!visible[engines]);
+}
+
+void TreeFilterIndexTest::updatesNodeText() {
+    index.updateNode(electrics, "2", "Гидравлика");
+    QVERIFY(index.match("электр").isEmpty());
+    QCOMPARE(index.match("гидрав"), QVector<int>({electrics}));
+}
+
+void TreeFilterIndexTest::addsNodesAfterRemoval() {
+    index.removeNode(pumpTemplate);
+    const int added = index.addNode(electrics, "2.1", "Шаблон проводки");
+    QVERIFY(added != pumpTemplate);
+    QCOMPARE(index.match("шаблон"), QVector<int>({added}));
+
+    const QVector<bool> visible = index.visibleNodes("проводк");
+    QCOMPARE(visible.size(), 5);
+    QVERIFY(visible[added]);
+    QVERIFY(visible[electrics]);
+}
+
+QTEST_GUILESS_MAIN(TreeFilterIndexTest)
+#include "treefilterindex_test.moc"